@@ -0,0 +1,441 @@
+//***************************************************************************************
+// GeometryBenchmark.cpp
+//
+// Headless benchmark of the geometry generators and of the scene build, without a
+// window or a device.  The scene build is the same path as ShapesApp::BuildShapeGeometry
+// and BuildRenderItems: ShapeGeometryBuilder generates the shapes, GeometryPacker packs
+// them with a null device (CPU copies only) and the scene file is placed into a
+// SceneStore.  Only the GPU buffer creation and upload are left out.
+//
+// Build it as a console program from this file and ..\GeometryGenerator.cpp,
+// ..\GeometryPacker.cpp, ..\GeometryCache.cpp, ..\MeshOptimizer.cpp, ..\SceneFile.cpp,
+// ..\SceneStore.cpp, ..\ShapeGeometry.cpp and Common\d3dUtil.cpp (d3dcompiler.lib
+// provides D3DCreateBlob).
+//
+//   Command line:
+//   -out PATH          Also write the results to PATH.
+//   -baseline PATH     Compare against the results of an earlier run; the exit code is
+//                      1 if a benchmark got slower than the baseline by more than the
+//                      tolerance, so CI can gate on it.
+//   -tolerance F       Allowed slowdown as a fraction of the baseline time (default 0.1).
+//   -mintime MS        Time spent measuring each benchmark (default 200).
+//   -filter TEXT       Only run the benchmarks whose name contains TEXT.
+//   -scene PATH        Scene placed by the scene build (default Scenes\Castle.scene).
+//
+// Results are CSV, one row per benchmark and parameter set:
+//   benchmark,params,calls,ms_per_call,vertices_per_sec,bytes_per_call,peak_bytes
+// ms_per_call is the fastest of several rounds, which is stable enough to compare runs.
+// bytes_per_call is the heap memory allocated by one call and peak_bytes the most heap
+// memory the call held at once, both counted by the operator new replacement below.
+//***************************************************************************************
+
+#include "../GeometryGenerator.h"
+#include "../GeometryPacker.h"
+#include "../ParallelFor.h"
+#include "../SceneFile.h"
+#include "../SceneStore.h"
+#include "../ShapeGeometry.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <new>
+#include <sstream>
+#include <stdexcept>
+
+namespace
+{
+	std::atomic<size_t> gAllocatedBytes(0);
+	std::atomic<size_t> gCurrentBytes(0);
+	std::atomic<size_t> gPeakBytes(0);
+
+	// Each block is prefixed with its size so delete can account for it.
+	const size_t AllocationHeaderSize = 16;
+
+	void* TrackedAlloc(size_t size)
+	{
+		void* block = std::malloc(size + AllocationHeaderSize);
+		if (block == nullptr)
+			throw std::bad_alloc();
+		*static_cast<size_t*>(block) = size;
+
+		gAllocatedBytes += size;
+		size_t current = gCurrentBytes += size;
+		size_t peak = gPeakBytes;
+		while (current > peak && !gPeakBytes.compare_exchange_weak(peak, current))
+		{
+		}
+
+		return static_cast<char*>(block) + AllocationHeaderSize;
+	}
+
+	void TrackedFree(void* p)
+	{
+		if (p == nullptr)
+			return;
+
+		void* block = static_cast<char*>(p) - AllocationHeaderSize;
+		gCurrentBytes -= *static_cast<size_t*>(block);
+		std::free(block);
+	}
+}
+
+void* operator new(size_t size) { return TrackedAlloc(size); }
+void* operator new[](size_t size) { return TrackedAlloc(size); }
+void operator delete(void* p) noexcept { TrackedFree(p); }
+void operator delete[](void* p) noexcept { TrackedFree(p); }
+void operator delete(void* p, size_t) noexcept { TrackedFree(p); }
+void operator delete[](void* p, size_t) noexcept { TrackedFree(p); }
+
+namespace
+{
+	struct BenchmarkOptions
+	{
+		std::string OutPath;
+		std::string BaselinePath;
+		double Tolerance = 0.1;
+		double MinTimeMs = 200.0;
+		std::string Filter;
+		std::string ScenePath = "Scenes\\Castle.scene";
+	};
+
+	struct BenchmarkResult
+	{
+		std::string Name;
+		std::string Params;
+		UINT Calls = 0;
+		double MsPerCall = 0.0;
+		double VerticesPerSec = 0.0;
+		double BytesPerCall = 0.0;
+		size_t PeakBytes = 0;
+	};
+
+	// Runs the benchmark in rounds until MinTimeMs has passed; call() returns the number
+	// of vertices it produced.
+	class BenchmarkRunner
+	{
+	public:
+
+		explicit BenchmarkRunner(const BenchmarkOptions& options) : mOptions(options) {}
+
+		void Run(const std::string& name, const std::string& params, const std::function<size_t()>& call)
+		{
+			if (!mOptions.Filter.empty() && name.find(mOptions.Filter) == std::string::npos)
+				return;
+
+			typedef std::chrono::steady_clock Clock;
+			const int roundCount = 5;
+			const double roundMs = mOptions.MinTimeMs / roundCount;
+
+			// The first call warms the caches and the allocator and measures the memory.
+			size_t currentBefore = gCurrentBytes;
+			gPeakBytes = currentBefore;
+			size_t allocatedBefore = gAllocatedBytes;
+			size_t vertices = call();
+
+			BenchmarkResult result;
+			result.Name = name;
+			result.Params = params;
+			result.BytesPerCall = (double)(gAllocatedBytes - allocatedBefore);
+			result.PeakBytes = gPeakBytes - currentBefore;
+			result.MsPerCall = 1.0e30;
+
+			for (int round = 0; round < roundCount; ++round)
+			{
+				UINT calls = 0;
+				double elapsedMs = 0.0;
+				Clock::time_point start = Clock::now();
+				do
+				{
+					call();
+					++calls;
+					elapsedMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+				} while (elapsedMs < roundMs);
+
+				result.Calls += calls;
+				result.MsPerCall = std::min(result.MsPerCall, elapsedMs / calls);
+			}
+
+			result.VerticesPerSec = result.MsPerCall > 0.0 ? vertices * 1000.0 / result.MsPerCall : 0.0;
+
+			std::printf("%s\n", FormatResult(result).c_str());
+			std::fflush(stdout);
+			mResults.push_back(result);
+		}
+
+		const std::vector<BenchmarkResult>& Results()const { return mResults; }
+
+		static std::string FormatResult(const BenchmarkResult& result)
+		{
+			std::ostringstream line;
+			line << result.Name << ',' << result.Params << ',' << result.Calls << ',' << result.MsPerCall << ','
+				<< result.VerticesPerSec << ',' << result.BytesPerCall << ',' << result.PeakBytes;
+			return line.str();
+		}
+
+	private:
+		BenchmarkOptions mOptions;
+		std::vector<BenchmarkResult> mResults;
+	};
+
+	const char* const ResultsHeader = "benchmark,params,calls,ms_per_call,vertices_per_sec,bytes_per_call,peak_bytes";
+
+	std::string Params(const char* format, ...)
+	{
+		char text[128];
+		va_list args;
+		va_start(args, format);
+		std::vsnprintf(text, sizeof(text), format, args);
+		va_end(args);
+		return text;
+	}
+
+	void RunGeneratorBenchmarks(BenchmarkRunner& runner)
+	{
+		GeometryGenerator geoGen;
+		const UINT tessellations[] = { 8, 16, 32, 64, 128, 256 };
+
+		// Every generator runs with all attributes and position-only; the full runs keep
+		// the parameter text of older baselines.
+		struct AttributeMode
+		{
+			GeometryGenerator::uint32 Attributes;
+			const char* Params;
+		};
+		const AttributeMode attributeModes[] =
+		{
+			{ GeometryGenerator::AttributeAll, "" },
+			{ GeometryGenerator::AttributePosition, " attributes=position" },
+		};
+
+		for (auto& mode : attributeModes)
+		{
+			for (UINT n : tessellations)
+			{
+				runner.Run("CreateSphere", Params("slices=%u stacks=%u%s", n, n, mode.Params), [&]()
+				{
+					return geoGen.CreateSphere(1.0f, n, n, mode.Attributes).VertexCount();
+				});
+			}
+
+			for (UINT n : tessellations)
+			{
+				runner.Run("CreateCylinder", Params("slices=%u stacks=%u%s", n, n, mode.Params), [&]()
+				{
+					return geoGen.CreateCylinder(1.5f, 1.5f, 6.0f, n, n, mode.Attributes).VertexCount();
+				});
+			}
+
+			for (UINT subdivisions = 0; subdivisions <= 6; ++subdivisions)
+			{
+				runner.Run("CreateGeosphere", Params("subdivisions=%u%s", subdivisions, mode.Params), [&]()
+				{
+					return geoGen.CreateGeosphere(1.0f, subdivisions, mode.Attributes).VertexCount();
+				});
+			}
+
+			const UINT gridSizes[] = { 16, 64, 256, 1024 };
+			for (UINT n : gridSizes)
+			{
+				runner.Run("CreateGrid", Params("m=%u n=%u%s", n, n, mode.Params), [&]()
+				{
+					return geoGen.CreateGrid(20.0f, 30.0f, n, n, mode.Attributes).VertexCount();
+				});
+			}
+		}
+
+		// Subdivides a box, so the cost of the repeated splitting is measured on its own.
+		GeometryGenerator::MeshData box = geoGen.CreateBox(1.0f, 1.0f, 1.0f, 0);
+		for (UINT subdivisions = 1; subdivisions <= 6; ++subdivisions)
+		{
+			runner.Run("Subdivide", Params("box subdivisions=%u", subdivisions), [&]()
+			{
+				GeometryGenerator::MeshData mesh = box;
+				for (UINT i = 0; i < subdivisions; ++i)
+					geoGen.Subdivide(mesh);
+				return mesh.VertexCount();
+			});
+		}
+	}
+
+	void RunSceneBenchmarks(BenchmarkRunner& runner, const SceneDesc& sceneDesc)
+	{
+		struct SceneBuild
+		{
+			UINT Jobs;
+			UINT PlanetSubdivisions;
+			bool CompactVertices;
+			bool OptimizeMeshes;
+		};
+		const SceneBuild builds[] =
+		{
+			{ 1, 0, false, false },
+			{ DefaultJobCount(), 0, false, false },
+			{ DefaultJobCount(), 0, true, false },
+			{ DefaultJobCount(), 0, false, true },
+			{ 1, 6, false, false },
+			{ DefaultJobCount(), 6, false, false },
+		};
+
+		for (auto& build : builds)
+		{
+			ShapeGeometryOptions options;
+			options.Jobs = build.Jobs;
+			options.PlanetSubdivisions = build.PlanetSubdivisions;
+			options.CompactVertices = build.CompactVertices;
+			options.OptimizeMeshes = build.OptimizeMeshes;
+
+			std::string params = Params("jobs=%u planet=%u compact=%d optimize=%d", build.Jobs,
+				build.PlanetSubdivisions, build.CompactVertices ? 1 : 0, build.OptimizeMeshes ? 1 : 0);
+
+			runner.Run("BuildScene", params, [&]()
+			{
+				ShapeGeometryBuilder builder(options);
+				GeometryPacker packer;
+				builder.ConfigurePacker(packer);
+				builder.Generate(packer);
+				packer.Build(nullptr, nullptr, "shapeGeo", options.IndexMode);
+
+				SceneStore scene(3);
+				builder.RegisterSubmeshes(packer, scene);
+
+				std::string error;
+				if (!ShapeGeometryBuilder::PlaceScene(sceneDesc, scene, error))
+					throw std::runtime_error(error);
+
+				size_t vertices = 0;
+				for (auto& geo : packer.Geometries())
+					vertices += geo->VertexBufferByteSize / geo->VertexByteStride;
+				return vertices;
+			});
+		}
+	}
+
+	bool WriteResults(const std::string& path, const std::vector<BenchmarkResult>& results)
+	{
+		std::ofstream file(path, std::ios::trunc);
+		file << ResultsHeader << '\n';
+		for (auto& result : results)
+			file << BenchmarkRunner::FormatResult(result) << '\n';
+		return (bool)file;
+	}
+
+	// Returns the number of regressions, or -1 if the baseline cannot be read.
+	int CompareWithBaseline(const std::string& path, double tolerance, const std::vector<BenchmarkResult>& results)
+	{
+		std::ifstream file(path);
+		if (!file)
+			return -1;
+
+		// benchmark,params -> ms_per_call
+		std::map<std::string, double> baseline;
+		std::string line;
+		std::getline(file, line);
+		while (std::getline(file, line))
+		{
+			std::istringstream fields(line);
+			std::string name, params, calls, msPerCall;
+			if (std::getline(fields, name, ',') && std::getline(fields, params, ',') &&
+				std::getline(fields, calls, ',') && std::getline(fields, msPerCall, ','))
+				baseline[name + "," + params] = std::atof(msPerCall.c_str());
+		}
+
+		int regressions = 0;
+		for (auto& result : results)
+		{
+			auto it = baseline.find(result.Name + "," + result.Params);
+			if (it == baseline.end() || it->second <= 0.0)
+				continue;
+
+			double ratio = result.MsPerCall / it->second;
+			if (ratio > 1.0 + tolerance)
+			{
+				std::printf("REGRESSION %s [%s]: %f ms, baseline %f ms (+%.1f%%)\n", result.Name.c_str(),
+					result.Params.c_str(), result.MsPerCall, it->second, (ratio - 1.0) * 100.0);
+				++regressions;
+			}
+		}
+
+		return regressions;
+	}
+
+	BenchmarkOptions ParseBenchmarkOptions(int argc, char** argv)
+	{
+		BenchmarkOptions options;
+		for (int i = 1; i < argc; ++i)
+		{
+			std::string arg = argv[i];
+			bool hasValue = i + 1 < argc;
+			if (arg == "-out" && hasValue)
+				options.OutPath = argv[++i];
+			else if (arg == "-baseline" && hasValue)
+				options.BaselinePath = argv[++i];
+			else if (arg == "-tolerance" && hasValue)
+				options.Tolerance = std::atof(argv[++i]);
+			else if (arg == "-mintime" && hasValue)
+				options.MinTimeMs = std::max(std::atof(argv[++i]), 1.0);
+			else if (arg == "-filter" && hasValue)
+				options.Filter = argv[++i];
+			else if (arg == "-scene" && hasValue)
+				options.ScenePath = argv[++i];
+		}
+		return options;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	BenchmarkOptions options = ParseBenchmarkOptions(argc, argv);
+
+	SceneDesc sceneDesc;
+	std::string error;
+	if (!SceneFile::Load(AnsiToWString(options.ScenePath), sceneDesc, error))
+	{
+		std::fprintf(stderr, "Cannot load %s: %s\n", options.ScenePath.c_str(), error.c_str());
+		return 2;
+	}
+
+	std::printf("%s\n", ResultsHeader);
+
+	BenchmarkRunner runner(options);
+	try
+	{
+		RunGeneratorBenchmarks(runner);
+		RunSceneBenchmarks(runner, sceneDesc);
+	}
+	catch (std::exception& e)
+	{
+		std::fprintf(stderr, "Benchmark failed: %s\n", e.what());
+		return 2;
+	}
+	catch (DxException& e)
+	{
+		std::fprintf(stderr, "Benchmark failed: %ls\n", e.ToString().c_str());
+		return 2;
+	}
+
+	if (!options.OutPath.empty() && !WriteResults(options.OutPath, runner.Results()))
+	{
+		std::fprintf(stderr, "Cannot write %s\n", options.OutPath.c_str());
+		return 2;
+	}
+
+	if (!options.BaselinePath.empty())
+	{
+		int regressions = CompareWithBaseline(options.BaselinePath, options.Tolerance, runner.Results());
+		if (regressions < 0)
+		{
+			std::fprintf(stderr, "Cannot read the baseline %s\n", options.BaselinePath.c_str());
+			return 2;
+		}
+		if (regressions > 0)
+			return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,66 @@
+//***************************************************************************************
+// DepthSort.cpp
+//***************************************************************************************
+
+#include "DepthSort.h"
+
+using namespace DirectX;
+
+void DepthSorter::Sort(const SceneStore& scene, const std::vector<UINT>& objects,
+	FXMMATRIX view, float nearZ, float farZ)
+{
+	size_t count = objects.size();
+	mKeys.resize(count);
+	mOrder.assign(objects.begin(), objects.end());
+	mScratchKeys.resize(count);
+	mScratchOrder.resize(count);
+	if (count == 0)
+		return;
+
+	// Both byte histograms are gathered while the keys are computed.
+	UINT counts[2][256] = {};
+	float keyScale = 65535.0f / (farZ - nearZ);
+	for (size_t i = 0; i < count; ++i)
+	{
+		UINT object = objects[i];
+		auto& submesh = scene.Submeshes[scene.SubmeshId[object]];
+
+		XMVECTOR centerW = XMVector3Transform(XMLoadFloat3(&submesh.Bounds.Center), XMLoadFloat4x4(&scene.World[object]));
+		float viewZ = XMVectorGetZ(XMVector3Transform(centerW, view));
+
+		float key = (viewZ - nearZ) * keyScale;
+		key = key < 0.0f ? 0.0f : (key > 65535.0f ? 65535.0f : key);
+		mKeys[i] = (std::uint16_t)(key + 0.5f);
+
+		counts[0][mKeys[i] & 0xff]++;
+		counts[1][mKeys[i] >> 8]++;
+	}
+
+	// Low byte first; each pass is a stable counting sort into the scratch arrays.
+	for (UINT pass = 0; pass < 2; ++pass)
+	{
+		UINT shift = pass * 8;
+
+		// Every key has the same byte: the pass would not move anything.
+		if (counts[pass][(mKeys[0] >> shift) & 0xff] == count)
+			continue;
+
+		UINT offset = 0;
+		for (UINT bucket = 0; bucket < 256; ++bucket)
+		{
+			UINT bucketCount = counts[pass][bucket];
+			counts[pass][bucket] = offset;
+			offset += bucketCount;
+		}
+
+		for (size_t i = 0; i < count; ++i)
+		{
+			UINT dest = counts[pass][(mKeys[i] >> shift) & 0xff]++;
+			mScratchKeys[dest] = mKeys[i];
+			mScratchOrder[dest] = mOrder[i];
+		}
+
+		mKeys.swap(mScratchKeys);
+		mOrder.swap(mScratchOrder);
+	}
+}
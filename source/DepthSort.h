@@ -0,0 +1,36 @@
+//***************************************************************************************
+// DepthSort.h
+//
+// Per-frame front-to-back ordering of scene objects, for drawing the nearest occluders
+// first.  The view-space depth of each object's bounding sphere center is quantized to
+// a 16-bit key and the keys are sorted with a two-pass LSD radix sort, linear in the
+// object count; objects with equal keys keep their relative order.
+//***************************************************************************************
+
+#pragma once
+
+#include "SceneStore.h"
+
+#include <cstdint>
+
+class DepthSorter
+{
+public:
+
+	// Sorts objects nearest first.  Depths are quantized over [nearZ, farZ]; objects
+	// outside the range share the first or the last key.
+	void Sort(const SceneStore& scene, const std::vector<UINT>& objects,
+		DirectX::FXMMATRIX view, float nearZ, float farZ);
+
+	// Object indices of the last Sort, nearest first.
+	const std::vector<UINT>& Order()const { return mOrder; }
+
+private:
+
+	std::vector<std::uint16_t> mKeys;
+	std::vector<UINT> mOrder;
+
+	// Destinations of the scatter passes, swapped with the above after each pass.
+	std::vector<std::uint16_t> mScratchKeys;
+	std::vector<UINT> mScratchOrder;
+};
@@ -0,0 +1,72 @@
+#include "FramePacer.h"
+
+FramePacer::FramePacer(ID3D12Fence* fence, UINT framesInFlight)
+	: mFence(fence)
+{
+	for (UINT i = 0; i < framesInFlight; ++i)
+	{
+		HANDLE eventHandle = CreateEventEx(nullptr, nullptr, 0, EVENT_ALL_ACCESS);
+		if (eventHandle == nullptr)
+			ThrowIfFailed(HRESULT_FROM_WIN32(GetLastError()));
+		mFrameEvents.push_back(eventHandle);
+	}
+
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+	mTicksToMs = 1000.0 / (double)frequency.QuadPart;
+}
+
+FramePacer::~FramePacer()
+{
+	for (HANDLE eventHandle : mFrameEvents)
+		CloseHandle(eventHandle);
+
+	if (mLatencyWaitable != nullptr)
+		CloseHandle(mLatencyWaitable);
+}
+
+bool FramePacer::EnableLatencyWaiter(IDXGISwapChain* swapChain, UINT maxFrameLatency)
+{
+	Microsoft::WRL::ComPtr<IDXGISwapChain2> swapChain2;
+	if (FAILED(swapChain->QueryInterface(IID_PPV_ARGS(&swapChain2))))
+		return false;
+
+	// Fails with DXGI_ERROR_INVALID_CALL unless the swap chain is waitable.
+	if (FAILED(swapChain2->SetMaximumFrameLatency(maxFrameLatency)))
+		return false;
+
+	mLatencyWaitable = swapChain2->GetFrameLatencyWaitableObject();
+	return mLatencyWaitable != nullptr;
+}
+
+void FramePacer::WaitForFrame(UINT frameIndex, UINT64 fenceValue)
+{
+	LARGE_INTEGER start;
+	QueryPerformanceCounter(&start);
+
+	// Never block forever on the display; a missed vblank must not hang the app.
+	if (mLatencyWaitable != nullptr)
+		WaitForSingleObject(mLatencyWaitable, 1000);
+
+	if (fenceValue != 0 && mFence->GetCompletedValue() < fenceValue)
+	{
+		HANDLE eventHandle = mFrameEvents[frameIndex];
+		ThrowIfFailed(mFence->SetEventOnCompletion(fenceValue, eventHandle));
+		WaitForSingleObject(eventHandle, INFINITE);
+	}
+
+	LARGE_INTEGER end;
+	QueryPerformanceCounter(&end);
+
+	mLastWaitMs = (double)(end.QuadPart - start.QuadPart) * mTicksToMs;
+	mStats.Frames++;
+	mStats.TotalWaitMs += mLastWaitMs;
+	mStats.MaxWaitMs = std::max(mStats.MaxWaitMs, mLastWaitMs);
+}
+
+FramePacer::Stats FramePacer::TakeStats()
+{
+	Stats stats = mStats;
+	mStats = Stats();
+	return stats;
+}
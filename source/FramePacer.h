@@ -0,0 +1,60 @@
+//***************************************************************************************
+// FramePacer.h
+//
+// Paces the CPU against the GPU for a ring of frame resources.  Each frame resource
+// slot owns a persistent event that the fence signals, so waiting for a slot never
+// creates or destroys kernel objects.  Optionally the swap chain's frame latency
+// waitable object is waited on first, which keeps the CPU from queuing frames ahead
+// of the display and shortens input-to-photon latency.
+//***************************************************************************************
+
+#pragma once
+
+#include "../../Common/d3dUtil.h"
+
+class FramePacer
+{
+public:
+
+	// CPU wait times accumulated since the last call to TakeStats.
+	struct Stats
+	{
+		UINT Frames = 0;
+		double TotalWaitMs = 0.0;
+		double MaxWaitMs = 0.0;
+
+		double AverageWaitMs()const { return Frames > 0 ? TotalWaitMs / Frames : 0.0; }
+	};
+
+	FramePacer(ID3D12Fence* fence, UINT framesInFlight);
+	FramePacer(const FramePacer& rhs) = delete;
+	FramePacer& operator=(const FramePacer& rhs) = delete;
+	~FramePacer();
+
+	// Waits on the swap chain's frame latency waitable object at the start of each frame.
+	// Returns false, leaving the pacer fence-only, if the swap chain was not created with
+	// DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT.
+	bool EnableLatencyWaiter(IDXGISwapChain* swapChain, UINT maxFrameLatency);
+
+	// Blocks until the frame resource slot can be reused, i.e. the GPU has reached
+	// fenceValue (0 means the slot was never submitted).
+	void WaitForFrame(UINT frameIndex, UINT64 fenceValue);
+
+	UINT FramesInFlight()const { return (UINT)mFrameEvents.size(); }
+	bool LatencyWaiterEnabled()const { return mLatencyWaitable != nullptr; }
+
+	// CPU time spent blocked in the last WaitForFrame, in milliseconds.
+	double LastWaitMs()const { return mLastWaitMs; }
+
+	Stats TakeStats();
+
+private:
+
+	ID3D12Fence* mFence = nullptr;
+	std::vector<HANDLE> mFrameEvents;
+	HANDLE mLatencyWaitable = nullptr;
+
+	double mTicksToMs = 0.0;
+	double mLastWaitMs = 0.0;
+	Stats mStats;
+};
@@ -0,0 +1,305 @@
+//***************************************************************************************
+// FrameProfiler.cpp
+//***************************************************************************************
+
+#include "FrameProfiler.h"
+
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+
+namespace
+{
+	INT64 QueryTicks()
+	{
+		LARGE_INTEGER ticks;
+		QueryPerformanceCounter(&ticks);
+		return ticks.QuadPart;
+	}
+}
+
+FrameProfiler::CpuScope::CpuScope(FrameProfiler* profiler, const char* name)
+	: mProfiler(profiler)
+{
+	mEvent = mProfiler->BeginCpuEvent(name);
+}
+
+FrameProfiler::CpuScope::~CpuScope()
+{
+	mProfiler->EndCpuEvent(mEvent);
+}
+
+FrameProfiler::FrameProfiler(ID3D12Device* device, ID3D12CommandQueue* queue, UINT framesInFlight)
+	: mQueue(queue)
+{
+	D3D12_QUERY_HEAP_DESC heapDesc;
+	heapDesc.Type = D3D12_QUERY_HEAP_TYPE_TIMESTAMP;
+	heapDesc.Count = framesInFlight * MaxGpuScopes * 2;
+	heapDesc.NodeMask = 0;
+	ThrowIfFailed(device->CreateQueryHeap(&heapDesc, IID_PPV_ARGS(mQueryHeap.GetAddressOf())));
+
+	mSlots.resize(framesInFlight);
+	for (auto& slot : mSlots)
+	{
+		ThrowIfFailed(device->CreateCommittedResource(
+			&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_READBACK),
+			D3D12_HEAP_FLAG_NONE,
+			&CD3DX12_RESOURCE_DESC::Buffer(MaxGpuScopes * 2 * sizeof(UINT64)),
+			D3D12_RESOURCE_STATE_COPY_DEST,
+			nullptr,
+			IID_PPV_ARGS(slot.Readback.GetAddressOf())));
+	}
+
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+	mTicksToMs = 1000.0 / (double)frequency.QuadPart;
+	mStartTicks = QueryTicks();
+
+	ThrowIfFailed(mQueue->GetTimestampFrequency(&mGpuFrequency));
+	Calibrate();
+
+	mHistory.reserve(HistoryFrameCount);
+}
+
+void FrameProfiler::BeginFrame()
+{
+	if (mHasCurrent)
+	{
+		// The slot's previous frame was collected by ReadBackFrame, so it is free.
+		Slot& slot = mSlots[mCurrentSlot];
+		std::swap(slot.Frame, mCurrent);
+		std::swap(slot.GpuNames, mCurrentGpuNames);
+		slot.Pending = true;
+	}
+
+	mCurrent.FrameNumber = mFrameNumber++;
+	mCurrent.Cpu.clear();
+	mCurrent.Gpu.clear();
+	mCurrentGpuNames.clear();
+	mCpuDepth = 0;
+	mHasCurrent = true;
+}
+
+void FrameProfiler::ReadBackFrame(UINT frameIndex)
+{
+	Slot& slot = mSlots[frameIndex];
+	mCurrentSlot = frameIndex;
+
+	if (!slot.Pending)
+		return;
+	slot.Pending = false;
+
+	FrameRecord& frame = slot.Frame;
+	frame.Gpu.clear();
+
+	UINT scopeCount = (UINT)slot.GpuNames.size();
+	if (scopeCount > 0)
+	{
+		D3D12_RANGE readRange = { 0, scopeCount * 2 * sizeof(UINT64) };
+		UINT64* timestamps = nullptr;
+		ThrowIfFailed(slot.Readback->Map(0, &readRange, reinterpret_cast<void**>(&timestamps)));
+
+		double gpuTicksToMs = 1000.0 / (double)mGpuFrequency;
+		double referenceMs = TicksToMs((INT64)mCpuReference - mStartTicks);
+		for (UINT i = 0; i < scopeCount; ++i)
+		{
+			UINT64 begin = timestamps[2 * i];
+			UINT64 end = std::max(timestamps[2 * i + 1], begin);
+
+			Event event;
+			event.Name = slot.GpuNames[i];
+			event.StartMs = referenceMs + (double)(INT64)(begin - mGpuReference) * gpuTicksToMs;
+			event.DurationMs = (double)(end - begin) * gpuTicksToMs;
+			frame.Gpu.push_back(event);
+		}
+
+		D3D12_RANGE writeRange = { 0, 0 };
+		slot.Readback->Unmap(0, &writeRange);
+
+		// GPU scopes may end on another command list, so nesting is found from the intervals.
+		for (auto& event : frame.Gpu)
+		{
+			for (auto& outer : frame.Gpu)
+			{
+				if (&outer == &event)
+					break;
+				if (outer.StartMs <= event.StartMs &&
+					event.StartMs + event.DurationMs <= outer.StartMs + outer.DurationMs)
+					event.Depth++;
+			}
+		}
+	}
+
+	for (auto& event : frame.Cpu)
+		AddSample(event, false);
+	for (auto& event : frame.Gpu)
+		AddSample(event, true);
+
+	// Swapping keeps the vectors' storage in use instead of reallocating every frame.
+	if (mHistory.size() < HistoryFrameCount)
+	{
+		mHistory.push_back(FrameRecord());
+		std::swap(mHistory.back(), frame);
+	}
+	else
+	{
+		std::swap(mHistory[mHistoryNext], frame);
+		mHistoryNext = (mHistoryNext + 1) % mHistory.size();
+	}
+}
+
+UINT FrameProfiler::BeginGpuScope(ID3D12GraphicsCommandList* cmdList, const char* name)
+{
+	if (mCurrentGpuNames.size() >= MaxGpuScopes)
+		return InvalidScope;
+
+	UINT scope = (UINT)mCurrentGpuNames.size();
+	mCurrentGpuNames.push_back(name);
+
+	cmdList->EndQuery(mQueryHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, (mCurrentSlot * MaxGpuScopes + scope) * 2);
+	return scope;
+}
+
+void FrameProfiler::EndGpuScope(ID3D12GraphicsCommandList* cmdList, UINT scope)const
+{
+	if (scope == InvalidScope)
+		return;
+
+	cmdList->EndQuery(mQueryHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, (mCurrentSlot * MaxGpuScopes + scope) * 2 + 1);
+}
+
+void FrameProfiler::ResolveGpuScopes(ID3D12GraphicsCommandList* cmdList)const
+{
+	UINT scopeCount = (UINT)mCurrentGpuNames.size();
+	if (scopeCount == 0)
+		return;
+
+	cmdList->ResolveQueryData(mQueryHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP,
+		mCurrentSlot * MaxGpuScopes * 2, scopeCount * 2, mSlots[mCurrentSlot].Readback.Get(), 0);
+}
+
+std::vector<FrameProfiler::ScopeStats> FrameProfiler::TakeStats()
+{
+	std::vector<ScopeStats> stats = mStats;
+	for (auto& scope : mStats)
+	{
+		scope.Samples = 0;
+		scope.TotalMs = 0.0;
+		scope.MaxMs = 0.0;
+	}
+
+	// The clocks drift apart slowly; the stats are taken often enough to follow them.
+	Calibrate();
+
+	return stats;
+}
+
+bool FrameProfiler::WriteCsv(const std::wstring& path)const
+{
+	std::ofstream file(path, std::ios::trunc);
+	if (!file)
+		return false;
+
+	file << std::fixed << std::setprecision(4);
+	file << "frame,clock,scope,depth,start_ms,duration_ms\n";
+
+	ForEachHistoryFrame([&](const FrameRecord& frame)
+	{
+		auto writeEvents = [&](const std::vector<Event>& events, const char* clock)
+		{
+			for (auto& event : events)
+			{
+				file << frame.FrameNumber << ',' << clock << ',' << event.Name << ',' << event.Depth << ','
+					<< event.StartMs << ',' << event.DurationMs << '\n';
+			}
+		};
+		writeEvents(frame.Cpu, "cpu");
+		writeEvents(frame.Gpu, "gpu");
+	});
+
+	return (bool)file;
+}
+
+bool FrameProfiler::WriteChromeTrace(const std::wstring& path)const
+{
+	std::ofstream file(path, std::ios::trunc);
+	if (!file)
+		return false;
+
+	// Scope names are literals chosen by the app, so they are written without escaping.
+	file << std::fixed << std::setprecision(3);
+	file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"CPU\"}},\n";
+	file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"GPU\"}}";
+
+	ForEachHistoryFrame([&](const FrameRecord& frame)
+	{
+		auto writeEvents = [&](const std::vector<Event>& events, int tid)
+		{
+			for (auto& event : events)
+			{
+				file << ",\n{\"name\":\"" << event.Name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << tid
+					<< ",\"ts\":" << event.StartMs * 1000.0 << ",\"dur\":" << event.DurationMs * 1000.0
+					<< ",\"args\":{\"frame\":" << frame.FrameNumber << "}}";
+			}
+		};
+		writeEvents(frame.Cpu, 1);
+		writeEvents(frame.Gpu, 2);
+	});
+
+	file << "\n]}\n";
+	return (bool)file;
+}
+
+UINT FrameProfiler::BeginCpuEvent(const char* name)
+{
+	Event event;
+	event.Name = name;
+	event.Depth = mCpuDepth++;
+	event.StartMs = TicksToMs(QueryTicks() - mStartTicks);
+	mCurrent.Cpu.push_back(event);
+
+	return (UINT)mCurrent.Cpu.size() - 1;
+}
+
+void FrameProfiler::EndCpuEvent(UINT event)
+{
+	Event& cpuEvent = mCurrent.Cpu[event];
+	cpuEvent.DurationMs = TicksToMs(QueryTicks() - mStartTicks) - cpuEvent.StartMs;
+	mCpuDepth--;
+}
+
+double FrameProfiler::TicksToMs(INT64 ticks)const
+{
+	return (double)ticks * mTicksToMs;
+}
+
+void FrameProfiler::Calibrate()
+{
+	ThrowIfFailed(mQueue->GetClockCalibration(&mGpuReference, &mCpuReference));
+}
+
+void FrameProfiler::AddSample(const Event& event, bool gpu)
+{
+	ScopeStats* stats = nullptr;
+	for (auto& scope : mStats)
+	{
+		if (scope.Gpu == gpu && std::strcmp(scope.Name, event.Name) == 0)
+		{
+			stats = &scope;
+			break;
+		}
+	}
+
+	if (stats == nullptr)
+	{
+		mStats.push_back(ScopeStats());
+		stats = &mStats.back();
+		stats->Name = event.Name;
+		stats->Gpu = gpu;
+	}
+
+	stats->Samples++;
+	stats->TotalMs += event.DurationMs;
+	stats->MaxMs = std::max(stats->MaxMs, event.DurationMs);
+}
@@ -0,0 +1,157 @@
+//***************************************************************************************
+// FrameProfiler.h
+//
+// CPU and GPU timings of each frame.  CPU scopes are timed with the performance
+// counter; GPU scopes are pairs of timestamp queries resolved at the end of the
+// frame into a readback buffer owned by the frame's resource slot, and read back
+// once the frame pacer has made that slot available again.  Completed frames are
+// kept in a short history that can be written as CSV or as a Chrome trace
+// (chrome://tracing, ui.perfetto.dev), with both clocks on the same time line.
+//***************************************************************************************
+
+#pragma once
+
+#include "../../Common/d3dUtil.h"
+
+class FrameProfiler
+{
+public:
+
+	// Scope names must outlive the profiler; string literals are expected.
+	struct Event
+	{
+		const char* Name = nullptr;
+		UINT Depth = 0;
+
+		// Milliseconds since the profiler was created, on the CPU clock.
+		double StartMs = 0.0;
+		double DurationMs = 0.0;
+	};
+
+	struct FrameRecord
+	{
+		UINT64 FrameNumber = 0;
+		std::vector<Event> Cpu;
+		std::vector<Event> Gpu;
+	};
+
+	// Average and maximum duration of one scope name since the last TakeStats.
+	struct ScopeStats
+	{
+		const char* Name = nullptr;
+		bool Gpu = false;
+		UINT Samples = 0;
+		double TotalMs = 0.0;
+		double MaxMs = 0.0;
+
+		double AverageMs()const { return Samples > 0 ? TotalMs / Samples : 0.0; }
+	};
+
+	// Times the enclosing block as a CPU scope of the current frame.
+	class CpuScope
+	{
+	public:
+		CpuScope(FrameProfiler* profiler, const char* name);
+		CpuScope(const CpuScope& rhs) = delete;
+		CpuScope& operator=(const CpuScope& rhs) = delete;
+		~CpuScope();
+
+	private:
+		FrameProfiler* mProfiler = nullptr;
+		UINT mEvent = 0;
+	};
+
+	// Timestamp pairs available to one frame.
+	static const UINT MaxGpuScopes = 16;
+
+	// Completed frames kept for the dumps.
+	static const UINT HistoryFrameCount = 600;
+
+	// Returned by BeginGpuScope when the frame ran out of timestamp pairs.
+	static const UINT InvalidScope = 0xffffffff;
+
+	FrameProfiler(ID3D12Device* device, ID3D12CommandQueue* queue, UINT framesInFlight);
+	FrameProfiler(const FrameProfiler& rhs) = delete;
+	FrameProfiler& operator=(const FrameProfiler& rhs) = delete;
+
+	// Starts recording a new frame; the previous one is handed to its frame resource slot.
+	void BeginFrame();
+
+	// Call once the frame resource slot is free again (after FramePacer::WaitForFrame).
+	// Reads back the GPU timings of the frame last submitted with the slot, moves it to
+	// the history and records the current frame's GPU scopes into the slot.
+	void ReadBackFrame(UINT frameIndex);
+
+	// Timestamps written on the command list; the end of a scope may be recorded on a
+	// later list of the same frame.  EndGpuScope does not change the profiler, so the
+	// record threads may call it.
+	UINT BeginGpuScope(ID3D12GraphicsCommandList* cmdList, const char* name);
+	void EndGpuScope(ID3D12GraphicsCommandList* cmdList, UINT scope)const;
+
+	// Copies the frame's timestamps to the slot's readback buffer.  Must be recorded
+	// after every EndGpuScope of the frame, on the last list submitted.
+	void ResolveGpuScopes(ID3D12GraphicsCommandList* cmdList)const;
+
+	// Per scope name and clock, in the order the scopes were first seen.  Also
+	// recalibrates the GPU clock against the CPU clock.
+	std::vector<ScopeStats> TakeStats();
+
+	const std::vector<FrameRecord>& History()const { return mHistory; }
+
+	// Write the history, oldest frame first.  Return false if the file cannot be written.
+	bool WriteCsv(const std::wstring& path)const;
+	bool WriteChromeTrace(const std::wstring& path)const;
+
+private:
+
+	UINT BeginCpuEvent(const char* name);
+	void EndCpuEvent(UINT event);
+
+	double TicksToMs(INT64 ticks)const;
+	void Calibrate();
+	void AddSample(const Event& event, bool gpu);
+
+	// Oldest to newest.
+	template<typename Visitor>
+	void ForEachHistoryFrame(const Visitor& visit)const
+	{
+		for (size_t i = 0; i < mHistory.size(); ++i)
+			visit(mHistory[(mHistoryNext + i) % mHistory.size()]);
+	}
+
+private:
+
+	Microsoft::WRL::ComPtr<ID3D12QueryHeap> mQueryHeap;
+	ID3D12CommandQueue* mQueue = nullptr;
+
+	// One readback buffer per frame resource slot, with the frame last submitted with it.
+	struct Slot
+	{
+		Microsoft::WRL::ComPtr<ID3D12Resource> Readback;
+		FrameRecord Frame;
+		std::vector<const char*> GpuNames;
+		bool Pending = false;
+	};
+	std::vector<Slot> mSlots;
+
+	// Frame being recorded, the slot it was given and its GPU scope names.
+	FrameRecord mCurrent;
+	UINT mCurrentSlot = 0;
+	std::vector<const char*> mCurrentGpuNames;
+	UINT mCpuDepth = 0;
+	UINT64 mFrameNumber = 0;
+	bool mHasCurrent = false;
+
+	INT64 mStartTicks = 0;
+	double mTicksToMs = 0.0;
+
+	// GPU timestamp = mGpuReference + (QPC - mCpuReference) * GPU ticks per QPC tick.
+	UINT64 mGpuFrequency = 0;
+	UINT64 mGpuReference = 0;
+	UINT64 mCpuReference = 0;
+
+	std::vector<FrameRecord> mHistory;
+	size_t mHistoryNext = 0;
+
+	std::vector<ScopeStats> mStats;
+};
@@ -0,0 +1,46 @@
+#include "FrameResource.h"
+
+FrameResource::FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT workerCount, bool objectConstantBuffer)
+{
+	ThrowIfFailed(device->CreateCommandAllocator(
+		D3D12_COMMAND_LIST_TYPE_DIRECT,
+		IID_PPV_ARGS(CmdListAlloc.GetAddressOf())));
+
+	WorkerCmdListAllocs.resize(workerCount);
+	WorkerCmdLists.resize(workerCount);
+	for (UINT i = 0; i < workerCount; ++i)
+	{
+		ThrowIfFailed(device->CreateCommandAllocator(
+			D3D12_COMMAND_LIST_TYPE_DIRECT,
+			IID_PPV_ARGS(WorkerCmdListAllocs[i].GetAddressOf())));
+
+		ThrowIfFailed(device->CreateCommandList(
+			0,
+			D3D12_COMMAND_LIST_TYPE_DIRECT,
+			WorkerCmdListAllocs[i].Get(),
+			nullptr,
+			IID_PPV_ARGS(WorkerCmdLists[i].GetAddressOf())));
+
+		// Start off in a closed state; the lists are reset before each use.
+		WorkerCmdLists[i]->Close();
+	}
+
+	PassCB = std::make_unique<UploadBuffer<PassConstants>>(device, passCount, true);
+	ObjectCB = std::make_unique<UploadBuffer<ObjectConstants>>(device, objectCount, objectConstantBuffer);
+	InstanceBuffer = std::make_unique<UploadBuffer<InstanceData>>(device, objectCount, false);
+
+	// Upload heap resources may be mapped more than once; the nested Map returns the
+	// same pointer as the one kept by UploadBuffer.
+	ThrowIfFailed(ObjectCB->Resource()->Map(0, nullptr, reinterpret_cast<void**>(&ObjectCBMappedData)));
+	ObjectCBStride = objectConstantBuffer ?
+		d3dUtil::CalcConstantBufferByteSize(sizeof(ObjectConstants)) : sizeof(ObjectConstants);
+
+	ThrowIfFailed(InstanceBuffer->Resource()->Map(0, nullptr, reinterpret_cast<void**>(&InstanceBufferMappedData)));
+	InstanceBufferStride = sizeof(InstanceData);
+}
+
+FrameResource::~FrameResource()
+{
+	ObjectCB->Resource()->Unmap(0, nullptr);
+	InstanceBuffer->Resource()->Unmap(0, nullptr);
+}
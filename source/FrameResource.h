@@ -0,0 +1,127 @@
+#pragma once
+
+#include "../../Common/d3dUtil.h"
+#include "../../Common/MathHelper.h"
+#include "../../Common/UploadBuffer.h"
+
+#include <DirectXPackedVector.h>
+
+// PosScale and PosBias decode the object's vertex positions: PosL = stored * scale + bias.
+// They are the identity for the full-precision vertex layout.
+struct ObjectConstants
+{
+	DirectX::XMFLOAT4X4 World = MathHelper::Identity4x4();
+	DirectX::XMFLOAT4 PosScale = { 1.0f, 1.0f, 1.0f, 0.0f };
+	DirectX::XMFLOAT4 PosBias = { 0.0f, 0.0f, 0.0f, 0.0f };
+};
+
+// Per-instance data read by the instanced vertex shader from a structured buffer.
+// Same layout as ObjectConstants so both are written by the same code.
+struct InstanceData
+{
+	DirectX::XMFLOAT4X4 World = MathHelper::Identity4x4();
+	DirectX::XMFLOAT4 PosScale = { 1.0f, 1.0f, 1.0f, 0.0f };
+	DirectX::XMFLOAT4 PosBias = { 0.0f, 0.0f, 0.0f, 0.0f };
+};
+
+// Static per-object data read by the culling compute shader: the local bounding
+// sphere of the object's submesh and its draw arguments.
+struct CullObjectData
+{
+	DirectX::XMFLOAT3 Center = { 0.0f, 0.0f, 0.0f };
+	float Radius = 0.0f;
+	UINT IndexCount = 0;
+	UINT StartIndexLocation = 0;
+	INT BaseVertexLocation = 0;
+	UINT InstanceIndex = 0;
+};
+
+// Indirect command written by the culling compute shader for every visible object;
+// sets the base instance root constant and draws one instance.
+struct IndirectCommand
+{
+	UINT BaseInstance = 0;
+	D3D12_DRAW_INDEXED_ARGUMENTS DrawArguments = {};
+};
+
+struct PassConstants
+{
+	DirectX::XMFLOAT4X4 View = MathHelper::Identity4x4();
+	DirectX::XMFLOAT4X4 InvView = MathHelper::Identity4x4();
+	DirectX::XMFLOAT4X4 Proj = MathHelper::Identity4x4();
+	DirectX::XMFLOAT4X4 InvProj = MathHelper::Identity4x4();
+	DirectX::XMFLOAT4X4 ViewProj = MathHelper::Identity4x4();
+	DirectX::XMFLOAT4X4 InvViewProj = MathHelper::Identity4x4();
+	DirectX::XMFLOAT3 EyePosW = { 0.0f, 0.0f, 0.0f };
+	float cbPerObjectPad1 = 0.0f;
+	DirectX::XMFLOAT2 RenderTargetSize = { 0.0f, 0.0f };
+	DirectX::XMFLOAT2 InvRenderTargetSize = { 0.0f, 0.0f };
+	float NearZ = 0.0f;
+	float FarZ = 0.0f;
+	float TotalTime = 0.0f;
+	float DeltaTime = 0.0f;
+
+	// Edge overlay drawn by the opaque pixel shader (Shaders\EdgeOverlay.hlsl); the edge
+	// width is in pixels, and an opacity of 0 hides the overlay.
+	DirectX::XMFLOAT4 EdgeColor = { 0.0f, 0.0f, 0.0f, 1.0f };
+	float EdgeWidth = 1.0f;
+	float EdgeOpacity = 0.0f;
+	DirectX::XMFLOAT2 cbPassPad2 = { 0.0f, 0.0f };
+};
+
+struct Vertex
+{
+	DirectX::XMFLOAT3 Pos;
+	DirectX::XMFLOAT4 Color;
+};
+
+// Compact vertex layout: SNORM16 positions normalized to the submesh bounds (w unused)
+// and RGBA8 colors, 12 bytes instead of 28.
+struct CompactVertex
+{
+	DirectX::PackedVector::XMSHORTN4 Pos;
+	DirectX::PackedVector::XMUBYTEN4 Color;
+};
+
+// Stores the resources needed for the CPU to build the command lists
+// for a frame.
+struct FrameResource
+{
+public:
+
+	FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT workerCount, bool objectConstantBuffer);
+	FrameResource(const FrameResource& rhs) = delete;
+	FrameResource& operator=(const FrameResource& rhs) = delete;
+	~FrameResource();
+
+	// We cannot reset the allocator until the GPU is done processing the commands.
+	// So each frame needs their own allocator.
+	Microsoft::WRL::ComPtr<ID3D12CommandAllocator> CmdListAlloc;
+
+	// One allocator and command list per record thread for multithreaded recording.
+	// The lists are created closed.
+	std::vector<Microsoft::WRL::ComPtr<ID3D12CommandAllocator>> WorkerCmdListAllocs;
+	std::vector<Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList>> WorkerCmdLists;
+
+	// We cannot update a cbuffer until the GPU is done processing the commands
+	// that reference it.  So each frame needs their own cbuffers.
+	std::unique_ptr<UploadBuffer<PassConstants>> PassCB = nullptr;
+	// When objectConstantBuffer is false the object constants are tightly packed
+	// as a structured buffer instead of 256-byte aligned constant buffers.
+	std::unique_ptr<UploadBuffer<ObjectConstants>> ObjectCB = nullptr;
+
+	// Structured buffer of per-instance world matrices used by the instanced
+	// drawing path.  Instances of one batch are stored contiguously.
+	std::unique_ptr<UploadBuffer<InstanceData>> InstanceBuffer = nullptr;
+
+	// Persistently mapped pointers and element strides of ObjectCB and InstanceBuffer,
+	// so runs of consecutive elements can be written with a single memcpy.
+	BYTE* ObjectCBMappedData = nullptr;
+	UINT ObjectCBStride = 0;
+	BYTE* InstanceBufferMappedData = nullptr;
+	UINT InstanceBufferStride = 0;
+
+	// Fence value to mark commands up to this fence point.  This lets us
+	// check if these constants are still in use by the GPU.
+	UINT64 Fence = 0;
+};
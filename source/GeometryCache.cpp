@@ -0,0 +1,55 @@
+//***************************************************************************************
+// GeometryCache.cpp
+//***************************************************************************************
+
+#include "GeometryCache.h"
+
+void GeometryCacheKey::Add(const void* data, size_t byteSize)
+{
+	const BYTE* bytes = static_cast<const BYTE*>(data);
+	for (size_t i = 0; i < byteSize; ++i)
+	{
+		mHash ^= bytes[i];
+		mHash *= 1099511628211ull;
+	}
+}
+
+void GeometryCacheKey::Add(const std::string& text)
+{
+	// Length first so consecutive strings cannot run into each other.
+	AddValue((std::uint64_t)text.size());
+	Add(text.data(), text.size());
+}
+
+MappedFile::~MappedFile()
+{
+	if (mData != nullptr)
+		UnmapViewOfFile(mData);
+	if (mMapping != nullptr)
+		CloseHandle(mMapping);
+	if (mFile != INVALID_HANDLE_VALUE)
+		CloseHandle(mFile);
+}
+
+bool MappedFile::Open(const std::wstring& path)
+{
+	mFile = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (mFile == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(mFile, &size) || size.QuadPart == 0)
+		return false;
+
+	mMapping = CreateFileMappingW(mFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mMapping == nullptr)
+		return false;
+
+	mData = static_cast<const BYTE*>(MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0));
+	if (mData == nullptr)
+		return false;
+
+	mSize = (std::uint64_t)size.QuadPart;
+	return true;
+}
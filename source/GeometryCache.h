@@ -0,0 +1,122 @@
+//***************************************************************************************
+// GeometryCache.h
+//
+// Binary cache of packed geometry, so the shapes are not regenerated on every launch.
+// The file holds the vertex/index buffers of every MeshGeometry together with their
+// DrawArgs tables and the packer's mesh list.  All offsets are relative to the start
+// of the file and all records are plain data, so a memory mapped file is used in place.
+//
+// Layout: GeometryCacheHeader, GeometryCacheGeometry[GeometryCount],
+// GeometryCacheSubmesh[SubmeshCount], GeometryCacheMesh[MeshCount],
+// uint32 submesh references[MeshSubmeshCount], then the buffer data (16-byte aligned).
+//***************************************************************************************
+
+#pragma once
+
+#include "../../Common/d3dUtil.h"
+
+#include <cstdint>
+#include <type_traits>
+
+// FNV-1a hash of everything the cached geometry depends on.
+class GeometryCacheKey
+{
+public:
+
+	void Add(const void* data, size_t byteSize);
+	void Add(const std::string& text);
+
+	template<typename T>
+	void AddValue(const T& value)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "AddValue needs plain data");
+		Add(&value, sizeof(T));
+	}
+
+	std::uint64_t Value()const { return mHash; }
+
+private:
+	std::uint64_t mHash = 14695981039346656037ull;
+};
+
+const std::uint32_t GeometryCacheMagic = 0x4f454753; // "SGEO"
+
+// Bump whenever a record layout, the meaning of a field or the output of the
+// generators changes; the key only covers the generator parameters.
+const std::uint32_t GeometryCacheVersion = 1;
+
+// Longest name, including the terminating null, that a record can hold.
+const size_t GeometryCacheNameSize = 64;
+
+struct GeometryCacheHeader
+{
+	std::uint32_t Magic = GeometryCacheMagic;
+	std::uint32_t Version = GeometryCacheVersion;
+	std::uint64_t Key = 0;
+	std::uint64_t FileSize = 0;
+	std::uint32_t GeometryCount = 0;
+	std::uint32_t SubmeshCount = 0;
+	std::uint32_t MeshCount = 0;
+	std::uint32_t MeshSubmeshCount = 0;
+};
+
+struct GeometryCacheGeometry
+{
+	char Name[GeometryCacheNameSize] = {};
+	std::uint32_t VertexByteStride = 0;
+	std::uint32_t VertexBufferByteSize = 0;
+	std::uint32_t IndexFormat = 0;
+	std::uint32_t IndexBufferByteSize = 0;
+	std::uint64_t VertexDataOffset = 0;
+	std::uint64_t IndexDataOffset = 0;
+
+	// Range of the geometry's DrawArgs in the submesh records.
+	std::uint32_t FirstSubmesh = 0;
+	std::uint32_t SubmeshCount = 0;
+};
+
+struct GeometryCacheSubmesh
+{
+	char Name[GeometryCacheNameSize] = {};
+	std::uint32_t IndexCount = 0;
+	std::uint32_t StartIndexLocation = 0;
+	std::int32_t BaseVertexLocation = 0;
+	DirectX::BoundingBox Bounds;
+};
+
+struct GeometryCacheMesh
+{
+	char Name[GeometryCacheNameSize] = {};
+	std::uint32_t GeometryIndex = 0;
+
+	// Range in the submesh references, which index the submesh records.
+	std::uint32_t FirstSubmeshRef = 0;
+	std::uint32_t SubmeshRefCount = 0;
+
+	DirectX::BoundingSphere SphereBounds;
+	DirectX::XMFLOAT3 PosScale = { 1.0f, 1.0f, 1.0f };
+	DirectX::XMFLOAT3 PosBias = { 0.0f, 0.0f, 0.0f };
+};
+
+// Read-only memory mapping of a whole file.
+class MappedFile
+{
+public:
+
+	MappedFile() = default;
+	MappedFile(const MappedFile& rhs) = delete;
+	MappedFile& operator=(const MappedFile& rhs) = delete;
+	~MappedFile();
+
+	// Returns false if the file does not exist or cannot be mapped.
+	bool Open(const std::wstring& path);
+
+	const BYTE* Data()const { return mData; }
+	std::uint64_t Size()const { return mSize; }
+
+private:
+	HANDLE mFile = INVALID_HANDLE_VALUE;
+	HANDLE mMapping = nullptr;
+	const BYTE* mData = nullptr;
+	std::uint64_t mSize = 0;
+};
@@ -4,178 +4,302 @@
 
 #include "GeometryGenerator.h"
 #include <algorithm>
+#include <iterator>
+#include <unordered_map>
 
 using namespace DirectX;
 
-GeometryGenerator::MeshData GeometryGenerator::CreateBox(float width, float height, float depth, uint32 numSubdivisions)
+// Definitions of the in-class constants, which std::min and default arguments take by reference.
+const GeometryGenerator::uint32 GeometryGenerator::MaxSubdivisions;
+const GeometryGenerator::uint32 GeometryGenerator::MaxVertices16;
+
+namespace
 {
-	MeshData meshData;
+	using uint32 = GeometryGenerator::uint32;
+	using Vertex = GeometryGenerator::Vertex;
 
-	//
-	// Create the vertices.
-	//
+	// Starting value of vertices generated with a partial attribute mask.
+	const Vertex ZeroVertex(0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f);
 
-	Vertex v[24];
+	// Vertex of the fixed shape tables, in the argument order of the Vertex constructor.
+	struct FixedVertex
+	{
+		float Px, Py, Pz;
+		float Nx, Ny, Nz;
+		float Tx, Ty, Tz;
+		float U, V;
+	};
 
-	float w2 = 0.5f * width;
-	float h2 = 0.5f * height;
-	float d2 = 0.5f * depth;
+	// The fixed shapes are built from these compile-time tables instead of rebuilding their
+	// topology on every call; the positions are scaled by the shape dimensions.  The box and
+	// wedge tables have half extents of 1.
+	constexpr FixedVertex BoxVertices[24] =
+	{
+		// Front face.
+		{ -1.0f, -1.0f, -1.0f, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f },
+		{ -1.0f, +1.0f, -1.0f, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f },
+		{ +1.0f, +1.0f, -1.0f, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f },
+		{ +1.0f, -1.0f, -1.0f, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f },
+		// Back face.
+		{ -1.0f, -1.0f, +1.0f, 0.0f, 0.0f, 1.0f, -1.0f, 0.0f, 0.0f, 1.0f, 1.0f },
+		{ +1.0f, -1.0f, +1.0f, 0.0f, 0.0f, 1.0f, -1.0f, 0.0f, 0.0f, 0.0f, 1.0f },
+		{ +1.0f, +1.0f, +1.0f, 0.0f, 0.0f, 1.0f, -1.0f, 0.0f, 0.0f, 0.0f, 0.0f },
+		{ -1.0f, +1.0f, +1.0f, 0.0f, 0.0f, 1.0f, -1.0f, 0.0f, 0.0f, 1.0f, 0.0f },
+		// Top face.
+		{ -1.0f, +1.0f, -1.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f },
+		{ -1.0f, +1.0f, +1.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f },
+		{ +1.0f, +1.0f, +1.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f },
+		{ +1.0f, +1.0f, -1.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f },
+		// Bottom face.
+		{ -1.0f, -1.0f, -1.0f, 0.0f, -1.0f, 0.0f, -1.0f, 0.0f, 0.0f, 1.0f, 1.0f },
+		{ +1.0f, -1.0f, -1.0f, 0.0f, -1.0f, 0.0f, -1.0f, 0.0f, 0.0f, 0.0f, 1.0f },
+		{ +1.0f, -1.0f, +1.0f, 0.0f, -1.0f, 0.0f, -1.0f, 0.0f, 0.0f, 0.0f, 0.0f },
+		{ -1.0f, -1.0f, +1.0f, 0.0f, -1.0f, 0.0f, -1.0f, 0.0f, 0.0f, 1.0f, 0.0f },
+		// Left face.
+		{ -1.0f, -1.0f, +1.0f, -1.0f, 0.0f, 0.0f, 0.0f, 0.0f, -1.0f, 0.0f, 1.0f },
+		{ -1.0f, +1.0f, +1.0f, -1.0f, 0.0f, 0.0f, 0.0f, 0.0f, -1.0f, 0.0f, 0.0f },
+		{ -1.0f, +1.0f, -1.0f, -1.0f, 0.0f, 0.0f, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f },
+		{ -1.0f, -1.0f, -1.0f, -1.0f, 0.0f, 0.0f, 0.0f, 0.0f, -1.0f, 1.0f, 1.0f },
+		// Right face.
+		{ +1.0f, -1.0f, -1.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f },
+		{ +1.0f, +1.0f, -1.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f },
+		{ +1.0f, +1.0f, +1.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 0.0f },
+		{ +1.0f, -1.0f, +1.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f },
+	};
 
-	// Fill in the front face vertex data.
-	v[0] = Vertex(-w2, -h2, -d2, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f);
-	v[1] = Vertex(-w2, +h2, -d2, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f);
-	v[2] = Vertex(+w2, +h2, -d2, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f);
-	v[3] = Vertex(+w2, -h2, -d2, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f);
-
-	// Fill in the back face vertex data.
-	v[4] = Vertex(-w2, -h2, +d2, 0.0f, 0.0f, 1.0f, -1.0f, 0.0f, 0.0f, 1.0f, 1.0f);
-	v[5] = Vertex(+w2, -h2, +d2, 0.0f, 0.0f, 1.0f, -1.0f, 0.0f, 0.0f, 0.0f, 1.0f);
-	v[6] = Vertex(+w2, +h2, +d2, 0.0f, 0.0f, 1.0f, -1.0f, 0.0f, 0.0f, 0.0f, 0.0f);
-	v[7] = Vertex(-w2, +h2, +d2, 0.0f, 0.0f, 1.0f, -1.0f, 0.0f, 0.0f, 1.0f, 0.0f);
-
-	// Fill in the top face vertex data.
-	v[8] = Vertex(-w2, +h2, -d2, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f);
-	v[9] = Vertex(-w2, +h2, +d2, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f);
-	v[10] = Vertex(+w2, +h2, +d2, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f);
-	v[11] = Vertex(+w2, +h2, -d2, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f);
-
-	// Fill in the bottom face vertex data.
-	v[12] = Vertex(-w2, -h2, -d2, 0.0f, -1.0f, 0.0f, -1.0f, 0.0f, 0.0f, 1.0f, 1.0f);
-	v[13] = Vertex(+w2, -h2, -d2, 0.0f, -1.0f, 0.0f, -1.0f, 0.0f, 0.0f, 0.0f, 1.0f);
-	v[14] = Vertex(+w2, -h2, +d2, 0.0f, -1.0f, 0.0f, -1.0f, 0.0f, 0.0f, 0.0f, 0.0f);
-	v[15] = Vertex(-w2, -h2, +d2, 0.0f, -1.0f, 0.0f, -1.0f, 0.0f, 0.0f, 1.0f, 0.0f);
-
-	// Fill in the left face vertex data.
-	v[16] = Vertex(-w2, -h2, +d2, -1.0f, 0.0f, 0.0f, 0.0f, 0.0f, -1.0f, 0.0f, 1.0f);
-	v[17] = Vertex(-w2, +h2, +d2, -1.0f, 0.0f, 0.0f, 0.0f, 0.0f, -1.0f, 0.0f, 0.0f);
-	v[18] = Vertex(-w2, +h2, -d2, -1.0f, 0.0f, 0.0f, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f);
-	v[19] = Vertex(-w2, -h2, -d2, -1.0f, 0.0f, 0.0f, 0.0f, 0.0f, -1.0f, 1.0f, 1.0f);
-
-	// Fill in the right face vertex data.
-	v[20] = Vertex(+w2, -h2, -d2, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f);
-	v[21] = Vertex(+w2, +h2, -d2, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f);
-	v[22] = Vertex(+w2, +h2, +d2, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 0.0f);
-	v[23] = Vertex(+w2, -h2, +d2, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f);
-
-	meshData.Vertices.assign(&v[0], &v[24]);
+	constexpr uint32 BoxIndices[36] =
+	{
+		// Front face.
+		0, 1, 2,
+		0, 2, 3,
+		// Back face.
+		4, 5, 6,
+		4, 6, 7,
+		// Top face.
+		8, 9, 10,
+		8, 10, 11,
+		// Bottom face.
+		12, 13, 14,
+		12, 14, 15,
+		// Left face.
+		16, 17, 18,
+		16, 18, 19,
+		// Right face.
+		20, 21, 22,
+		20, 22, 23,
+	};
 
-	//
-	// Create the indices.
-	//
+	constexpr FixedVertex WedgeVertices[20] =
+	{
+		// Front face.
+		{ -1.0f, -1.0f, -1.0f, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f },
+		{ -1.0f, +1.0f, +1.0f, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f },
+		{ +1.0f, +1.0f, +1.0f, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f },
+		{ +1.0f, -1.0f, -1.0f, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f },
+		// Back face.
+		{ -1.0f, -1.0f, +1.0f, 0.0f, 0.0f, 1.0f, -1.0f, 0.0f, 0.0f, 1.0f, 1.0f },
+		{ +1.0f, -1.0f, +1.0f, 0.0f, 0.0f, 1.0f, -1.0f, 0.0f, 0.0f, 0.0f, 1.0f },
+		{ +1.0f, +1.0f, +1.0f, 0.0f, 0.0f, 1.0f, -1.0f, 0.0f, 0.0f, 0.0f, 0.0f },
+		{ -1.0f, +1.0f, +1.0f, 0.0f, 0.0f, 1.0f, -1.0f, 0.0f, 0.0f, 1.0f, 0.0f },
+		// Bottom face.
+		{ -1.0f, -1.0f, -1.0f, 0.0f, -1.0f, 0.0f, -1.0f, 0.0f, 0.0f, 1.0f, 1.0f },
+		{ +1.0f, -1.0f, -1.0f, 0.0f, -1.0f, 0.0f, -1.0f, 0.0f, 0.0f, 0.0f, 1.0f },
+		{ +1.0f, -1.0f, +1.0f, 0.0f, -1.0f, 0.0f, -1.0f, 0.0f, 0.0f, 0.0f, 0.0f },
+		{ -1.0f, -1.0f, +1.0f, 0.0f, -1.0f, 0.0f, -1.0f, 0.0f, 0.0f, 1.0f, 0.0f },
+		// Left face.
+		{ -1.0f, -1.0f, +1.0f, -1.0f, 0.0f, 0.0f, 0.0f, 0.0f, -1.0f, 0.0f, 1.0f },
+		{ -1.0f, +1.0f, +1.0f, -1.0f, 0.0f, 0.0f, 0.0f, 0.0f, -1.0f, 0.0f, 0.0f },
+		{ -1.0f, +0.0f, -0.0f, -1.0f, 0.0f, 0.0f, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f },
+		{ -1.0f, -1.0f, -1.0f, -1.0f, 0.0f, 0.0f, 0.0f, 0.0f, -1.0f, 1.0f, 1.0f },
+		// Right face.
+		{ +1.0f, -1.0f, -1.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f },
+		{ +1.0f, +0.0f, -0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f },
+		{ +1.0f, +1.0f, +1.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 0.0f },
+		{ +1.0f, -1.0f, +1.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f },
+	};
+
+	constexpr uint32 WedgeIndices[30] =
+	{
+		// Front face.
+		0, 1, 2,
+		0, 2, 3,
+		// Back face.
+		4, 5, 6,
+		4, 6, 7,
+		// Bottom face.
+		8, 9, 10,
+		8, 10, 11,
+		// Left face.
+		12, 13, 14,
+		12, 14, 15,
+		// Right face.
+		16, 17, 18,
+		16, 18, 19,
+	};
+
+	// Unit quad with its top left corner at the origin, extending along +x and -y.
+	constexpr FixedVertex QuadVertices[4] =
+	{
+		{ 0.0f, -1.0f, 1.0f, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f },
+		{ 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f },
+		{ 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f },
+		{ 1.0f, -1.0f, 1.0f, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f },
+	};
+
+	constexpr uint32 QuadIndices[6] =
+	{
+		0, 1, 2,
+		0, 2, 3,
+	};
+
+	// Attribute stores of the templated generators.  A position-only stream has no room
+	// for the other attributes, and its mask never asks for them.
+	XMFLOAT3& PositionOf(Vertex& v) { return v.Position; }
+	XMFLOAT3& PositionOf(XMFLOAT3& v) { return v; }
+
+	void SetNormal(Vertex& v, const XMFLOAT3& n) { v.Normal = n; }
+	void SetNormal(XMFLOAT3&, const XMFLOAT3&) {}
+	void SetTangentU(Vertex& v, const XMFLOAT3& t) { v.TangentU = t; }
+	void SetTangentU(XMFLOAT3&, const XMFLOAT3&) {}
+	void SetTexC(Vertex& v, const XMFLOAT2& uv) { v.TexC = uv; }
+	void SetTexC(XMFLOAT3&, const XMFLOAT2&) {}
+
+	// Stores a vertex whose attributes are constants or cheap to compute.
+	template<typename VertexT>
+	void StoreVertex(VertexT& v, uint32 attributes, const XMFLOAT3& p, const XMFLOAT3& n, const XMFLOAT3& t, const XMFLOAT2& uv)
+	{
+		PositionOf(v) = p;
+		if(attributes & GeometryGenerator::AttributeNormal)
+			SetNormal(v, n);
+		if(attributes & GeometryGenerator::AttributeTangentU)
+			SetTangentU(v, t);
+		if(attributes & GeometryGenerator::AttributeTexC)
+			SetTexC(v, uv);
+	}
+
+	// Writes table vertices with their positions scaled and offset.
+	template<typename VertexT>
+	void WriteFixedVertices(const FixedVertex* table, uint32 vertexCount, const XMFLOAT3& scale, const XMFLOAT3& offset,
+		uint32 attributes, VertexT* vertices)
+	{
+		for(uint32 i = 0; i < vertexCount; ++i)
+		{
+			const FixedVertex& v = table[i];
+			StoreVertex(vertices[i], attributes,
+				XMFLOAT3(offset.x + v.Px*scale.x, offset.y + v.Py*scale.y, offset.z + v.Pz*scale.z),
+				XMFLOAT3(v.Nx, v.Ny, v.Nz), XMFLOAT3(v.Tx, v.Ty, v.Tz), XMFLOAT2(v.U, v.V));
+		}
+	}
 
-	uint32 i[36];
+	// Fills a mesh whose mask is set with a fixed shape, reserving capacity vertices so
+	// the subdivisions do not grow the vertex array.
+	template<uint32 VertexCount, uint32 IndexCount>
+	void AssignFixedShape(GeometryGenerator::MeshData& meshData, const FixedVertex (&vertices)[VertexCount],
+		const uint32 (&indices)[IndexCount], const XMFLOAT3& scale, uint32 capacity)
+	{
+		const XMFLOAT3 origin(0.0f, 0.0f, 0.0f);
+		if(meshData.PositionsOnly())
+		{
+			meshData.Positions.reserve(capacity);
+			meshData.Positions.resize(VertexCount);
+			WriteFixedVertices(vertices, VertexCount, scale, origin, meshData.Attributes, meshData.Positions.data());
+		}
+		else
+		{
+			meshData.Vertices.reserve(capacity);
+			meshData.Vertices.assign(VertexCount, ZeroVertex);
+			WriteFixedVertices(vertices, VertexCount, scale, origin, meshData.Attributes, meshData.Vertices.data());
+		}
 
-	// Fill in the front face index data
-	i[0] = 0; i[1] = 1; i[2] = 2;
-	i[3] = 0; i[4] = 2; i[5] = 3;
+		meshData.Indices32.assign(&indices[0], &indices[IndexCount]);
+	}
 
-	// Fill in the back face index data
-	i[6] = 4; i[7] = 5; i[8] = 6;
-	i[9] = 4; i[10] = 6; i[11] = 7;
+	template<typename VertexT>
+	void ProjectOntoSphere(std::vector<VertexT>& vertices, float radius, uint32 attributes)
+	{
+		for(auto& vertex : vertices)
+		{
+			XMFLOAT3& position = PositionOf(vertex);
 
-	// Fill in the top face index data
-	i[12] = 8; i[13] = 9; i[14] = 10;
-	i[15] = 8; i[16] = 10; i[17] = 11;
+			// Project onto unit sphere.
+			XMVECTOR n = XMVector3Normalize(XMLoadFloat3(&position));
 
-	// Fill in the bottom face index data
-	i[18] = 12; i[19] = 13; i[20] = 14;
-	i[21] = 12; i[22] = 14; i[23] = 15;
+			// Project onto sphere.
+			XMStoreFloat3(&position, radius*n);
 
-	// Fill in the left face index data
-	i[24] = 16; i[25] = 17; i[26] = 18;
-	i[27] = 16; i[28] = 18; i[29] = 19;
+			if(attributes & GeometryGenerator::AttributeNormal)
+			{
+				XMFLOAT3 normal;
+				XMStoreFloat3(&normal, n);
+				SetNormal(vertex, normal);
+			}
 
-	// Fill in the right face index data
-	i[30] = 20; i[31] = 21; i[32] = 22;
-	i[33] = 20; i[34] = 22; i[35] = 23;
+			// The spherical coordinates are the costly part; only the texture
+			// coordinates and the tangent need them.
+			if(!(attributes & (GeometryGenerator::AttributeTexC | GeometryGenerator::AttributeTangentU)))
+				continue;
 
-	meshData.Indices32.assign(&i[0], &i[36]);
+			// Derive texture coordinates from spherical coordinates.
+			float theta = atan2f(position.z, position.x);
 
-	// Put a cap on the number of subdivisions.
-	numSubdivisions = std::min<uint32>(numSubdivisions, 6u);
+			// Put in [0, 2pi].
+			if(theta < 0.0f)
+				theta += XM_2PI;
 
-	for (uint32 i = 0; i < numSubdivisions; ++i)
-		Subdivide(meshData);
+			float phi = acosf(position.y / radius);
 
-	return meshData;
+			if(attributes & GeometryGenerator::AttributeTexC)
+				SetTexC(vertex, XMFLOAT2(theta/XM_2PI, phi/XM_PI));
+
+			if(attributes & GeometryGenerator::AttributeTangentU)
+			{
+				// Partial derivative of P with respect to theta
+				XMFLOAT3 tangent(-radius*sinf(phi)*sinf(theta), 0.0f, +radius*sinf(phi)*cosf(theta));
+				XMStoreFloat3(&tangent, XMVector3Normalize(XMLoadFloat3(&tangent)));
+				SetTangentU(vertex, tangent);
+			}
+		}
+	}
 }
 
-GeometryGenerator::MeshData GeometryGenerator::CreateWedge(float width, float height, float depth, uint32 numSubdivisions)
+GeometryGenerator::MeshData GeometryGenerator::CreateBox(float width, float height, float depth, uint32 numSubdivisions, uint32 attributes)
 {
 	MeshData meshData;
+	meshData.Attributes = attributes | AttributePosition;
 
-	//
-	// Create the vertices.
-	//
-
-	Vertex v[20];
+	// Put a cap on the number of subdivisions.
+	numSubdivisions = std::min<uint32>(numSubdivisions, MaxSubdivisions);
 
 	float w2 = 0.5f * width;
 	float h2 = 0.5f * height;
 	float d2 = 0.5f * depth;
 
-	// Fill in the front face vertex data.
-	v[0] = Vertex(-w2, -h2, -d2, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f);
-	v[1] = Vertex(-w2, +h2, d2, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f);
-	v[2] = Vertex(+w2, +h2, d2, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f);
-	v[3] = Vertex(+w2, -h2, -d2, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f);
-
-	// Fill in the back face vertex data.
-	v[4] = Vertex(-w2, -h2, +d2, 0.0f, 0.0f, 1.0f, -1.0f, 0.0f, 0.0f, 1.0f, 1.0f);
-	v[5] = Vertex(+w2, -h2, +d2, 0.0f, 0.0f, 1.0f, -1.0f, 0.0f, 0.0f, 0.0f, 1.0f);
-	v[6] = Vertex(+w2, +h2, +d2, 0.0f, 0.0f, 1.0f, -1.0f, 0.0f, 0.0f, 0.0f, 0.0f);
-	v[7] = Vertex(-w2, +h2, +d2, 0.0f, 0.0f, 1.0f, -1.0f, 0.0f, 0.0f, 1.0f, 0.0f);
-
-	// Fill in the bottom face vertex data.
-	v[8] = Vertex(-w2, -h2, -d2, 0.0f, -1.0f, 0.0f, -1.0f, 0.0f, 0.0f, 1.0f, 1.0f);
-	v[9] = Vertex(+w2, -h2, -d2, 0.0f, -1.0f, 0.0f, -1.0f, 0.0f, 0.0f, 0.0f, 1.0f);
-	v[10] = Vertex(+w2, -h2, +d2, 0.0f, -1.0f, 0.0f, -1.0f, 0.0f, 0.0f, 0.0f, 0.0f);
-	v[11] = Vertex(-w2, -h2, +d2, 0.0f, -1.0f, 0.0f, -1.0f, 0.0f, 0.0f, 1.0f, 0.0f);
-
-	// Fill in the left face vertex data.
-	v[12] = Vertex(-w2, -h2, +d2, -1.0f, 0.0f, 0.0f, 0.0f, 0.0f, -1.0f, 0.0f, 1.0f);
-	v[13] = Vertex(-w2, +h2, +d2, -1.0f, 0.0f, 0.0f, 0.0f, 0.0f, -1.0f, 0.0f, 0.0f);
-	v[14] = Vertex(-w2, +0.0, -0.0, -1.0f, 0.0f, 0.0f, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f);
-	v[15] = Vertex(-w2, -h2, -d2, -1.0f, 0.0f, 0.0f, 0.0f, 0.0f, -1.0f, 1.0f, 1.0f);
-
-	//// Fill in the right face vertex data.
-	v[16] = Vertex(+w2, -h2, -d2, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f);
-	v[17] = Vertex(+w2, +0.0, -0.0, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f);
-	v[18] = Vertex(+w2, +h2, +d2, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 0.0f);
-	v[19] = Vertex(+w2, -h2, +d2, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f);
-
-	meshData.Vertices.assign(&v[0], &v[20]);
-
-	//
-	// Create the indices.
-	//
+	AssignFixedShape(meshData, BoxVertices, BoxIndices, XMFLOAT3(w2, h2, d2), BoxSize(numSubdivisions).VertexCount);
 
-	uint32 i[30];
+	// Subdivision only adds midpoints, so the bounds do not change.
+	SetBoxBounds(meshData, XMFLOAT3(-w2, -h2, -d2), XMFLOAT3(+w2, +h2, +d2));
 
-	// Fill in the front face index data
-	i[0] = 0; i[1] = 1; i[2] = 2;
-	i[3] = 0; i[4] = 2; i[5] = 3;
+	for (uint32 i = 0; i < numSubdivisions; ++i)
+		Subdivide(meshData);
 
-	// Fill in the back face index data
-	i[6] = 4; i[7] = 5; i[8] = 6;
-	i[9] = 4; i[10] = 6; i[11] = 7;
+	return meshData;
+}
 
-	// Fill in the bottom face index data
-	i[12] = 8; i[13] = 9; i[14] = 10;
-	i[15] = 8; i[16] = 10; i[17] = 11;
+GeometryGenerator::MeshData GeometryGenerator::CreateWedge(float width, float height, float depth, uint32 numSubdivisions, uint32 attributes)
+{
+	MeshData meshData;
+	meshData.Attributes = attributes | AttributePosition;
 
-	// Fill in the left face index data
-	i[18] = 12; i[19] = 13; i[20] = 14;
-	i[21] = 12; i[22] = 14; i[23] = 15;
+	// Put a cap on the number of subdivisions.
+	numSubdivisions = std::min<uint32>(numSubdivisions, MaxSubdivisions);
 
-	// Fill in the right face index data
-	i[24] = 16; i[25] = 17; i[26] = 18;
-	i[27] = 16; i[28] = 18; i[29] = 19;
+	float w2 = 0.5f * width;
+	float h2 = 0.5f * height;
+	float d2 = 0.5f * depth;
 
-	meshData.Indices32.assign(&i[0], &i[30]);
+	AssignFixedShape(meshData, WedgeVertices, WedgeIndices, XMFLOAT3(w2, h2, d2), WedgeSize(numSubdivisions).VertexCount);
 
-	// Put a cap on the number of subdivisions.
-	numSubdivisions = std::min<uint32>(numSubdivisions, 6u);
+	SetBoxBounds(meshData, XMFLOAT3(-w2, -h2, -d2), XMFLOAT3(+w2, +h2, +d2));
 
 	for (uint32 i = 0; i < numSubdivisions; ++i)
 		Subdivide(meshData);
@@ -183,9 +307,35 @@ GeometryGenerator::MeshData GeometryGenerator::CreateWedge(float width, float he
 	return meshData;
 }
 
-GeometryGenerator::MeshData GeometryGenerator::CreateSphere(float radius, uint32 sliceCount, uint32 stackCount)
+GeometryGenerator::MeshData GeometryGenerator::CreateSphere(float radius, uint32 sliceCount, uint32 stackCount, uint32 attributes)
 {
     MeshData meshData;
+
+	AllocateMesh(meshData, SphereSize(sliceCount, stackCount), attributes);
+	if(meshData.PositionsOnly())
+		BuildSphere(radius, sliceCount, stackCount, meshData.Attributes, meshData.Positions.data(), meshData.Indices32.data());
+	else
+		BuildSphere(radius, sliceCount, stackCount, meshData.Attributes, meshData.Vertices.data(), meshData.Indices32.data());
+
+	SetBoxBounds(meshData, XMFLOAT3(-radius, -radius, -radius), XMFLOAT3(+radius, +radius, +radius));
+	meshData.SphereBounds = BoundingSphere(XMFLOAT3(0.0f, 0.0f, 0.0f), radius);
+
+    return meshData;
+}
+
+void GeometryGenerator::CreateSphere(float radius, uint32 sliceCount, uint32 stackCount, Vertex* vertices, uint32* indices)
+{
+	BuildSphere(radius, sliceCount, stackCount, AttributeAll, vertices, indices);
+}
+
+void GeometryGenerator::CreateSphere(float radius, uint32 sliceCount, uint32 stackCount, XMFLOAT3* positions, uint32* indices)
+{
+	BuildSphere(radius, sliceCount, stackCount, AttributePosition, positions, indices);
+}
+
+template<typename VertexT>
+void GeometryGenerator::BuildSphere(float radius, uint32 sliceCount, uint32 stackCount, uint32 attributes, VertexT* vertices, uint32* indices)
+{
 	//
 	// Compute the vertices stating at the top pole and moving down the stacks.
 	//
@@ -193,10 +343,9 @@ GeometryGenerator::MeshData GeometryGenerator::CreateSphere(float radius, uint32
 	// Poles: note that there will be texture coordinate distortion as there is
 	// not a unique point on the texture map to assign to the pole when mapping
 	// a rectangular texture onto a sphere.
-	Vertex topVertex(0.0f, +radius, 0.0f, 0.0f, +1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f);
-	Vertex bottomVertex(0.0f, -radius, 0.0f, 0.0f, -1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f);
-
-	meshData.Vertices.push_back( topVertex  );
+	uint32 vertexCount = 0;
+	StoreVertex(vertices[vertexCount++], attributes,
+		XMFLOAT3(0.0f, +radius, 0.0f), XMFLOAT3(0.0f, +1.0f, 0.0f), XMFLOAT3(1.0f, 0.0f, 0.0f), XMFLOAT2(0.0f, 0.0f));
 
 	float phiStep   = XM_PI/stackCount;
 	float thetaStep = 2.0f*XM_PI/sliceCount;
@@ -211,43 +360,48 @@ GeometryGenerator::MeshData GeometryGenerator::CreateSphere(float radius, uint32
 		{
 			float theta = j*thetaStep;
 
-			Vertex v;
+			VertexT& v = vertices[vertexCount++];
 
 			// spherical to cartesian
-			v.Position.x = radius*sinf(phi)*cosf(theta);
-			v.Position.y = radius*cosf(phi);
-			v.Position.z = radius*sinf(phi)*sinf(theta);
-
-			// Partial derivative of P with respect to theta
-			v.TangentU.x = -radius*sinf(phi)*sinf(theta);
-			v.TangentU.y = 0.0f;
-			v.TangentU.z = +radius*sinf(phi)*cosf(theta);
-
-			XMVECTOR T = XMLoadFloat3(&v.TangentU);
-			XMStoreFloat3(&v.TangentU, XMVector3Normalize(T));
-
-			XMVECTOR p = XMLoadFloat3(&v.Position);
-			XMStoreFloat3(&v.Normal, XMVector3Normalize(p));
-
-			v.TexC.x = theta / XM_2PI;
-			v.TexC.y = phi / XM_PI;
-
-			meshData.Vertices.push_back( v );
+			XMFLOAT3& position = PositionOf(v);
+			position.x = radius*sinf(phi)*cosf(theta);
+			position.y = radius*cosf(phi);
+			position.z = radius*sinf(phi)*sinf(theta);
+
+			if(attributes & AttributeTangentU)
+			{
+				// Partial derivative of P with respect to theta
+				XMFLOAT3 tangent(-radius*sinf(phi)*sinf(theta), 0.0f, +radius*sinf(phi)*cosf(theta));
+				XMStoreFloat3(&tangent, XMVector3Normalize(XMLoadFloat3(&tangent)));
+				SetTangentU(v, tangent);
+			}
+
+			if(attributes & AttributeNormal)
+			{
+				XMFLOAT3 normal;
+				XMStoreFloat3(&normal, XMVector3Normalize(XMLoadFloat3(&position)));
+				SetNormal(v, normal);
+			}
+
+			if(attributes & AttributeTexC)
+				SetTexC(v, XMFLOAT2(theta / XM_2PI, phi / XM_PI));
 		}
 	}
 
-	meshData.Vertices.push_back( bottomVertex );
+	StoreVertex(vertices[vertexCount++], attributes,
+		XMFLOAT3(0.0f, -radius, 0.0f), XMFLOAT3(0.0f, -1.0f, 0.0f), XMFLOAT3(1.0f, 0.0f, 0.0f), XMFLOAT2(0.0f, 1.0f));
 
 	//
 	// Compute indices for top stack.  The top stack was written first to the vertex buffer
 	// and connects the top pole to the first ring.
 	//
 
+	uint32 k = 0;
     for(uint32 i = 1; i <= sliceCount; ++i)
 	{
-		meshData.Indices32.push_back(0);
-		meshData.Indices32.push_back(i+1);
-		meshData.Indices32.push_back(i);
+		indices[k++] = 0;
+		indices[k++] = i+1;
+		indices[k++] = i;
 	}
 	
 	//
@@ -262,13 +416,13 @@ GeometryGenerator::MeshData GeometryGenerator::CreateSphere(float radius, uint32
 	{
 		for(uint32 j = 0; j < sliceCount; ++j)
 		{
-			meshData.Indices32.push_back(baseIndex + i*ringVertexCount + j);
-			meshData.Indices32.push_back(baseIndex + i*ringVertexCount + j+1);
-			meshData.Indices32.push_back(baseIndex + (i+1)*ringVertexCount + j);
+			indices[k++] = baseIndex + i*ringVertexCount + j;
+			indices[k++] = baseIndex + i*ringVertexCount + j+1;
+			indices[k++] = baseIndex + (i+1)*ringVertexCount + j;
 
-			meshData.Indices32.push_back(baseIndex + (i+1)*ringVertexCount + j);
-			meshData.Indices32.push_back(baseIndex + i*ringVertexCount + j+1);
-			meshData.Indices32.push_back(baseIndex + (i+1)*ringVertexCount + j+1);
+			indices[k++] = baseIndex + (i+1)*ringVertexCount + j;
+			indices[k++] = baseIndex + i*ringVertexCount + j+1;
+			indices[k++] = baseIndex + (i+1)*ringVertexCount + j+1;
 		}
 	}
 
@@ -278,29 +432,35 @@ GeometryGenerator::MeshData GeometryGenerator::CreateSphere(float radius, uint32
 	//
 
 	// South pole vertex was added last.
-	uint32 southPoleIndex = ((uint32)meshData.Vertices.size()-1);
+	uint32 southPoleIndex = vertexCount-1;
 
 	// Offset the indices to the index of the first vertex in the last ring.
 	baseIndex = southPoleIndex - ringVertexCount;
 	
 	for(uint32 i = 0; i < sliceCount; ++i)
 	{
-		meshData.Indices32.push_back(southPoleIndex);
-		meshData.Indices32.push_back(baseIndex+i);
-		meshData.Indices32.push_back(baseIndex+i+1);
+		indices[k++] = southPoleIndex;
+		indices[k++] = baseIndex+i;
+		indices[k++] = baseIndex+i+1;
 	}
-
-    return meshData;
 }
  
 void GeometryGenerator::Subdivide(MeshData& meshData)
 {
-	// Save a copy of the input geometry.
-	MeshData inputCopy = meshData;
-
+	if(meshData.PositionsOnly())
+		SubdivideVertices(meshData.Positions, meshData.Indices32, meshData.Attributes);
+	else
+		SubdivideVertices(meshData.Vertices, meshData.Indices32, meshData.Attributes);
+}
 
-	meshData.Vertices.resize(0);
-	meshData.Indices32.resize(0);
+template<typename VertexT>
+void GeometryGenerator::SubdivideVertices(std::vector<VertexT>& vertices, std::vector<uint32>& indices, uint32 attributes)
+{
+	// The vertices are kept in place and only the index list is rebuilt, so the input
+	// is never copied.  Each edge midpoint is appended once and shared by the
+	// triangles on both sides of the edge.
+	std::vector<uint32> inputIndices;
+	inputIndices.swap(indices);
 
 	//       v1
 	//       *
@@ -312,86 +472,178 @@ void GeometryGenerator::Subdivide(MeshData& meshData)
 	// *-----*-----*
 	// v0    m2     v2
 
-	uint32 numTris = (uint32)inputCopy.Indices32.size()/3;
+	uint32 numTris = (uint32)inputIndices.size()/3;
+
+	// A closed mesh has 3/2 edges per triangle; open edges only cost a rehash.
+	uint32 numEdges = numTris*3/2;
+
+	std::unordered_map<std::uint64_t, uint32> midPoints;
+	midPoints.reserve(numEdges);
+	vertices.reserve(vertices.size() + numEdges);
+	indices.reserve(numTris*12);
+
+	auto midPointIndex = [&](uint32 a, uint32 b)
+	{
+		std::uint64_t key = a < b ?
+			((std::uint64_t)a << 32) | b :
+			((std::uint64_t)b << 32) | a;
+
+		auto result = midPoints.emplace(key, (uint32)vertices.size());
+		if(result.second)
+			vertices.push_back(MidPoint(vertices[a], vertices[b], attributes));
+
+		return result.first->second;
+	};
+
 	for(uint32 i = 0; i < numTris; ++i)
 	{
-		Vertex v0 = inputCopy.Vertices[ inputCopy.Indices32[i*3+0] ];
-		Vertex v1 = inputCopy.Vertices[ inputCopy.Indices32[i*3+1] ];
-		Vertex v2 = inputCopy.Vertices[ inputCopy.Indices32[i*3+2] ];
+		uint32 v0 = inputIndices[i*3+0];
+		uint32 v1 = inputIndices[i*3+1];
+		uint32 v2 = inputIndices[i*3+2];
 
 		//
 		// Generate the midpoints.
 		//
 
-        Vertex m0 = MidPoint(v0, v1);
-        Vertex m1 = MidPoint(v1, v2);
-        Vertex m2 = MidPoint(v0, v2);
+		uint32 m0 = midPointIndex(v0, v1);
+		uint32 m1 = midPointIndex(v1, v2);
+		uint32 m2 = midPointIndex(v0, v2);
 
 		//
 		// Add new geometry.
 		//
 
-		meshData.Vertices.push_back(v0); // 0
-		meshData.Vertices.push_back(v1); // 1
-		meshData.Vertices.push_back(v2); // 2
-		meshData.Vertices.push_back(m0); // 3
-		meshData.Vertices.push_back(m1); // 4
-		meshData.Vertices.push_back(m2); // 5
- 
-		meshData.Indices32.push_back(i*6+0);
-		meshData.Indices32.push_back(i*6+3);
-		meshData.Indices32.push_back(i*6+5);
+		indices.push_back(v0);
+		indices.push_back(m0);
+		indices.push_back(m2);
 
-		meshData.Indices32.push_back(i*6+3);
-		meshData.Indices32.push_back(i*6+4);
-		meshData.Indices32.push_back(i*6+5);
+		indices.push_back(m0);
+		indices.push_back(m1);
+		indices.push_back(m2);
 
-		meshData.Indices32.push_back(i*6+5);
-		meshData.Indices32.push_back(i*6+4);
-		meshData.Indices32.push_back(i*6+2);
+		indices.push_back(m2);
+		indices.push_back(m1);
+		indices.push_back(v2);
 
-		meshData.Indices32.push_back(i*6+3);
-		meshData.Indices32.push_back(i*6+1);
-		meshData.Indices32.push_back(i*6+4);
+		indices.push_back(m0);
+		indices.push_back(v1);
+		indices.push_back(m1);
 	}
 }
 
-GeometryGenerator::Vertex GeometryGenerator::MidPoint(const Vertex& v0, const Vertex& v1)
+std::vector<GeometryGenerator::MeshData> GeometryGenerator::SplitMesh(const MeshData& meshData, uint32 maxVertices)
 {
-    XMVECTOR p0 = XMLoadFloat3(&v0.Position);
-    XMVECTOR p1 = XMLoadFloat3(&v1.Position);
+	std::vector<MeshData> pieces;
 
-    XMVECTOR n0 = XMLoadFloat3(&v0.Normal);
-    XMVECTOR n1 = XMLoadFloat3(&v1.Normal);
+	// Index of each source vertex in the current piece, or ~0 if it is not in it yet.
+	const uint32 unmapped = ~0u;
+	std::vector<uint32> remap(meshData.VertexCount(), unmapped);
 
-    XMVECTOR tan0 = XMLoadFloat3(&v0.TangentU);
-    XMVECTOR tan1 = XMLoadFloat3(&v1.TangentU);
+	// Source vertices of the current piece, to clear remap when the piece is full.
+	std::vector<uint32> pieceSource;
 
-    XMVECTOR tex0 = XMLoadFloat2(&v0.TexC);
-    XMVECTOR tex1 = XMLoadFloat2(&v1.TexC);
+	MeshData piece;
+	piece.Attributes = meshData.Attributes;
 
-    // Compute the midpoints of all the attributes.  Vectors need to be normalized
-    // since linear interpolating can make them not unit length.  
-    XMVECTOR pos = 0.5f*(p0 + p1);
-    XMVECTOR normal = XMVector3Normalize(0.5f*(n0 + n1));
-    XMVECTOR tangent = XMVector3Normalize(0.5f*(tan0+tan1));
-    XMVECTOR tex = 0.5f*(tex0 + tex1);
+	auto finishPiece = [&]()
+	{
+		for(uint32 source : pieceSource)
+			remap[source] = unmapped;
+		pieceSource.clear();
+
+		piece.Bounds = meshData.Bounds;
+		piece.SphereBounds = meshData.SphereBounds;
+		pieces.push_back(std::move(piece));
+		piece = MeshData();
+		piece.Attributes = meshData.Attributes;
+	};
 
-    Vertex v;
-    XMStoreFloat3(&v.Position, pos);
-    XMStoreFloat3(&v.Normal, normal);
-    XMStoreFloat3(&v.TangentU, tangent);
-    XMStoreFloat2(&v.TexC, tex);
+	uint32 numTris = (uint32)(meshData.Indices32.size()/3);
+	for(uint32 i = 0; i < numTris; ++i)
+	{
+		const uint32* tri = &meshData.Indices32[i*3];
+
+		uint32 newVertices = 0;
+		for(uint32 j = 0; j < 3; ++j)
+		{
+			// A degenerate triangle may repeat a vertex; count it once.
+			bool repeated = (j > 0 && tri[j] == tri[0]) || (j > 1 && tri[j] == tri[1]);
+			if(remap[tri[j]] == unmapped && !repeated)
+				++newVertices;
+		}
+
+		if(piece.VertexCount() + newVertices > maxVertices)
+			finishPiece();
+
+		for(uint32 j = 0; j < 3; ++j)
+		{
+			if(remap[tri[j]] == unmapped)
+			{
+				remap[tri[j]] = piece.VertexCount();
+				if(meshData.PositionsOnly())
+					piece.Positions.push_back(meshData.Positions[tri[j]]);
+				else
+					piece.Vertices.push_back(meshData.Vertices[tri[j]]);
+				pieceSource.push_back(tri[j]);
+			}
+
+			piece.Indices32.push_back(remap[tri[j]]);
+		}
+	}
+
+	if(!piece.Indices32.empty() || pieces.empty())
+		finishPiece();
+
+	return pieces;
+}
+
+GeometryGenerator::Vertex GeometryGenerator::MidPoint(const Vertex& v0, const Vertex& v1, uint32 attributes)
+{
+    // Compute the midpoints of the attributes in the mask; the others stay zero.
+    // Vectors need to be normalized since linear interpolating can make them not
+    // unit length.
+    Vertex v = ZeroVertex;
+    v.Position = MidPoint(v0.Position, v1.Position, attributes);
+
+    if(attributes & AttributeNormal)
+    {
+        XMVECTOR n0 = XMLoadFloat3(&v0.Normal);
+        XMVECTOR n1 = XMLoadFloat3(&v1.Normal);
+        XMStoreFloat3(&v.Normal, XMVector3Normalize(0.5f*(n0 + n1)));
+    }
+
+    if(attributes & AttributeTangentU)
+    {
+        XMVECTOR tan0 = XMLoadFloat3(&v0.TangentU);
+        XMVECTOR tan1 = XMLoadFloat3(&v1.TangentU);
+        XMStoreFloat3(&v.TangentU, XMVector3Normalize(0.5f*(tan0 + tan1)));
+    }
+
+    if(attributes & AttributeTexC)
+    {
+        XMVECTOR tex0 = XMLoadFloat2(&v0.TexC);
+        XMVECTOR tex1 = XMLoadFloat2(&v1.TexC);
+        XMStoreFloat2(&v.TexC, 0.5f*(tex0 + tex1));
+    }
 
     return v;
 }
 
-GeometryGenerator::MeshData GeometryGenerator::CreateGeosphere(float radius, uint32 numSubdivisions)
+XMFLOAT3 GeometryGenerator::MidPoint(const XMFLOAT3& p0, const XMFLOAT3& p1, uint32)
+{
+    XMFLOAT3 p;
+    XMStoreFloat3(&p, 0.5f*(XMLoadFloat3(&p0) + XMLoadFloat3(&p1)));
+
+    return p;
+}
+
+GeometryGenerator::MeshData GeometryGenerator::CreateGeosphere(float radius, uint32 numSubdivisions, uint32 attributes)
 {
     MeshData meshData;
+	meshData.Attributes = attributes | AttributePosition;
 
 	// Put a cap on the number of subdivisions.
-    numSubdivisions = std::min<uint32>(numSubdivisions, 6u);
+    numSubdivisions = std::min<uint32>(numSubdivisions, MaxSubdivisions);
 
 	// Approximate a sphere by tessellating an icosahedron.
 
@@ -416,54 +668,87 @@ GeometryGenerator::MeshData GeometryGenerator::CreateGeosphere(float radius, uin
 		10,1,6, 11,0,9, 2,11,9, 5,2,9,  11,2,7 
 	};
 
-    meshData.Vertices.resize(12);
     meshData.Indices32.assign(&k[0], &k[60]);
 
-	for(uint32 i = 0; i < 12; ++i)
-		meshData.Vertices[i].Position = pos[i];
+	// Reserve the subdivided size so Subdivide never grows the vertex array.  The other
+	// attributes are derived after the projection, so only the positions are subdivided.
+	uint32 vertexCount = GeosphereSize(numSubdivisions).VertexCount;
+	if(meshData.PositionsOnly())
+	{
+		meshData.Positions.reserve(vertexCount);
+		meshData.Positions.assign(&pos[0], &pos[12]);
 
-	for(uint32 i = 0; i < numSubdivisions; ++i)
-		Subdivide(meshData);
+		for(uint32 i = 0; i < numSubdivisions; ++i)
+			SubdivideVertices(meshData.Positions, meshData.Indices32, AttributePosition);
 
-	// Project vertices onto sphere and scale.
-	for(uint32 i = 0; i < meshData.Vertices.size(); ++i)
+		ProjectOntoSphere(meshData.Positions, radius, meshData.Attributes);
+	}
+	else
 	{
-		// Project onto unit sphere.
-		XMVECTOR n = XMVector3Normalize(XMLoadFloat3(&meshData.Vertices[i].Position));
+		meshData.Vertices.reserve(vertexCount);
+		meshData.Vertices.assign(12, ZeroVertex);
+		for(uint32 i = 0; i < 12; ++i)
+			meshData.Vertices[i].Position = pos[i];
 
-		// Project onto sphere.
-		XMVECTOR p = radius*n;
+		for(uint32 i = 0; i < numSubdivisions; ++i)
+			SubdivideVertices(meshData.Vertices, meshData.Indices32, AttributePosition);
 
-		XMStoreFloat3(&meshData.Vertices[i].Position, p);
-		XMStoreFloat3(&meshData.Vertices[i].Normal, n);
+		ProjectOntoSphere(meshData.Vertices, radius, meshData.Attributes);
+	}
 
-		// Derive texture coordinates from spherical coordinates.
-        float theta = atan2f(meshData.Vertices[i].Position.z, meshData.Vertices[i].Position.x);
+	SetBoxBounds(meshData, XMFLOAT3(-radius, -radius, -radius), XMFLOAT3(+radius, +radius, +radius));
+	meshData.SphereBounds = BoundingSphere(XMFLOAT3(0.0f, 0.0f, 0.0f), radius);
 
-        // Put in [0, 2pi].
-        if(theta < 0.0f)
-            theta += XM_2PI;
+    return meshData;
+}
 
-		float phi = acosf(meshData.Vertices[i].Position.y / radius);
+GeometryGenerator::MeshData GeometryGenerator::CreateCylinder(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount,
+	uint32 attributes)
+{
+    MeshData meshData = CreateCylinderWithIndices(bottomRadius, topRadius, height, sliceCount, stackCount, nullptr, attributes);
+	WriteCylinderIndices(sliceCount, stackCount, meshData.Indices32.data());
 
-		meshData.Vertices[i].TexC.x = theta/XM_2PI;
-		meshData.Vertices[i].TexC.y = phi/XM_PI;
+    return meshData;
+}
 
-		// Partial derivative of P with respect to theta
-		meshData.Vertices[i].TangentU.x = -radius*sinf(phi)*sinf(theta);
-		meshData.Vertices[i].TangentU.y = 0.0f;
-		meshData.Vertices[i].TangentU.z = +radius*sinf(phi)*cosf(theta);
+GeometryGenerator::MeshData GeometryGenerator::CreateCylinderWithIndices(float bottomRadius, float topRadius, float height,
+	uint32 sliceCount, uint32 stackCount, const uint32* indices, uint32 attributes)
+{
+    MeshData meshData;
 
-		XMVECTOR T = XMLoadFloat3(&meshData.Vertices[i].TangentU);
-		XMStoreFloat3(&meshData.Vertices[i].TangentU, XMVector3Normalize(T));
-	}
+	MeshSize size = CylinderSize(sliceCount, stackCount);
+	AllocateMesh(meshData, size, attributes);
+	if(meshData.PositionsOnly())
+		BuildCylinderVertices(bottomRadius, topRadius, height, sliceCount, stackCount, meshData.Attributes, meshData.Positions.data());
+	else
+		BuildCylinderVertices(bottomRadius, topRadius, height, sliceCount, stackCount, meshData.Attributes, meshData.Vertices.data());
+
+	if(indices != nullptr)
+		std::copy(indices, indices + size.IndexCount, meshData.Indices32.begin());
+
+	SetRevolutionBounds(meshData, std::max(bottomRadius, topRadius), -0.5f*height, 0.5f*height);
 
     return meshData;
 }
 
-GeometryGenerator::MeshData GeometryGenerator::CreateCylinder(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount)
+void GeometryGenerator::CreateCylinder(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount,
+	Vertex* vertices, uint32* indices)
+{
+	BuildCylinderVertices(bottomRadius, topRadius, height, sliceCount, stackCount, AttributeAll, vertices);
+	WriteCylinderIndices(sliceCount, stackCount, indices);
+}
+
+void GeometryGenerator::CreateCylinder(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount,
+	XMFLOAT3* positions, uint32* indices)
+{
+	BuildCylinderVertices(bottomRadius, topRadius, height, sliceCount, stackCount, AttributePosition, positions);
+	WriteCylinderIndices(sliceCount, stackCount, indices);
+}
+
+template<typename VertexT>
+void GeometryGenerator::BuildCylinderVertices(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount,
+	uint32 attributes, VertexT* vertices)
 {
-    MeshData meshData;
 	//
 	// Build Stacks.
 	// 
@@ -474,6 +759,7 @@ GeometryGenerator::MeshData GeometryGenerator::CreateCylinder(float bottomRadius
 	float radiusStep = (topRadius - bottomRadius) / stackCount;
 
 	uint32 ringCount = stackCount+1;
+	uint32 vertexCount = 0;
 
 	// Compute vertices for each stack ring starting at the bottom and moving up.
 	for(uint32 i = 0; i < ringCount; ++i)
@@ -485,15 +771,15 @@ GeometryGenerator::MeshData GeometryGenerator::CreateCylinder(float bottomRadius
 		float dTheta = 2.0f*XM_PI/sliceCount;
 		for(uint32 j = 0; j <= sliceCount; ++j)
 		{
-			Vertex vertex;
+			VertexT& vertex = vertices[vertexCount++];
 
 			float c = cosf(j*dTheta);
 			float s = sinf(j*dTheta);
 
-			vertex.Position = XMFLOAT3(r*c, y, r*s);
+			PositionOf(vertex) = XMFLOAT3(r*c, y, r*s);
 
-			vertex.TexC.x = (float)j/sliceCount;
-			vertex.TexC.y = 1.0f - (float)i/stackCount;
+			if(attributes & AttributeTexC)
+				SetTexC(vertex, XMFLOAT2((float)j/sliceCount, 1.0f - (float)i/stackCount));
 
 			// Cylinder can be parameterized as follows, where we introduce v
 			// parameter that goes in the same direction as the v tex-coord
@@ -515,65 +801,108 @@ GeometryGenerator::MeshData GeometryGenerator::CreateCylinder(float bottomRadius
 			//  dz/dv = (r0-r1)*sin(t)
 
 			// This is unit length.
-			vertex.TangentU = XMFLOAT3(-s, 0.0f, c);
+			XMFLOAT3 tangent(-s, 0.0f, c);
+			if(attributes & AttributeTangentU)
+				SetTangentU(vertex, tangent);
+
+			if(attributes & AttributeNormal)
+			{
+				float dr = bottomRadius-topRadius;
+				XMFLOAT3 bitangent(dr*c, -height, dr*s);
+
+				XMVECTOR T = XMLoadFloat3(&tangent);
+				XMVECTOR B = XMLoadFloat3(&bitangent);
+				XMFLOAT3 normal;
+				XMStoreFloat3(&normal, XMVector3Normalize(XMVector3Cross(T, B)));
+				SetNormal(vertex, normal);
+			}
+		}
+	}
 
-			float dr = bottomRadius-topRadius;
-			XMFLOAT3 bitangent(dr*c, -height, dr*s);
+	BuildCylinderTopCap(bottomRadius, topRadius, height, sliceCount, stackCount, attributes, vertices + vertexCount);
+	vertexCount += sliceCount + 2;
 
-			XMVECTOR T = XMLoadFloat3(&vertex.TangentU);
-			XMVECTOR B = XMLoadFloat3(&bitangent);
-			XMVECTOR N = XMVector3Normalize(XMVector3Cross(T, B));
-			XMStoreFloat3(&vertex.Normal, N);
+	BuildCylinderBottomCap(bottomRadius, topRadius, height, sliceCount, stackCount, attributes, vertices + vertexCount);
+}
 
-			meshData.Vertices.push_back(vertex);
-		}
-	}
+GeometryGenerator::MeshData GeometryGenerator::CreateCone(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount, uint32 attributes)
+{
+	return CreateCylinder(bottomRadius, topRadius, height, sliceCount, stackCount, attributes);
+}
 
-	// Add one because we duplicate the first and last vertex per ring
-	// since the texture coordinates are different.
-	uint32 ringVertexCount = sliceCount+1;
+GeometryGenerator::MeshData GeometryGenerator::CreatePyramid(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount, uint32 attributes)
+{
+	return CreateCylinder(bottomRadius, topRadius, height, sliceCount, stackCount, attributes);
+}
 
-	// Compute indices for each stack.
-	for(uint32 i = 0; i < stackCount; ++i)
-	{
-		for(uint32 j = 0; j < sliceCount; ++j)
-		{
-			meshData.Indices32.push_back(i*ringVertexCount + j);
-			meshData.Indices32.push_back((i+1)*ringVertexCount + j);
-			meshData.Indices32.push_back((i+1)*ringVertexCount + j+1);
+GeometryGenerator::MeshData GeometryGenerator::CreatePrism(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount, uint32 attributes)
+{
+	return CreateCylinder(bottomRadius, topRadius, height, sliceCount, stackCount, attributes);
+}
 
-			meshData.Indices32.push_back(i*ringVertexCount + j);
-			meshData.Indices32.push_back((i+1)*ringVertexCount + j+1);
-			meshData.Indices32.push_back(i*ringVertexCount + j+1);
-		}
+std::vector<GeometryGenerator::MeshData> GeometryGenerator::CreateSphereLods(float radius, uint32 sliceCount, uint32 stackCount, uint32 levelCount,
+	uint32 attributes)
+{
+	std::vector<MeshData> lods;
+	lods.reserve(levelCount);
+
+	for(uint32 level = 0; level < levelCount; ++level)
+	{
+		lods.push_back(CreateSphere(radius,
+			LodTessellation(sliceCount, level, 3), LodTessellation(stackCount, level, 2), attributes));
 	}
 
-	BuildCylinderTopCap(bottomRadius, topRadius, height, sliceCount, stackCount, meshData);
-	BuildCylinderBottomCap(bottomRadius, topRadius, height, sliceCount, stackCount, meshData);
+	return lods;
+}
 
-    return meshData;
+std::vector<GeometryGenerator::MeshData> GeometryGenerator::CreateCylinderLods(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount, uint32 levelCount,
+	uint32 attributes)
+{
+	std::vector<MeshData> lods;
+	lods.reserve(levelCount);
+
+	for(uint32 level = 0; level < levelCount; ++level)
+	{
+		lods.push_back(CreateCylinder(bottomRadius, topRadius, height,
+			LodTessellation(sliceCount, level, 3), LodTessellation(stackCount, level, 1), attributes));
+	}
+
+	return lods;
 }
 
-GeometryGenerator::MeshData GeometryGenerator::CreateCone(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount)
+std::vector<GeometryGenerator::MeshData> GeometryGenerator::CreateConeLods(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount, uint32 levelCount,
+	uint32 attributes)
 {
-	return CreateCylinder(bottomRadius, topRadius, height, sliceCount,stackCount);
+	return CreateCylinderLods(bottomRadius, topRadius, height, sliceCount, stackCount, levelCount, attributes);
 }
 
-GeometryGenerator::MeshData GeometryGenerator::CreatePyramid(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount)
+std::vector<GeometryGenerator::MeshData> GeometryGenerator::CreateDiamondLods(float middleRadius, float topRadius, float heightBottom, float heightTop, uint32 sliceCount, uint32 stackCount, uint32 levelCount,
+	uint32 attributes)
 {
-	return CreateCylinder(bottomRadius, topRadius, height, sliceCount, stackCount);
+	std::vector<MeshData> lods;
+	lods.reserve(levelCount);
+
+	for(uint32 level = 0; level < levelCount; ++level)
+	{
+		lods.push_back(CreateDiamond(middleRadius, topRadius, heightBottom, heightTop,
+			LodTessellation(sliceCount, level, 3), LodTessellation(stackCount, level, 1), attributes));
+	}
+
+	return lods;
 }
 
-GeometryGenerator::MeshData GeometryGenerator::CreatePrism(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount)
+GeometryGenerator::uint32 GeometryGenerator::LodTessellation(uint32 count, uint32 level, uint32 minCount)
 {
-	return CreateCylinder(bottomRadius, topRadius, height, sliceCount, stackCount);
+	uint32 levelCount = level < 32 ? count >> level : 0;
+
+	return std::max(levelCount, std::min(count, minCount));
 }
 
+template<typename VertexT>
 void GeometryGenerator::BuildCylinderTopCap(float bottomRadius, float topRadius, float height,
-											uint32 sliceCount, uint32 stackCount, MeshData& meshData)
+											uint32 sliceCount, uint32 stackCount,
+											uint32 attributes, VertexT* vertices)
 {
-	uint32 baseIndex = (uint32)meshData.Vertices.size();
-
 	float y = 0.5f*height;
 	float dTheta = 2.0f*XM_PI/sliceCount;
 
@@ -588,31 +917,23 @@ void GeometryGenerator::BuildCylinderTopCap(float bottomRadius, float topRadius,
 		float u = x/height + 0.5f;
 		float v = z/height + 0.5f;
 
-		meshData.Vertices.push_back( Vertex(x, y, z, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, u, v) );
+		StoreVertex(vertices[i], attributes, XMFLOAT3(x, y, z), XMFLOAT3(0.0f, 1.0f, 0.0f), XMFLOAT3(1.0f, 0.0f, 0.0f), XMFLOAT2(u, v));
 	}
 
 	// Cap center vertex.
-	meshData.Vertices.push_back( Vertex(0.0f, y, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.5f, 0.5f) );
-
-	// Index of center vertex.
-	uint32 centerIndex = (uint32)meshData.Vertices.size()-1;
-
-	for(uint32 i = 0; i < sliceCount; ++i)
-	{
-		meshData.Indices32.push_back(centerIndex);
-		meshData.Indices32.push_back(baseIndex + i+1);
-		meshData.Indices32.push_back(baseIndex + i);
-	}
+	StoreVertex(vertices[sliceCount+1], attributes,
+		XMFLOAT3(0.0f, y, 0.0f), XMFLOAT3(0.0f, 1.0f, 0.0f), XMFLOAT3(1.0f, 0.0f, 0.0f), XMFLOAT2(0.5f, 0.5f));
 }
 
+template<typename VertexT>
 void GeometryGenerator::BuildCylinderBottomCap(float bottomRadius, float topRadius, float height,
-											   uint32 sliceCount, uint32 stackCount, MeshData& meshData)
+											   uint32 sliceCount, uint32 stackCount,
+											   uint32 attributes, VertexT* vertices)
 {
 	// 
 	// Build bottom cap.
 	//
 
-	uint32 baseIndex = (uint32)meshData.Vertices.size();
 	float y = -0.5f*height;
 
 	// vertices of ring
@@ -627,28 +948,56 @@ void GeometryGenerator::BuildCylinderBottomCap(float bottomRadius, float topRadi
 		float u = x/height + 0.5f;
 		float v = z/height + 0.5f;
 
-		meshData.Vertices.push_back( Vertex(x, y, z, 0.0f, -1.0f, 0.0f, 1.0f, 0.0f, 0.0f, u, v) );
+		StoreVertex(vertices[i], attributes, XMFLOAT3(x, y, z), XMFLOAT3(0.0f, -1.0f, 0.0f), XMFLOAT3(1.0f, 0.0f, 0.0f), XMFLOAT2(u, v));
 	}
 
 	// Cap center vertex.
-	meshData.Vertices.push_back( Vertex(0.0f, y, 0.0f, 0.0f, -1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.5f, 0.5f) );
+	StoreVertex(vertices[sliceCount+1], attributes,
+		XMFLOAT3(0.0f, y, 0.0f), XMFLOAT3(0.0f, -1.0f, 0.0f), XMFLOAT3(1.0f, 0.0f, 0.0f), XMFLOAT2(0.5f, 0.5f));
+}
 
-	// Cache the index of center vertex.
-	uint32 centerIndex = (uint32)meshData.Vertices.size()-1;
+GeometryGenerator::MeshData GeometryGenerator::CreateDiamond(float middleRadius, float topRadius, float heightBottom, float heightTop, uint32 sliceCount, uint32 stackCount,
+	uint32 attributes)
+{
+	MeshData meshData;
 
-	for(uint32 i = 0; i < sliceCount; ++i)
+	AllocateMesh(meshData, DiamondSize(sliceCount, stackCount), attributes);
+	if(meshData.PositionsOnly())
 	{
-		meshData.Indices32.push_back(centerIndex);
-		meshData.Indices32.push_back(baseIndex + i);
-		meshData.Indices32.push_back(baseIndex + i+1);
+		BuildDiamond(middleRadius, topRadius, heightBottom, heightTop, sliceCount, stackCount, meshData.Attributes,
+			meshData.Positions.data(), meshData.Indices32.data());
 	}
+	else
+	{
+		BuildDiamond(middleRadius, topRadius, heightBottom, heightTop, sliceCount, stackCount, meshData.Attributes,
+			meshData.Vertices.data(), meshData.Indices32.data());
+	}
+
+	// Bottom rings span [-heightBottom/2, heightBottom/2], top rings [heightTop, 2*heightTop]
+	// and the cap sits at heightTop/2.
+	float yMin = std::min({ -0.5f * heightBottom, heightTop, 0.5f * heightTop });
+	float yMax = std::max({ 0.5f * heightBottom, 2.0f * heightTop, 0.5f * heightTop });
+	SetRevolutionBounds(meshData, std::max(middleRadius, topRadius), yMin, yMax);
+
+	return meshData;
 }
 
-GeometryGenerator::MeshData GeometryGenerator::CreateDiamond(float middleRadius, float topRadius, float heightBottom, float heightTop, uint32 sliceCount, uint32 stackCount)
+void GeometryGenerator::CreateDiamond(float middleRadius, float topRadius, float heightBottom, float heightTop, uint32 sliceCount, uint32 stackCount,
+	Vertex* vertices, uint32* indices)
 {
-	MeshData meshData;
+	BuildDiamond(middleRadius, topRadius, heightBottom, heightTop, sliceCount, stackCount, AttributeAll, vertices, indices);
+}
 
+void GeometryGenerator::CreateDiamond(float middleRadius, float topRadius, float heightBottom, float heightTop, uint32 sliceCount, uint32 stackCount,
+	XMFLOAT3* positions, uint32* indices)
+{
+	BuildDiamond(middleRadius, topRadius, heightBottom, heightTop, sliceCount, stackCount, AttributePosition, positions, indices);
+}
 
+template<typename VertexT>
+void GeometryGenerator::BuildDiamond(float middleRadius, float topRadius, float heightBottom, float heightTop, uint32 sliceCount, uint32 stackCount,
+	uint32 attributes, VertexT* vertices, uint32* indices)
+{
 	//
 	// Build Stacks.
 	// 
@@ -661,6 +1010,7 @@ GeometryGenerator::MeshData GeometryGenerator::CreateDiamond(float middleRadius,
 	float radiusStepTop = (topRadius - middleRadius) / stackCount;;
 
 	uint32 ringCount = stackCount + 1;
+	uint32 vertexCount = 0;
 	float dTheta = 2.0f * XM_PI / sliceCount;
 	// Compute vertices for each stack ring starting at the bottom and moving up.
 	for (uint32 i = 0; i < ringCount; ++i)
@@ -672,27 +1022,31 @@ GeometryGenerator::MeshData GeometryGenerator::CreateDiamond(float middleRadius,
 
 		for (uint32 j = 0; j <= sliceCount; ++j)
 		{
-			Vertex vertex;
+			VertexT& vertex = vertices[vertexCount++];
 
 			float c = cosf(j * dTheta);
 			float s = sinf(j * dTheta);
 
-			vertex.Position = XMFLOAT3(r * c, y, r * s);
+			PositionOf(vertex) = XMFLOAT3(r * c, y, r * s);
 
-			vertex.TexC.x = (float)j / sliceCount;
-			vertex.TexC.y = 1.0f - (float)i / stackCount;
+			if (attributes & AttributeTexC)
+				SetTexC(vertex, XMFLOAT2((float)j / sliceCount, 1.0f - (float)i / stackCount));
 
-			vertex.TangentU = XMFLOAT3(-s, 0.0f, c);
+			XMFLOAT3 tangent(-s, 0.0f, c);
+			if (attributes & AttributeTangentU)
+				SetTangentU(vertex, tangent);
 
-			float dr = middleRadius;
-			XMFLOAT3 bitangent(dr * c, -heightBottom, dr * s);
+			if (attributes & AttributeNormal)
+			{
+				float dr = middleRadius;
+				XMFLOAT3 bitangent(dr * c, -heightBottom, dr * s);
 
-			XMVECTOR T = XMLoadFloat3(&vertex.TangentU);
-			XMVECTOR B = XMLoadFloat3(&bitangent);
-			XMVECTOR N = XMVector3Normalize(XMVector3Cross(T, B));
-			XMStoreFloat3(&vertex.Normal, N);
-
-			meshData.Vertices.push_back(vertex);
+				XMVECTOR T = XMLoadFloat3(&tangent);
+				XMVECTOR B = XMLoadFloat3(&bitangent);
+				XMFLOAT3 normal;
+				XMStoreFloat3(&normal, XMVector3Normalize(XMVector3Cross(T, B)));
+				SetNormal(vertex, normal);
+			}
 		}
 
 	}
@@ -705,27 +1059,31 @@ GeometryGenerator::MeshData GeometryGenerator::CreateDiamond(float middleRadius,
 		for (uint32 j = 0; j <= sliceCount; ++j)
 		{
 			//second
-			Vertex vertex2;
+			VertexT& vertex2 = vertices[vertexCount++];
 
 			float c2 = cosf(j * dTheta);
 			float s2 = sinf(j * dTheta);
 
-			vertex2.Position = XMFLOAT3(r2 * c2, y2 + heightTop*1.5, r2 * s2);
-
-			vertex2.TexC.x = (float)j / sliceCount;
-			vertex2.TexC.y = 1.0f - (float)i / stackCount;
+			PositionOf(vertex2) = XMFLOAT3(r2 * c2, y2 + heightTop*1.5, r2 * s2);
 
-			vertex2.TangentU = XMFLOAT3(-s2, 0.0f, c2);
+			if (attributes & AttributeTexC)
+				SetTexC(vertex2, XMFLOAT2((float)j / sliceCount, 1.0f - (float)i / stackCount));
 
-			float dr2 = middleRadius - topRadius;
-			XMFLOAT3 bitangent2(dr2 * c2, -heightTop, dr2 * s2);
+			XMFLOAT3 tangent2(-s2, 0.0f, c2);
+			if (attributes & AttributeTangentU)
+				SetTangentU(vertex2, tangent2);
 
-			XMVECTOR T2 = XMLoadFloat3(&vertex2.TangentU);
-			XMVECTOR B2 = XMLoadFloat3(&bitangent2);
-			XMVECTOR N2 = XMVector3Normalize(XMVector3Cross(T2, B2));
-			XMStoreFloat3(&vertex2.Normal, N2);
+			if (attributes & AttributeNormal)
+			{
+				float dr2 = middleRadius - topRadius;
+				XMFLOAT3 bitangent2(dr2 * c2, -heightTop, dr2 * s2);
 
-			meshData.Vertices.push_back(vertex2);
+				XMVECTOR T2 = XMLoadFloat3(&tangent2);
+				XMVECTOR B2 = XMLoadFloat3(&bitangent2);
+				XMFLOAT3 normal2;
+				XMStoreFloat3(&normal2, XMVector3Normalize(XMVector3Cross(T2, B2)));
+				SetNormal(vertex2, normal2);
+			}
 
 		}
 	}
@@ -734,36 +1092,59 @@ GeometryGenerator::MeshData GeometryGenerator::CreateDiamond(float middleRadius,
 	uint32 ringVertexCount = sliceCount + 2;
 
 	// Compute indices for each stack.
+	uint32 k = 0;
 	for (uint32 i = 0; i < 2*stackCount; ++i)
 	{
 		for (uint32 j = 0; j < 2*sliceCount; ++j)
 		{
-			meshData.Indices32.push_back(i * ringVertexCount + j);
-			meshData.Indices32.push_back((i + 1) * ringVertexCount + j);
-			meshData.Indices32.push_back((i + 1) * ringVertexCount + j + 1);
+			indices[k++] = i * ringVertexCount + j;
+			indices[k++] = (i + 1) * ringVertexCount + j;
+			indices[k++] = (i + 1) * ringVertexCount + j + 1;
 
-			meshData.Indices32.push_back(i * ringVertexCount + j);
-			meshData.Indices32.push_back((i + 1) * ringVertexCount + j + 1);
-			meshData.Indices32.push_back(i * ringVertexCount + j + 1);
+			indices[k++] = i * ringVertexCount + j;
+			indices[k++] = (i + 1) * ringVertexCount + j + 1;
+			indices[k++] = i * ringVertexCount + j + 1;
 
 		}
 	}
 
-	BuildCylinderTopCap(middleRadius, topRadius, heightTop, sliceCount, stackCount, meshData);
-
-	return meshData;
+	BuildCylinderTopCap(middleRadius, topRadius, heightTop, sliceCount, stackCount, attributes, vertices + vertexCount);
+	WriteCapIndices(sliceCount, vertexCount, true, indices + k);
 }
 
 
 
 
-GeometryGenerator::MeshData GeometryGenerator::CreateGrid(float width, float depth, uint32 m, uint32 n)
+GeometryGenerator::MeshData GeometryGenerator::CreateGrid(float width, float depth, uint32 m, uint32 n, uint32 attributes)
 {
     MeshData meshData;
 
-	uint32 vertexCount = m*n;
-	uint32 faceCount   = (m-1)*(n-1)*2;
+	AllocateMesh(meshData, GridSize(m, n), attributes);
+	if(meshData.PositionsOnly())
+		BuildGrid(width, depth, m, n, meshData.Attributes, meshData.Positions.data(), meshData.Indices32.data());
+	else
+		BuildGrid(width, depth, m, n, meshData.Attributes, meshData.Vertices.data(), meshData.Indices32.data());
+
+	float halfWidth = 0.5f*width;
+	float halfDepth = 0.5f*depth;
+	SetBoxBounds(meshData, XMFLOAT3(-halfWidth, 0.0f, -halfDepth), XMFLOAT3(+halfWidth, 0.0f, +halfDepth));
+
+    return meshData;
+}
 
+void GeometryGenerator::CreateGrid(float width, float depth, uint32 m, uint32 n, Vertex* vertices, uint32* indices)
+{
+	BuildGrid(width, depth, m, n, AttributeAll, vertices, indices);
+}
+
+void GeometryGenerator::CreateGrid(float width, float depth, uint32 m, uint32 n, XMFLOAT3* positions, uint32* indices)
+{
+	BuildGrid(width, depth, m, n, AttributePosition, positions, indices);
+}
+
+template<typename VertexT>
+void GeometryGenerator::BuildGrid(float width, float depth, uint32 m, uint32 n, uint32 attributes, VertexT* vertices, uint32* indices)
+{
 	//
 	// Create the vertices.
 	//
@@ -777,7 +1158,6 @@ GeometryGenerator::MeshData GeometryGenerator::CreateGrid(float width, float dep
 	float du = 1.0f / (n-1);
 	float dv = 1.0f / (m-1);
 
-	meshData.Vertices.resize(vertexCount);
 	for(uint32 i = 0; i < m; ++i)
 	{
 		float z = halfDepth - i*dz;
@@ -785,13 +1165,9 @@ GeometryGenerator::MeshData GeometryGenerator::CreateGrid(float width, float dep
 		{
 			float x = -halfWidth + j*dx;
 
-			meshData.Vertices[i*n+j].Position = XMFLOAT3(x, 0.0f, z);
-			meshData.Vertices[i*n+j].Normal   = XMFLOAT3(0.0f, 1.0f, 0.0f);
-			meshData.Vertices[i*n+j].TangentU = XMFLOAT3(1.0f, 0.0f, 0.0f);
-
 			// Stretch texture over grid.
-			meshData.Vertices[i*n+j].TexC.x = j*du;
-			meshData.Vertices[i*n+j].TexC.y = i*dv;
+			StoreVertex(vertices[i*n+j], attributes,
+				XMFLOAT3(x, 0.0f, z), XMFLOAT3(0.0f, 1.0f, 0.0f), XMFLOAT3(1.0f, 0.0f, 0.0f), XMFLOAT2(j*du, i*dv));
 		}
 	}
  
@@ -799,68 +1175,172 @@ GeometryGenerator::MeshData GeometryGenerator::CreateGrid(float width, float dep
 	// Create the indices.
 	//
 
-	meshData.Indices32.resize(faceCount*3); // 3 indices per face
-
 	// Iterate over each quad and compute indices.
 	uint32 k = 0;
 	for(uint32 i = 0; i < m-1; ++i)
 	{
 		for(uint32 j = 0; j < n-1; ++j)
 		{
-			meshData.Indices32[k]   = i*n+j;
-			meshData.Indices32[k+1] = i*n+j+1;
-			meshData.Indices32[k+2] = (i+1)*n+j;
+			indices[k]   = i*n+j;
+			indices[k+1] = i*n+j+1;
+			indices[k+2] = (i+1)*n+j;
 
-			meshData.Indices32[k+3] = (i+1)*n+j;
-			meshData.Indices32[k+4] = i*n+j+1;
-			meshData.Indices32[k+5] = (i+1)*n+j+1;
+			indices[k+3] = (i+1)*n+j;
+			indices[k+4] = i*n+j+1;
+			indices[k+5] = (i+1)*n+j+1;
 
 			k += 6; // next quad
 		}
 	}
 
-    return meshData;
 }
 
-GeometryGenerator::MeshData GeometryGenerator::CreateQuad(float x, float y, float w, float h, float depth)
+GeometryGenerator::MeshData GeometryGenerator::CreateQuad(float x, float y, float w, float h, float depth, uint32 attributes)
 {
     MeshData meshData;
 
-	meshData.Vertices.resize(4);
-	meshData.Indices32.resize(6);
+	AllocateMesh(meshData, QuadSize(), attributes);
+	if(meshData.PositionsOnly())
+		BuildQuad(x, y, w, h, depth, meshData.Attributes, meshData.Positions.data(), meshData.Indices32.data());
+	else
+		BuildQuad(x, y, w, h, depth, meshData.Attributes, meshData.Vertices.data(), meshData.Indices32.data());
 
-	// Position coordinates specified in NDC space.
-	meshData.Vertices[0] = Vertex(
-        x, y - h, depth,
-		0.0f, 0.0f, -1.0f,
-		1.0f, 0.0f, 0.0f,
-		0.0f, 1.0f);
-
-	meshData.Vertices[1] = Vertex(
-		x, y, depth,
-		0.0f, 0.0f, -1.0f,
-		1.0f, 0.0f, 0.0f,
-		0.0f, 0.0f);
-
-	meshData.Vertices[2] = Vertex(
-		x+w, y, depth,
-		0.0f, 0.0f, -1.0f,
-		1.0f, 0.0f, 0.0f,
-		1.0f, 0.0f);
-
-	meshData.Vertices[3] = Vertex(
-		x+w, y-h, depth,
-		0.0f, 0.0f, -1.0f,
-		1.0f, 0.0f, 0.0f,
-		1.0f, 1.0f);
-
-	meshData.Indices32[0] = 0;
-	meshData.Indices32[1] = 1;
-	meshData.Indices32[2] = 2;
-
-	meshData.Indices32[3] = 0;
-	meshData.Indices32[4] = 2;
-	meshData.Indices32[5] = 3;
+	SetBoxBounds(meshData, XMFLOAT3(x, y - h, depth), XMFLOAT3(x + w, y, depth));
 
     return meshData;
 }
+
+void GeometryGenerator::CreateQuad(float x, float y, float w, float h, float depth, Vertex* vertices, uint32* indices)
+{
+	BuildQuad(x, y, w, h, depth, AttributeAll, vertices, indices);
+}
+
+void GeometryGenerator::CreateQuad(float x, float y, float w, float h, float depth, XMFLOAT3* positions, uint32* indices)
+{
+	BuildQuad(x, y, w, h, depth, AttributePosition, positions, indices);
+}
+
+template<typename VertexT>
+void GeometryGenerator::BuildQuad(float x, float y, float w, float h, float depth, uint32 attributes, VertexT* vertices, uint32* indices)
+{
+	// Position coordinates specified in NDC space.
+	WriteFixedVertices(QuadVertices, 4, XMFLOAT3(w, h, depth), XMFLOAT3(x, y, 0.0f), attributes, vertices);
+	std::copy(std::begin(QuadIndices), std::end(QuadIndices), indices);
+}
+
+GeometryGenerator::MeshSize GeometryGenerator::BoxSize(uint32 numSubdivisions)
+{
+	// Each face is a quad of two triangles; n subdivisions turn it into a
+	// (2^n+1) x (2^n+1) vertex grid that is not shared with the other faces.
+	numSubdivisions = std::min<uint32>(numSubdivisions, MaxSubdivisions);
+	uint32 faceSide = (1u << numSubdivisions) + 1;
+
+	MeshSize size;
+	size.VertexCount = 6*faceSide*faceSide;
+	size.IndexCount = 36 << (2*numSubdivisions);
+	return size;
+}
+
+GeometryGenerator::MeshSize GeometryGenerator::WedgeSize(uint32 numSubdivisions)
+{
+	// Five quad faces, subdivided like the box faces.
+	numSubdivisions = std::min<uint32>(numSubdivisions, MaxSubdivisions);
+	uint32 faceSide = (1u << numSubdivisions) + 1;
+
+	MeshSize size;
+	size.VertexCount = 5*faceSide*faceSide;
+	size.IndexCount = 30 << (2*numSubdivisions);
+	return size;
+}
+
+GeometryGenerator::MeshSize GeometryGenerator::SphereSize(uint32 sliceCount, uint32 stackCount)
+{
+	// Two poles plus stackCount-1 rings; a fan at each pole and quads in between.
+	MeshSize size;
+	size.VertexCount = 2 + (stackCount-1)*(sliceCount+1);
+	size.IndexCount = 6*sliceCount + 6*sliceCount*(stackCount-2);
+	return size;
+}
+
+GeometryGenerator::MeshSize GeometryGenerator::GeosphereSize(uint32 numSubdivisions)
+{
+	// Subdividing the icosahedron adds one vertex per edge: 10*4^n + 2 vertices.
+	numSubdivisions = std::min<uint32>(numSubdivisions, MaxSubdivisions);
+
+	MeshSize size;
+	size.VertexCount = 10*(1u << (2*numSubdivisions)) + 2;
+	size.IndexCount = 60*(1u << (2*numSubdivisions));
+	return size;
+}
+
+GeometryGenerator::MeshSize GeometryGenerator::CylinderSize(uint32 sliceCount, uint32 stackCount)
+{
+	// stackCount+1 rings of sliceCount+1 vertices, plus a ring and a center per cap.
+	MeshSize size;
+	size.VertexCount = (stackCount+1)*(sliceCount+1) + 2*(sliceCount+2);
+	size.IndexCount = 6*sliceCount*stackCount + 2*3*sliceCount;
+	return size;
+}
+
+GeometryGenerator::MeshSize GeometryGenerator::DiamondSize(uint32 sliceCount, uint32 stackCount)
+{
+	// Two sets of stackCount+1 rings, and a top cap.
+	MeshSize size;
+	size.VertexCount = 2*(stackCount+1)*(sliceCount+1) + (sliceCount+2);
+	size.IndexCount = 6*(2*stackCount)*(2*sliceCount) + 3*sliceCount;
+	return size;
+}
+
+GeometryGenerator::MeshSize GeometryGenerator::GridSize(uint32 m, uint32 n)
+{
+	MeshSize size;
+	size.VertexCount = m*n;
+	size.IndexCount = (m-1)*(n-1)*2*3;
+	return size;
+}
+
+GeometryGenerator::MeshSize GeometryGenerator::QuadSize()
+{
+	MeshSize size;
+	size.VertexCount = 4;
+	size.IndexCount = 6;
+	return size;
+}
+
+void GeometryGenerator::AllocateMesh(MeshData& meshData, const MeshSize& size, uint32 attributes)
+{
+	meshData.Attributes = attributes | AttributePosition;
+
+	// The generators write every attribute of the mask, so only a partial mask needs the
+	// other attributes cleared.
+	if(meshData.PositionsOnly())
+		meshData.Positions.resize(size.VertexCount);
+	else if(meshData.Attributes == AttributeAll)
+		meshData.Vertices.resize(size.VertexCount);
+	else
+		meshData.Vertices.assign(size.VertexCount, ZeroVertex);
+
+	meshData.Indices32.resize(size.IndexCount);
+}
+
+void GeometryGenerator::SetBoxBounds(MeshData& meshData, const XMFLOAT3& vMin, const XMFLOAT3& vMax)
+{
+	XMVECTOR minV = XMLoadFloat3(&vMin);
+	XMVECTOR maxV = XMLoadFloat3(&vMax);
+
+	XMStoreFloat3(&meshData.Bounds.Center, 0.5f*(minV + maxV));
+	XMStoreFloat3(&meshData.Bounds.Extents, 0.5f*(maxV - minV));
+
+	meshData.SphereBounds.Center = meshData.Bounds.Center;
+	meshData.SphereBounds.Radius = XMVectorGetX(XMVector3Length(XMLoadFloat3(&meshData.Bounds.Extents)));
+}
+
+void GeometryGenerator::SetRevolutionBounds(MeshData& meshData, float maxRadius, float yMin, float yMax)
+{
+	SetBoxBounds(meshData, XMFLOAT3(-maxRadius, yMin, -maxRadius), XMFLOAT3(+maxRadius, yMax, +maxRadius));
+
+	// Every ring lies within maxRadius of the axis, so the sphere only needs the
+	// radial and half-height extents rather than the box diagonal.
+	float h2 = 0.5f*(yMax - yMin);
+	meshData.SphereBounds.Radius = sqrtf(maxRadius*maxRadius + h2*h2);
+}
@@ -16,6 +16,7 @@
 
 #include <cstdint>
 #include <DirectXMath.h>
+#include <DirectXCollision.h>
 #include <vector>
 
 class GeometryGenerator
@@ -25,6 +26,24 @@ public:
     using uint16 = std::uint16_t;
     using uint32 = std::uint32_t;
 
+	// Largest subdivision level accepted by CreateBox, CreateWedge and CreateGeosphere.
+	// Each level quadruples the triangle count; at 13 a geosphere has about 1.3 billion
+	// triangles, so triangle ids and vertex indices still fit in 32 bits.
+	static const uint32 MaxSubdivisions = 13;
+
+	// Meshes with at most this many vertices can be drawn with 16-bit indices.
+	static const uint32 MaxVertices16 = 65536;
+
+	// Vertex attributes a Create* call computes.  The position is always computed.
+	enum VertexAttributes : uint32
+	{
+		AttributePosition = 0x1,
+		AttributeNormal = 0x2,
+		AttributeTangentU = 0x4,
+		AttributeTexC = 0x8,
+		AttributeAll = 0xf
+	};
+
 	struct Vertex
 	{
 		Vertex(){}
@@ -55,9 +74,26 @@ public:
 
 	struct MeshData
 	{
+		// Attributes the mesh was generated with.  A position-only mesh keeps its vertices
+		// tightly packed in Positions and leaves Vertices empty; with any other mask the
+		// attributes left out of it are zero.
+		uint32 Attributes = AttributeAll;
+
 		std::vector<Vertex> Vertices;
+		std::vector<DirectX::XMFLOAT3> Positions;
         std::vector<uint32> Indices32;
 
+		// Local-space bounds, computed from the shape parameters while the mesh is
+		// generated (no pass over the vertices).
+		DirectX::BoundingBox Bounds;
+		DirectX::BoundingSphere SphereBounds;
+
+		bool PositionsOnly()const { return Attributes == AttributePosition; }
+		uint32 VertexCount()const { return (uint32)(PositionsOnly() ? Positions.size() : Vertices.size()); }
+		const DirectX::XMFLOAT3& GetPosition(size_t i)const { return PositionsOnly() ? Positions[i] : Vertices[i].Position; }
+
+		bool FitsIndices16()const { return VertexCount() <= MaxVertices16; }
+
         std::vector<uint16>& GetIndices16()
         {
 			if(mIndices16.empty())
@@ -74,60 +110,264 @@ public:
 		std::vector<uint16> mIndices16;
 	};
 
+	// Exact vertex and index counts a Create* call produces.
+	struct MeshSize
+	{
+		uint32 VertexCount = 0;
+		uint32 IndexCount = 0;
+	};
+
+	///<summary>
+	/// Sizes of the meshes produced with the same arguments, so callers can allocate
+	/// once and use the overloads that write into caller-provided arrays.  The overloads
+	/// taking an XMFLOAT3 array write a position-only stream.
+	///</summary>
+	static MeshSize BoxSize(uint32 numSubdivisions);
+	static MeshSize WedgeSize(uint32 numSubdivisions);
+	static MeshSize SphereSize(uint32 sliceCount, uint32 stackCount);
+	static MeshSize GeosphereSize(uint32 numSubdivisions);
+	static MeshSize CylinderSize(uint32 sliceCount, uint32 stackCount);
+	static MeshSize DiamondSize(uint32 sliceCount, uint32 stackCount);
+	static MeshSize GridSize(uint32 m, uint32 n);
+	static MeshSize QuadSize();
+
 	///<summary>
 	/// Creates a box centered at the origin with the given dimensions, where each
     /// face has m rows and n columns of vertices.
 	///</summary>
-    MeshData CreateBox(float width, float height, float depth, uint32 numSubdivisions);
+    MeshData CreateBox(float width, float height, float depth, uint32 numSubdivisions, uint32 attributes = AttributeAll);
 
 	///<summary>
 	/// Creates a box centered at the origin with the given dimensions, where each
 	/// face has m rows and n columns of vertices.
 	///</summary>
-	MeshData CreateWedge(float width, float height, float depth, uint32 numSubdivisions);
+	MeshData CreateWedge(float width, float height, float depth, uint32 numSubdivisions, uint32 attributes = AttributeAll);
 
 	///<summary>
 	/// Creates a sphere centered at the origin with the given radius.  The
 	/// slices and stacks parameters control the degree of tessellation.
+	/// The overloads taking vertex and index pointers write exactly SphereSize()
+	/// (or the matching *Size()) elements and leave the bounds to the caller.
+	/// The attributes mask selects the VertexAttributes every MeshData overload computes.
 	///</summary>
-    MeshData CreateSphere(float radius, uint32 sliceCount, uint32 stackCount);
+    MeshData CreateSphere(float radius, uint32 sliceCount, uint32 stackCount, uint32 attributes = AttributeAll);
+	void CreateSphere(float radius, uint32 sliceCount, uint32 stackCount, Vertex* vertices, uint32* indices);
+	void CreateSphere(float radius, uint32 sliceCount, uint32 stackCount, DirectX::XMFLOAT3* positions, uint32* indices);
 
 	///<summary>
 	/// Creates a geosphere centered at the origin with the given radius.  The
 	/// depth controls the level of tessellation.
 	///</summary>
-    MeshData CreateGeosphere(float radius, uint32 numSubdivisions);
+    MeshData CreateGeosphere(float radius, uint32 numSubdivisions, uint32 attributes = AttributeAll);
 
 	///<summary>
 	/// Creates a cylinder parallel to the y-axis, and centered about the origin.  
 	/// The bottom and top radius can vary to form various cone shapes rather than true
 	// cylinders.  The slices and stacks parameters control the degree of tessellation.
 	///</summary>
-    MeshData CreateCylinder(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount);
+    MeshData CreateCylinder(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount,
+		uint32 attributes = AttributeAll);
+	void CreateCylinder(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount,
+		Vertex* vertices, uint32* indices);
+	void CreateCylinder(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount,
+		DirectX::XMFLOAT3* positions, uint32* indices);
+
+	MeshData CreateCone(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount, uint32 attributes = AttributeAll);
+	MeshData CreatePyramid(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount, uint32 attributes = AttributeAll);
+	MeshData CreatePrism(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount, uint32 attributes = AttributeAll);
+
+	///<summary>
+	/// Index writers shared by CreateCylinder and the compile-time topologies.  The
+	/// cylinder indices are the stack quads, then the top and bottom cap fans, in the
+	/// vertex order CreateCylinder writes.
+	///</summary>
+	static constexpr void WriteRingIndices(uint32 sliceCount, uint32 stackCount, uint32* indices)
+	{
+		// Add one because we duplicate the first and last vertex per ring
+		// since the texture coordinates are different.
+		uint32 ringVertexCount = sliceCount+1;
+
+		uint32 k = 0;
+		for(uint32 i = 0; i < stackCount; ++i)
+		{
+			for(uint32 j = 0; j < sliceCount; ++j)
+			{
+				indices[k++] = i*ringVertexCount + j;
+				indices[k++] = (i+1)*ringVertexCount + j;
+				indices[k++] = (i+1)*ringVertexCount + j+1;
+
+				indices[k++] = i*ringVertexCount + j;
+				indices[k++] = (i+1)*ringVertexCount + j+1;
+				indices[k++] = i*ringVertexCount + j+1;
+			}
+		}
+	}
+
+	// baseIndex is the first of the sliceCount+1 cap ring vertices; the center follows them.
+	static constexpr void WriteCapIndices(uint32 sliceCount, uint32 baseIndex, bool top, uint32* indices)
+	{
+		uint32 centerIndex = baseIndex + sliceCount+1;
+
+		for(uint32 i = 0; i < sliceCount; ++i)
+		{
+			indices[i*3+0] = centerIndex;
+			indices[i*3+1] = baseIndex + (top ? i+1 : i);
+			indices[i*3+2] = baseIndex + (top ? i : i+1);
+		}
+	}
+
+	static constexpr void WriteCylinderIndices(uint32 sliceCount, uint32 stackCount, uint32* indices)
+	{
+		uint32 topCapBase = (stackCount+1)*(sliceCount+1);
+		uint32 sideIndexCount = 6*sliceCount*stackCount;
+
+		WriteRingIndices(sliceCount, stackCount, indices);
+		WriteCapIndices(sliceCount, topCapBase, true, indices + sideIndexCount);
+		WriteCapIndices(sliceCount, topCapBase + sliceCount+2, false, indices + sideIndexCount + 3*sliceCount);
+	}
+
+	///<summary>
+	/// Index topology of a cylinder with constant slice and stack counts, computed at
+	/// compile time.  A constexpr instance lives in read-only memory.
+	///</summary>
+	template<uint32 SliceCount, uint32 StackCount>
+	struct CylinderTopology
+	{
+		static_assert(SliceCount >= 3 && StackCount >= 1, "A cylinder needs at least 3 slices and 1 stack.");
+
+		static const uint32 VertexCount = (StackCount+1)*(SliceCount+1) + 2*(SliceCount+2);
+		static const uint32 IndexCount = 6*SliceCount*StackCount + 2*3*SliceCount;
+
+		constexpr CylinderTopology() : Indices() { WriteCylinderIndices(SliceCount, StackCount, Indices); }
+
+		uint32 Indices[IndexCount];
+	};
+
+	///<summary>
+	/// Cylinder shapes with constant tessellation: only the vertices are computed and
+	/// the indices are copied from the compile-time topology.
+	///</summary>
+	template<uint32 SliceCount, uint32 StackCount>
+	MeshData CreateCylinder(float bottomRadius, float topRadius, float height, uint32 attributes = AttributeAll)
+	{
+		static constexpr CylinderTopology<SliceCount, StackCount> topology;
+		return CreateCylinderWithIndices(bottomRadius, topRadius, height, SliceCount, StackCount, topology.Indices, attributes);
+	}
+
+	template<uint32 SliceCount, uint32 StackCount>
+	MeshData CreateCone(float bottomRadius, float topRadius, float height, uint32 attributes = AttributeAll)
+	{
+		return CreateCylinder<SliceCount, StackCount>(bottomRadius, topRadius, height, attributes);
+	}
+
+	template<uint32 SliceCount, uint32 StackCount>
+	MeshData CreatePyramid(float bottomRadius, float topRadius, float height, uint32 attributes = AttributeAll)
+	{
+		return CreateCylinder<SliceCount, StackCount>(bottomRadius, topRadius, height, attributes);
+	}
+
+	template<uint32 SliceCount, uint32 StackCount>
+	MeshData CreatePrism(float bottomRadius, float topRadius, float height, uint32 attributes = AttributeAll)
+	{
+		return CreateCylinder<SliceCount, StackCount>(bottomRadius, topRadius, height, attributes);
+	}
 
-	MeshData CreateCone(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount);
-	MeshData CreatePyramid(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount);
-	MeshData CreatePrism(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount);
+	MeshData CreateDiamond(float middleRadius, float topRadius, float heightBottom, float heightTop, uint32 sliceCount, uint32 stackCount,
+		uint32 attributes = AttributeAll);
+	void CreateDiamond(float middleRadius, float topRadius, float heightBottom, float heightTop, uint32 sliceCount, uint32 stackCount,
+		Vertex* vertices, uint32* indices);
+	void CreateDiamond(float middleRadius, float topRadius, float heightBottom, float heightTop, uint32 sliceCount, uint32 stackCount,
+		DirectX::XMFLOAT3* positions, uint32* indices);
 
-	MeshData CreateDiamond(float middleRadius, float topRadius, float heightBottom, float heightTop, uint32 sliceCount, uint32 stackCount);
+	///<summary>
+	/// Discrete LOD chains: element 0 uses the given tessellation and every further
+	/// level halves the slice and stack counts (never below what keeps the shape closed).
+	/// All levels share the bounds of level 0.
+	///</summary>
+	std::vector<MeshData> CreateSphereLods(float radius, uint32 sliceCount, uint32 stackCount, uint32 levelCount,
+		uint32 attributes = AttributeAll);
+	std::vector<MeshData> CreateCylinderLods(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount, uint32 levelCount,
+		uint32 attributes = AttributeAll);
+	std::vector<MeshData> CreateConeLods(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount, uint32 levelCount,
+		uint32 attributes = AttributeAll);
+	std::vector<MeshData> CreateDiamondLods(float middleRadius, float topRadius, float heightBottom, float heightTop, uint32 sliceCount, uint32 stackCount, uint32 levelCount,
+		uint32 attributes = AttributeAll);
 
 
 	///<summary>
 	/// Creates an mxn grid in the xz-plane with m rows and n columns, centered
 	/// at the origin with the specified width and depth.
 	///</summary>
-    MeshData CreateGrid(float width, float depth, uint32 m, uint32 n);
+    MeshData CreateGrid(float width, float depth, uint32 m, uint32 n, uint32 attributes = AttributeAll);
+	void CreateGrid(float width, float depth, uint32 m, uint32 n, Vertex* vertices, uint32* indices);
+	void CreateGrid(float width, float depth, uint32 m, uint32 n, DirectX::XMFLOAT3* positions, uint32* indices);
 
 	///<summary>
 	/// Creates a quad aligned with the screen.  This is useful for postprocessing and screen effects.
 	///</summary>
-    MeshData CreateQuad(float x, float y, float w, float h, float depth);
+    MeshData CreateQuad(float x, float y, float w, float h, float depth, uint32 attributes = AttributeAll);
+	void CreateQuad(float x, float y, float w, float h, float depth, Vertex* vertices, uint32* indices);
+	void CreateQuad(float x, float y, float w, float h, float depth, DirectX::XMFLOAT3* positions, uint32* indices);
+
+	///<summary>
+	/// Splits every triangle into four.  Vertices on shared edges are shared, so a
+	/// closed mesh grows by one vertex per edge instead of six vertices per triangle.
+	/// Only the attributes of the mesh's mask are interpolated.
+	///</summary>
 	void Subdivide(MeshData& meshData);
+
+	///<summary>
+	/// Splits a mesh into pieces that each reference at most maxVertices vertices, so
+	/// every piece can use 16-bit indices.  Vertices on piece borders are duplicated and
+	/// every piece keeps the bounds of the whole mesh.
+	///</summary>
+	std::vector<MeshData> SplitMesh(const MeshData& meshData, uint32 maxVertices = MaxVertices16);
 private:
 	
-    Vertex MidPoint(const Vertex& v0, const Vertex& v1);
-    void BuildCylinderTopCap(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount, MeshData& meshData);
-    void BuildCylinderBottomCap(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount, MeshData& meshData);
+    Vertex MidPoint(const Vertex& v0, const Vertex& v1, uint32 attributes);
+	DirectX::XMFLOAT3 MidPoint(const DirectX::XMFLOAT3& p0, const DirectX::XMFLOAT3& p1, uint32 attributes);
+
+	template<typename VertexT>
+	void SubdivideVertices(std::vector<VertexT>& vertices, std::vector<uint32>& indices, uint32 attributes);
+
+	// Shared by the Vertex and the position-only overloads; VertexT is Vertex or XMFLOAT3
+	// and only the attributes in the mask are computed.
+	template<typename VertexT>
+	void BuildSphere(float radius, uint32 sliceCount, uint32 stackCount, uint32 attributes, VertexT* vertices, uint32* indices);
+	template<typename VertexT>
+	void BuildCylinderVertices(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount,
+		uint32 attributes, VertexT* vertices);
+	template<typename VertexT>
+	void BuildDiamond(float middleRadius, float topRadius, float heightBottom, float heightTop, uint32 sliceCount, uint32 stackCount,
+		uint32 attributes, VertexT* vertices, uint32* indices);
+	template<typename VertexT>
+	void BuildGrid(float width, float depth, uint32 m, uint32 n, uint32 attributes, VertexT* vertices, uint32* indices);
+	template<typename VertexT>
+	void BuildQuad(float x, float y, float w, float h, float depth, uint32 attributes, VertexT* vertices, uint32* indices);
+
+	// The caps write sliceCount+2 vertices; WriteCapIndices writes their 3*sliceCount indices.
+	template<typename VertexT>
+    void BuildCylinderTopCap(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount,
+		uint32 attributes, VertexT* vertices);
+	template<typename VertexT>
+    void BuildCylinderBottomCap(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount,
+		uint32 attributes, VertexT* vertices);
+
+	// Cylinder whose CylinderSize(sliceCount, stackCount).IndexCount indices are given.
+	MeshData CreateCylinderWithIndices(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount,
+		const uint32* indices, uint32 attributes);
+
+	// Sizes the vertex and index arrays of a mesh generated with the given mask.
+	static void AllocateMesh(MeshData& meshData, const MeshSize& size, uint32 attributes);
+
+	// Tessellation count of an LOD level.
+	static uint32 LodTessellation(uint32 count, uint32 level, uint32 minCount);
+
+	// Sets the box bounds and the sphere circumscribing it.
+	static void SetBoxBounds(MeshData& meshData, const DirectX::XMFLOAT3& vMin, const DirectX::XMFLOAT3& vMax);
+
+	// Bounds of a shape of revolution about the y-axis with the given maximum radius.
+	static void SetRevolutionBounds(MeshData& meshData, float maxRadius, float yMin, float yMax);
 
 };
 
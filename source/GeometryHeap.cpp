@@ -0,0 +1,386 @@
+//***************************************************************************************
+// GeometryHeap.cpp
+//***************************************************************************************
+
+#include "GeometryHeap.h"
+
+#include <cassert>
+#include <iterator>
+
+using Microsoft::WRL::ComPtr;
+
+namespace
+{
+	// Ring allocations keep 16-byte offsets, and so does the index data after the vertices.
+	const UINT64 gUploadAlignment = 16;
+
+	UINT64 AlignUp(UINT64 value, UINT64 alignment)
+	{
+		return (value + alignment - 1) / alignment * alignment;
+	}
+}
+
+RangeAllocator::RangeAllocator(UINT64 capacity)
+	: mCapacity(capacity)
+{
+	if (capacity > 0)
+		InsertFree(0, capacity);
+}
+
+UINT64 RangeAllocator::Allocate(UINT64 size)
+{
+	// Zero-sized ranges take no space and need no offset.
+	if (size == 0)
+		return 0;
+
+	auto fit = mFreeBySize.lower_bound(size);
+	if (fit == mFreeBySize.end())
+		return InvalidOffset;
+
+	UINT64 offset = fit->second;
+	UINT64 freeSize = fit->first;
+	EraseFree(mFreeByOffset.find(offset));
+
+	// Keep the remainder after the allocation.
+	if (freeSize > size)
+		InsertFree(offset + size, freeSize - size);
+
+	return offset;
+}
+
+void RangeAllocator::Free(UINT64 offset, UINT64 size)
+{
+	if (size == 0)
+		return;
+
+	assert(offset + size <= mCapacity);
+
+	// Merge with the free ranges just before and just after.
+	auto next = mFreeByOffset.lower_bound(offset);
+	assert(next == mFreeByOffset.end() || next->first >= offset + size);
+	if (next != mFreeByOffset.begin())
+	{
+		auto prev = std::prev(next);
+		assert(prev->first + prev->second <= offset);
+		if (prev->first + prev->second == offset)
+		{
+			offset = prev->first;
+			size += prev->second;
+			EraseFree(prev);
+		}
+	}
+
+	if (next != mFreeByOffset.end() && next->first == offset + size)
+	{
+		size += next->second;
+		EraseFree(next);
+	}
+
+	InsertFree(offset, size);
+}
+
+void RangeAllocator::InsertFree(UINT64 offset, UINT64 size)
+{
+	mFreeByOffset[offset] = size;
+	mFreeBySize.insert(std::make_pair(size, offset));
+	mFreeSize += size;
+}
+
+void RangeAllocator::EraseFree(std::map<UINT64, UINT64>::iterator range)
+{
+	auto sizes = mFreeBySize.equal_range(range->second);
+	for (auto it = sizes.first; it != sizes.second; ++it)
+	{
+		if (it->second == range->first)
+		{
+			mFreeBySize.erase(it);
+			break;
+		}
+	}
+
+	mFreeSize -= range->second;
+	mFreeByOffset.erase(range);
+}
+
+GeometryHeap::GeometryHeap(ID3D12Device* device, const std::string& name, UINT vertexByteStride,
+	UINT vertexCapacity, UINT indexCapacity, UINT64 uploadRingByteSize)
+	: mDevice(device), mVertexRanges(vertexCapacity), mIndexRanges(indexCapacity)
+{
+	UINT64 vbByteSize = (UINT64)vertexCapacity * vertexByteStride;
+	UINT64 ibByteSize = (UINT64)indexCapacity * sizeof(std::uint32_t);
+
+	mGeo.Name = name;
+	mGeo.VertexBufferGPU = CreateBuffer(device, D3D12_HEAP_TYPE_DEFAULT, vbByteSize, D3D12_RESOURCE_STATE_COMMON,
+		D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+	mGeo.IndexBufferGPU = CreateBuffer(device, D3D12_HEAP_TYPE_DEFAULT, ibByteSize, D3D12_RESOURCE_STATE_COMMON,
+		D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+	mGeo.VertexByteStride = vertexByteStride;
+	mGeo.VertexBufferByteSize = (UINT)vbByteSize;
+	mGeo.IndexFormat = DXGI_FORMAT_R32_UINT;
+	mGeo.IndexBufferByteSize = (UINT)ibByteSize;
+
+	D3D12_COMMAND_QUEUE_DESC queueDesc = {};
+	queueDesc.Type = D3D12_COMMAND_LIST_TYPE_COPY;
+	queueDesc.Flags = D3D12_COMMAND_QUEUE_FLAG_NONE;
+	ThrowIfFailed(device->CreateCommandQueue(&queueDesc, IID_PPV_ARGS(mCopyQueue.GetAddressOf())));
+
+	ThrowIfFailed(device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(mCopyFence.GetAddressOf())));
+	mCopyEvent = CreateEventEx(nullptr, nullptr, 0, EVENT_ALL_ACCESS);
+
+	// The ring stays mapped; the CPU only writes it.
+	mRingSize = AlignUp(uploadRingByteSize, gUploadAlignment);
+	mUploadRing = CreateBuffer(device, D3D12_HEAP_TYPE_UPLOAD, mRingSize, D3D12_RESOURCE_STATE_GENERIC_READ);
+	CD3DX12_RANGE readRange(0, 0);
+	ThrowIfFailed(mUploadRing->Map(0, &readRange, reinterpret_cast<void**>(&mMappedRing)));
+}
+
+GeometryHeap::~GeometryHeap()
+{
+	if (mCopyFence != nullptr && mCopyFence->GetCompletedValue() < mCopyFenceValue)
+	{
+		ThrowIfFailed(mCopyFence->SetEventOnCompletion(mCopyFenceValue, mCopyEvent));
+		WaitForSingleObject(mCopyEvent, INFINITE);
+	}
+
+	if (mCopyEvent != nullptr)
+		CloseHandle(mCopyEvent);
+
+	if (mUploadRing != nullptr)
+		mUploadRing->Unmap(0, nullptr);
+}
+
+bool GeometryHeap::AddSubmesh(const std::string& name, UINT vertexCount, UINT indexCount,
+	const DirectX::BoundingBox& bounds, BYTE** vertices, std::uint32_t** indices)
+{
+	assert(mAllocations.count(name) == 0);
+
+	UINT64 vertexBytes = (UINT64)vertexCount * mGeo.VertexByteStride;
+	UINT64 indexBytes = (UINT64)indexCount * sizeof(std::uint32_t);
+	UINT64 indexUploadOffset = AlignUp(vertexBytes, gUploadAlignment);
+
+	Allocation allocation;
+	if (!AllocateRanges(vertexCount, indexCount, allocation))
+		return false;
+
+	UINT64 uploadOffset = AllocateUpload(indexUploadOffset + AlignUp(indexBytes, gUploadAlignment));
+	if (uploadOffset == RangeAllocator::InvalidOffset)
+	{
+		mVertexRanges.Free(allocation.VertexOffset, vertexCount);
+		mIndexRanges.Free(allocation.IndexOffset, indexCount);
+		return false;
+	}
+
+	// The copies read the ring when the list executes, after the caller has written it.
+	BeginCopies();
+	if (vertexBytes > 0)
+	{
+		mCopyList->CopyBufferRegion(mGeo.VertexBufferGPU.Get(), allocation.VertexOffset * mGeo.VertexByteStride,
+			mUploadRing.Get(), uploadOffset, vertexBytes);
+	}
+	if (indexBytes > 0)
+	{
+		mCopyList->CopyBufferRegion(mGeo.IndexBufferGPU.Get(), allocation.IndexOffset * sizeof(std::uint32_t),
+			mUploadRing.Get(), uploadOffset + indexUploadOffset, indexBytes);
+	}
+
+	allocation.CopyFence = mCopyFenceValue + 1;
+	AddAllocation(name, allocation, bounds);
+
+	*vertices = mMappedRing + uploadOffset;
+	*indices = reinterpret_cast<std::uint32_t*>(mMappedRing + uploadOffset + indexUploadOffset);
+	return true;
+}
+
+bool GeometryHeap::AddGpuSubmesh(const std::string& name, UINT vertexCount, UINT indexCount,
+	const DirectX::BoundingBox& bounds, D3D12_GPU_VIRTUAL_ADDRESS* vertices, D3D12_GPU_VIRTUAL_ADDRESS* indices)
+{
+	assert(mAllocations.count(name) == 0);
+
+	// Nothing to copy, so the copy fence is already past it.
+	Allocation allocation;
+	if (!AllocateRanges(vertexCount, indexCount, allocation))
+		return false;
+	AddAllocation(name, allocation, bounds);
+
+	*vertices = mGeo.VertexBufferGPU->GetGPUVirtualAddress() + allocation.VertexOffset * mGeo.VertexByteStride;
+	*indices = mGeo.IndexBufferGPU->GetGPUVirtualAddress() + allocation.IndexOffset * sizeof(std::uint32_t);
+	return true;
+}
+
+void GeometryHeap::Submit()
+{
+	if (!mCopyListOpen)
+		return;
+
+	ThrowIfFailed(mCopyList->Close());
+	ID3D12CommandList* cmdsLists[] = { mCopyList.Get() };
+	mCopyQueue->ExecuteCommandLists(_countof(cmdsLists), cmdsLists);
+	ThrowIfFailed(mCopyQueue->Signal(mCopyFence.Get(), ++mCopyFenceValue));
+
+	CopyBatch batch;
+	batch.CopyFence = mCopyFenceValue;
+	batch.RingEnd = mRingHead;
+	batch.Allocator = std::move(mCopyAllocator);
+	mCopyBatches.push_back(std::move(batch));
+
+	mCopyListOpen = false;
+}
+
+bool GeometryHeap::IsUploaded(const std::string& name)const
+{
+	auto it = mAllocations.find(name);
+	if (it == mAllocations.end() || it->second.CopyFence > mCopyFenceValue)
+		return false;
+
+	return mCopyFence->GetCompletedValue() >= it->second.CopyFence;
+}
+
+void GeometryHeap::RemoveSubmesh(const std::string& name, UINT64 lastFrameFence)
+{
+	auto it = mAllocations.find(name);
+	if (it == mAllocations.end())
+		return;
+
+	// Frame fence values only grow, so the queue stays sorted.  The ranges also wait for
+	// their own copy (Ranges.CopyFence): once reused they may be written on the direct
+	// queue, which is not ordered against the copy queue.
+	RemovedAllocation removed;
+	removed.Ranges = it->second;
+	removed.FrameFence = lastFrameFence;
+	mRemoved.push_back(removed);
+
+	mGeo.DrawArgs.erase(name);
+	mAllocations.erase(it);
+}
+
+void GeometryHeap::Collect(UINT64 completedFrameFence)
+{
+	UINT64 completedCopies = mCopyFence->GetCompletedValue();
+	while (!mCopyBatches.empty() && mCopyBatches.front().CopyFence <= completedCopies)
+	{
+		// The distance includes any space skipped at the end of the ring when it wrapped.
+		CopyBatch& batch = mCopyBatches.front();
+		mRingUsed -= (batch.RingEnd + mRingSize - mRingTail) % mRingSize;
+		mRingTail = batch.RingEnd;
+		mFreeAllocators.push_back(std::move(batch.Allocator));
+		mCopyBatches.pop_front();
+	}
+
+	// Start over from the beginning once nothing is in flight, which also settles a
+	// batch that filled the whole ring.
+	if (mCopyBatches.empty() && !mCopyListOpen)
+	{
+		mRingHead = 0;
+		mRingTail = 0;
+		mRingUsed = 0;
+	}
+
+	while (!mRemoved.empty() && mRemoved.front().FrameFence <= completedFrameFence &&
+		mRemoved.front().Ranges.CopyFence <= completedCopies)
+	{
+		const Allocation& ranges = mRemoved.front().Ranges;
+		mVertexRanges.Free(ranges.VertexOffset, ranges.VertexCount);
+		mIndexRanges.Free(ranges.IndexOffset, ranges.IndexCount);
+		mRemoved.pop_front();
+	}
+}
+
+bool GeometryHeap::AllocateRanges(UINT vertexCount, UINT indexCount, Allocation& allocation)
+{
+	allocation.VertexCount = vertexCount;
+	allocation.IndexCount = indexCount;
+	allocation.VertexOffset = mVertexRanges.Allocate(vertexCount);
+	allocation.IndexOffset = mIndexRanges.Allocate(indexCount);
+	if (allocation.VertexOffset != RangeAllocator::InvalidOffset && allocation.IndexOffset != RangeAllocator::InvalidOffset)
+		return true;
+
+	if (allocation.VertexOffset != RangeAllocator::InvalidOffset)
+		mVertexRanges.Free(allocation.VertexOffset, vertexCount);
+	if (allocation.IndexOffset != RangeAllocator::InvalidOffset)
+		mIndexRanges.Free(allocation.IndexOffset, indexCount);
+	return false;
+}
+
+void GeometryHeap::AddAllocation(const std::string& name, const Allocation& allocation, const DirectX::BoundingBox& bounds)
+{
+	mAllocations[name] = allocation;
+
+	SubmeshGeometry submesh;
+	submesh.IndexCount = (UINT)allocation.IndexCount;
+	submesh.StartIndexLocation = (UINT)allocation.IndexOffset;
+	submesh.BaseVertexLocation = (INT)allocation.VertexOffset;
+	submesh.Bounds = bounds;
+	mGeo.DrawArgs[name] = submesh;
+}
+
+UINT64 GeometryHeap::AllocateUpload(UINT64 byteSize)
+{
+	if (byteSize > mRingSize)
+		return RangeAllocator::InvalidOffset;
+
+	// Data does not wrap around; what does not fit before the end starts over at 0,
+	// and the space skipped is freed with it.
+	UINT64 offset = mRingHead;
+	UINT64 skipped = 0;
+	if (mRingHead + byteSize > mRingSize)
+	{
+		offset = 0;
+		skipped = mRingSize - mRingHead;
+	}
+
+	if (mRingUsed + skipped + byteSize > mRingSize)
+		return RangeAllocator::InvalidOffset;
+
+	mRingUsed += skipped + byteSize;
+	mRingHead = (offset + byteSize) % mRingSize;
+	return offset;
+}
+
+void GeometryHeap::BeginCopies()
+{
+	if (mCopyListOpen)
+		return;
+
+	// Reuse the allocator of a completed copy list if there is one.
+	if (!mFreeAllocators.empty())
+	{
+		mCopyAllocator = std::move(mFreeAllocators.back());
+		mFreeAllocators.pop_back();
+		ThrowIfFailed(mCopyAllocator->Reset());
+	}
+	else
+	{
+		ThrowIfFailed(mDevice->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_COPY,
+			IID_PPV_ARGS(mCopyAllocator.GetAddressOf())));
+	}
+
+	// A new command list starts open.
+	if (mCopyList == nullptr)
+	{
+		ThrowIfFailed(mDevice->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_COPY, mCopyAllocator.Get(), nullptr,
+			IID_PPV_ARGS(mCopyList.GetAddressOf())));
+	}
+	else
+	{
+		ThrowIfFailed(mCopyList->Reset(mCopyAllocator.Get(), nullptr));
+	}
+
+	mCopyListOpen = true;
+}
+
+ComPtr<ID3D12Resource> GeometryHeap::CreateBuffer(ID3D12Device* device, D3D12_HEAP_TYPE heapType,
+	UINT64 byteSize, D3D12_RESOURCE_STATES state, D3D12_RESOURCE_FLAGS flags)
+{
+	ComPtr<ID3D12Resource> buffer;
+
+	// Zero-sized buffers are not allowed.
+	ThrowIfFailed(device->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(heapType),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(std::max<UINT64>(byteSize, 1), flags),
+		state,
+		nullptr,
+		IID_PPV_ARGS(buffer.GetAddressOf())));
+
+	return buffer;
+}
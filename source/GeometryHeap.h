@@ -0,0 +1,182 @@
+//***************************************************************************************
+// GeometryHeap.h
+//
+// Geometry that changes at runtime.  One large default-heap vertex buffer and one R32
+// index buffer are suballocated per submesh, so submeshes can be added and removed
+// while the others keep drawing, without rebuilding or reuploading the buffers.  The
+// data is written into a persistently mapped upload ring and copied on a copy queue of
+// the heap's own; the ring space and the command allocators are recycled on the copy
+// fence, and removed ranges are only reused once the frames that may draw them have
+// completed on the frame fence.  Submeshes can also be written on the GPU, by compute
+// shaders on the direct queue.
+//***************************************************************************************
+
+#pragma once
+
+#include "../../Common/d3dUtil.h"
+
+#include <cstdint>
+#include <deque>
+#include <map>
+
+// Best-fit allocator of ranges in [0, capacity), in arbitrary units.  Free ranges are
+// kept by offset, to merge them with their neighbors, and by size, to find the
+// smallest one that fits; both in O(log n).
+class RangeAllocator
+{
+public:
+
+	static const UINT64 InvalidOffset = ~0ull;
+
+	explicit RangeAllocator(UINT64 capacity = 0);
+
+	// Returns InvalidOffset if no free range is large enough.
+	UINT64 Allocate(UINT64 size);
+
+	// size must be the size the range was allocated with.
+	void Free(UINT64 offset, UINT64 size);
+
+	UINT64 Capacity()const { return mCapacity; }
+	UINT64 FreeSize()const { return mFreeSize; }
+	UINT64 LargestFreeRange()const { return mFreeBySize.empty() ? 0 : mFreeBySize.rbegin()->first; }
+
+private:
+
+	void InsertFree(UINT64 offset, UINT64 size);
+	void EraseFree(std::map<UINT64, UINT64>::iterator range);
+
+private:
+
+	UINT64 mCapacity = 0;
+	UINT64 mFreeSize = 0;
+
+	// Free ranges: offset -> size, and size -> offset.
+	std::map<UINT64, UINT64> mFreeByOffset;
+	std::multimap<UINT64, UINT64> mFreeBySize;
+};
+
+class GeometryHeap
+{
+public:
+
+	// The buffers hold vertexCapacity vertices of vertexByteStride bytes and indexCapacity
+	// 32-bit indices.  Data waiting to be copied takes up to uploadRingByteSize bytes.
+	GeometryHeap(ID3D12Device* device, const std::string& name, UINT vertexByteStride,
+		UINT vertexCapacity, UINT indexCapacity, UINT64 uploadRingByteSize);
+	GeometryHeap(const GeometryHeap& rhs) = delete;
+	GeometryHeap& operator=(const GeometryHeap& rhs) = delete;
+
+	// Waits for the pending copies.  The frames drawing from the heap must have completed.
+	~GeometryHeap();
+
+	// The buffers; DrawArgs holds the submeshes added and not removed.
+	MeshGeometry* Geometry() { return &mGeo; }
+
+	// Allocates a submesh and its space in the upload ring, and returns where to write
+	// its vertices and its indices (relative to its first vertex) before Submit.  Returns
+	// false if the buffers or the ring are full; the ring frees up as copies complete,
+	// the buffers as removed submeshes are collected.
+	bool AddSubmesh(const std::string& name, UINT vertexCount, UINT indexCount,
+		const DirectX::BoundingBox& bounds, BYTE** vertices, std::uint32_t** indices);
+
+	// Allocates a submesh that the caller writes on the direct queue, and returns the GPU
+	// virtual addresses of its first vertex and its first index.  The buffers allow
+	// unordered access; the writes must execute in a command list of their own, ahead of
+	// the frames drawing the submesh, so the buffers decay back to COMMON in between.
+	// IsUploaded is true for it at once.  Returns false if the buffers are full.
+	bool AddGpuSubmesh(const std::string& name, UINT vertexCount, UINT indexCount,
+		const DirectX::BoundingBox& bounds, D3D12_GPU_VIRTUAL_ADDRESS* vertices, D3D12_GPU_VIRTUAL_ADDRESS* indices);
+
+	// Starts the copies of the submeshes added since the last Submit.
+	void Submit();
+
+	// Whether the copy of a submesh has completed, so the frames may draw it.  The heap
+	// buffers stay in the COMMON state: the copy queue writes them through implicit
+	// promotion to COPY_DEST, and they decay back once its copy list has completed.
+	// Buffers allow simultaneous access, so a range may be copied while the direct
+	// queue draws from the others.
+	bool IsUploaded(const std::string& name)const;
+
+	// Removes a submesh from DrawArgs.  Its ranges are reused once the frame fence has
+	// reached lastFrameFence, the fence value of the last frame that may draw it, and
+	// its copy, if any, has completed.
+	void RemoveSubmesh(const std::string& name, UINT64 lastFrameFence);
+
+	// Frees the ranges of the submeshes removed up to completedFrameFence, and the
+	// upload ring space and command allocators of the completed copies.
+	void Collect(UINT64 completedFrameFence);
+
+	UINT VertexCapacity()const { return (UINT)mVertexRanges.Capacity(); }
+	UINT IndexCapacity()const { return (UINT)mIndexRanges.Capacity(); }
+	UINT FreeVertexCount()const { return (UINT)mVertexRanges.FreeSize(); }
+	UINT FreeIndexCount()const { return (UINT)mIndexRanges.FreeSize(); }
+
+private:
+
+	struct Allocation
+	{
+		UINT64 VertexOffset = 0;
+		UINT64 VertexCount = 0;
+		UINT64 IndexOffset = 0;
+		UINT64 IndexCount = 0;
+
+		// Value of mCopyFence signaled after the copy of the submesh.
+		UINT64 CopyFence = 0;
+	};
+
+	struct RemovedAllocation
+	{
+		Allocation Ranges;
+		UINT64 FrameFence = 0;
+	};
+
+	// Copy lists submitted and not yet known to be complete, with the ring position
+	// after their data.
+	struct CopyBatch
+	{
+		UINT64 CopyFence = 0;
+		UINT64 RingEnd = 0;
+		Microsoft::WRL::ComPtr<ID3D12CommandAllocator> Allocator;
+	};
+
+	// Returns the ring offset of byteSize bytes, or InvalidOffset if the ring is full.
+	UINT64 AllocateUpload(UINT64 byteSize);
+	void BeginCopies();
+
+	// Allocates the vertex and index ranges of a submesh; false if either does not fit.
+	bool AllocateRanges(UINT vertexCount, UINT indexCount, Allocation& allocation);
+	void AddAllocation(const std::string& name, const Allocation& allocation, const DirectX::BoundingBox& bounds);
+
+	static Microsoft::WRL::ComPtr<ID3D12Resource> CreateBuffer(ID3D12Device* device, D3D12_HEAP_TYPE heapType,
+		UINT64 byteSize, D3D12_RESOURCE_STATES state, D3D12_RESOURCE_FLAGS flags = D3D12_RESOURCE_FLAG_NONE);
+
+private:
+
+	ID3D12Device* mDevice = nullptr;
+	MeshGeometry mGeo;
+
+	RangeAllocator mVertexRanges;
+	RangeAllocator mIndexRanges;
+	std::map<std::string, Allocation> mAllocations;
+	std::deque<RemovedAllocation> mRemoved;
+
+	Microsoft::WRL::ComPtr<ID3D12CommandQueue> mCopyQueue;
+	Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> mCopyList;
+	Microsoft::WRL::ComPtr<ID3D12CommandAllocator> mCopyAllocator;
+	std::vector<Microsoft::WRL::ComPtr<ID3D12CommandAllocator>> mFreeAllocators;
+	bool mCopyListOpen = false;
+
+	Microsoft::WRL::ComPtr<ID3D12Fence> mCopyFence;
+	UINT64 mCopyFenceValue = 0;
+	HANDLE mCopyEvent = nullptr;
+
+	// Upload ring: data is written at mRingHead and freed from mRingTail, in submission
+	// order.  mRingUsed tells a full ring from an empty one when the two meet.
+	Microsoft::WRL::ComPtr<ID3D12Resource> mUploadRing;
+	BYTE* mMappedRing = nullptr;
+	UINT64 mRingSize = 0;
+	UINT64 mRingHead = 0;
+	UINT64 mRingTail = 0;
+	UINT64 mRingUsed = 0;
+	std::deque<CopyBatch> mCopyBatches;
+};
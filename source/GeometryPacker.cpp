@@ -0,0 +1,616 @@
+//***************************************************************************************
+// GeometryPacker.cpp
+//***************************************************************************************
+
+#include "GeometryPacker.h"
+#include "FrameResource.h"
+#include "GeometryCache.h"
+#include "ParallelFor.h"
+
+#include <fstream>
+
+using namespace DirectX;
+using namespace DirectX::PackedVector;
+
+// Largest buffer every device can create: the views and the draw arguments are 32-bit,
+// and D3D12 only guarantees resources up to 128 MB.
+const UINT64 gMaxBufferByteSize = (UINT64)D3D12_REQ_RESOURCE_SIZE_IN_MEGABYTES_EXPRESSION_A_TERM * 1024 * 1024;
+
+void GeometryPacker::Add(const std::string& name, const GeometryGenerator::MeshData& mesh, const XMFLOAT4& color)
+{
+	Part part;
+	part.Name = name;
+	part.Mesh = &mesh;
+	part.Color = color;
+
+	mParts.push_back(part);
+}
+
+const GeometryPacker::PackedMesh* GeometryPacker::FindMesh(const std::string& name)const
+{
+	for (auto& mesh : mMeshes)
+	{
+		if (mesh.Name == name)
+			return &mesh;
+	}
+
+	return nullptr;
+}
+
+void GeometryPacker::Build(ID3D12Device* device, ID3D12GraphicsCommandList* cmdList, const std::string& name, IndexMode mode)
+{
+	GeometryGenerator geoGen;
+
+	Bucket bucket16;
+	Bucket bucket32;
+
+	mPieces.clear();
+
+	mMeshes.resize(mParts.size());
+	for (size_t i = 0; i < mParts.size(); ++i)
+	{
+		auto& part = mParts[i];
+
+		mMeshes[i].Name = part.Name;
+		mMeshes[i].SphereBounds = part.Mesh->SphereBounds;
+
+		// Split pieces keep the bounds of the whole mesh, so all of them share this decode.
+		GetPositionDecode(mVertexFormat, part.Mesh->Bounds, mMeshes[i].PosScale, mMeshes[i].PosBias);
+
+		if (mode == IndexMode::Force32 || (mode == IndexMode::Auto && !part.Mesh->FitsIndices16()))
+		{
+			bucket32.Parts.push_back(part);
+			bucket32.Owners.push_back(i);
+		}
+		else if (part.Mesh->FitsIndices16())
+		{
+			bucket16.Parts.push_back(part);
+			bucket16.Owners.push_back(i);
+		}
+		else
+		{
+			std::vector<GeometryGenerator::MeshData> pieces = geoGen.SplitMesh(*part.Mesh);
+			for (size_t j = 0; j < pieces.size(); ++j)
+			{
+				mPieces.push_back(std::move(pieces[j]));
+
+				Part piece = part;
+				piece.Name = j == 0 ? part.Name : part.Name + "#" + std::to_string(j);
+				piece.Mesh = &mPieces.back();
+				bucket16.Parts.push_back(piece);
+				bucket16.Owners.push_back(i);
+			}
+		}
+	}
+
+	if (!bucket16.Parts.empty())
+		mGeometries.push_back(BuildBuffer(device, cmdList, name, bucket16, DXGI_FORMAT_R16_UINT));
+
+	if (!bucket32.Parts.empty())
+		mGeometries.push_back(BuildBuffer(device, cmdList, name + "_32", bucket32, DXGI_FORMAT_R32_UINT));
+}
+
+std::unique_ptr<MeshGeometry> GeometryPacker::BuildBuffer(ID3D12Device* device, ID3D12GraphicsCommandList* cmdList,
+	const std::string& name, const Bucket& bucket, DXGI_FORMAT indexFormat)
+{
+	UINT indexByteStride = indexFormat == DXGI_FORMAT_R16_UINT ? sizeof(std::uint16_t) : sizeof(std::uint32_t);
+	const UINT vertexByteStride = VertexByteStride();
+
+	// The sizes are checked in 64 bits before the 32-bit offsets below are computed.
+	UINT64 totalVertices = 0;
+	UINT64 totalIndices = 0;
+	for (auto& part : bucket.Parts)
+	{
+		totalVertices += part.Mesh->VertexCount();
+		totalIndices += part.Mesh->Indices32.size();
+	}
+	if (totalVertices * vertexByteStride > gMaxBufferByteSize || totalIndices * indexByteStride > gMaxBufferByteSize)
+	{
+		std::string text = "GeometryPacker: " + name + " needs " + std::to_string(totalVertices * vertexByteStride) +
+			" vertex and " + std::to_string(totalIndices * indexByteStride) + " index bytes, over the " +
+			std::to_string(gMaxBufferByteSize) + " byte buffer limit\n";
+		::OutputDebugStringA(text.c_str());
+		ThrowIfFailed(E_OUTOFMEMORY);
+	}
+
+	auto geo = std::make_unique<MeshGeometry>();
+	geo->Name = name;
+
+	// The generated meshes already have their final sizes, so the region of every part
+	// is a prefix sum of the sizes before it and the parts can be written independently.
+	std::vector<UINT> vertexOffsets(bucket.Parts.size() + 1, 0);
+	std::vector<UINT> indexOffsets(bucket.Parts.size() + 1, 0);
+	for (size_t i = 0; i < bucket.Parts.size(); ++i)
+	{
+		auto& part = bucket.Parts[i];
+		auto& mesh = *part.Mesh;
+
+		vertexOffsets[i + 1] = vertexOffsets[i] + mesh.VertexCount();
+		indexOffsets[i + 1] = indexOffsets[i] + (UINT)mesh.Indices32.size();
+
+		// Define the region in the buffers the submesh covers.
+		SubmeshGeometry submesh;
+		submesh.IndexCount = (UINT)mesh.Indices32.size();
+		submesh.StartIndexLocation = indexOffsets[i];
+		submesh.BaseVertexLocation = (INT)vertexOffsets[i];
+		submesh.Bounds = mesh.Bounds;
+
+		geo->DrawArgs[part.Name] = submesh;
+		mMeshes[bucket.Owners[i]].Geo = geo.get();
+		mMeshes[bucket.Owners[i]].Submeshes.push_back(part.Name);
+	}
+
+	const UINT vbByteSize = (UINT)(totalVertices * vertexByteStride);
+	const UINT ibByteSize = (UINT)(totalIndices * indexByteStride);
+
+	// Upload heap memory is write-combined: write sequentially and never read it back.
+	BYTE* vertices = nullptr;
+	BYTE* indices = nullptr;
+	if (device != nullptr)
+	{
+		geo->VertexBufferUploader = CreateUploadBuffer(device, vbByteSize);
+		geo->IndexBufferUploader = CreateUploadBuffer(device, ibByteSize);
+
+		CD3DX12_RANGE readRange(0, 0);
+		ThrowIfFailed(geo->VertexBufferUploader->Map(0, &readRange, reinterpret_cast<void**>(&vertices)));
+		ThrowIfFailed(geo->IndexBufferUploader->Map(0, &readRange, reinterpret_cast<void**>(&indices)));
+	}
+
+	// The CPU copy is opt-in.  It is written from the source meshes rather than read
+	// back from the upload buffers, which are slow to read.
+	const bool keepCpuCopy = mKeepCpuCopy || device == nullptr;
+	BYTE* cpuVertices = nullptr;
+	BYTE* cpuIndices = nullptr;
+	if (keepCpuCopy)
+	{
+		ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo->VertexBufferCPU));
+		ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
+		cpuVertices = reinterpret_cast<BYTE*>(geo->VertexBufferCPU->GetBufferPointer());
+		cpuIndices = reinterpret_cast<BYTE*>(geo->IndexBufferCPU->GetBufferPointer());
+	}
+
+	// Each job extracts the vertex elements we are interested in for one part and
+	// writes them and the part's indices to its own region.
+	ParallelFor(bucket.Parts.size(), mJobCount, [&](size_t i)
+	{
+		auto& part = bucket.Parts[i];
+		auto& packed = mMeshes[bucket.Owners[i]];
+		size_t vertexOffset = (size_t)vertexOffsets[i] * vertexByteStride;
+		size_t indexOffset = (size_t)indexOffsets[i] * indexByteStride;
+
+		if (vertices != nullptr)
+			WritePart(part, packed, indexFormat, vertices + vertexOffset, indices + indexOffset);
+		if (keepCpuCopy)
+			WritePart(part, packed, indexFormat, cpuVertices + vertexOffset, cpuIndices + indexOffset);
+	});
+
+	if (device != nullptr)
+	{
+		geo->VertexBufferUploader->Unmap(0, nullptr);
+		geo->IndexBufferUploader->Unmap(0, nullptr);
+
+		geo->VertexBufferGPU = CreateDefaultBuffer(device, cmdList, geo->VertexBufferUploader.Get(), vbByteSize);
+		geo->IndexBufferGPU = CreateDefaultBuffer(device, cmdList, geo->IndexBufferUploader.Get(), ibByteSize);
+	}
+
+	geo->VertexByteStride = vertexByteStride;
+	geo->VertexBufferByteSize = vbByteSize;
+	geo->IndexFormat = indexFormat;
+	geo->IndexBufferByteSize = ibByteSize;
+
+	return geo;
+}
+
+void GeometryPacker::WritePart(const Part& part, const PackedMesh& packed, DXGI_FORMAT indexFormat,
+	BYTE* vertices, BYTE* indices)const
+{
+	WriteVertices(mVertexFormat, *part.Mesh, part.Color, packed.PosScale, packed.PosBias, vertices);
+
+	auto& meshIndices = part.Mesh->Indices32;
+	if (indexFormat == DXGI_FORMAT_R16_UINT)
+	{
+		assert(part.Mesh->FitsIndices16());
+		std::uint16_t* indices16 = reinterpret_cast<std::uint16_t*>(indices);
+		for (size_t j = 0; j < meshIndices.size(); ++j)
+			indices16[j] = static_cast<std::uint16_t>(meshIndices[j]);
+	}
+	else
+	{
+		std::copy(meshIndices.begin(), meshIndices.end(), reinterpret_cast<std::uint32_t*>(indices));
+	}
+}
+
+UINT GeometryPacker::VertexByteStride()const
+{
+	return VertexByteStride(mVertexFormat);
+}
+
+UINT GeometryPacker::VertexByteStride(VertexFormat format)
+{
+	return format == VertexFormat::Compact ? sizeof(CompactVertex) : sizeof(Vertex);
+}
+
+void GeometryPacker::GetPositionDecode(VertexFormat format, const BoundingBox& bounds,
+	XMFLOAT3& posScale, XMFLOAT3& posBias)
+{
+	posScale = XMFLOAT3(1.0f, 1.0f, 1.0f);
+	posBias = XMFLOAT3(0.0f, 0.0f, 0.0f);
+	if (format != VertexFormat::Compact)
+		return;
+
+	// Quantize to the mesh bounds.  Flat axes keep a unit scale.
+	posBias = bounds.Center;
+	posScale.x = bounds.Extents.x > 0.0f ? bounds.Extents.x : 1.0f;
+	posScale.y = bounds.Extents.y > 0.0f ? bounds.Extents.y : 1.0f;
+	posScale.z = bounds.Extents.z > 0.0f ? bounds.Extents.z : 1.0f;
+}
+
+void GeometryPacker::WriteVertices(VertexFormat format, const GeometryGenerator::MeshData& mesh,
+	const XMFLOAT4& color, const XMFLOAT3& posScale, const XMFLOAT3& posBias, BYTE* dest)
+{
+	// Only the positions are read, so position-only meshes are packed the same way.
+	UINT vertexCount = mesh.VertexCount();
+
+	if (format == VertexFormat::Full)
+	{
+		Vertex* vertices = reinterpret_cast<Vertex*>(dest);
+		for (UINT j = 0; j < vertexCount; ++j)
+		{
+			vertices[j].Pos = mesh.GetPosition(j);
+			vertices[j].Color = color;
+		}
+		return;
+	}
+
+	// Inverse of the decode done by the vertex shaders.
+	XMVECTOR invScale = XMVectorReciprocal(XMLoadFloat3(&posScale));
+	XMVECTOR bias = XMLoadFloat3(&posBias);
+
+	XMUBYTEN4 compactColor;
+	XMStoreUByteN4(&compactColor, XMLoadFloat4(&color));
+
+	CompactVertex* vertices = reinterpret_cast<CompactVertex*>(dest);
+	for (UINT j = 0; j < vertexCount; ++j)
+	{
+		XMVECTOR p = XMVectorMultiply(XMVectorSubtract(XMLoadFloat3(&mesh.GetPosition(j)), bias), invScale);
+
+		// XMStoreShortN4 clamps to [-1, 1]; w is unused.
+		CompactVertex vertex;
+		XMStoreShortN4(&vertex.Pos, XMVectorSetW(p, 0.0f));
+		vertex.Color = compactColor;
+		vertices[j] = vertex;
+	}
+}
+
+Microsoft::WRL::ComPtr<ID3D12Resource> GeometryPacker::CreateUploadBuffer(ID3D12Device* device, UINT64 byteSize)
+{
+	Microsoft::WRL::ComPtr<ID3D12Resource> uploadBuffer;
+
+	// Zero-sized buffers are not allowed.
+	ThrowIfFailed(device->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(std::max<UINT64>(byteSize, 1)),
+		D3D12_RESOURCE_STATE_GENERIC_READ,
+		nullptr,
+		IID_PPV_ARGS(uploadBuffer.GetAddressOf())));
+
+	return uploadBuffer;
+}
+
+Microsoft::WRL::ComPtr<ID3D12Resource> GeometryPacker::CreateDefaultBuffer(ID3D12Device* device,
+	ID3D12GraphicsCommandList* cmdList, ID3D12Resource* uploadBuffer, UINT64 byteSize)
+{
+	Microsoft::WRL::ComPtr<ID3D12Resource> defaultBuffer;
+
+	ThrowIfFailed(device->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(std::max<UINT64>(byteSize, 1)),
+		D3D12_RESOURCE_STATE_COPY_DEST,
+		nullptr,
+		IID_PPV_ARGS(defaultBuffer.GetAddressOf())));
+
+	// Same final state as d3dUtil::CreateDefaultBuffer.  The upload buffer must be kept
+	// alive until the copy has executed.
+	cmdList->CopyBufferRegion(defaultBuffer.Get(), 0, uploadBuffer, 0, byteSize);
+	cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(defaultBuffer.Get(),
+		D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_GENERIC_READ));
+
+	return defaultBuffer;
+}
+
+namespace
+{
+	bool CopyName(const std::string& name, char (&dest)[GeometryCacheNameSize])
+	{
+		if (name.size() >= GeometryCacheNameSize)
+			return false;
+
+		std::copy(name.begin(), name.end(), dest);
+		dest[name.size()] = '\0';
+		return true;
+	}
+
+	bool ReadName(const char (&src)[GeometryCacheNameSize], std::string& name)
+	{
+		const char* end = std::find(src, src + GeometryCacheNameSize, '\0');
+		if (end == src + GeometryCacheNameSize)
+			return false;
+
+		name.assign(src, end);
+		return true;
+	}
+
+	std::uint64_t AlignData(std::uint64_t offset)
+	{
+		return (offset + 15) & ~15ull;
+	}
+
+	bool InFile(std::uint64_t offset, std::uint64_t byteSize, std::uint64_t fileSize)
+	{
+		return offset <= fileSize && byteSize <= fileSize - offset;
+	}
+}
+
+bool GeometryPacker::LoadCache(ID3D12Device* device, ID3D12GraphicsCommandList* cmdList,
+	const std::wstring& path, std::uint64_t key)
+{
+	mGeometries.clear();
+	mMeshes.clear();
+
+	MappedFile file;
+	if (!file.Open(path) || file.Size() < sizeof(GeometryCacheHeader))
+		return false;
+
+	const BYTE* data = file.Data();
+	const auto& header = *reinterpret_cast<const GeometryCacheHeader*>(data);
+	if (header.Magic != GeometryCacheMagic || header.Version != GeometryCacheVersion ||
+		header.Key != key || header.FileSize != file.Size())
+		return false;
+
+	std::uint64_t tableBytes = sizeof(GeometryCacheHeader) +
+		(std::uint64_t)header.GeometryCount * sizeof(GeometryCacheGeometry) +
+		(std::uint64_t)header.SubmeshCount * sizeof(GeometryCacheSubmesh) +
+		(std::uint64_t)header.MeshCount * sizeof(GeometryCacheMesh) +
+		(std::uint64_t)header.MeshSubmeshCount * sizeof(std::uint32_t);
+	if (tableBytes > file.Size())
+		return false;
+
+	auto geometries = reinterpret_cast<const GeometryCacheGeometry*>(data + sizeof(GeometryCacheHeader));
+	auto submeshes = reinterpret_cast<const GeometryCacheSubmesh*>(geometries + header.GeometryCount);
+	auto meshes = reinterpret_cast<const GeometryCacheMesh*>(submeshes + header.SubmeshCount);
+	auto submeshRefs = reinterpret_cast<const std::uint32_t*>(meshes + header.MeshCount);
+
+	// Validate every record before creating anything, so a bad file never leaves
+	// upload commands for released resources on cmdList.
+	std::vector<std::string> submeshNames(header.SubmeshCount);
+	for (UINT i = 0; i < header.SubmeshCount; ++i)
+	{
+		if (!ReadName(submeshes[i].Name, submeshNames[i]))
+			return false;
+	}
+
+	std::vector<std::string> geometryNames(header.GeometryCount);
+	for (UINT i = 0; i < header.GeometryCount; ++i)
+	{
+		auto& record = geometries[i];
+		if (!ReadName(record.Name, geometryNames[i]) ||
+			!InFile(record.VertexDataOffset, record.VertexBufferByteSize, file.Size()) ||
+			!InFile(record.IndexDataOffset, record.IndexBufferByteSize, file.Size()) ||
+			record.FirstSubmesh > header.SubmeshCount || record.SubmeshCount > header.SubmeshCount - record.FirstSubmesh ||
+			(record.IndexFormat != DXGI_FORMAT_R16_UINT && record.IndexFormat != DXGI_FORMAT_R32_UINT) ||
+			record.VertexByteStride == 0)
+			return false;
+
+		// Every draw of the geometry stays inside its buffers.
+		std::uint64_t vertexCount = record.VertexBufferByteSize / record.VertexByteStride;
+		std::uint64_t indexCount = record.IndexBufferByteSize / (record.IndexFormat == DXGI_FORMAT_R16_UINT ? 2 : 4);
+		for (UINT j = record.FirstSubmesh; j < record.FirstSubmesh + record.SubmeshCount; ++j)
+		{
+			auto& submesh = submeshes[j];
+			if ((std::uint64_t)submesh.StartIndexLocation + submesh.IndexCount > indexCount ||
+				submesh.BaseVertexLocation < 0 || (std::uint64_t)submesh.BaseVertexLocation >= vertexCount)
+				return false;
+		}
+	}
+
+	std::vector<std::string> meshNames(header.MeshCount);
+	for (UINT i = 0; i < header.MeshCount; ++i)
+	{
+		auto& record = meshes[i];
+		if (!ReadName(record.Name, meshNames[i]) || record.GeometryIndex >= header.GeometryCount ||
+			record.FirstSubmeshRef > header.MeshSubmeshCount ||
+			record.SubmeshRefCount > header.MeshSubmeshCount - record.FirstSubmeshRef)
+			return false;
+
+		// A mesh only references submeshes of its own geometry.
+		auto& geoRecord = geometries[record.GeometryIndex];
+		for (UINT j = 0; j < record.SubmeshRefCount; ++j)
+		{
+			std::uint32_t ref = submeshRefs[record.FirstSubmeshRef + j];
+			if (ref < geoRecord.FirstSubmesh || ref >= geoRecord.FirstSubmesh + geoRecord.SubmeshCount)
+				return false;
+		}
+	}
+
+	// The buffer data goes from the mapped file into the upload buffers in one copy.
+	for (UINT i = 0; i < header.GeometryCount; ++i)
+	{
+		auto& record = geometries[i];
+
+		auto geo = std::make_unique<MeshGeometry>();
+		geo->Name = geometryNames[i];
+
+		for (UINT j = record.FirstSubmesh; j < record.FirstSubmesh + record.SubmeshCount; ++j)
+		{
+			SubmeshGeometry submesh;
+			submesh.IndexCount = submeshes[j].IndexCount;
+			submesh.StartIndexLocation = submeshes[j].StartIndexLocation;
+			submesh.BaseVertexLocation = submeshes[j].BaseVertexLocation;
+			submesh.Bounds = submeshes[j].Bounds;
+			geo->DrawArgs[submeshNames[j]] = submesh;
+		}
+
+		geo->VertexBufferUploader = CreateUploadBuffer(device, record.VertexBufferByteSize);
+		geo->IndexBufferUploader = CreateUploadBuffer(device, record.IndexBufferByteSize);
+
+		BYTE* mapped = nullptr;
+		CD3DX12_RANGE readRange(0, 0);
+		ThrowIfFailed(geo->VertexBufferUploader->Map(0, &readRange, reinterpret_cast<void**>(&mapped)));
+		CopyMemory(mapped, data + record.VertexDataOffset, record.VertexBufferByteSize);
+		geo->VertexBufferUploader->Unmap(0, nullptr);
+
+		ThrowIfFailed(geo->IndexBufferUploader->Map(0, &readRange, reinterpret_cast<void**>(&mapped)));
+		CopyMemory(mapped, data + record.IndexDataOffset, record.IndexBufferByteSize);
+		geo->IndexBufferUploader->Unmap(0, nullptr);
+
+		geo->VertexBufferGPU = CreateDefaultBuffer(device, cmdList, geo->VertexBufferUploader.Get(), record.VertexBufferByteSize);
+		geo->IndexBufferGPU = CreateDefaultBuffer(device, cmdList, geo->IndexBufferUploader.Get(), record.IndexBufferByteSize);
+
+		geo->VertexByteStride = record.VertexByteStride;
+		geo->VertexBufferByteSize = record.VertexBufferByteSize;
+		geo->IndexFormat = (DXGI_FORMAT)record.IndexFormat;
+		geo->IndexBufferByteSize = record.IndexBufferByteSize;
+
+		mGeometries.push_back(std::move(geo));
+	}
+
+	mMeshes.resize(header.MeshCount);
+	for (UINT i = 0; i < header.MeshCount; ++i)
+	{
+		auto& record = meshes[i];
+		auto& mesh = mMeshes[i];
+
+		mesh.Name = meshNames[i];
+		mesh.Geo = mGeometries[record.GeometryIndex].get();
+		mesh.SphereBounds = record.SphereBounds;
+		mesh.PosScale = record.PosScale;
+		mesh.PosBias = record.PosBias;
+
+		for (UINT j = 0; j < record.SubmeshRefCount; ++j)
+			mesh.Submeshes.push_back(submeshNames[submeshRefs[record.FirstSubmeshRef + j]]);
+	}
+
+	return true;
+}
+
+bool GeometryPacker::SaveCache(const std::wstring& path, std::uint64_t key)const
+{
+	GeometryCacheHeader header;
+	header.Key = key;
+
+	std::vector<GeometryCacheGeometry> geometries(mGeometries.size());
+	std::vector<GeometryCacheSubmesh> submeshes;
+	std::vector<GeometryCacheMesh> meshes(mMeshes.size());
+	std::vector<std::uint32_t> submeshRefs;
+
+	// Index of every submesh record, per geometry.
+	std::vector<std::unordered_map<std::string, std::uint32_t>> submeshIndex(mGeometries.size());
+
+	for (size_t i = 0; i < mGeometries.size(); ++i)
+	{
+		auto& geo = *mGeometries[i];
+		if (geo.VertexBufferCPU == nullptr || geo.IndexBufferCPU == nullptr || !CopyName(geo.Name, geometries[i].Name))
+			return false;
+
+		geometries[i].VertexByteStride = geo.VertexByteStride;
+		geometries[i].VertexBufferByteSize = geo.VertexBufferByteSize;
+		geometries[i].IndexFormat = geo.IndexFormat;
+		geometries[i].IndexBufferByteSize = geo.IndexBufferByteSize;
+		geometries[i].FirstSubmesh = (std::uint32_t)submeshes.size();
+		geometries[i].SubmeshCount = (std::uint32_t)geo.DrawArgs.size();
+
+		for (auto& drawArgs : geo.DrawArgs)
+		{
+			GeometryCacheSubmesh record;
+			if (!CopyName(drawArgs.first, record.Name))
+				return false;
+
+			record.IndexCount = drawArgs.second.IndexCount;
+			record.StartIndexLocation = drawArgs.second.StartIndexLocation;
+			record.BaseVertexLocation = drawArgs.second.BaseVertexLocation;
+			record.Bounds = drawArgs.second.Bounds;
+
+			submeshIndex[i][drawArgs.first] = (std::uint32_t)submeshes.size();
+			submeshes.push_back(record);
+		}
+	}
+
+	for (size_t i = 0; i < mMeshes.size(); ++i)
+	{
+		auto& mesh = mMeshes[i];
+		auto geoIt = std::find_if(mGeometries.begin(), mGeometries.end(),
+			[&](const std::unique_ptr<MeshGeometry>& geo) { return geo.get() == mesh.Geo; });
+		if (geoIt == mGeometries.end() || !CopyName(mesh.Name, meshes[i].Name))
+			return false;
+
+		meshes[i].GeometryIndex = (std::uint32_t)(geoIt - mGeometries.begin());
+		meshes[i].FirstSubmeshRef = (std::uint32_t)submeshRefs.size();
+		meshes[i].SubmeshRefCount = (std::uint32_t)mesh.Submeshes.size();
+		meshes[i].SphereBounds = mesh.SphereBounds;
+		meshes[i].PosScale = mesh.PosScale;
+		meshes[i].PosBias = mesh.PosBias;
+
+		for (auto& submeshName : mesh.Submeshes)
+			submeshRefs.push_back(submeshIndex[meshes[i].GeometryIndex].at(submeshName));
+	}
+
+	header.GeometryCount = (std::uint32_t)geometries.size();
+	header.SubmeshCount = (std::uint32_t)submeshes.size();
+	header.MeshCount = (std::uint32_t)meshes.size();
+	header.MeshSubmeshCount = (std::uint32_t)submeshRefs.size();
+
+	// Place the buffer data after the tables.
+	std::uint64_t offset = sizeof(GeometryCacheHeader) +
+		geometries.size() * sizeof(GeometryCacheGeometry) +
+		submeshes.size() * sizeof(GeometryCacheSubmesh) +
+		meshes.size() * sizeof(GeometryCacheMesh) +
+		submeshRefs.size() * sizeof(std::uint32_t);
+	for (auto& record : geometries)
+	{
+		record.VertexDataOffset = offset = AlignData(offset);
+		offset += record.VertexBufferByteSize;
+		record.IndexDataOffset = offset = AlignData(offset);
+		offset += record.IndexBufferByteSize;
+	}
+	header.FileSize = offset;
+
+	// Write to a temporary file and move it into place, so a partly written cache is
+	// never picked up.
+	std::wstring tempPath = path + L".tmp";
+	{
+		std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+		if (!out)
+			return false;
+
+		auto write = [&](const void* bytes, std::uint64_t byteSize)
+		{
+			out.write(static_cast<const char*>(bytes), (std::streamsize)byteSize);
+		};
+		auto pad = [&](std::uint64_t toOffset)
+		{
+			static const char zeros[16] = {};
+			write(zeros, toOffset - (std::uint64_t)out.tellp());
+		};
+
+		write(&header, sizeof(header));
+		write(geometries.data(), geometries.size() * sizeof(GeometryCacheGeometry));
+		write(submeshes.data(), submeshes.size() * sizeof(GeometryCacheSubmesh));
+		write(meshes.data(), meshes.size() * sizeof(GeometryCacheMesh));
+		write(submeshRefs.data(), submeshRefs.size() * sizeof(std::uint32_t));
+
+		for (size_t i = 0; i < mGeometries.size(); ++i)
+		{
+			pad(geometries[i].VertexDataOffset);
+			write(mGeometries[i]->VertexBufferCPU->GetBufferPointer(), geometries[i].VertexBufferByteSize);
+			pad(geometries[i].IndexDataOffset);
+			write(mGeometries[i]->IndexBufferCPU->GetBufferPointer(), geometries[i].IndexBufferByteSize);
+		}
+
+		if (!out)
+			return false;
+	}
+
+	return MoveFileExW(tempPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+}
@@ -0,0 +1,141 @@
+//***************************************************************************************
+// GeometryPacker.h
+//
+// Packs generated meshes into shared vertex/index buffers.  The index format is picked
+// per buffer: meshes that fit 16-bit indices share an R16 buffer (indices are relative
+// to each submesh's BaseVertexLocation), larger meshes go to an R32 buffer or are split
+// into 16-bit pieces, so no index is ever silently truncated.  Vertices and indices are
+// written straight into mapped upload buffers; a CPU copy is only kept on request.
+// In the compact vertex format positions are quantized to SNORM16 relative to the
+// bounds of each mesh, which the vertex shaders decode with PackedMesh::PosScale/PosBias.
+//***************************************************************************************
+
+#pragma once
+
+#include "../../Common/d3dUtil.h"
+#include "GeometryGenerator.h"
+
+#include <cstdint>
+
+#include <deque>
+
+class GeometryPacker
+{
+public:
+
+	enum class IndexMode
+	{
+		// R16 for meshes that fit, R32 for the others.
+		Auto,
+		// Everything in one R32 buffer.
+		Force32,
+		// R16 only; meshes that do not fit are split into pieces.
+		Split16
+	};
+
+	enum class VertexFormat
+	{
+		// Vertex: float3 position, float4 color.
+		Full,
+		// CompactVertex: SNORM16 position, RGBA8 color.
+		Compact
+	};
+
+	// Where a mesh ended up.  A split mesh has one submesh per piece.
+	struct PackedMesh
+	{
+		std::string Name;
+		MeshGeometry* Geo = nullptr;
+		std::vector<std::string> Submeshes;
+		DirectX::BoundingSphere SphereBounds;
+
+		// Position decode of the mesh's vertices: PosL = stored * PosScale + PosBias.
+		DirectX::XMFLOAT3 PosScale = { 1.0f, 1.0f, 1.0f };
+		DirectX::XMFLOAT3 PosBias = { 0.0f, 0.0f, 0.0f };
+	};
+
+	// The mesh is referenced, not copied; it must outlive Build.
+	void Add(const std::string& name, const GeometryGenerator::MeshData& mesh, const DirectX::XMFLOAT4& color);
+
+	// Also keep the packed vertices and indices in VertexBufferCPU/IndexBufferCPU.
+	// Off by default.
+	void SetKeepCpuCopy(bool keep) { mKeepCpuCopy = keep; }
+
+	void SetVertexFormat(VertexFormat format) { mVertexFormat = format; }
+	UINT VertexByteStride()const;
+	static UINT VertexByteStride(VertexFormat format);
+
+	// Position decode of a mesh with these bounds: unit for the full format, the bounds
+	// box for the compact one.
+	static void GetPositionDecode(VertexFormat format, const DirectX::BoundingBox& bounds,
+		DirectX::XMFLOAT3& posScale, DirectX::XMFLOAT3& posBias);
+
+	// Writes the vertices of a mesh in a vertex format, for buffers filled outside the
+	// packer.  Only the positions are read.
+	static void WriteVertices(VertexFormat format, const GeometryGenerator::MeshData& mesh,
+		const DirectX::XMFLOAT4& color, const DirectX::XMFLOAT3& posScale, const DirectX::XMFLOAT3& posBias, BYTE* dest);
+
+	// Threads used to write the parts of a buffer; each part is written by one job.
+	void SetJobCount(unsigned jobCount) { mJobCount = jobCount; }
+
+	// Creates the buffers and records the upload commands on cmdList.  The upload
+	// buffers are kept in the MeshGeometry until the caller disposes of them.  The 16-bit buffer
+	// is named name, the 32-bit one name + "_32".  With a null device (and command list)
+	// nothing is created on the GPU and the packed data is only written to the CPU copies.
+	// Throws a DxException (E_OUTOFMEMORY) if a buffer would exceed the 128 MB that every
+	// device supports.
+	void Build(ID3D12Device* device, ID3D12GraphicsCommandList* cmdList, const std::string& name, IndexMode mode);
+
+	// Replaces the packed geometry with the contents of a cache file written by SaveCache
+	// and records the upload commands on cmdList.  Returns false, leaving the packer
+	// empty, if the file is missing, has another version or key, or is malformed (which
+	// includes a submesh reaching past the buffers of its geometry).
+	bool LoadCache(ID3D12Device* device, ID3D12GraphicsCommandList* cmdList,
+		const std::wstring& path, std::uint64_t key);
+
+	// Writes the packed geometry to a cache file.  Needs the CPU copies, so the packer
+	// must have been built with SetKeepCpuCopy(true).
+	bool SaveCache(const std::wstring& path, std::uint64_t key)const;
+
+	std::vector<std::unique_ptr<MeshGeometry>>& Geometries() { return mGeometries; }
+	const std::vector<PackedMesh>& Meshes()const { return mMeshes; }
+
+	// Returns nullptr if no mesh with that name was added.
+	const PackedMesh* FindMesh(const std::string& name)const;
+
+private:
+
+	struct Part
+	{
+		std::string Name;
+		const GeometryGenerator::MeshData* Mesh = nullptr;
+		DirectX::XMFLOAT4 Color;
+	};
+
+	// Parts packed into one buffer; PackedMesh index of each part.
+	struct Bucket
+	{
+		std::vector<Part> Parts;
+		std::vector<size_t> Owners;
+	};
+
+	std::unique_ptr<MeshGeometry> BuildBuffer(ID3D12Device* device, ID3D12GraphicsCommandList* cmdList,
+		const std::string& name, const Bucket& bucket, DXGI_FORMAT indexFormat);
+	// Writes the vertices and indices of a part at the start of its regions.
+	void WritePart(const Part& part, const PackedMesh& packed, DXGI_FORMAT indexFormat,
+		BYTE* vertices, BYTE* indices)const;
+
+	static Microsoft::WRL::ComPtr<ID3D12Resource> CreateUploadBuffer(ID3D12Device* device, UINT64 byteSize);
+	// Creates a default heap buffer and records the copy from uploadBuffer into it.
+	static Microsoft::WRL::ComPtr<ID3D12Resource> CreateDefaultBuffer(ID3D12Device* device,
+		ID3D12GraphicsCommandList* cmdList, ID3D12Resource* uploadBuffer, UINT64 byteSize);
+
+	std::vector<Part> mParts;
+	// Pieces of split meshes; a deque so the parts referencing them stay valid.
+	std::deque<GeometryGenerator::MeshData> mPieces;
+	std::vector<std::unique_ptr<MeshGeometry>> mGeometries;
+	std::vector<PackedMesh> mMeshes;
+	bool mKeepCpuCopy = false;
+	VertexFormat mVertexFormat = VertexFormat::Full;
+	unsigned mJobCount = 1;
+};
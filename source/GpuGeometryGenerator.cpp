@@ -0,0 +1,157 @@
+//***************************************************************************************
+// GpuGeometryGenerator.cpp
+//***************************************************************************************
+
+#include "GpuGeometryGenerator.h"
+#include "ParallelFor.h"
+
+using Microsoft::WRL::ComPtr;
+using namespace DirectX;
+
+GpuGeometryGenerator::GpuGeometryGenerator(ID3D12Device* device, PipelineCache& pipelineCache)
+{
+	CD3DX12_ROOT_PARAMETER slotRootParameter[3];
+
+	// Shape constants, then the vertex and index buffers as raw root UAVs.
+	slotRootParameter[0].InitAsConstants(sizeof(GenerateConstants) / sizeof(UINT), 0);
+	slotRootParameter[1].InitAsUnorderedAccessView(0);
+	slotRootParameter[2].InitAsUnorderedAccessView(1);
+
+	CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(3, slotRootParameter, 0, nullptr,
+		D3D12_ROOT_SIGNATURE_FLAG_NONE);
+
+	ComPtr<ID3DBlob> serializedRootSig = nullptr;
+	ComPtr<ID3DBlob> errorBlob = nullptr;
+	HRESULT hr = D3D12SerializeRootSignature(&rootSigDesc, D3D_ROOT_SIGNATURE_VERSION_1,
+		serializedRootSig.GetAddressOf(), errorBlob.GetAddressOf());
+
+	if (errorBlob != nullptr)
+	{
+		::OutputDebugStringA((char*)errorBlob->GetBufferPointer());
+	}
+	ThrowIfFailed(hr);
+
+	ThrowIfFailed(device->CreateRootSignature(
+		0,
+		serializedRootSig->GetBufferPointer(),
+		serializedRootSig->GetBufferSize(),
+		IID_PPV_ARGS(mRootSignature.GetAddressOf())));
+
+	std::unordered_map<std::string, ComPtr<ID3DBlob>> shaders;
+	pipelineCache.LoadShaders(
+	{
+		{ "gridCS", L"Shaders\\GenerateCS.hlsl", "GridCS", "cs_5_1" },
+		{ "sphereCS", L"Shaders\\GenerateCS.hlsl", "SphereCS", "cs_5_1" },
+		{ "cylinderCS", L"Shaders\\GenerateCS.hlsl", "CylinderCS", "cs_5_1" },
+	}, DefaultJobCount(), shaders);
+
+	auto createPSO = [&](const char* shader, ComPtr<ID3D12PipelineState>& pso)
+	{
+		D3D12_COMPUTE_PIPELINE_STATE_DESC psoDesc = {};
+		psoDesc.pRootSignature = mRootSignature.Get();
+		psoDesc.CS =
+		{
+		 reinterpret_cast<BYTE*>(shaders[shader]->GetBufferPointer()),
+		 shaders[shader]->GetBufferSize()
+		};
+		ThrowIfFailed(device->CreateComputePipelineState(&psoDesc, IID_PPV_ARGS(pso.GetAddressOf())));
+	};
+	createPSO("gridCS", mGridPSO);
+	createPSO("sphereCS", mSpherePSO);
+	createPSO("cylinderCS", mCylinderPSO);
+}
+
+GpuGeometryGenerator::Layout GpuGeometryGenerator::PackerLayout(GeometryPacker::VertexFormat format)
+{
+	return format == GeometryPacker::VertexFormat::Compact ? Layout::Compact : Layout::Full;
+}
+
+UINT GpuGeometryGenerator::VertexByteStride(Layout layout, uint32 attributes)
+{
+	if (layout == Layout::Full)
+		return GeometryPacker::VertexByteStride(GeometryPacker::VertexFormat::Full);
+	if (layout == Layout::Compact)
+		return GeometryPacker::VertexByteStride(GeometryPacker::VertexFormat::Compact);
+
+	bool positionsOnly = (attributes | GeometryGenerator::AttributePosition) == GeometryGenerator::AttributePosition;
+	return positionsOnly ? sizeof(XMFLOAT3) : sizeof(GeometryGenerator::Vertex);
+}
+
+// The steps below are computed exactly as the CPU generator computes them, since the
+// shader only multiplies and adds them.
+
+GeometryGenerator::MeshSize GpuGeometryGenerator::Grid(ID3D12GraphicsCommandList* cmdList, const Target& target,
+	float width, float depth, uint32 m, uint32 n, uint32 attributes)
+{
+	GenerateConstants constants;
+	constants.Params[0] = 0.5f*width;
+	constants.Params[1] = 0.5f*depth;
+	constants.Params[2] = width / (n-1);
+	constants.Params[3] = depth / (m-1);
+	constants.Params[4] = 1.0f / (n-1);
+	constants.Params[5] = 1.0f / (m-1);
+	constants.Counts[0] = m;
+	constants.Counts[1] = n;
+
+	return Dispatch(cmdList, mGridPSO.Get(), target, constants, GeometryGenerator::GridSize(m, n), attributes);
+}
+
+GeometryGenerator::MeshSize GpuGeometryGenerator::Sphere(ID3D12GraphicsCommandList* cmdList, const Target& target,
+	float radius, uint32 sliceCount, uint32 stackCount, uint32 attributes)
+{
+	GenerateConstants constants;
+	constants.Params[0] = radius;
+	constants.Params[1] = XM_PI/stackCount;
+	constants.Params[2] = 2.0f*XM_PI/sliceCount;
+	constants.Counts[0] = sliceCount;
+	constants.Counts[1] = stackCount;
+
+	return Dispatch(cmdList, mSpherePSO.Get(), target, constants, GeometryGenerator::SphereSize(sliceCount, stackCount), attributes);
+}
+
+GeometryGenerator::MeshSize GpuGeometryGenerator::Cylinder(ID3D12GraphicsCommandList* cmdList, const Target& target,
+	float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount, uint32 attributes)
+{
+	GenerateConstants constants;
+	constants.Params[0] = bottomRadius;
+	constants.Params[1] = topRadius;
+	constants.Params[2] = height;
+	constants.Params[3] = height / stackCount;
+	constants.Params[4] = (topRadius - bottomRadius) / stackCount;
+	constants.Params[5] = 2.0f*XM_PI/sliceCount;
+	constants.Counts[0] = sliceCount;
+	constants.Counts[1] = stackCount;
+
+	return Dispatch(cmdList, mCylinderPSO.Get(), target, constants, GeometryGenerator::CylinderSize(sliceCount, stackCount), attributes);
+}
+
+GeometryGenerator::MeshSize GpuGeometryGenerator::Dispatch(ID3D12GraphicsCommandList* cmdList, ID3D12PipelineState* pso,
+	const Target& target, GenerateConstants& constants, const GeometryGenerator::MeshSize& size, uint32 attributes)
+{
+	// The position is always generated, as by AllocateMesh.
+	constants.VertexCount = size.VertexCount;
+	constants.TriangleCount = size.IndexCount / 3;
+	constants.Attributes = attributes | GeometryGenerator::AttributePosition;
+
+	// The packer layouts encode like GeometryPacker::WriteVertices; the RGBA8 color is
+	// packed here with the same rounding.
+	constants.VertexLayout = (uint32)target.VertexLayout;
+	XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(constants.Color), XMLoadFloat4(&target.Color));
+	XMStoreFloat3(reinterpret_cast<XMFLOAT3*>(constants.PosInvScale), XMVectorReciprocal(XMLoadFloat3(&target.PosScale)));
+	XMStoreFloat3(reinterpret_cast<XMFLOAT3*>(constants.PosBias), XMLoadFloat3(&target.PosBias));
+	PackedVector::XMUBYTEN4 packedColor;
+	PackedVector::XMStoreUByteN4(&packedColor, XMLoadFloat4(&target.Color));
+	constants.PackedColor = packedColor.v;
+
+	cmdList->SetPipelineState(pso);
+	cmdList->SetComputeRootSignature(mRootSignature.Get());
+	cmdList->SetComputeRoot32BitConstants(0, sizeof(GenerateConstants) / sizeof(UINT), &constants, 0);
+	cmdList->SetComputeRootUnorderedAccessView(1, target.Vertices);
+	cmdList->SetComputeRootUnorderedAccessView(2, target.Indices);
+
+	// One thread per vertex and per triangle.
+	UINT threadCount = std::max(constants.VertexCount, constants.TriangleCount);
+	cmdList->Dispatch((threadCount + 63) / 64, 1, 1);
+
+	return size;
+}
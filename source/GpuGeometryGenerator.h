@@ -0,0 +1,104 @@
+//***************************************************************************************
+// GpuGeometryGenerator.h
+//
+// Records compute dispatches that generate grids, spheres and cylinders straight into
+// GPU buffers (Shaders\GenerateCS.hlsl), so a mesh can be regrown or retessellated at
+// runtime without touching the CPU copy.  The parameters are those of GeometryGenerator
+// and the 32-bit indices are those of MeshData::Indices32, in the same order.  Vertices
+// are written in the generator's layouts (MeshData::Vertices, or ::Positions for a
+// position-only mask) or in the app's drawable Vertex and CompactVertex layouts, as
+// GeometryPacker::WriteVertices writes them.  Indices and grid vertices are bit-identical
+// to the CPU generator; sphere and cylinder vertices go through the GPU's sin/cos and
+// differ by a few ulps.
+//***************************************************************************************
+
+#pragma once
+
+#include "../../Common/d3dUtil.h"
+#include "GeometryGenerator.h"
+#include "GeometryPacker.h"
+#include "PipelineCache.h"
+
+class GpuGeometryGenerator
+{
+public:
+
+	typedef GeometryGenerator::uint32 uint32;
+
+	// Vertex layouts: the generator's, selected by the attribute mask, or one of the
+	// GeometryPacker formats, which only use the position.
+	enum class Layout
+	{
+		Generator,
+		Full,
+		Compact
+	};
+
+	// Where a mesh is written; the GPU virtual addresses of its first vertex and its first
+	// index.  Both buffers must allow unordered access, be in the UNORDERED_ACCESS state
+	// and have room for the GeometryGenerator::*Size of the mesh, in bytes of
+	// VertexByteStride per vertex and 4 per index.  The indices are relative to the first
+	// vertex.  The packer layouts take the color and the position decode of
+	// GeometryPacker::WriteVertices.
+	struct Target
+	{
+		D3D12_GPU_VIRTUAL_ADDRESS Vertices = 0;
+		D3D12_GPU_VIRTUAL_ADDRESS Indices = 0;
+
+		Layout VertexLayout = Layout::Generator;
+		DirectX::XMFLOAT4 Color = { 0.0f, 0.0f, 0.0f, 1.0f };
+		DirectX::XMFLOAT3 PosScale = { 1.0f, 1.0f, 1.0f };
+		DirectX::XMFLOAT3 PosBias = { 0.0f, 0.0f, 0.0f };
+	};
+
+	// The target layout of a packer format.
+	static Layout PackerLayout(GeometryPacker::VertexFormat format);
+
+	// Loads the shaders through the pipeline cache and creates the root signature and
+	// the PSOs.
+	GpuGeometryGenerator(ID3D12Device* device, PipelineCache& pipelineCache);
+	GpuGeometryGenerator(const GpuGeometryGenerator& rhs) = delete;
+	GpuGeometryGenerator& operator=(const GpuGeometryGenerator& rhs) = delete;
+
+	// Size of one generated vertex.  Generator layout: sizeof(GeometryGenerator::Vertex), or
+	// sizeof(XMFLOAT3) for a position-only mask; packer layouts: GeometryPacker::VertexByteStride.
+	static UINT VertexByteStride(Layout layout, uint32 attributes = GeometryGenerator::AttributeAll);
+
+	// Record the generation of a mesh on cmdList, which is left with this generator's
+	// compute root signature and PSO bound.  The caller places a UAV barrier (or a
+	// transition) before the buffers are read.  Return the sizes of the mesh.
+	GeometryGenerator::MeshSize Grid(ID3D12GraphicsCommandList* cmdList, const Target& target,
+		float width, float depth, uint32 m, uint32 n, uint32 attributes = GeometryGenerator::AttributeAll);
+	GeometryGenerator::MeshSize Sphere(ID3D12GraphicsCommandList* cmdList, const Target& target,
+		float radius, uint32 sliceCount, uint32 stackCount, uint32 attributes = GeometryGenerator::AttributeAll);
+	GeometryGenerator::MeshSize Cylinder(ID3D12GraphicsCommandList* cmdList, const Target& target,
+		float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount,
+		uint32 attributes = GeometryGenerator::AttributeAll);
+
+private:
+
+	// Layout of cbGenerate; the parameters of each shape are listed in the shader.
+	struct GenerateConstants
+	{
+		float Params[6] = {};
+		uint32 Counts[2] = {};
+		uint32 VertexCount = 0;
+		uint32 TriangleCount = 0;
+		uint32 Attributes = 0;
+		uint32 VertexLayout = 0;
+		float Color[4] = {};
+		float PosInvScale[3] = {};
+		uint32 PackedColor = 0;
+		float PosBias[3] = {};
+	};
+
+	GeometryGenerator::MeshSize Dispatch(ID3D12GraphicsCommandList* cmdList, ID3D12PipelineState* pso,
+		const Target& target, GenerateConstants& constants, const GeometryGenerator::MeshSize& size, uint32 attributes);
+
+private:
+
+	Microsoft::WRL::ComPtr<ID3D12RootSignature> mRootSignature;
+	Microsoft::WRL::ComPtr<ID3D12PipelineState> mGridPSO;
+	Microsoft::WRL::ComPtr<ID3D12PipelineState> mSpherePSO;
+	Microsoft::WRL::ComPtr<ID3D12PipelineState> mCylinderPSO;
+};
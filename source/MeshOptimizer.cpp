@@ -0,0 +1,252 @@
+//***************************************************************************************
+// MeshOptimizer.cpp
+//***************************************************************************************
+
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+	// Scoring constants from Forsyth's paper.
+	const int ScoringCacheSize = 32;
+	const float CacheDecayPower = 1.5f;
+	const float LastTriScore = 0.75f;
+	const float ValenceBoostScale = 2.0f;
+	const float ValenceBoostPower = 0.5f;
+
+	float VertexScore(int cachePosition, MeshOptimizer::uint32 remainingValence)
+	{
+		// No triangle left needs this vertex.
+		if (remainingValence == 0)
+			return -1.0f;
+
+		float score = 0.0f;
+		if (cachePosition >= 0)
+		{
+			if (cachePosition < 3)
+			{
+				// The vertices of the last triangle get a fixed score, so the next one is
+				// not picked just because it shares them.
+				score = LastTriScore;
+			}
+			else
+			{
+				const float scaler = 1.0f / (ScoringCacheSize - 3);
+				score = std::pow(1.0f - (cachePosition - 3) * scaler, CacheDecayPower);
+			}
+		}
+
+		// Boost vertices with few triangles left so they do not linger as lone triangles.
+		score += ValenceBoostScale * std::pow((float)remainingValence, -ValenceBoostPower);
+
+		return score;
+	}
+}
+
+MeshOptimizer::Stats MeshOptimizer::Optimize(GeometryGenerator::MeshData& meshData)
+{
+	Stats stats;
+
+	uint32 vertexCount = meshData.VertexCount();
+	if (!ValidateIndices(meshData.Indices32, vertexCount))
+		return stats;
+
+	stats.AcmrBefore = ComputeAcmr(meshData.Indices32, vertexCount);
+
+	OptimizeVertexCache(meshData.Indices32, vertexCount);
+	OptimizeVertexFetch(meshData);
+
+	stats.AcmrAfter = ComputeAcmr(meshData.Indices32, vertexCount);
+	stats.Optimized = true;
+
+	return stats;
+}
+
+void MeshOptimizer::OptimizeVertexCache(std::vector<uint32>& indices, uint32 vertexCount)
+{
+	uint32 triangleCount = (uint32)indices.size() / 3;
+	if (triangleCount == 0)
+		return;
+
+	// Triangles using each vertex, as one array with per-vertex offsets.
+	std::vector<uint32> valence(vertexCount, 0);
+	for (uint32 index : indices)
+		++valence[index];
+
+	std::vector<uint32> adjacencyOffset(vertexCount + 1, 0);
+	for (uint32 v = 0; v < vertexCount; ++v)
+		adjacencyOffset[v + 1] = adjacencyOffset[v] + valence[v];
+
+	std::vector<uint32> adjacency(indices.size());
+	std::vector<uint32> fill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+	for (uint32 t = 0; t < triangleCount; ++t)
+	{
+		for (uint32 k = 0; k < 3; ++k)
+			adjacency[fill[indices[3*t + k]]++] = t;
+	}
+
+	// Triangles not emitted yet remain in the front valence[v] entries of each list.
+	std::vector<int> cachePosition(vertexCount, -1);
+	std::vector<float> vertexScore(vertexCount);
+	for (uint32 v = 0; v < vertexCount; ++v)
+		vertexScore[v] = VertexScore(-1, valence[v]);
+
+	std::vector<float> triangleScore(triangleCount);
+	std::vector<bool> emitted(triangleCount, false);
+	for (uint32 t = 0; t < triangleCount; ++t)
+		triangleScore[t] = vertexScore[indices[3*t]] + vertexScore[indices[3*t + 1]] + vertexScore[indices[3*t + 2]];
+
+	// LRU cache of vertices; three extra slots hold the vertices pushed out by the
+	// newest triangle until their scores are updated.
+	std::vector<uint32> cache;
+	cache.reserve(ScoringCacheSize + 3);
+	std::vector<uint32> newCache;
+	newCache.reserve(ScoringCacheSize + 3);
+
+	std::vector<uint32> optimized;
+	optimized.reserve(indices.size());
+
+	// Start from the best scoring triangle; later ones come from the cache, or from
+	// a linear scan when the cached vertices have no triangles left.
+	uint32 bestTriangle = (uint32)(std::max_element(triangleScore.begin(), triangleScore.end()) - triangleScore.begin());
+	uint32 scanCursor = 0;
+
+	for (uint32 emittedCount = 0; emittedCount < triangleCount; ++emittedCount)
+	{
+		if (bestTriangle == ~0u)
+		{
+			while (emitted[scanCursor])
+				++scanCursor;
+			bestTriangle = scanCursor;
+		}
+
+		emitted[bestTriangle] = true;
+		const uint32* tri = &indices[3*bestTriangle];
+		optimized.insert(optimized.end(), tri, tri + 3);
+
+		// Move the triangle's vertices to the front of the cache and drop the
+		// triangle from their remaining lists.
+		newCache.clear();
+		for (uint32 k = 0; k < 3; ++k)
+		{
+			uint32 v = tri[k];
+			newCache.push_back(v);
+
+			uint32* first = &adjacency[adjacencyOffset[v]];
+			uint32* last = first + valence[v];
+			std::iter_swap(std::find(first, last, bestTriangle), last - 1);
+			--valence[v];
+		}
+
+		for (uint32 v : cache)
+		{
+			if (v != tri[0] && v != tri[1] && v != tri[2])
+				newCache.push_back(v);
+		}
+		std::swap(cache, newCache);
+
+		// Rescore the cached vertices; the ones pushed past the cache size leave it.
+		for (size_t i = 0; i < cache.size(); ++i)
+		{
+			uint32 v = cache[i];
+			cachePosition[v] = i < (size_t)ScoringCacheSize ? (int)i : -1;
+			vertexScore[v] = VertexScore(cachePosition[v], valence[v]);
+		}
+
+		// Rescore the remaining triangles of the cached vertices and pick the best one.
+		bestTriangle = ~0u;
+		float bestScore = -1.0f;
+		for (uint32 v : cache)
+		{
+			for (uint32 i = 0; i < valence[v]; ++i)
+			{
+				uint32 t = adjacency[adjacencyOffset[v] + i];
+				const uint32* other = &indices[3*t];
+				triangleScore[t] = vertexScore[other[0]] + vertexScore[other[1]] + vertexScore[other[2]];
+
+				if (triangleScore[t] > bestScore)
+				{
+					bestScore = triangleScore[t];
+					bestTriangle = t;
+				}
+			}
+		}
+
+		if (cache.size() > (size_t)ScoringCacheSize)
+			cache.resize(ScoringCacheSize);
+	}
+
+	indices.swap(optimized);
+}
+
+void MeshOptimizer::OptimizeVertexFetch(GeometryGenerator::MeshData& meshData)
+{
+	if (meshData.PositionsOnly())
+		OptimizeVertexFetch(meshData.Positions, meshData.Indices32);
+	else
+		OptimizeVertexFetch(meshData.Vertices, meshData.Indices32);
+}
+
+template<typename VertexT>
+void MeshOptimizer::OptimizeVertexFetch(std::vector<VertexT>& meshVertices, std::vector<uint32>& indices)
+{
+	const uint32 unmapped = ~0u;
+	uint32 vertexCount = (uint32)meshVertices.size();
+
+	std::vector<uint32> remap(vertexCount, unmapped);
+	std::vector<VertexT> vertices;
+	vertices.reserve(vertexCount);
+
+	for (uint32& index : indices)
+	{
+		if (remap[index] == unmapped)
+		{
+			remap[index] = (uint32)vertices.size();
+			vertices.push_back(meshVertices[index]);
+		}
+		index = remap[index];
+	}
+
+	for (uint32 v = 0; v < vertexCount; ++v)
+	{
+		if (remap[v] == unmapped)
+			vertices.push_back(meshVertices[v]);
+	}
+
+	meshVertices.swap(vertices);
+}
+
+float MeshOptimizer::ComputeAcmr(const std::vector<uint32>& indices, uint32 vertexCount, uint32 cacheSize)
+{
+	uint32 triangleCount = (uint32)indices.size() / 3;
+	if (triangleCount == 0)
+		return 0.0f;
+
+	// A vertex is in the FIFO if it was inserted fewer than cacheSize misses ago;
+	// insertedAt holds the miss count after its insertion, 0 if never.
+	std::vector<uint32> insertedAt(vertexCount, 0);
+	uint32 misses = 0;
+	for (uint32 index : indices)
+	{
+		if (insertedAt[index] == 0 || misses - insertedAt[index] >= cacheSize)
+		{
+			++misses;
+			insertedAt[index] = misses;
+		}
+	}
+
+	return (float)misses / triangleCount;
+}
+
+bool MeshOptimizer::ValidateIndices(const std::vector<uint32>& indices, uint32 vertexCount)
+{
+	for (uint32 index : indices)
+	{
+		if (index >= vertexCount)
+			return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,76 @@
+//***************************************************************************************
+// ParallelFor.h
+//
+// Runs independent jobs on short-lived worker threads.  Used at load time, where the
+// jobs are few and large (one shape, one buffer region), so threads are not pooled.
+//***************************************************************************************
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Worker count used when the caller has no preference.
+inline unsigned DefaultJobCount()
+{
+	return std::max(std::thread::hardware_concurrency(), 1u);
+}
+
+///<summary>
+/// Calls job(i) for every i in [0, count) on up to jobCount threads, including the
+/// calling one, and returns when all calls have finished.  Jobs are handed out in
+/// order.  The first exception thrown by a job is rethrown on the calling thread;
+/// the jobs not started yet are skipped.
+///</summary>
+template<typename Job>
+void ParallelFor(std::size_t count, unsigned jobCount, const Job& job)
+{
+	std::size_t threadCount = std::min<std::size_t>(std::max(jobCount, 1u), count);
+	if (threadCount <= 1)
+	{
+		for (std::size_t i = 0; i < count; ++i)
+			job(i);
+		return;
+	}
+
+	std::atomic<std::size_t> next(0);
+	std::atomic<bool> failed(false);
+	std::exception_ptr error;
+	std::mutex errorMutex;
+
+	auto worker = [&]()
+	{
+		for (std::size_t i = next++; i < count && !failed; i = next++)
+		{
+			try
+			{
+				job(i);
+			}
+			catch (...)
+			{
+				std::lock_guard<std::mutex> lock(errorMutex);
+				if (!error)
+					error = std::current_exception();
+				failed = true;
+			}
+		}
+	};
+
+	std::vector<std::thread> threads;
+	threads.reserve(threadCount - 1);
+	for (std::size_t t = 1; t < threadCount; ++t)
+		threads.emplace_back(worker);
+
+	worker();
+
+	for (auto& thread : threads)
+		thread.join();
+
+	if (error)
+		std::rethrow_exception(error);
+}
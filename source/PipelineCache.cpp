@@ -0,0 +1,267 @@
+//***************************************************************************************
+// PipelineCache.cpp
+//***************************************************************************************
+
+#include "PipelineCache.h"
+#include "ParallelFor.h"
+
+#include <cstring>
+#include <fstream>
+
+using Microsoft::WRL::ComPtr;
+
+namespace
+{
+	bool ReadFileData(const std::wstring& path, std::vector<char>& data)
+	{
+		std::ifstream file(path, std::ios::binary | std::ios::ate);
+		if (!file)
+			return false;
+
+		data.resize((size_t)file.tellg());
+		file.seekg(0, std::ios::beg);
+		return data.empty() || (bool)file.read(data.data(), (std::streamsize)data.size());
+	}
+
+	// Writes to a temporary file and moves it into place, so a partly written file is
+	// never picked up.
+	bool WriteFileData(const std::wstring& path, const void* data, size_t byteSize)
+	{
+		std::wstring tempPath = path + L".tmp";
+		{
+			std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+			if (!out)
+				return false;
+
+			out.write(static_cast<const char*>(data), (std::streamsize)byteSize);
+			if (!out)
+				return false;
+		}
+
+		return MoveFileExW(tempPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+	}
+}
+
+PipelineCache::PipelineCache(ID3D12Device* device, const std::wstring& libraryPath)
+	: mDevice(device), mLibraryPath(libraryPath)
+{
+	if (mLibraryPath.empty())
+		return;
+
+	if (!ReadFileData(mLibraryPath, mLibraryData))
+		mLibraryData.clear();
+
+	CreateLibrary(mLibraryData.data(), mLibraryData.size());
+
+	// Written by another driver or adapter: start over.
+	if (mLibrary == nullptr && !mLibraryData.empty())
+	{
+		mLibraryData.clear();
+		CreateLibrary(nullptr, 0);
+	}
+}
+
+PipelineCache::~PipelineCache()
+{
+	if (mThread.joinable())
+		mThread.join();
+}
+
+void PipelineCache::LoadShaders(const std::vector<ShaderDesc>& descs, unsigned jobCount,
+	std::unordered_map<std::string, ComPtr<ID3DBlob>>& shaders)
+{
+	std::vector<ComPtr<ID3DBlob>> blobs(descs.size());
+	ParallelFor(descs.size(), jobCount, [&](size_t i)
+	{
+		blobs[i] = LoadShader(descs[i]);
+	});
+
+	for (size_t i = 0; i < descs.size(); ++i)
+		shaders[descs[i].Name] = blobs[i];
+}
+
+void PipelineCache::AddGraphicsPipeline(const std::string& name, const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc)
+{
+	Pipeline pipeline;
+	pipeline.Name = name;
+	pipeline.GraphicsDesc = desc;
+	mPipelines.push_back(pipeline);
+}
+
+void PipelineCache::AddComputePipeline(const std::string& name, const D3D12_COMPUTE_PIPELINE_STATE_DESC& desc)
+{
+	Pipeline pipeline;
+	pipeline.Name = name;
+	pipeline.Compute = true;
+	pipeline.ComputeDesc = desc;
+	mPipelines.push_back(pipeline);
+}
+
+void PipelineCache::Start(unsigned jobCount)
+{
+	mError = nullptr;
+	mThread = std::thread([this, jobCount]()
+	{
+		try
+		{
+			// Loading from the library and creating PSOs are free-threaded; each
+			// pipeline is touched by one job only.
+			ParallelFor(mPipelines.size(), jobCount, [this](size_t i)
+			{
+				CreatePipeline(mPipelines[i]);
+			});
+		}
+		catch (...)
+		{
+			mError = std::current_exception();
+		}
+	});
+}
+
+void PipelineCache::Finish(std::unordered_map<std::string, ComPtr<ID3D12PipelineState>>& psos)
+{
+	if (mThread.joinable())
+		mThread.join();
+
+	if (mError)
+	{
+		std::exception_ptr error = mError;
+		mError = nullptr;
+		mPipelines.clear();
+		std::rethrow_exception(error);
+	}
+
+	size_t loadedCount = 0;
+	for (auto& pipeline : mPipelines)
+	{
+		if (pipeline.Loaded)
+			loadedCount++;
+	}
+
+	if (mLibrary != nullptr && loadedCount < mPipelines.size())
+	{
+		StorePipelines();
+		SaveLibrary();
+
+		std::string text = "PipelineCache: " + std::to_string(mPipelines.size() - loadedCount) + " of " +
+			std::to_string(mPipelines.size()) + " pipelines missing, library rebuilt\n";
+		::OutputDebugStringA(text.c_str());
+	}
+
+	for (auto& pipeline : mPipelines)
+		psos[pipeline.Name] = pipeline.State;
+
+	mPipelines.clear();
+}
+
+ComPtr<ID3DBlob> PipelineCache::LoadShader(const ShaderDesc& desc)
+{
+	// Shaders\Name.hlsl, entry point PS -> Shaders\Name_PS.cso.  The bytecode depends on
+	// the compile flags, so debug builds keep their own files.  Included files are not
+	// checked; none of the shaders include any.
+	std::wstring binaryPath = desc.Filename.substr(0, desc.Filename.find_last_of(L'.')) + L"_" + AnsiToWString(desc.EntryPoint);
+#if defined(DEBUG) || defined(_DEBUG)
+	binaryPath += L"_debug";
+#endif
+	binaryPath += L".cso";
+
+	WIN32_FILE_ATTRIBUTE_DATA source;
+	WIN32_FILE_ATTRIBUTE_DATA binary;
+	bool hasSource = GetFileAttributesExW(desc.Filename.c_str(), GetFileExInfoStandard, &source) != 0;
+	bool hasBinary = GetFileAttributesExW(binaryPath.c_str(), GetFileExInfoStandard, &binary) != 0;
+	if (hasBinary && (!hasSource || CompareFileTime(&binary.ftLastWriteTime, &source.ftLastWriteTime) >= 0))
+	{
+		std::vector<char> data;
+		if (ReadFileData(binaryPath, data) && !data.empty())
+		{
+			ComPtr<ID3DBlob> blob;
+			ThrowIfFailed(D3DCreateBlob(data.size(), blob.GetAddressOf()));
+			std::memcpy(blob->GetBufferPointer(), data.data(), data.size());
+			return blob;
+		}
+	}
+
+	ComPtr<ID3DBlob> blob = d3dUtil::CompileShader(desc.Filename, nullptr, desc.EntryPoint, desc.Target);
+
+	// Without the file the shader is only compiled again on the next launch.
+	if (!WriteFileData(binaryPath, blob->GetBufferPointer(), blob->GetBufferSize()))
+		::OutputDebugStringW((L"PipelineCache: could not write " + binaryPath + L"\n").c_str());
+
+	return blob;
+}
+
+void PipelineCache::CreateLibrary(const void* data, size_t byteSize)
+{
+	mLibrary.Reset();
+
+	// Pipeline libraries need ID3D12Device1; without one every PSO is created.
+	ComPtr<ID3D12Device1> device1;
+	if (FAILED(mDevice->QueryInterface(IID_PPV_ARGS(device1.GetAddressOf()))))
+		return;
+
+	// Fails for data written by another driver or adapter, and where tools such as
+	// graphics debuggers do not support libraries.
+	if (FAILED(device1->CreatePipelineLibrary(byteSize > 0 ? data : nullptr, byteSize, IID_PPV_ARGS(mLibrary.GetAddressOf()))))
+		mLibrary.Reset();
+}
+
+void PipelineCache::CreatePipeline(Pipeline& pipeline)
+{
+	if (mLibrary != nullptr)
+	{
+		// E_INVALIDARG when the name is not in the library or was stored with another
+		// description (e.g. after a shader change).
+		std::wstring name = AnsiToWString(pipeline.Name);
+		HRESULT hr = pipeline.Compute ?
+			mLibrary->LoadComputePipeline(name.c_str(), &pipeline.ComputeDesc, IID_PPV_ARGS(pipeline.State.GetAddressOf())) :
+			mLibrary->LoadGraphicsPipeline(name.c_str(), &pipeline.GraphicsDesc, IID_PPV_ARGS(pipeline.State.GetAddressOf()));
+		if (SUCCEEDED(hr))
+		{
+			pipeline.Loaded = true;
+			return;
+		}
+	}
+
+	if (pipeline.Compute)
+		ThrowIfFailed(mDevice->CreateComputePipelineState(&pipeline.ComputeDesc, IID_PPV_ARGS(pipeline.State.ReleaseAndGetAddressOf())));
+	else
+		ThrowIfFailed(mDevice->CreateGraphicsPipelineState(&pipeline.GraphicsDesc, IID_PPV_ARGS(pipeline.State.ReleaseAndGetAddressOf())));
+}
+
+void PipelineCache::StorePipelines()
+{
+	auto storeAll = [this](bool onlyCreated)
+	{
+		for (auto& pipeline : mPipelines)
+		{
+			if (onlyCreated && pipeline.Loaded)
+				continue;
+			if (FAILED(mLibrary->StorePipeline(AnsiToWString(pipeline.Name).c_str(), pipeline.State.Get())))
+				return false;
+		}
+		return true;
+	};
+
+	// A name cannot be stored twice, so a pipeline whose description changed since it
+	// was stored needs a new library holding the current set.
+	if (storeAll(true))
+		return;
+
+	mLibraryData.clear();
+	CreateLibrary(nullptr, 0);
+	if (mLibrary != nullptr && !storeAll(false))
+		mLibrary.Reset();
+}
+
+void PipelineCache::SaveLibrary()const
+{
+	if (mLibrary == nullptr)
+		return;
+
+	std::vector<char> data(mLibrary->GetSerializedSize());
+	if (FAILED(mLibrary->Serialize(data.data(), data.size())) ||
+		!WriteFileData(mLibraryPath, data.data(), data.size()))
+	{
+		::OutputDebugStringA("PipelineCache: could not write the pipeline library\n");
+	}
+}
@@ -0,0 +1,89 @@
+//***************************************************************************************
+// PipelineCache.h
+//
+// Startup shader and PSO creation.  Shader bytecode is loaded from a .cso file next to
+// the source when it is at least as new as the .hlsl (or the source is absent, for
+// builds that ship precompiled shaders), and otherwise compiled and written there.
+// PSOs are created on background threads while the rest of the app initializes, and
+// are stored in an ID3D12PipelineLibrary persisted across runs, so a pipeline the
+// driver has already compiled is loaded instead of compiled again.
+//***************************************************************************************
+
+#pragma once
+
+#include "../../Common/d3dUtil.h"
+
+#include <exception>
+#include <thread>
+#include <unordered_map>
+
+class PipelineCache
+{
+public:
+
+	struct ShaderDesc
+	{
+		std::string Name;
+		std::wstring Filename;
+		std::string EntryPoint;
+		std::string Target;
+	};
+
+	// Pipelines persist in libraryPath; an empty path, an unreadable file or a library
+	// written by another driver or adapter starts an empty library.
+	PipelineCache(ID3D12Device* device, const std::wstring& libraryPath);
+	PipelineCache(const PipelineCache& rhs) = delete;
+	PipelineCache& operator=(const PipelineCache& rhs) = delete;
+
+	// Joins the background PSO creation if Finish was not called.
+	~PipelineCache();
+
+	// Loads or compiles the shaders on up to jobCount threads into shaders[Name].
+	void LoadShaders(const std::vector<ShaderDesc>& descs, unsigned jobCount,
+		std::unordered_map<std::string, Microsoft::WRL::ComPtr<ID3DBlob>>& shaders);
+
+	// Queue a pipeline for Start.  Everything the description points to (shaders, input
+	// layout, root signature) must stay alive until Finish.
+	void AddGraphicsPipeline(const std::string& name, const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc);
+	void AddComputePipeline(const std::string& name, const D3D12_COMPUTE_PIPELINE_STATE_DESC& desc);
+
+	// Creates the queued pipelines on up to jobCount background threads and returns.
+	void Start(unsigned jobCount);
+
+	// Waits for the pipelines and moves them into psos[name].  Rethrows the first error
+	// of the background threads.  The library is written back if it gained pipelines.
+	void Finish(std::unordered_map<std::string, Microsoft::WRL::ComPtr<ID3D12PipelineState>>& psos);
+
+private:
+
+	struct Pipeline
+	{
+		std::string Name;
+		bool Compute = false;
+		D3D12_GRAPHICS_PIPELINE_STATE_DESC GraphicsDesc = {};
+		D3D12_COMPUTE_PIPELINE_STATE_DESC ComputeDesc = {};
+		Microsoft::WRL::ComPtr<ID3D12PipelineState> State;
+		bool Loaded = false;
+	};
+
+	static Microsoft::WRL::ComPtr<ID3DBlob> LoadShader(const ShaderDesc& desc);
+
+	void CreateLibrary(const void* data, size_t byteSize);
+	void CreatePipeline(Pipeline& pipeline);
+	void StorePipelines();
+	void SaveLibrary()const;
+
+private:
+
+	ID3D12Device* mDevice = nullptr;
+	std::wstring mLibraryPath;
+
+	// The library reads the pipelines from the serialized data it was created with, so
+	// the data lives as long as the library.
+	std::vector<char> mLibraryData;
+	Microsoft::WRL::ComPtr<ID3D12PipelineLibrary> mLibrary;
+
+	std::vector<Pipeline> mPipelines;
+	std::thread mThread;
+	std::exception_ptr mError;
+};
@@ -0,0 +1,373 @@
+//***************************************************************************************
+// SceneFile.cpp
+//***************************************************************************************
+
+#include "SceneFile.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+
+using namespace DirectX;
+
+namespace
+{
+	const std::uint32_t SceneBinaryMagic = 0x424e4353; // "SCNB"
+	const std::uint32_t SceneBinaryVersion = 1;
+	const size_t SceneNameSize = 64;
+
+	// Limits of a text scene, as large as the largest stress scene.
+	const long long MaxRepeatCount = 1000000;
+	const size_t MaxSceneItems = 1000000;
+
+	struct SceneBinaryHeader
+	{
+		std::uint32_t Magic = SceneBinaryMagic;
+		std::uint32_t Version = SceneBinaryVersion;
+		std::uint32_t ShapeCount = 0;
+		std::uint32_t ItemCount = 0;
+	};
+
+	struct SceneBinaryItem
+	{
+		std::uint32_t Shape = 0;
+		std::uint32_t Optional = 0;
+		XMFLOAT4X4 World;
+	};
+
+	enum class OpType { Translate, Scale, RotateX, RotateY, RotateZ };
+
+	// One transform op of an item; Step is added once per repeat iteration.
+	struct Op
+	{
+		OpType Type = OpType::Translate;
+		float Value[3] = {};
+		float Step[3] = {};
+	};
+
+	struct ItemTemplate
+	{
+		UINT Shape = 0;
+		bool Optional = false;
+		std::vector<Op> Ops;
+	};
+
+	UINT ShapeIndex(SceneDesc& scene, const std::string& name)
+	{
+		for (size_t i = 0; i < scene.Shapes.size(); ++i)
+		{
+			if (scene.Shapes[i] == name)
+				return (UINT)i;
+		}
+
+		scene.Shapes.push_back(name);
+		return (UINT)scene.Shapes.size() - 1;
+	}
+
+	void EmitItem(const ItemTemplate& item, UINT iteration, SceneDesc& scene)
+	{
+		XMMATRIX world = XMMatrixIdentity();
+		for (auto& op : item.Ops)
+		{
+			float v[3];
+			for (int k = 0; k < 3; ++k)
+				v[k] = op.Value[k] + iteration * op.Step[k];
+
+			switch (op.Type)
+			{
+			case OpType::Translate: world = world * XMMatrixTranslation(v[0], v[1], v[2]); break;
+			case OpType::Scale: world = world * XMMatrixScaling(v[0], v[1], v[2]); break;
+			case OpType::RotateX: world = world * XMMatrixRotationX(v[0]); break;
+			case OpType::RotateY: world = world * XMMatrixRotationY(v[0]); break;
+			case OpType::RotateZ: world = world * XMMatrixRotationZ(v[0]); break;
+			}
+		}
+
+		SceneDesc::Item sceneItem;
+		sceneItem.Shape = item.Shape;
+		sceneItem.Optional = item.Optional;
+		XMStoreFloat4x4(&sceneItem.World, world);
+		scene.Items.push_back(sceneItem);
+	}
+
+	bool ReadFloats(std::istringstream& line, float* values, int count)
+	{
+		for (int k = 0; k < count; ++k)
+		{
+			if (!(line >> values[k]))
+				return false;
+		}
+		return true;
+	}
+
+	bool ParseItem(std::istringstream& line, const std::string& first, SceneDesc& scene,
+		ItemTemplate& item, std::string& error)
+	{
+		std::string shape = first;
+		if (shape == "optional")
+		{
+			item.Optional = true;
+			if (!(line >> shape))
+			{
+				error = "missing shape after 'optional'";
+				return false;
+			}
+		}
+		item.Shape = ShapeIndex(scene, shape);
+
+		std::string word;
+		while (line >> word)
+		{
+			if (word == "step")
+			{
+				if (item.Ops.empty())
+				{
+					error = "'step' before any transform";
+					return false;
+				}
+
+				Op& op = item.Ops.back();
+				if (!ReadFloats(line, op.Step, op.Type == OpType::Translate || op.Type == OpType::Scale ? 3 : 1))
+				{
+					error = "bad 'step' values";
+					return false;
+				}
+				continue;
+			}
+
+			Op op;
+			if (word == "translate")
+				op.Type = OpType::Translate;
+			else if (word == "scale")
+				op.Type = OpType::Scale;
+			else if (word == "rotatex")
+				op.Type = OpType::RotateX;
+			else if (word == "rotatey")
+				op.Type = OpType::RotateY;
+			else if (word == "rotatez")
+				op.Type = OpType::RotateZ;
+			else
+			{
+				error = "unknown transform '" + word + "'";
+				return false;
+			}
+
+			if (!ReadFloats(line, op.Value, op.Type == OpType::Translate || op.Type == OpType::Scale ? 3 : 1))
+			{
+				error = "bad '" + word + "' values";
+				return false;
+			}
+			item.Ops.push_back(op);
+		}
+
+		return true;
+	}
+}
+
+bool SceneFile::Load(const std::wstring& path, SceneDesc& scene, std::string& error)
+{
+	const std::wstring binaryExtension = L".sceneb";
+	if (path.size() >= binaryExtension.size() &&
+		path.compare(path.size() - binaryExtension.size(), binaryExtension.size(), binaryExtension) == 0)
+		return LoadBinary(path, scene, error);
+
+	return LoadText(path, scene, error);
+}
+
+bool SceneFile::LoadText(const std::wstring& path, SceneDesc& scene, std::string& error)
+{
+	std::ifstream file(path);
+	if (!file)
+	{
+		error = "cannot open the scene file";
+		return false;
+	}
+
+	std::stringstream text;
+	text << file.rdbuf();
+	return ParseText(text.str(), scene, error);
+}
+
+bool SceneFile::ParseText(const std::string& text, SceneDesc& scene, std::string& error)
+{
+	scene = SceneDesc();
+
+	std::istringstream lines(text);
+	std::string lineText;
+	UINT lineNumber = 0;
+
+	// Items of the open repeat block and its count.
+	bool inRepeat = false;
+	UINT repeatCount = 0;
+	std::vector<ItemTemplate> repeatItems;
+
+	auto fail = [&](const std::string& message)
+	{
+		error = "line " + std::to_string(lineNumber) + ": " + message;
+		return false;
+	};
+
+	while (std::getline(lines, lineText))
+	{
+		++lineNumber;
+
+		size_t comment = lineText.find('#');
+		if (comment != std::string::npos)
+			lineText.resize(comment);
+
+		std::istringstream line(lineText);
+		std::string first;
+		if (!(line >> first))
+			continue;
+
+		if (first == "repeat")
+		{
+			if (inRepeat)
+				return fail("nested 'repeat'");
+			// Read signed, so "-1" is rejected instead of wrapping around.
+			long long count = 0;
+			if (!(line >> count) || count <= 0)
+				return fail("bad repeat count");
+			if (count > MaxRepeatCount)
+				return fail("repeat count over " + std::to_string(MaxRepeatCount));
+			repeatCount = (UINT)count;
+
+			inRepeat = true;
+			repeatItems.clear();
+		}
+		else if (first == "end")
+		{
+			if (!inRepeat)
+				return fail("'end' without 'repeat'");
+
+			// Iterations are emitted in order, with all the block's items per iteration.
+			if ((std::uint64_t)repeatCount * repeatItems.size() > MaxSceneItems - scene.Items.size())
+				return fail("more than " + std::to_string(MaxSceneItems) + " items");
+			for (UINT i = 0; i < repeatCount; ++i)
+			{
+				for (auto& item : repeatItems)
+					EmitItem(item, i, scene);
+			}
+			inRepeat = false;
+		}
+		else
+		{
+			ItemTemplate item;
+			std::string itemError;
+			if (!ParseItem(line, first, scene, item, itemError))
+				return fail(itemError);
+
+			if (inRepeat)
+				repeatItems.push_back(item);
+			else if (scene.Items.size() >= MaxSceneItems)
+				return fail("more than " + std::to_string(MaxSceneItems) + " items");
+			else
+				EmitItem(item, 0, scene);
+		}
+	}
+
+	if (inRepeat)
+		return fail("'repeat' without 'end'");
+
+	return true;
+}
+
+bool SceneFile::LoadBinary(const std::wstring& path, SceneDesc& scene, std::string& error)
+{
+	scene = SceneDesc();
+
+	std::ifstream file(path, std::ios::binary);
+	SceneBinaryHeader header;
+	if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+		header.Magic != SceneBinaryMagic || header.Version != SceneBinaryVersion)
+	{
+		error = "not a binary scene file of this version";
+		return false;
+	}
+
+	// The tables must fit in the file before anything is sized from the counts.
+	file.seekg(0, std::ios::end);
+	std::uint64_t fileSize = (std::uint64_t)file.tellg();
+	file.seekg(sizeof(header), std::ios::beg);
+	std::uint64_t tableBytes = sizeof(header) + (std::uint64_t)header.ShapeCount * SceneNameSize +
+		(std::uint64_t)header.ItemCount * sizeof(SceneBinaryItem);
+	if (!file || tableBytes > fileSize)
+	{
+		error = "truncated binary scene file";
+		return false;
+	}
+
+	scene.Shapes.resize(header.ShapeCount);
+	for (auto& shape : scene.Shapes)
+	{
+		char name[SceneNameSize];
+		if (!file.read(name, sizeof(name)) || std::find(name, name + SceneNameSize, '\0') == name + SceneNameSize)
+		{
+			error = "bad shape table";
+			return false;
+		}
+		shape = name;
+	}
+
+	scene.Items.resize(header.ItemCount);
+	for (auto& item : scene.Items)
+	{
+		SceneBinaryItem record;
+		if (!file.read(reinterpret_cast<char*>(&record), sizeof(record)) || record.Shape >= header.ShapeCount)
+		{
+			error = "bad item table";
+			return false;
+		}
+
+		item.Shape = record.Shape;
+		item.Optional = record.Optional != 0;
+		item.World = record.World;
+	}
+
+	return true;
+}
+
+bool SceneFile::SaveBinary(const std::wstring& path, const SceneDesc& scene)
+{
+	for (auto& shape : scene.Shapes)
+	{
+		if (shape.size() >= SceneNameSize)
+			return false;
+	}
+
+	// Write to a temporary file and move it into place, so a partly written scene
+	// never replaces a good one.
+	std::wstring tempPath = path + L".tmp";
+	{
+		std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+		if (!file)
+			return false;
+
+		SceneBinaryHeader header;
+		header.ShapeCount = (std::uint32_t)scene.Shapes.size();
+		header.ItemCount = (std::uint32_t)scene.Items.size();
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+		for (auto& shape : scene.Shapes)
+		{
+			char name[SceneNameSize] = {};
+			std::copy(shape.begin(), shape.end(), name);
+			file.write(name, sizeof(name));
+		}
+
+		for (auto& item : scene.Items)
+		{
+			SceneBinaryItem record;
+			record.Shape = item.Shape;
+			record.Optional = item.Optional ? 1 : 0;
+			record.World = item.World;
+			file.write(reinterpret_cast<const char*>(&record), sizeof(record));
+		}
+
+		if (!file)
+			return false;
+	}
+
+	return MoveFileExW(tempPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+}
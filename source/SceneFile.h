@@ -0,0 +1,50 @@
+//***************************************************************************************
+// SceneFile.h
+//
+// Scene descriptions: which shapes are placed where.  Text files are for authoring,
+// binary files are the same scene with the transforms already expanded.
+//
+// Text format, one statement per line, '#' starts a comment:
+//
+//   [optional] <shape> <op>...     places one item; optional items are skipped when
+//                                  the shape does not exist (e.g. the planet)
+//   repeat <count>                 the items up to 'end' are placed count times
+//   end                            (1 to 1000000; a scene holds at most 1000000 items)
+//
+//   <op> is translate x y z | scale x y z | rotatex a | rotatey a | rotatez a
+//   (radians), each optionally followed by 'step' and as many values, which are added
+//   once per repeat iteration.  The world matrix is the product of the ops in order,
+//   so the first op is applied first (DirectXMath row vectors).
+//***************************************************************************************
+
+#pragma once
+
+#include "../../Common/d3dUtil.h"
+
+struct SceneDesc
+{
+	struct Item
+	{
+		// Index into Shapes.
+		UINT Shape = 0;
+		bool Optional = false;
+		DirectX::XMFLOAT4X4 World;
+	};
+
+	std::vector<std::string> Shapes;
+	std::vector<Item> Items;
+};
+
+class SceneFile
+{
+public:
+
+	// Picks the binary loader for ".sceneb" files and the text parser otherwise.
+	static bool Load(const std::wstring& path, SceneDesc& scene, std::string& error);
+
+	static bool LoadText(const std::wstring& path, SceneDesc& scene, std::string& error);
+	static bool ParseText(const std::string& text, SceneDesc& scene, std::string& error);
+
+	static bool LoadBinary(const std::wstring& path, SceneDesc& scene, std::string& error);
+	static bool SaveBinary(const std::wstring& path, const SceneDesc& scene);
+};
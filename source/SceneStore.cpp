@@ -0,0 +1,184 @@
+//***************************************************************************************
+// SceneStore.cpp
+//***************************************************************************************
+
+#include "SceneStore.h"
+
+using namespace DirectX;
+
+SceneStore::SceneStore(int numFrameResources)
+	: mNumFrameResources(numFrameResources)
+{
+}
+
+UINT SceneStore::AddSubmesh(const std::string& name, MeshGeometry* geo, const SubmeshGeometry& args,
+	D3D12_PRIMITIVE_TOPOLOGY primitiveType)
+{
+	BoundingSphere sphereBounds;
+	BoundingSphere::CreateFromBoundingBox(sphereBounds, args.Bounds);
+
+	return AddSubmesh(name, geo, args, sphereBounds, primitiveType);
+}
+
+UINT SceneStore::AddSubmesh(const std::string& name, MeshGeometry* geo, const SubmeshGeometry& args,
+	const BoundingSphere& sphereBounds, D3D12_PRIMITIVE_TOPOLOGY primitiveType)
+{
+	Submesh submesh;
+	submesh.Name = name;
+	submesh.Geo = geo;
+	submesh.PrimitiveType = primitiveType;
+	submesh.IndexCount = args.IndexCount;
+	submesh.StartIndexLocation = args.StartIndexLocation;
+	submesh.BaseVertexLocation = args.BaseVertexLocation;
+	submesh.Bounds = sphereBounds;
+
+	Submeshes.push_back(submesh);
+
+	return (UINT)Submeshes.size() - 1;
+}
+
+UINT SceneStore::FindSubmesh(const std::string& name)const
+{
+	for (size_t i = 0; i < Submeshes.size(); ++i)
+	{
+		if (Submeshes[i].Name == name)
+			return (UINT)i;
+	}
+
+	return InvalidId;
+}
+
+UINT SceneStore::AddLodChain(const std::vector<UINT>& levels, const std::vector<float>& minScreenSize)
+{
+	assert(!levels.empty() && levels.size() == minScreenSize.size());
+
+	LodChain chain;
+	chain.Levels = levels;
+	chain.MinScreenSize = minScreenSize;
+
+	LodChains.push_back(chain);
+
+	UINT chainId = (UINT)LodChains.size() - 1;
+	Submeshes[levels[0]].LodChain = chainId;
+
+	return chainId;
+}
+
+void SceneStore::Reserve(size_t objectCount)
+{
+	World.reserve(objectCount);
+	NumFramesDirty.reserve(objectCount);
+	ObjCBIndex.reserve(objectCount);
+	SubmeshId.reserve(objectCount);
+	LodChainId.reserve(objectCount);
+	InstanceIndex.reserve(objectCount);
+	Layer.reserve(objectCount);
+}
+
+void SceneStore::Clear()
+{
+	World.clear();
+	NumFramesDirty.clear();
+	ObjCBIndex.clear();
+	SubmeshId.clear();
+	LodChainId.clear();
+	InstanceIndex.clear();
+	Layer.clear();
+	DirtyObjects.clear();
+	mLodObjects.clear();
+	mLodCursor = 0;
+}
+
+UINT SceneStore::AddObject(UINT submeshId, const XMFLOAT4X4& world, RenderLayer layer)
+{
+	assert(submeshId < Submeshes.size());
+
+	UINT object = (UINT)World.size();
+
+	World.push_back(world);
+	NumFramesDirty.push_back(mNumFrameResources);
+	ObjCBIndex.push_back(object);
+	SubmeshId.push_back(submeshId);
+	LodChainId.push_back(Submeshes[submeshId].LodChain);
+	InstanceIndex.push_back(object);
+	Layer.push_back(layer);
+	DirtyObjects.push_back(object);
+
+	if (Submeshes[submeshId].LodChain != InvalidId)
+		mLodObjects.push_back(object);
+
+	return object;
+}
+
+void SceneStore::SetWorld(UINT object, const XMFLOAT4X4& world)
+{
+	World[object] = world;
+	MarkDirty(object);
+}
+
+void SceneStore::MarkDirty(UINT object)
+{
+	if (NumFramesDirty[object] == 0)
+		DirtyObjects.push_back(object);
+	NumFramesDirty[object] = mNumFrameResources;
+}
+
+void SceneStore::ConsumeDirtyFrame()
+{
+	size_t kept = 0;
+	for (size_t i = 0; i < DirtyObjects.size(); ++i)
+	{
+		UINT object = DirtyObjects[i];
+		if (--NumFramesDirty[object] > 0)
+			DirtyObjects[kept++] = object;
+	}
+
+	DirtyObjects.resize(kept);
+}
+
+void SceneStore::SelectLods(FXMVECTOR eyePosW, float projScale, size_t maxObjects,
+	std::vector<UINT>& changedObjects)
+{
+	// Moved objects right away; objects only affected by the camera in turn.
+	for (UINT object : DirtyObjects)
+	{
+		if (LodChainId[object] != InvalidId && SelectLod(object, eyePosW, projScale))
+			changedObjects.push_back(object);
+	}
+
+	size_t count = std::min(maxObjects, mLodObjects.size());
+	for (size_t i = 0; i < count; ++i)
+	{
+		if (mLodCursor >= mLodObjects.size())
+			mLodCursor = 0;
+
+		UINT object = mLodObjects[mLodCursor++];
+		if (SelectLod(object, eyePosW, projScale))
+			changedObjects.push_back(object);
+	}
+}
+
+bool SceneStore::SelectLod(UINT object, FXMVECTOR eyePosW, float projScale)
+{
+	const LodChain& chain = LodChains[LodChainId[object]];
+	const BoundingSphere& bounds = Submeshes[chain.Levels[0]].Bounds;
+
+	// The radius grows with the largest axis scale of the world matrix.
+	XMMATRIX world = XMLoadFloat4x4(&World[object]);
+	XMVECTOR centerW = XMVector3Transform(XMLoadFloat3(&bounds.Center), world);
+	float scale = sqrtf(std::max(XMVectorGetX(XMVector3LengthSq(world.r[0])),
+		std::max(XMVectorGetX(XMVector3LengthSq(world.r[1])), XMVectorGetX(XMVector3LengthSq(world.r[2])))));
+
+	float distance = std::max(XMVectorGetX(XMVector3Length(centerW - eyePosW)), 1e-3f);
+	float screenSize = bounds.Radius * scale * projScale / distance;
+
+	size_t level = 0;
+	while (level + 1 < chain.Levels.size() && screenSize < chain.MinScreenSize[level])
+		++level;
+
+	if (SubmeshId[object] == chain.Levels[level])
+		return false;
+
+	SubmeshId[object] = chain.Levels[level];
+	return true;
+}
@@ -0,0 +1,144 @@
+//***************************************************************************************
+// SceneStore.h
+//
+// Contiguous structure-of-arrays storage for the objects of a scene.  Object i owns
+// element i of every column, so per-frame passes (dirty checks, constant buffer
+// updates, draw submission) are linear scans over densely packed arrays instead of
+// pointer chases through individually allocated render items.
+//***************************************************************************************
+
+#pragma once
+
+#include "../../Common/d3dUtil.h"
+#include "../../Common/MathHelper.h"
+
+enum class RenderLayer : int
+{
+	Opaque = 0,
+	Count
+};
+
+class SceneStore
+{
+public:
+
+	static const UINT InvalidId = 0xffffffff;
+
+	// Draw arguments shared by every object that references the submesh.
+	struct Submesh
+	{
+		std::string Name;
+		MeshGeometry* Geo = nullptr;
+		D3D12_PRIMITIVE_TOPOLOGY PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+
+		// DrawIndexedInstanced parameters.
+		UINT IndexCount = 0;
+		UINT StartIndexLocation = 0;
+		int BaseVertexLocation = 0;
+
+		// Bounding sphere in the submesh's local space.
+		DirectX::BoundingSphere Bounds;
+
+		// Decode of quantized vertex positions: PosL = stored * PosScale + PosBias.
+		DirectX::XMFLOAT3 PosScale = { 1.0f, 1.0f, 1.0f };
+		DirectX::XMFLOAT3 PosBias = { 0.0f, 0.0f, 0.0f };
+
+		// LOD chain whose level 0 is this submesh, or InvalidId.
+		UINT LodChain = InvalidId;
+	};
+
+	// Submeshes of decreasing detail.  Level i is used while the projected size of the
+	// object is at least MinScreenSize[i]; the last level is the fallback.
+	struct LodChain
+	{
+		std::vector<UINT> Levels;
+		std::vector<float> MinScreenSize;
+	};
+
+	explicit SceneStore(int numFrameResources);
+	SceneStore(const SceneStore& rhs) = delete;
+	SceneStore& operator=(const SceneStore& rhs) = delete;
+
+	// The bounding sphere is derived from the box in args.Bounds.
+	UINT AddSubmesh(const std::string& name, MeshGeometry* geo, const SubmeshGeometry& args,
+		D3D12_PRIMITIVE_TOPOLOGY primitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	UINT AddSubmesh(const std::string& name, MeshGeometry* geo, const SubmeshGeometry& args,
+		const DirectX::BoundingSphere& sphereBounds,
+		D3D12_PRIMITIVE_TOPOLOGY primitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+
+	// Returns InvalidId if no submesh with that name was added.
+	UINT FindSubmesh(const std::string& name)const;
+
+	// Objects added afterwards with levels[0] as their submesh select a level every frame.
+	UINT AddLodChain(const std::vector<UINT>& levels, const std::vector<float>& minScreenSize);
+
+	void Reserve(size_t objectCount);
+	void Clear();
+
+	// Adds an object and returns its index.  The object constant buffer index is
+	// the object index, and the object starts dirty in every frame resource.
+	UINT AddObject(UINT submeshId, const DirectX::XMFLOAT4X4& world, RenderLayer layer = RenderLayer::Opaque);
+
+	// Changes the world matrix of an object and marks it dirty in every frame resource.
+	void SetWorld(UINT object, const DirectX::XMFLOAT4X4& world);
+
+	// Marks an object dirty in every frame resource after its World was written in place.
+	void MarkDirty(UINT object);
+
+	// Picks the LOD level of objects with an LOD chain from their projected size: the
+	// world-space bounding sphere diameter as a fraction of the viewport height.
+	// projScale is the [1][1] element of the projection matrix.  The objects in
+	// DirtyObjects are evaluated, and the next maxObjects of the others in turn, so a
+	// frame costs at most maxObjects evaluations plus the moved objects.  Appends the
+	// objects whose SubmeshId changed to changedObjects.
+	void SelectLods(DirectX::FXMVECTOR eyePosW, float projScale, size_t maxObjects,
+		std::vector<UINT>& changedObjects);
+
+	// Consumes one frame resource's worth of dirtiness: decrements the counters of
+	// every object in DirtyObjects and drops the objects that became clean.
+	void ConsumeDirtyFrame();
+
+	size_t Size()const { return World.size(); }
+
+	// World matrix of the object describing its local space relative to world space.
+	std::vector<DirectX::XMFLOAT4X4> World;
+
+	// Dirty counter indicating the object data has changed and we need to update the constant buffer.
+	// Because we have an object cbuffer for each FrameResource, we have to apply the
+	// update to each FrameResource, so a change resets the counter to the frame resource count.
+	std::vector<int> NumFramesDirty;
+
+	// Index into the GPU object constant buffer for the object.
+	std::vector<UINT> ObjCBIndex;
+
+	// Index into Submeshes; draw args are referenced, never copied per object.
+	// For objects with an LOD chain this is the currently selected level.
+	std::vector<UINT> SubmeshId;
+
+	// Index into LodChains, or InvalidId for objects with a fixed submesh.
+	std::vector<UINT> LodChainId;
+
+	// Index into the per-frame instance buffer used by the instanced drawing path.
+	std::vector<UINT> InstanceIndex;
+
+	// Layer the object is drawn in; selects the PSO.
+	std::vector<RenderLayer> Layer;
+
+	std::vector<Submesh> Submeshes;
+	std::vector<LodChain> LodChains;
+
+	// Objects with NumFramesDirty > 0.  Written when a transform changes so that a
+	// static scene costs nothing per frame; an object appears at most once.
+	std::vector<UINT> DirtyObjects;
+
+private:
+	// Selects the level of one object with an LOD chain; returns whether it changed.
+	bool SelectLod(UINT object, DirectX::FXMVECTOR eyePosW, float projScale);
+
+private:
+	int mNumFrameResources = 0;
+
+	// Objects with an LOD chain, and where SelectLods continues in them.
+	std::vector<UINT> mLodObjects;
+	size_t mLodCursor = 0;
+};
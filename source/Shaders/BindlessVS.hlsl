@@ -0,0 +1,68 @@
+//***************************************************************************************
+// BindlessVS.hlsl
+//
+// Vertex shader for the bindless object constants layout.  All object constants of a
+// frame live in one structured buffer bound once per command list; each draw selects
+// its entry with a root constant instead of binding a per-object CBV descriptor table.
+//***************************************************************************************
+
+struct ObjectData
+{
+	float4x4 World;
+	float4   PosScale;
+	float4   PosBias;
+};
+
+StructuredBuffer<ObjectData> gObjectData : register(t1);
+
+cbuffer cbObjectIndex : register(b0)
+{
+	uint gObjIndex;
+};
+
+cbuffer cbPass : register(b1)
+{
+	float4x4 gView;
+	float4x4 gInvView;
+	float4x4 gProj;
+	float4x4 gInvProj;
+	float4x4 gViewProj;
+	float4x4 gInvViewProj;
+	float3 gEyePosW;
+	float cbPerObjectPad1;
+	float2 gRenderTargetSize;
+	float2 gInvRenderTargetSize;
+	float gNearZ;
+	float gFarZ;
+	float gTotalTime;
+	float gDeltaTime;
+};
+
+struct VertexIn
+{
+	float3 PosL  : POSITION;
+	float4 Color : COLOR;
+};
+
+struct VertexOut
+{
+	float4 PosH  : SV_POSITION;
+	float4 Color : COLOR;
+};
+
+VertexOut VS(VertexIn vin)
+{
+	VertexOut vout;
+
+	ObjectData obj = gObjectData[gObjIndex];
+
+	// Decode the (possibly quantized) position, then transform to homogeneous clip space.
+	float3 posL = vin.PosL * obj.PosScale.xyz + obj.PosBias.xyz;
+	precise float4 posH = mul(mul(float4(posL, 1.0f), obj.World), gViewProj);
+	vout.PosH = posH;
+
+	// Just pass vertex color into the pixel shader.
+	vout.Color = vin.Color;
+
+	return vout;
+}
@@ -0,0 +1,59 @@
+//***************************************************************************************
+// CompactVS.hlsl
+//
+// Vertex shader for the per-object constant buffer layout with the compact vertex
+// format.  Positions arrive as SNORM16 normalized to the submesh bounds and are
+// decoded with the per-object scale and bias; colors arrive as RGBA8 UNORM.
+//***************************************************************************************
+
+cbuffer cbPerObject : register(b0)
+{
+	float4x4 gWorld;
+	float4 gPosScale;
+	float4 gPosBias;
+};
+
+cbuffer cbPass : register(b1)
+{
+	float4x4 gView;
+	float4x4 gInvView;
+	float4x4 gProj;
+	float4x4 gInvProj;
+	float4x4 gViewProj;
+	float4x4 gInvViewProj;
+	float3 gEyePosW;
+	float cbPerObjectPad1;
+	float2 gRenderTargetSize;
+	float2 gInvRenderTargetSize;
+	float gNearZ;
+	float gFarZ;
+	float gTotalTime;
+	float gDeltaTime;
+};
+
+struct VertexIn
+{
+	float3 PosL  : POSITION;
+	float4 Color : COLOR;
+};
+
+struct VertexOut
+{
+	float4 PosH  : SV_POSITION;
+	float4 Color : COLOR;
+};
+
+VertexOut VS(VertexIn vin)
+{
+	VertexOut vout;
+
+	// Decode the position, then transform to homogeneous clip space.
+	float3 posL = vin.PosL * gPosScale.xyz + gPosBias.xyz;
+	precise float4 posH = mul(mul(float4(posL, 1.0f), gWorld), gViewProj);
+	vout.PosH = posH;
+
+	// Just pass vertex color into the pixel shader.
+	vout.Color = vin.Color;
+
+	return vout;
+}
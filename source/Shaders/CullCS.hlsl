@@ -0,0 +1,107 @@
+//***************************************************************************************
+// CullCS.hlsl
+//
+// Frustum culling of the scene objects.  Each thread tests the world-space bounding
+// sphere of one object against the planes of gViewProj and appends an indirect draw
+// for visible objects.  The commands are consumed by ExecuteIndirect with the
+// instanced vertex shader, so BaseInstance selects the world matrix.
+//***************************************************************************************
+
+struct InstanceData
+{
+	float4x4 World;
+	float4   PosScale;
+	float4   PosBias;
+};
+
+struct CullObject
+{
+	float3 Center;
+	float  Radius;
+	uint   IndexCount;
+	uint   StartIndexLocation;
+	int    BaseVertexLocation;
+	uint   InstanceIndex;
+};
+
+// Layout must match IndirectCommand in FrameResource.h.
+struct IndirectCommand
+{
+	uint BaseInstance;
+	uint IndexCountPerInstance;
+	uint InstanceCount;
+	uint StartIndexLocation;
+	int  BaseVertexLocation;
+	uint StartInstanceLocation;
+};
+
+StructuredBuffer<InstanceData> gInstanceData : register(t0);
+StructuredBuffer<CullObject> gCullObjects : register(t1);
+AppendStructuredBuffer<IndirectCommand> gVisibleCommands : register(u0);
+
+cbuffer cbCull : register(b0)
+{
+	uint gObjectCount;
+};
+
+cbuffer cbPass : register(b1)
+{
+	float4x4 gView;
+	float4x4 gInvView;
+	float4x4 gProj;
+	float4x4 gInvProj;
+	float4x4 gViewProj;
+	float4x4 gInvViewProj;
+	float3 gEyePosW;
+	float cbPerObjectPad1;
+	float2 gRenderTargetSize;
+	float2 gInvRenderTargetSize;
+	float gNearZ;
+	float gFarZ;
+	float gTotalTime;
+	float gDeltaTime;
+};
+
+[numthreads(64, 1, 1)]
+void CS(uint3 dispatchThreadID : SV_DispatchThreadID)
+{
+	if (dispatchThreadID.x >= gObjectCount)
+		return;
+
+	CullObject obj = gCullObjects[dispatchThreadID.x];
+	float4x4 world = gInstanceData[obj.InstanceIndex].World;
+
+	// Bounding sphere in world space; the radius grows with the largest axis scale.
+	float3 centerW = mul(float4(obj.Center, 1.0f), world).xyz;
+	float scaleSq = max(dot(world[0].xyz, world[0].xyz),
+		max(dot(world[1].xyz, world[1].xyz), dot(world[2].xyz, world[2].xyz)));
+	float radiusW = obj.Radius * sqrt(scaleSq);
+
+	// Frustum planes from the columns of the view-projection matrix (row vectors, z in [0,1]).
+	float4x4 columns = transpose(gViewProj);
+	float4 planes[6] =
+	{
+		columns[3] + columns[0],
+		columns[3] - columns[0],
+		columns[3] + columns[1],
+		columns[3] - columns[1],
+		columns[2],
+		columns[3] - columns[2]
+	};
+
+	[unroll]
+	for (int i = 0; i < 6; ++i)
+	{
+		if (dot(planes[i].xyz, centerW) + planes[i].w < -radiusW * length(planes[i].xyz))
+			return;
+	}
+
+	IndirectCommand command;
+	command.BaseInstance = obj.InstanceIndex;
+	command.IndexCountPerInstance = obj.IndexCount;
+	command.InstanceCount = 1;
+	command.StartIndexLocation = obj.StartIndexLocation;
+	command.BaseVertexLocation = obj.BaseVertexLocation;
+	command.StartInstanceLocation = 0;
+	gVisibleCommands.Append(command);
+}
@@ -0,0 +1,74 @@
+//***************************************************************************************
+// EdgeOverlay.hlsl
+//
+// Geometry and pixel shader of the opaque PSOs.  The geometry shader passes each
+// triangle through with the barycentric coordinates of its corners, so the pixel
+// shader can draw the triangle edges over the solid color in the same pass.  The
+// overlay opacity is a pass constant, so switching it never changes the PSO.
+//***************************************************************************************
+
+cbuffer cbPass : register(b1)
+{
+	float4x4 gView;
+	float4x4 gInvView;
+	float4x4 gProj;
+	float4x4 gInvProj;
+	float4x4 gViewProj;
+	float4x4 gInvViewProj;
+	float3 gEyePosW;
+	float cbPerObjectPad1;
+	float2 gRenderTargetSize;
+	float2 gInvRenderTargetSize;
+	float gNearZ;
+	float gFarZ;
+	float gTotalTime;
+	float gDeltaTime;
+	float4 gEdgeColor;
+	float gEdgeWidth;
+	float gEdgeOpacity;
+	float2 cbPassPad2;
+};
+
+struct VertexOut
+{
+	float4 PosH  : SV_POSITION;
+	float4 Color : COLOR;
+};
+
+struct GeoOut
+{
+	float4 PosH  : SV_POSITION;
+	float4 Color : COLOR;
+
+	// Interpolated in screen space so the edges keep the same width in pixels.
+	noperspective float3 Bary : BARYCENTRIC;
+};
+
+[maxvertexcount(3)]
+void GS(triangle VertexOut gin[3], inout TriangleStream<GeoOut> triStream)
+{
+	const float3 corners[3] = { float3(1.0f, 0.0f, 0.0f), float3(0.0f, 1.0f, 0.0f), float3(0.0f, 0.0f, 1.0f) };
+
+	[unroll]
+	for (int i = 0; i < 3; ++i)
+	{
+		GeoOut gout;
+		gout.PosH = gin[i].PosH;
+		gout.Color = gin[i].Color;
+		gout.Bary = corners[i];
+		triStream.Append(gout);
+	}
+}
+
+float4 PS(GeoOut pin) : SV_Target
+{
+	// Distance to the nearest edge in pixels, antialiased over one pixel.  Without the
+	// edge view the opacity is 0 and the solid color comes through.
+	float3 pixels = pin.Bary / max(fwidth(pin.Bary), 1e-6f);
+	float edgeDistance = min(pixels.x, min(pixels.y, pixels.z));
+	float coverage = 1.0f - saturate(edgeDistance - 0.5f * gEdgeWidth);
+
+	float4 color = pin.Color;
+	color.rgb = lerp(color.rgb, gEdgeColor.rgb, coverage * gEdgeColor.a * gEdgeOpacity);
+	return color;
+}
@@ -0,0 +1,291 @@
+//***************************************************************************************
+// GenerateCS.hlsl
+//
+// GPU versions of GeometryGenerator::CreateGrid, CreateSphere and CreateCylinder.  Each
+// thread writes at most one vertex and one triangle, in the order and layout of the CPU
+// generator: GeometryGenerator::Vertex (44 bytes, attributes outside the mask zero) or
+// tightly packed positions for a position-only mask, and 32-bit indices.  Drawable
+// vertices use the app's layouts instead: Vertex (float3 position, float4 color) or
+// CompactVertex (SNORM16 position in the submesh bounds, RGBA8 color).  The steps
+// (dx, phiStep, ...) are computed by the CPU the same way the generator does, and the
+// arithmetic is precise, so the grid and all indices are bit-identical; the sphere and
+// cylinder use the GPU's sin/cos and match to within a few ulps.
+//***************************************************************************************
+
+// GeometryGenerator::VertexAttributes.
+#define ATTRIBUTE_POSITION 0x1
+#define ATTRIBUTE_NORMAL   0x2
+#define ATTRIBUTE_TANGENTU 0x4
+#define ATTRIBUTE_TEXC     0x8
+
+// GpuGeometryGenerator::Layout.
+#define LAYOUT_GENERATOR 0
+#define LAYOUT_FULL      1
+#define LAYOUT_COMPACT   2
+
+// Layout must match GenerateConstants in GpuGeometryGenerator.cpp.
+cbuffer cbGenerate : register(b0)
+{
+	// Grid: halfWidth, halfDepth, dx, dz, du, dv.
+	// Sphere: radius, phiStep, thetaStep.
+	// Cylinder: bottomRadius, topRadius, height, stackHeight, radiusStep, dTheta.
+	float gParam0;
+	float gParam1;
+	float gParam2;
+	float gParam3;
+	float gParam4;
+	float gParam5;
+
+	// Grid: m, n.  Sphere and cylinder: sliceCount, stackCount.
+	uint gCount0;
+	uint gCount1;
+
+	uint gVertexCount;
+	uint gTriangleCount;
+	uint gAttributes;
+	uint gLayout;
+
+	// Packer layouts: the color, and the inverse of the position decode.
+	float4 gColor;
+	float3 gPosInvScale;
+	uint gPackedColor;
+	float3 gPosBias;
+};
+
+RWByteAddressBuffer gVertices : register(u0);
+RWByteAddressBuffer gIndices  : register(u1);
+
+// Round to nearest even and two's complement, as XMStoreShortN4.
+uint PackSnorm16(float x)
+{
+	return (uint)(int)round(clamp(x, -1.0f, 1.0f) * 32767.0f) & 0xffff;
+}
+
+void StoreVertex(uint index, float3 position, float3 normal, float3 tangentU, float2 texC)
+{
+	if (gLayout == LAYOUT_FULL)
+	{
+		uint address = index * 28;
+		gVertices.Store3(address, asuint(position));
+		gVertices.Store4(address + 12, asuint(gColor));
+		return;
+	}
+
+	if (gLayout == LAYOUT_COMPACT)
+	{
+		// w is unused and stored as 0.
+		precise float3 p = (position - gPosBias) * gPosInvScale;
+		gVertices.Store3(index * 12, uint3(PackSnorm16(p.x) | (PackSnorm16(p.y) << 16), PackSnorm16(p.z), gPackedColor));
+		return;
+	}
+
+	if (gAttributes == ATTRIBUTE_POSITION)
+	{
+		gVertices.Store3(index * 12, asuint(position));
+		return;
+	}
+
+	if (!(gAttributes & ATTRIBUTE_NORMAL))
+		normal = float3(0.0f, 0.0f, 0.0f);
+	if (!(gAttributes & ATTRIBUTE_TANGENTU))
+		tangentU = float3(0.0f, 0.0f, 0.0f);
+	if (!(gAttributes & ATTRIBUTE_TEXC))
+		texC = float2(0.0f, 0.0f);
+
+	uint address = index * 44;
+	gVertices.Store3(address, asuint(position));
+	gVertices.Store3(address + 12, asuint(normal));
+	gVertices.Store3(address + 24, asuint(tangentU));
+	gVertices.Store2(address + 36, asuint(texC));
+}
+
+void StoreTriangle(uint triangle, uint i0, uint i1, uint i2)
+{
+	gIndices.Store3(triangle * 12, uint3(i0, i1, i2));
+}
+
+// One of the two triangles of the quad whose first corner is v00, in a vertex lattice
+// with rowLength vertices per row, in the CPU's order.  The grid and sphere split the
+// quad along v01-v10, the cylinder along v00-v11.
+void StoreQuadTriangle(uint triangle, bool second, uint v00, uint rowLength, bool ringOrder)
+{
+	uint v01 = v00 + 1;
+	uint v10 = v00 + rowLength;
+	uint v11 = v10 + 1;
+
+	if (ringOrder)
+	{
+		if (second)
+			StoreTriangle(triangle, v00, v11, v01);
+		else
+			StoreTriangle(triangle, v00, v10, v11);
+	}
+	else
+	{
+		if (second)
+			StoreTriangle(triangle, v10, v01, v11);
+		else
+			StoreTriangle(triangle, v00, v01, v10);
+	}
+}
+
+[numthreads(64, 1, 1)]
+void GridCS(uint3 dispatchThreadID : SV_DispatchThreadID)
+{
+	uint id = dispatchThreadID.x;
+	uint n = gCount1;
+
+	if (id < gVertexCount)
+	{
+		uint i = id / n;
+		uint j = id % n;
+
+		precise float x = -gParam0 + (float)j * gParam2;
+		precise float z = gParam1 - (float)i * gParam3;
+		precise float u = (float)j * gParam4;
+		precise float v = (float)i * gParam5;
+
+		StoreVertex(id, float3(x, 0.0f, z), float3(0.0f, 1.0f, 0.0f), float3(1.0f, 0.0f, 0.0f), float2(u, v));
+	}
+
+	if (id < gTriangleCount)
+	{
+		uint quad = id / 2;
+		StoreQuadTriangle(id, (id & 1) != 0, (quad / (n-1))*n + quad % (n-1), n, false);
+	}
+}
+
+[numthreads(64, 1, 1)]
+void SphereCS(uint3 dispatchThreadID : SV_DispatchThreadID)
+{
+	uint id = dispatchThreadID.x;
+	float radius = gParam0;
+	uint sliceCount = gCount0;
+	uint stackCount = gCount1;
+	uint ringVertexCount = sliceCount + 1;
+	uint southPoleIndex = gVertexCount - 1;
+
+	if (id == 0)
+	{
+		StoreVertex(id, float3(0.0f, +radius, 0.0f), float3(0.0f, +1.0f, 0.0f), float3(1.0f, 0.0f, 0.0f), float2(0.0f, 0.0f));
+	}
+	else if (id == southPoleIndex)
+	{
+		StoreVertex(id, float3(0.0f, -radius, 0.0f), float3(0.0f, -1.0f, 0.0f), float3(1.0f, 0.0f, 0.0f), float2(0.0f, 1.0f));
+	}
+	else if (id < gVertexCount)
+	{
+		uint i = (id - 1) / ringVertexCount + 1;
+		uint j = (id - 1) % ringVertexCount;
+
+		precise float phi = (float)i * gParam1;
+		precise float theta = (float)j * gParam2;
+
+		// spherical to cartesian
+		float3 position = float3(radius*sin(phi)*cos(theta), radius*cos(phi), radius*sin(phi)*sin(theta));
+
+		// Partial derivative of P with respect to theta
+		float3 tangentU = normalize(float3(-radius*sin(phi)*sin(theta), 0.0f, +radius*sin(phi)*cos(theta)));
+
+		StoreVertex(id, position, normalize(position), tangentU, float2(theta / 6.283185307f, phi / 3.141592654f));
+	}
+
+	uint innerTriangleCount = 2*sliceCount*(stackCount-2);
+	if (id < sliceCount)
+	{
+		// Top stack, around the north pole.
+		StoreTriangle(id, 0, id+2, id+1);
+	}
+	else if (id < sliceCount + innerTriangleCount)
+	{
+		// Inner stacks, skipping the north pole vertex.
+		uint triangle = id - sliceCount;
+		uint quad = triangle / 2;
+		StoreQuadTriangle(id, (triangle & 1) != 0, 1 + (quad / sliceCount)*ringVertexCount + quad % sliceCount, ringVertexCount, false);
+	}
+	else if (id < gTriangleCount)
+	{
+		// Bottom stack, around the south pole.
+		uint i = id - sliceCount - innerTriangleCount;
+		uint baseIndex = southPoleIndex - ringVertexCount;
+		StoreTriangle(id, southPoleIndex, baseIndex+i, baseIndex+i+1);
+	}
+}
+
+[numthreads(64, 1, 1)]
+void CylinderCS(uint3 dispatchThreadID : SV_DispatchThreadID)
+{
+	uint id = dispatchThreadID.x;
+	float bottomRadius = gParam0;
+	float topRadius = gParam1;
+	float height = gParam2;
+	uint sliceCount = gCount0;
+	uint stackCount = gCount1;
+	uint ringVertexCount = sliceCount + 1;
+	uint topCapBase = (stackCount+1)*ringVertexCount;
+	uint bottomCapBase = topCapBase + sliceCount+2;
+
+	if (id < topCapBase)
+	{
+		// Stack rings from the bottom up.
+		uint i = id / ringVertexCount;
+		uint j = id % ringVertexCount;
+
+		precise float y = -0.5f*height + (float)i * gParam3;
+		precise float r = bottomRadius + (float)i * gParam4;
+		precise float angle = (float)j * gParam5;
+		float c = cos(angle);
+		float s = sin(angle);
+
+		// Cross of the tangent (-s, 0, c) and the bitangent (dr*c, -height, dr*s).
+		float dr = bottomRadius - topRadius;
+		float3 normal = normalize(float3(c*height, dr, s*height));
+
+		StoreVertex(id, float3(r*c, y, r*s), normal, float3(-s, 0.0f, c),
+			float2((float)j / sliceCount, 1.0f - (float)i / stackCount));
+	}
+	else if (id < gVertexCount)
+	{
+		// Caps: a duplicated ring and a center vertex each.
+		bool top = id < bottomCapBase;
+		uint i = id - (top ? topCapBase : bottomCapBase);
+		float y = top ? 0.5f*height : -0.5f*height;
+		float capRadius = top ? topRadius : bottomRadius;
+		float3 normal = float3(0.0f, top ? 1.0f : -1.0f, 0.0f);
+
+		float x = 0.0f;
+		float z = 0.0f;
+		float2 texC = float2(0.5f, 0.5f);
+		if (i <= sliceCount)
+		{
+			precise float angle = (float)i * gParam5;
+			x = capRadius*cos(angle);
+			z = capRadius*sin(angle);
+
+			// Scale down by the height to try and make top cap texture coord area
+			// proportional to base.
+			texC = float2(x/height + 0.5f, z/height + 0.5f);
+		}
+
+		StoreVertex(id, float3(x, y, z), normal, float3(1.0f, 0.0f, 0.0f), texC);
+	}
+
+	uint sideTriangleCount = 2*sliceCount*stackCount;
+	if (id < sideTriangleCount)
+	{
+		uint quad = id / 2;
+		StoreQuadTriangle(id, (id & 1) != 0, (quad / sliceCount)*ringVertexCount + quad % sliceCount, ringVertexCount, true);
+	}
+	else if (id < gTriangleCount)
+	{
+		uint i = id - sideTriangleCount;
+		bool top = i < sliceCount;
+		i = top ? i : i - sliceCount;
+		uint baseIndex = top ? topCapBase : bottomCapBase;
+		uint centerIndex = baseIndex + sliceCount+1;
+		if (top)
+			StoreTriangle(id, centerIndex, baseIndex+i+1, baseIndex+i);
+		else
+			StoreTriangle(id, centerIndex, baseIndex+i, baseIndex+i+1);
+	}
+}
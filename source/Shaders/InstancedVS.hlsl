@@ -0,0 +1,68 @@
+//***************************************************************************************
+// InstancedVS.hlsl
+//
+// Vertex shader for the instanced drawing path.  World matrices are fetched from a
+// structured buffer indexed by the instance id, offset by the first instance of the
+// batch being drawn (SV_InstanceID does not include StartInstanceLocation).
+//***************************************************************************************
+
+struct InstanceData
+{
+	float4x4 World;
+	float4   PosScale;
+	float4   PosBias;
+};
+
+StructuredBuffer<InstanceData> gInstanceData : register(t0);
+
+cbuffer cbPass : register(b1)
+{
+	float4x4 gView;
+	float4x4 gInvView;
+	float4x4 gProj;
+	float4x4 gInvProj;
+	float4x4 gViewProj;
+	float4x4 gInvViewProj;
+	float3 gEyePosW;
+	float cbPerObjectPad1;
+	float2 gRenderTargetSize;
+	float2 gInvRenderTargetSize;
+	float gNearZ;
+	float gFarZ;
+	float gTotalTime;
+	float gDeltaTime;
+};
+
+cbuffer cbInstanceBatch : register(b2)
+{
+	uint gBaseInstance;
+};
+
+struct VertexIn
+{
+	float3 PosL  : POSITION;
+	float4 Color : COLOR;
+};
+
+struct VertexOut
+{
+	float4 PosH  : SV_POSITION;
+	float4 Color : COLOR;
+};
+
+VertexOut VS(VertexIn vin, uint instanceID : SV_InstanceID)
+{
+	VertexOut vout;
+
+	InstanceData instance = gInstanceData[gBaseInstance + instanceID];
+
+	// Decode the (possibly quantized) position, then transform to homogeneous clip space.
+	float3 posL = vin.PosL * instance.PosScale.xyz + instance.PosBias.xyz;
+	precise float4 posH = mul(mul(float4(posL, 1.0f), instance.World), gViewProj);
+	vout.PosH = posH;
+
+	// Just pass vertex color into the pixel shader.
+	vout.Color = vin.Color;
+
+	return vout;
+}
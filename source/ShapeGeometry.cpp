@@ -0,0 +1,295 @@
+//***************************************************************************************
+// ShapeGeometry.cpp
+//***************************************************************************************
+
+#include "ShapeGeometry.h"
+#include "MeshOptimizer.h"
+#include "ParallelFor.h"
+
+#include <random>
+
+using namespace DirectX;
+
+// The packed vertices carry only the position, so the generators skip the normals,
+// tangents and texture coordinates and keep the meshes tightly packed.
+const GeometryGenerator::uint32 gShapeAttributes = GeometryGenerator::AttributePosition;
+
+const float gPlanetRadius = 3.0f;
+
+ShapeGeometryBuilder::ShapeGeometryBuilder(const ShapeGeometryOptions& options)
+	: mOptions(options)
+{
+	// The shapes are independent, so each one is generated by its own job.  The round
+	// shapes come with coarser LOD levels.  The optional planet is a dense geosphere;
+	// past 6 subdivisions it needs 32-bit indices or splitting.  The text of every call
+	// is part of the geometry cache key.
+#define GENERATE_JOB(target, call) GenerateJob{ #target " = " #call, [this]() { target = call; } }
+	mGenerateJobs =
+	{
+		GENERATE_JOB(mBox, mGeoGen.CreateBox(1.0f, 1.0f, 1.0f, 0, gShapeAttributes)),
+		GENERATE_JOB(mGrid, mGeoGen.CreateGrid(20.0f, 30.0f, 60, 40, gShapeAttributes)),
+		GENERATE_JOB(mSphereLods, mGeoGen.CreateSphereLods(1.0f, 20, 20, gLodLevelCount, gShapeAttributes)),
+		GENERATE_JOB(mCylinderLods, mGeoGen.CreateCylinderLods(1.5f, 1.5f, 6.0f, 20, 20, gLodLevelCount, gShapeAttributes)),
+		GENERATE_JOB(mConeLods, mGeoGen.CreateConeLods(2.0f, 0.0f, 3.0f, 20, 20, gLodLevelCount, gShapeAttributes)),
+		GENERATE_JOB(mDiamondLods, mGeoGen.CreateDiamondLods(1.0f, 0.5f, 1.0f, 0.5f, 10, 20, gLodLevelCount, gShapeAttributes)),
+		GENERATE_JOB(mWedge, mGeoGen.CreateWedge(1.0f, 1.0f, 1.0f, 0, gShapeAttributes)),
+		GENERATE_JOB(mPyramid, (mGeoGen.CreatePyramid<4, 20>(1.0f, 0.0f, 3.0f, gShapeAttributes))),
+		GENERATE_JOB(mPrism, (mGeoGen.CreatePrism<3, 1>(1.0f, 1.0f, 1.0f, gShapeAttributes))),
+		GENERATE_JOB(mPlanet, mOptions.PlanetSubdivisions > 0 ?
+			mGeoGen.CreateGeosphere(gPlanetRadius, mOptions.PlanetSubdivisions, gShapeAttributes) : GeometryGenerator::MeshData()),
+	};
+#undef GENERATE_JOB
+
+	// Packed parts in buffer order.  Level 0 of an LOD chain keeps the plain shape name;
+	// the coarser levels are <shape>_lodN.
+	mShapeMeshes =
+	{
+		{ "box", &mBox, XMFLOAT4(DirectX::Colors::Gold) },
+		{ "grid", &mGrid, XMFLOAT4(DirectX::Colors::ForestGreen) },
+		{ "wedge", &mWedge, XMFLOAT4(DirectX::Colors::White) },
+		{ "pyramid", &mPyramid, XMFLOAT4(DirectX::Colors::Yellow) },
+		{ "prism", &mPrism, XMFLOAT4(DirectX::Colors::Orange) },
+	};
+
+	mLodMeshes =
+	{
+		{ "sphere", &mSphereLods, XMFLOAT4(DirectX::Colors::Crimson) },
+		{ "cylinder", &mCylinderLods, XMFLOAT4(DirectX::Colors::SteelBlue) },
+		{ "cone", &mConeLods, XMFLOAT4(DirectX::Colors::Black) },
+		{ "diamond", &mDiamondLods, XMFLOAT4(DirectX::Colors::GhostWhite) },
+	};
+
+	mPlanetColor = PlanetColor();
+}
+
+std::uint64_t ShapeGeometryBuilder::CacheKey()const
+{
+	GeometryCacheKey cacheKey;
+	for (auto& job : mGenerateJobs)
+		cacheKey.Add(job.Call);
+	for (auto& shape : mShapeMeshes)
+	{
+		cacheKey.Add(shape.Name);
+		cacheKey.AddValue(shape.Color);
+	}
+	for (auto& lod : mLodMeshes)
+	{
+		cacheKey.Add(lod.Name);
+		cacheKey.AddValue(lod.Color);
+	}
+	cacheKey.AddValue(mPlanetColor);
+	cacheKey.AddValue(gPlanetRadius);
+	cacheKey.AddValue(gLodLevelCount);
+	cacheKey.AddValue(mOptions.PlanetSubdivisions);
+	cacheKey.AddValue(mOptions.IndexMode);
+	cacheKey.AddValue(mOptions.CompactVertices);
+	cacheKey.AddValue(mOptions.OptimizeMeshes);
+
+	return cacheKey.Value();
+}
+
+void ShapeGeometryBuilder::ConfigurePacker(GeometryPacker& packer)const
+{
+	packer.SetVertexFormat(mOptions.CompactVertices ? GeometryPacker::VertexFormat::Compact : GeometryPacker::VertexFormat::Full);
+	packer.SetJobCount(mOptions.Jobs);
+}
+
+void ShapeGeometryBuilder::Generate(GeometryPacker& packer)
+{
+	// The planet job is by far the largest; start it first so it does not finish last.
+	std::vector<GenerateJob*> jobs;
+	jobs.push_back(&mGenerateJobs.back());
+	for (size_t i = 0; i + 1 < mGenerateJobs.size(); ++i)
+		jobs.push_back(&mGenerateJobs[i]);
+	ParallelFor(jobs.size(), mOptions.Jobs, [&](size_t i) { jobs[i]->Run(); });
+
+	// Meshes to optimize, once all of them are known.
+	std::vector<std::pair<std::string, GeometryGenerator::MeshData*>> addedMeshes;
+	auto addMesh = [&](const std::string& name, GeometryGenerator::MeshData& mesh, const XMFLOAT4& color)
+	{
+		addedMeshes.push_back(std::make_pair(name, &mesh));
+		packer.Add(name, mesh, color);
+	};
+
+	for (auto& shape : mShapeMeshes)
+		addMesh(shape.Name, *shape.Mesh, shape.Color);
+
+	for (auto& lod : mLodMeshes)
+	{
+		for (size_t level = 0; level < lod.Levels->size(); ++level)
+		{
+			std::string name = level == 0 ? lod.Name : std::string(lod.Name) + "_lod" + std::to_string(level);
+			addMesh(name, (*lod.Levels)[level], lod.Color);
+		}
+	}
+
+	if (mOptions.PlanetSubdivisions > 0)
+		addMesh("planet", mPlanet, mPlanetColor);
+
+	// The packer only reads the meshes in Build, so they can still be reordered here.
+	if (mOptions.OptimizeMeshes)
+	{
+		ParallelFor(addedMeshes.size(), mOptions.Jobs, [&](size_t i)
+		{
+			OptimizeMesh(addedMeshes[i].first, *addedMeshes[i].second);
+		});
+	}
+}
+
+GeometryGenerator::MeshData ShapeGeometryBuilder::CreatePlanet(UINT subdivisions, bool optimize)
+{
+	GeometryGenerator geoGen;
+	GeometryGenerator::MeshData planet = geoGen.CreateGeosphere(gPlanetRadius, subdivisions, gShapeAttributes);
+	if (optimize)
+		OptimizeMesh("planet", planet);
+
+	return planet;
+}
+
+XMFLOAT4 ShapeGeometryBuilder::PlanetColor()
+{
+	return XMFLOAT4(DirectX::Colors::DarkSeaGreen);
+}
+
+float ShapeGeometryBuilder::PlanetRadius()
+{
+	return gPlanetRadius;
+}
+
+void ShapeGeometryBuilder::RegisterSubmeshes(const GeometryPacker& packer, SceneStore& scene)const
+{
+	// Register the submeshes with the scene so render items can refer to them by id.
+	for (auto& mesh : packer.Meshes())
+	{
+		for (auto& submeshName : mesh.Submeshes)
+		{
+			UINT submeshId = scene.AddSubmesh(submeshName, mesh.Geo, mesh.Geo->DrawArgs[submeshName], mesh.SphereBounds);
+			scene.Submeshes[submeshId].PosScale = mesh.PosScale;
+			scene.Submeshes[submeshId].PosBias = mesh.PosBias;
+		}
+	}
+
+	// Link each round shape to its coarser levels.  Every level uses the level 0 bounds
+	// for selection, so a single sphere is tested per object.
+	for (auto& lod : mLodMeshes)
+	{
+		std::vector<UINT> levels = { scene.FindSubmesh(lod.Name) };
+		std::vector<float> minScreenSize;
+		for (UINT level = 1; level < gLodLevelCount; ++level)
+		{
+			levels.push_back(scene.FindSubmesh(std::string(lod.Name) + "_lod" + std::to_string(level)));
+			minScreenSize.push_back(gLodMinScreenSize[level - 1]);
+		}
+		minScreenSize.push_back(0.0f);
+
+		scene.AddLodChain(levels, minScreenSize);
+	}
+}
+
+bool ShapeGeometryBuilder::PlaceScene(const SceneDesc& desc, SceneStore& scene, std::string& error)
+{
+	// Resolve the submesh ids once per shape instead of once per item.  A shape that
+	// was split for 16-bit indices places one object per piece.
+	std::vector<std::vector<UINT>> shapeSubmeshes(desc.Shapes.size());
+	for (size_t i = 0; i < desc.Shapes.size(); ++i)
+	{
+		UINT piece = scene.FindSubmesh(desc.Shapes[i]);
+		for (UINT j = 1; piece != SceneStore::InvalidId; ++j)
+		{
+			shapeSubmeshes[i].push_back(piece);
+			piece = scene.FindSubmesh(desc.Shapes[i] + "#" + std::to_string(j));
+		}
+	}
+
+	scene.Reserve(scene.Size() + desc.Items.size());
+	for (auto& item : desc.Items)
+	{
+		auto& submeshes = shapeSubmeshes[item.Shape];
+		if (submeshes.empty() && !item.Optional)
+		{
+			error = "Scene uses the unknown shape " + desc.Shapes[item.Shape];
+			return false;
+		}
+
+		for (UINT submeshId : submeshes)
+			scene.AddObject(submeshId, item.World);
+	}
+
+	return true;
+}
+
+UINT ShapeGeometryBuilder::PlaceStressScene(const StressSceneOptions& options, SceneStore& scene)
+{
+	const char* const shapes[] = { "box", "wedge", "cone", "sphere", "cylinder", "diamond", "pyramid", "prism" };
+	const UINT shapeCount = _countof(shapes);
+	const UINT animatedRunLength = 64;
+	const float cellSize = 2.0f;
+
+	UINT shapeSubmeshes[shapeCount];
+	for (UINT i = 0; i < shapeCount; ++i)
+		shapeSubmeshes[i] = scene.FindSubmesh(shapes[i]);
+
+	UINT objectCount = options.ObjectCount;
+	UINT animatedCount = (UINT)(objectCount * std::min(std::max(options.AnimatedFraction, 0.0f), 1.0f) + 0.5f);
+	UINT side = std::max((UINT)ceilf(sqrtf((float)objectCount)), 1u);
+	float origin = -0.5f * cellSize * (side - 1);
+
+	// Fixed seed, so every run measures the same scene.
+	std::mt19937 random(options.Seed);
+	std::uniform_real_distribution<float> angle(0.0f, XM_2PI);
+	std::uniform_int_distribution<UINT> pickShape(0, shapeCount - 1);
+
+	scene.Reserve(scene.Size() + objectCount + 1);
+	UINT runShape = 0;
+	for (UINT i = 0; i < objectCount; ++i)
+	{
+		// Animated groups need runs of one submesh with consecutive slots.
+		UINT shape = pickShape(random);
+		if (i < animatedCount)
+		{
+			if (i % animatedRunLength == 0)
+				runShape = shape;
+			shape = runShape;
+		}
+
+		UINT submeshId = shapeSubmeshes[shape];
+		if (submeshId == SceneStore::InvalidId)
+			continue;
+
+		// Scale every shape to about one cell and stand it on the ground.
+		const BoundingSphere& bounds = scene.Submeshes[submeshId].Bounds;
+		float scale = 0.4f * cellSize / std::max(bounds.Radius, 0.001f);
+		float x = origin + cellSize * (i % side);
+		float z = origin + cellSize * (i / side);
+		float y = (bounds.Radius - bounds.Center.y) * scale;
+
+		XMFLOAT4X4 world;
+		XMStoreFloat4x4(&world, XMMatrixScaling(scale, scale, scale) * XMMatrixRotationY(angle(random)) *
+			XMMatrixTranslation(x, y, z));
+		scene.AddObject(submeshId, world);
+	}
+
+	// The grid is 20 x 30 units; stretch it under all the cells.
+	UINT gridSubmesh = scene.FindSubmesh("grid");
+	if (gridSubmesh != SceneStore::InvalidId)
+	{
+		float extent = cellSize * side;
+		XMFLOAT4X4 world;
+		XMStoreFloat4x4(&world, XMMatrixScaling(extent / 20.0f, 1.0f, extent / 30.0f));
+		scene.AddObject(gridSubmesh, world);
+	}
+
+	return animatedCount;
+}
+
+void ShapeGeometryBuilder::OptimizeMesh(const std::string& name, GeometryGenerator::MeshData& mesh)
+{
+	MeshOptimizer::Stats stats = MeshOptimizer::Optimize(mesh);
+
+	std::string report = "MeshOptimizer: " + name;
+	if (stats.Optimized)
+		report += " ACMR " + std::to_string(stats.AcmrBefore) + " -> " + std::to_string(stats.AcmrAfter) + "\n";
+	else
+		report += " skipped (indices out of range)\n";
+	::OutputDebugStringA(report.c_str());
+}
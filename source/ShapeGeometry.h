@@ -0,0 +1,125 @@
+//***************************************************************************************
+// ShapeGeometry.h
+//
+// The demo's shape set: which meshes are generated with which parameters, their colors
+// and LOD chains, and how a scene description is placed on them.  Nothing here needs a
+// device, so the app and the headless benchmark build the scene the same way.
+//***************************************************************************************
+
+#pragma once
+
+#include "GeometryCache.h"
+#include "GeometryGenerator.h"
+#include "GeometryPacker.h"
+#include "SceneFile.h"
+#include "SceneStore.h"
+
+#include <functional>
+
+// LOD levels generated for the round shapes, and the projected size (fraction of
+// the viewport height) below which an object drops from level i to level i+1.
+const UINT gLodLevelCount = 3;
+const float gLodMinScreenSize[gLodLevelCount - 1] = { 0.25f, 0.1f };
+
+struct ShapeGeometryOptions
+{
+	// Subdivisions of the optional planet geosphere (0 = none).
+	UINT PlanetSubdivisions = 0;
+	GeometryPacker::IndexMode IndexMode = GeometryPacker::IndexMode::Auto;
+	bool CompactVertices = false;
+	bool OptimizeMeshes = false;
+
+	// Threads generating and optimizing the meshes.
+	UINT Jobs = 1;
+};
+
+// Procedural scene for scaling tests: the shapes laid out on a square grid of cells.
+struct StressSceneOptions
+{
+	UINT ObjectCount = 1000;
+
+	// Fraction of the objects placed first, in runs of one shape, for the batch animation.
+	float AnimatedFraction = 0.1f;
+
+	UINT Seed = 1;
+};
+
+class ShapeGeometryBuilder
+{
+public:
+
+	explicit ShapeGeometryBuilder(const ShapeGeometryOptions& options);
+	ShapeGeometryBuilder(const ShapeGeometryBuilder& rhs) = delete;
+	ShapeGeometryBuilder& operator=(const ShapeGeometryBuilder& rhs) = delete;
+
+	// Everything the packed buffers depend on, for GeometryPacker::LoadCache/SaveCache.
+	std::uint64_t CacheKey()const;
+
+	// Sets the packer's vertex format and job count.
+	void ConfigurePacker(GeometryPacker& packer)const;
+
+	// Generates (and optionally optimizes) the meshes and adds them to the packer.  The
+	// meshes are owned by the builder, which must outlive the packer's Build.
+	void Generate(GeometryPacker& packer);
+
+	// The planet as Generate makes it, for meshes regenerated at runtime.
+	static GeometryGenerator::MeshData CreatePlanet(UINT subdivisions, bool optimize);
+	static DirectX::XMFLOAT4 PlanetColor();
+	static float PlanetRadius();
+
+	// Adds the packed submeshes to the scene and links the round shapes to their levels.
+	void RegisterSubmeshes(const GeometryPacker& packer, SceneStore& scene)const;
+
+	// Places the items of a scene description.  Returns false with a message if an item
+	// that is not optional uses a shape without submeshes.
+	static bool PlaceScene(const SceneDesc& desc, SceneStore& scene, std::string& error);
+
+	// Places the stress scene, the animated objects first and the ground grid last.
+	// Returns the number of animated objects.
+	static UINT PlaceStressScene(const StressSceneOptions& options, SceneStore& scene);
+
+private:
+
+	struct GenerateJob
+	{
+		const char* Call;
+		std::function<void()> Run;
+	};
+
+	struct ShapeMeshes
+	{
+		const char* Name;
+		GeometryGenerator::MeshData* Mesh;
+		DirectX::XMFLOAT4 Color;
+	};
+
+	struct LodMeshes
+	{
+		const char* Name;
+		std::vector<GeometryGenerator::MeshData>* Levels;
+		DirectX::XMFLOAT4 Color;
+	};
+
+	static void OptimizeMesh(const std::string& name, GeometryGenerator::MeshData& mesh);
+
+private:
+
+	ShapeGeometryOptions mOptions;
+
+	GeometryGenerator mGeoGen;
+	GeometryGenerator::MeshData mBox;
+	GeometryGenerator::MeshData mGrid;
+	std::vector<GeometryGenerator::MeshData> mSphereLods;
+	std::vector<GeometryGenerator::MeshData> mCylinderLods;
+	std::vector<GeometryGenerator::MeshData> mConeLods;
+	std::vector<GeometryGenerator::MeshData> mDiamondLods;
+	GeometryGenerator::MeshData mWedge;
+	GeometryGenerator::MeshData mPyramid;
+	GeometryGenerator::MeshData mPrism;
+	GeometryGenerator::MeshData mPlanet;
+
+	std::vector<GenerateJob> mGenerateJobs;
+	std::vector<ShapeMeshes> mShapeMeshes;
+	std::vector<LodMeshes> mLodMeshes;
+	DirectX::XMFLOAT4 mPlanetColor;
+};
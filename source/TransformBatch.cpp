@@ -0,0 +1,194 @@
+//***************************************************************************************
+// TransformBatch.cpp
+//***************************************************************************************
+
+#include "TransformBatch.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#else
+#include <emmintrin.h>
+#endif
+
+using namespace DirectX;
+
+namespace
+{
+	// Per-lane components of the 3x3 scale*rotation block and the translation,
+	// laid out as the four output rows of a matrix, four components each.
+	//   untransposed row r = (m[r][0], m[r][1], m[r][2], 0), row 3 = (t, 1)
+	//   transposed   row r = (m[0][r], m[1][r], m[2][r], t[r]), row 3 = (0, 0, 0, 1)
+	template<typename V>
+	struct MatrixLanes
+	{
+		V Rows[4][4];
+	};
+
+	template<typename V>
+	void ArrangeRows(MatrixLanes<V>& out, const V m[3][3], const V t[3], V zero, V one, bool transpose)
+	{
+		for (int r = 0; r < 3; ++r)
+		{
+			for (int c = 0; c < 3; ++c)
+				out.Rows[r][c] = transpose ? m[c][r] : m[r][c];
+
+			out.Rows[r][3] = transpose ? t[r] : zero;
+		}
+
+		for (int c = 0; c < 3; ++c)
+			out.Rows[3][c] = transpose ? zero : t[c];
+		out.Rows[3][3] = one;
+	}
+}
+
+void TransformBatch::ComposeWorlds(const Streams& s, std::size_t count,
+	std::uint8_t* dest, std::size_t destStride, bool transpose)
+{
+	std::size_t i = 0;
+
+#if defined(__AVX2__)
+	const __m256 one = _mm256_set1_ps(1.0f);
+	const __m256 two = _mm256_set1_ps(2.0f);
+	const __m256 zero = _mm256_setzero_ps();
+
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256 qx = _mm256_loadu_ps(s.RotationX + i);
+		__m256 qy = _mm256_loadu_ps(s.RotationY + i);
+		__m256 qz = _mm256_loadu_ps(s.RotationZ + i);
+		__m256 qw = _mm256_loadu_ps(s.RotationW + i);
+
+		__m256 xx = _mm256_mul_ps(qx, qx), yy = _mm256_mul_ps(qy, qy), zz = _mm256_mul_ps(qz, qz);
+		__m256 xy = _mm256_mul_ps(qx, qy), xz = _mm256_mul_ps(qx, qz), yz = _mm256_mul_ps(qy, qz);
+		__m256 wx = _mm256_mul_ps(qw, qx), wy = _mm256_mul_ps(qw, qy), wz = _mm256_mul_ps(qw, qz);
+
+		__m256 sx = _mm256_loadu_ps(s.ScaleX + i);
+		__m256 sy = _mm256_loadu_ps(s.ScaleY + i);
+		__m256 sz = _mm256_loadu_ps(s.ScaleZ + i);
+
+		// Rows of the rotation matrix (row-vector convention), each scaled by its axis scale.
+		__m256 m[3][3];
+		m[0][0] = _mm256_mul_ps(sx, _mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(yy, zz))));
+		m[0][1] = _mm256_mul_ps(sx, _mm256_mul_ps(two, _mm256_add_ps(xy, wz)));
+		m[0][2] = _mm256_mul_ps(sx, _mm256_mul_ps(two, _mm256_sub_ps(xz, wy)));
+
+		m[1][0] = _mm256_mul_ps(sy, _mm256_mul_ps(two, _mm256_sub_ps(xy, wz)));
+		m[1][1] = _mm256_mul_ps(sy, _mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(xx, zz))));
+		m[1][2] = _mm256_mul_ps(sy, _mm256_mul_ps(two, _mm256_add_ps(yz, wx)));
+
+		m[2][0] = _mm256_mul_ps(sz, _mm256_mul_ps(two, _mm256_add_ps(xz, wy)));
+		m[2][1] = _mm256_mul_ps(sz, _mm256_mul_ps(two, _mm256_sub_ps(yz, wx)));
+		m[2][2] = _mm256_mul_ps(sz, _mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(xx, yy))));
+
+		__m256 t[3] =
+		{
+			_mm256_loadu_ps(s.TranslationX + i),
+			_mm256_loadu_ps(s.TranslationY + i),
+			_mm256_loadu_ps(s.TranslationZ + i)
+		};
+
+		MatrixLanes<__m256> lanes;
+		ArrangeRows(lanes, m, t, zero, one, transpose);
+
+		// Transpose each row group from lanes-per-item to items-per-register.  The
+		// in-lane 4x4 transpose handles items 0-3 in the low half and 4-7 in the high half.
+		for (int r = 0; r < 4; ++r)
+		{
+			__m256 t0 = _mm256_unpacklo_ps(lanes.Rows[r][0], lanes.Rows[r][1]);
+			__m256 t1 = _mm256_unpackhi_ps(lanes.Rows[r][0], lanes.Rows[r][1]);
+			__m256 t2 = _mm256_unpacklo_ps(lanes.Rows[r][2], lanes.Rows[r][3]);
+			__m256 t3 = _mm256_unpackhi_ps(lanes.Rows[r][2], lanes.Rows[r][3]);
+
+			__m256 item[4] =
+			{
+				_mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0)),
+				_mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2)),
+				_mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0)),
+				_mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2))
+			};
+
+			for (int k = 0; k < 4; ++k)
+			{
+				float* lo = reinterpret_cast<float*>(dest + (i + k) * destStride) + r * 4;
+				float* hi = reinterpret_cast<float*>(dest + (i + k + 4) * destStride) + r * 4;
+				_mm_storeu_ps(lo, _mm256_castps256_ps128(item[k]));
+				_mm_storeu_ps(hi, _mm256_extractf128_ps(item[k], 1));
+			}
+		}
+	}
+#else
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 two = _mm_set1_ps(2.0f);
+	const __m128 zero = _mm_setzero_ps();
+
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 qx = _mm_loadu_ps(s.RotationX + i);
+		__m128 qy = _mm_loadu_ps(s.RotationY + i);
+		__m128 qz = _mm_loadu_ps(s.RotationZ + i);
+		__m128 qw = _mm_loadu_ps(s.RotationW + i);
+
+		__m128 xx = _mm_mul_ps(qx, qx), yy = _mm_mul_ps(qy, qy), zz = _mm_mul_ps(qz, qz);
+		__m128 xy = _mm_mul_ps(qx, qy), xz = _mm_mul_ps(qx, qz), yz = _mm_mul_ps(qy, qz);
+		__m128 wx = _mm_mul_ps(qw, qx), wy = _mm_mul_ps(qw, qy), wz = _mm_mul_ps(qw, qz);
+
+		__m128 sx = _mm_loadu_ps(s.ScaleX + i);
+		__m128 sy = _mm_loadu_ps(s.ScaleY + i);
+		__m128 sz = _mm_loadu_ps(s.ScaleZ + i);
+
+		// Rows of the rotation matrix (row-vector convention), each scaled by its axis scale.
+		__m128 m[3][3];
+		m[0][0] = _mm_mul_ps(sx, _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))));
+		m[0][1] = _mm_mul_ps(sx, _mm_mul_ps(two, _mm_add_ps(xy, wz)));
+		m[0][2] = _mm_mul_ps(sx, _mm_mul_ps(two, _mm_sub_ps(xz, wy)));
+
+		m[1][0] = _mm_mul_ps(sy, _mm_mul_ps(two, _mm_sub_ps(xy, wz)));
+		m[1][1] = _mm_mul_ps(sy, _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))));
+		m[1][2] = _mm_mul_ps(sy, _mm_mul_ps(two, _mm_add_ps(yz, wx)));
+
+		m[2][0] = _mm_mul_ps(sz, _mm_mul_ps(two, _mm_add_ps(xz, wy)));
+		m[2][1] = _mm_mul_ps(sz, _mm_mul_ps(two, _mm_sub_ps(yz, wx)));
+		m[2][2] = _mm_mul_ps(sz, _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))));
+
+		__m128 t[3] =
+		{
+			_mm_loadu_ps(s.TranslationX + i),
+			_mm_loadu_ps(s.TranslationY + i),
+			_mm_loadu_ps(s.TranslationZ + i)
+		};
+
+		MatrixLanes<__m128> lanes;
+		ArrangeRows(lanes, m, t, zero, one, transpose);
+
+		for (int r = 0; r < 4; ++r)
+		{
+			__m128 c0 = lanes.Rows[r][0], c1 = lanes.Rows[r][1], c2 = lanes.Rows[r][2], c3 = lanes.Rows[r][3];
+			_MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+
+			_mm_storeu_ps(reinterpret_cast<float*>(dest + (i + 0) * destStride) + r * 4, c0);
+			_mm_storeu_ps(reinterpret_cast<float*>(dest + (i + 1) * destStride) + r * 4, c1);
+			_mm_storeu_ps(reinterpret_cast<float*>(dest + (i + 2) * destStride) + r * 4, c2);
+			_mm_storeu_ps(reinterpret_cast<float*>(dest + (i + 3) * destStride) + r * 4, c3);
+		}
+	}
+#endif
+
+	ComposeWorldsScalar(s, i, count - i, dest, destStride, transpose);
+}
+
+void TransformBatch::ComposeWorldsScalar(const Streams& s, std::size_t first, std::size_t count,
+	std::uint8_t* dest, std::size_t destStride, bool transpose)
+{
+	for (std::size_t i = first; i < first + count; ++i)
+	{
+		XMMATRIX S = XMMatrixScaling(s.ScaleX[i], s.ScaleY[i], s.ScaleZ[i]);
+		XMMATRIX R = XMMatrixRotationQuaternion(XMVectorSet(s.RotationX[i], s.RotationY[i], s.RotationZ[i], s.RotationW[i]));
+		XMMATRIX T = XMMatrixTranslation(s.TranslationX[i], s.TranslationY[i], s.TranslationZ[i]);
+
+		XMMATRIX world = S * R * T;
+		if (transpose)
+			world = XMMatrixTranspose(world);
+
+		XMStoreFloat4x4(reinterpret_cast<XMFLOAT4X4*>(dest + i * destStride), world);
+	}
+}
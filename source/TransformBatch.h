@@ -0,0 +1,51 @@
+//***************************************************************************************
+// TransformBatch.h
+//
+// Vectorized composition of world matrices for large groups of objects.  Inputs are
+// structure-of-arrays streams of translation, rotation (unit quaternion) and scale;
+// the output is one 4x4 matrix per item written with an arbitrary byte stride, so a
+// batch can be written straight into a mapped constant/structured buffer.
+//
+// The AVX2 path composes 8 items per iteration, the SSE path 4.  The tail and the
+// non-SIMD build fall back to DirectXMath.
+//***************************************************************************************
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <DirectXMath.h>
+
+class TransformBatch
+{
+public:
+
+	// Component streams of a batch.  Every pointer addresses count floats.
+	struct Streams
+	{
+		const float* TranslationX = nullptr;
+		const float* TranslationY = nullptr;
+		const float* TranslationZ = nullptr;
+
+		const float* RotationX = nullptr;
+		const float* RotationY = nullptr;
+		const float* RotationZ = nullptr;
+		const float* RotationW = nullptr;
+
+		const float* ScaleX = nullptr;
+		const float* ScaleY = nullptr;
+		const float* ScaleZ = nullptr;
+	};
+
+	///<summary>
+	/// Writes World = XMMatrixScaling * XMMatrixRotationQuaternion * XMMatrixTranslation
+	/// for each item.  If transpose is true the transposed matrix is written, which is
+	/// the layout the shaders expect in the object constants.
+	///</summary>
+	static void ComposeWorlds(const Streams& streams, std::size_t count,
+		std::uint8_t* dest, std::size_t destStride, bool transpose);
+
+private:
+	static void ComposeWorldsScalar(const Streams& streams, std::size_t first, std::size_t count,
+		std::uint8_t* dest, std::size_t destStride, bool transpose);
+};
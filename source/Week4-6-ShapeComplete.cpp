@@ -6,10 +6,72 @@
  * world matrix needs to be changed between objects)
  *
  *   Controls:
- *   Hold down '1' key to view scene in wireframe mode.
+ *   Hold down '1' key to draw the triangle edges over the solid shapes.
+ *   Press '2' to toggle instanced drawing of repeated shapes.
+ *   Press '3' to toggle the sorted draw list (redundant state binds skipped).
+ *   Press '4' to toggle multithreaded recording of the opaque pass.
+ *   Press '5' to toggle the battlement animation.
+ *   Press '6' to toggle GPU frustum culling (compute pass + ExecuteIndirect).
+ *   Press '7' to show the CPU and GPU scope timings in the window caption.
+ *   Press '8' to write the last frames' timings to ShapesProfile.csv and
+ *   ShapesProfile.json (Chrome trace; open in chrome://tracing or ui.perfetto.dev).
+ *   Press '9' (with -planet) to regenerate the planet at the next of 1-6 subdivisions
+ *   and stream it in through the runtime geometry heap; the previous version keeps
+ *   drawing until the copy queue has uploaded the new one.  With -gpuplanet the
+ *   compute generators write it in place instead.
+ *   Press '0' to toggle the depth pre-pass: the opaque objects are first drawn depth-only,
+ *   front to back, then shaded with an EQUAL depth test so each pixel is shaded once
+ *   (not with GPU culling).  Without the draw list ('3') the objects are always drawn
+ *   front to back.
  *   Hold the left mouse button down and move the mouse to rotate.
  *   Hold the right mouse button down and move the mouse to zoom in and out.
  *
+ *   Spheres, cylinders, cones and diamonds switch to coarser LOD levels as their
+ *   projected size shrinks (per-object draws; instanced and GPU-culled draws use level 0).
+ *
+ *   Command line:
+ *   -recordthreads N   Number of worker threads used for multithreaded recording.
+ *   -bindless          Bind object constants as one structured buffer per frame (root SRV)
+ *                      selected by a root constant, instead of one CBV descriptor per object.
+ *   -framesinflight N  Number of frame resources the CPU may run ahead of the GPU (1-16).
+ *   -latencywaiter     Recreate the swap chain with a frame latency waitable object and
+ *                      wait on it each frame.
+ *   -maxlatency N      Maximum frame latency used with -latencywaiter.
+ *   -planet N          Add a geosphere with N subdivisions above the castle.
+ *   -indexmode M       Index format of the geometry buffers: auto (R16 where it fits,
+ *                      R32 otherwise), 32 (R32 only) or split16 (split large meshes).
+ *   -compactvertices   Store positions as SNORM16 relative to each submesh's bounds and
+ *                      colors as RGBA8 (12-byte vertices instead of 28).
+ *   -optimizemeshes    Reorder every generated mesh for vertex cache and vertex fetch
+ *                      locality and report the ACMR of each shape before and after.
+ *   -geometryjobs N    Threads used to generate and pack the geometry at startup
+ *                      (default: one per hardware thread; 1 generates serially).
+ *   -scene PATH        Scene to load (default Scenes\Castle.scene); ".sceneb" files are
+ *                      binary scenes written by -bakescene.
+ *   -bakescene PATH    Write the loaded scene as a binary scene file.
+ *   -nogeometrycache   Always generate the geometry.  By default the packed buffers are
+ *                      loaded from ShapesGeometry.cache and regenerated (and the cache
+ *                      rewritten) only when the generator parameters have changed.
+ *   -depthprepass      Start with the depth pre-pass on.
+ *   -gpugeometrycheck  Generate the grid, a sphere and a cylinder with the compute
+ *                      generators at startup and report how far they are from the CPU
+ *                      meshes in the debug log.
+ *   -gpuplanet         Stream the planet ('9') as a UV sphere generated by the compute
+ *                      generators straight into the geometry heap, instead of a geosphere
+ *                      generated on the CPU and copied.
+ *   -nopipelinecache   Create every PSO.  By default the PSOs are loaded from the pipeline
+ *                      library in ShapesPipelines.cache, which is rewritten when a PSO
+ *                      was missing or changed.  Shader bytecode is always read from the
+ *                      .cso next to each .hlsl when it is up to date.
+ *   -profile NAME      Write the last frames' timings to NAME.csv and NAME.json on exit.
+ *   -stress N          Replace the scene with N shapes (1k-1M) laid out on a grid, to
+ *                      test the render path at scale.  Frame time percentiles are
+ *                      reported once per second.  Past the shader-visible descriptor heap
+ *                      limit the object constants are bound bindless.
+ *   -stressanimated F  Fraction of the stress objects animated every frame (default 0.1).
+ *   -stressframes N    Quit after measuring N stress frames and append the percentiles
+ *                      and the draw path to ShapesStress.csv.
+ *
  *  @author Hooman Salamat
  */
 
@@ -17,50 +79,196 @@
 #include "../../Common/d3dApp.h"
 #include "../../Common/MathHelper.h"
 #include "../../Common/UploadBuffer.h"
-#include "../../Common/GeometryGenerator.h"
+#include "DepthSort.h"
+#include "FramePacer.h"
+#include "FrameProfiler.h"
 #include "FrameResource.h"
+#include "GeometryGenerator.h"
+#include "GeometryHeap.h"
+#include "GeometryPacker.h"
+#include "GpuGeometryGenerator.h"
+#include "ParallelFor.h"
+#include "PipelineCache.h"
+#include "SceneFile.h"
+#include "SceneStore.h"
+#include "ShapeGeometry.h"
+#include "TransformBatch.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <mutex>
+#include <sstream>
+#include <thread>
 
 using Microsoft::WRL::ComPtr;
 using namespace DirectX;
 using namespace DirectX::PackedVector;
 
-const int gNumFrameResources = 3;
+// Packed geometry cache and pipeline library, relative to the working directory.
+const wchar_t* const gGeometryCachePath = L"ShapesGeometry.cache";
+const wchar_t* const gPipelineLibraryPath = L"ShapesPipelines.cache";
+
+// Objects with an LOD chain whose level is re-evaluated per frame, besides the moved
+// ones; larger scenes take several frames to go through.
+const size_t gLodObjectsPerFrame = 16384;
+
+// Clip planes of the camera projection, also the range of the depth sort keys.
+const float gNearZ = 1.0f;
+const float gFarZ = 1000.0f;
+
+// Subdivisions the streamed planet cycles through, and how many of the largest of them
+// the geometry heap holds at once: the one drawn, the one uploading and room for
+// fragmentation.
+const UINT gMaxStreamedPlanetSubdivisions = 6;
+const UINT gGeometryHeapPlanetCapacity = 3;
+
+// Startup options read from the command line.
+struct AppOptions
+{
+	// Frame resources in the ring; how many frames the CPU may queue ahead of the GPU.
+	UINT FramesInFlight = 3;
+
+	// Pace frames with the swap chain's frame latency waitable object.
+	bool LatencyWaiter = false;
+	UINT MaxFrameLatency = 1;
+
+	// Subdivisions of the optional planet geosphere (0 = none) and how meshes too
+	// large for 16-bit indices are packed.
+	UINT PlanetSubdivisions = 0;
+	GeometryPacker::IndexMode IndexMode = GeometryPacker::IndexMode::Auto;
+
+	// Quantized vertex layout, decoded by the vertex shaders.
+	bool CompactVertices = false;
+
+	// Vertex cache / vertex fetch reordering of the generated meshes.
+	bool OptimizeMeshes = false;
+
+	// Threads generating and packing the geometry at startup.
+	UINT GeometryJobs = DefaultJobCount();
+
+	// Load the packed geometry from the cache file when its key matches.
+	bool GeometryCache = true;
+
+	// Load and store the PSOs in the pipeline library file.
+	bool PipelineCache = true;
+
+	// Compare the compute shape generators with GeometryGenerator at startup.
+	bool GpuGeometryCheck = false;
+
+	// Generate the streamed planet with the compute shape generators.
+	bool GpuPlanet = false;
 
-// Lightweight structure stores parameters to draw a shape.  This will
-// vary from app-to-app.
-struct RenderItem
+	// Lay down the depth of the opaque objects before shading them.
+	bool DepthPrePass = false;
+
+	// Scene description to load, and where to write its binary form (empty = don't).
+	std::wstring ScenePath = L"Scenes\\Castle.scene";
+	std::wstring BakeScenePath;
+
+	// Base path of the profiler dumps written on exit (empty = don't).
+	std::wstring ProfilePath;
+
+	// Stress scene in place of ScenePath (0 = off); see StressSceneOptions.
+	UINT StressObjects = 0;
+	float StressAnimatedFraction = 0.1f;
+
+	// Stress frames measured before quitting (0 = run until closed).
+	UINT StressFrames = 0;
+
+	// Worker threads (and command lists per frame resource) for multithreaded recording.
+	UINT RecordThreads = 4;
+
+	// Object constants in a structured buffer indexed by a root constant rather
+	// than one CBV descriptor per object per frame resource.
+	bool BindlessObjectConstants = false;
+};
+
+// Group of render items that draw the same submesh.  The whole group is drawn
+// with a single DrawIndexedInstanced call; the world matrices of its items are
+// stored contiguously in the instance buffer starting at StartInstance.
+struct InstanceBatch
 {
-	RenderItem() = default;
+	// Index into SceneStore::Submeshes.
+	UINT SubmeshId = 0;
+
+	UINT StartInstance = 0;
+
+	// Scene object indices of the items in the batch.
+	std::vector<UINT> Objects;
+};
+
+// Contiguous range of scene objects animated every frame.  The rest pose is kept as
+// transform streams so the whole group is composed by the batch transform kernel.
+struct AnimatedGroup
+{
+	UINT FirstObject = 0;
+	UINT Count = 0;
+
+	std::vector<float> TranslationX, TranslationY, TranslationZ;
+	std::vector<float> RotationX, RotationY, RotationZ, RotationW;
+	std::vector<float> ScaleX, ScaleY, ScaleZ;
+
+	// Animated copy of TranslationY.
+	std::vector<float> AnimatedY;
+
+	TransformBatch::Streams GetStreams(const std::vector<float>& translationY)const
+	{
+		TransformBatch::Streams streams;
+		streams.TranslationX = TranslationX.data();
+		streams.TranslationY = translationY.data();
+		streams.TranslationZ = TranslationZ.data();
+		streams.RotationX = RotationX.data();
+		streams.RotationY = RotationY.data();
+		streams.RotationZ = RotationZ.data();
+		streams.RotationW = RotationW.data();
+		streams.ScaleX = ScaleX.data();
+		streams.ScaleY = ScaleY.data();
+		streams.ScaleZ = ScaleZ.data();
+		return streams;
+	}
+};
 
-	// World matrix of the shape that describes the object's local space
-	// relative to the world space, which defines the position, orientation,
-	// and scale of the object in the world.
-	XMFLOAT4X4 World = MathHelper::Identity4x4();
+// Counters gathered while recording a draw list, so the number of state
+// changes can be compared against the number of draws.
+struct DrawListStats
+{
+	UINT PsoChanges = 0;
+	UINT GeometryChanges = 0;
+	UINT TopologyChanges = 0;
+	UINT Draws = 0;
 
-	// Dirty flag indicating the object data has changed and we need to update the constant buffer.
-	// Because we have an object cbuffer for each FrameResource, we have to apply the
-	// update to each FrameResource.  Thus, when we modify obect data we should set 
-	// NumFramesDirty = gNumFrameResources so that each frame resource gets the update.
-	int NumFramesDirty = gNumFrameResources;
+	UINT StateChanges()const { return PsoChanges + GeometryChanges + TopologyChanges; }
+};
 
-	// Index into GPU constant buffer corresponding to the ObjectCB for this render item.
-	UINT ObjCBIndex = -1;
+// Render items sorted once by (PSO, geometry, topology).  Recording only binds
+// pipeline and input assembler state when the key changes.
+struct DrawList
+{
+	struct Entry
+	{
+		UINT64 SortKey = 0;
+		UINT Object = 0;
+	};
 
-	MeshGeometry* Geo = nullptr;
+	std::vector<Entry> Entries;
 
-	// Primitive topology.
-	D3D12_PRIMITIVE_TOPOLOGY PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+	// Geometry ids of the sort keys, and the entry of each scene object (SIZE_MAX if
+	// the object is not in the list), to check objects that changed submesh.
+	std::vector<MeshGeometry*> Geometries;
+	std::vector<size_t> ObjectEntries;
 
-	// DrawIndexedInstanced parameters.
-	UINT IndexCount = 0;
-	UINT StartIndexLocation = 0;
-	int BaseVertexLocation = 0;
+	// Stats of the last recording.
+	DrawListStats Stats;
 };
 
 class ShapesApp : public D3DApp
 {
 public:
-	ShapesApp(HINSTANCE hInstance);
+	ShapesApp(HINSTANCE hInstance, const AppOptions& options);
 	ShapesApp(const ShapesApp& rhs) = delete;
 	ShapesApp& operator=(const ShapesApp& rhs) = delete;
 	~ShapesApp();
@@ -69,6 +277,8 @@ public:
 
 private:
 	virtual void OnResize()override;
+	void CreateWaitableSwapChain();
+	void ResizeSwapChain();
 	virtual void Update(const GameTimer& gt)override;
 	virtual void Draw(const GameTimer& gt)override;
 
@@ -77,48 +287,224 @@ private:
 	virtual void OnMouseMove(WPARAM btnState, int x, int y)override;
 
 	void OnKeyboardInput(const GameTimer& gt);
+	bool IsKeyToggled(int key);
 	void UpdateCamera(const GameTimer& gt);
 	void UpdateObjectCBs(const GameTimer& gt);
+	void UploadWorldMatrices(const std::vector<UINT>& objects, const std::vector<UINT>& slots,
+		BYTE* mappedData, UINT stride);
 	void UpdateMainPassCB(const GameTimer& gt);
+	void UpdateAnimatedGroups(const GameTimer& gt);
+	void UpdateLods(const GameTimer& gt);
+	void UpdateDrawOrder();
+	void RestoreAnimatedGroups();
 
 	void BuildDescriptorHeaps();
 	void BuildConstantBufferViews();
 	void BuildRootSignature();
+	void BuildCullRootSignature();
+	void BuildCullResources();
 	void BuildShadersAndInputLayout();
 	void BuildShapeGeometry();
+	void CheckGpuGeometry();
+	void BuildGeometryHeap();
+	void StreamPlanet();
+	bool AddGpuPlanet(const std::string& name, UINT subdivisions);
+	void WriteGpuPlanet(ID3D12CommandAllocator* cmdListAlloc);
+	void UpdateStreamedGeometry();
 	void BuildPSOs();
 	void BuildFrameResources();
-	void BuildRenderItems();
-	void DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems);
+	bool BuildRenderItems();
+	void BuildInstanceBatches();
+	void BuildAnimatedGroups();
+	void AddAnimatedGroup(UINT first, UINT last);
+	void BuildDrawList(const std::vector<UINT>& ritems, DrawList& drawList);
+	void PatchDrawList(const std::vector<UINT>& ritems, const std::vector<UINT>& changedObjects, DrawList& drawList);
+	UINT64 DrawListSortKey(UINT object, DrawList& drawList);
+	void DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<UINT>& ritems);
+	void DrawInstanceBatches(ID3D12GraphicsCommandList* cmdList, const std::vector<InstanceBatch>& batches);
+	void RecordDrawList(ID3D12GraphicsCommandList* cmdList, DrawList& drawList,
+		ID3D12PipelineState* const layerPSOs[], ID3D12PipelineState* boundPSO);
+	DrawListStats RecordDrawListRange(ID3D12GraphicsCommandList* cmdList, const DrawList& drawList,
+		size_t first, size_t last, ID3D12PipelineState* const layerPSOs[], ID3D12PipelineState* boundPSO);
+	void ReportDrawListStats(DrawList& drawList, const DrawListStats& stats);
+
+	void BindPassState(ID3D12GraphicsCommandList* cmdList);
+	void BindObjectConstants(ID3D12GraphicsCommandList* cmdList, UINT object);
+	void PresentAndSignal();
+	void ReportFramePacing(const GameTimer& gt);
+	void ReportProfiler(const GameTimer& gt);
+	void UpdateStressStats(const GameTimer& gt);
+	void WriteStressResults();
+	void WriteProfile(const std::wstring& path);
+	void StartRecordThreads();
+	void StopRecordThreads();
+	void RecordThreadLoop(UINT threadIndex);
+	void RecordOpaqueChunk(UINT threadIndex);
+	void RecordOpaquePassMultithreaded();
+	void DrawCulledIndirect(ID3D12GraphicsCommandList* cmdList, ID3D12PipelineState* pso);
+	void DrawDepthPrePass(ID3D12GraphicsCommandList* cmdList);
 
 private:
 
+	UINT mNumFrameResources = 0;
 	std::vector<std::unique_ptr<FrameResource>> mFrameResources;
 	FrameResource* mCurrFrameResource = nullptr;
 	int mCurrFrameResourceIndex = 0;
 
+	// Waits for frame resources to be released by the GPU; created once the fence exists.
+	std::unique_ptr<FramePacer> mFramePacer;
+	bool mUseLatencyWaiter = false;
+	UINT mMaxFrameLatency = 1;
+
+	// Flags the swap chain was created with, which ResizeBuffers must pass unchanged;
+	// -latencywaiter adds DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT.
+	UINT mSwapChainFlags = DXGI_SWAP_CHAIN_FLAG_ALLOW_MODE_SWITCH;
+	float mFramePacingReportTime = 0.0f;
+
+	// CPU scope and GPU timestamp timings; created with the frame pacer.
+	std::unique_ptr<FrameProfiler> mProfiler;
+	std::wstring mProfilePath;
+	std::wstring mBaseCaption;
+	bool mShowProfilerOverlay = false;
+	float mProfilerReportTime = 0.0f;
+
 	ComPtr<ID3D12RootSignature> mRootSignature = nullptr;
+
+	// GPU frustum culling: the compute pass appends one indirect command per visible
+	// object, with the append counter stored after the commands in the same buffer.
+	ComPtr<ID3D12RootSignature> mCullRootSignature = nullptr;
+	ComPtr<ID3D12CommandSignature> mCullCommandSignature = nullptr;
+	std::unique_ptr<UploadBuffer<CullObjectData>> mCullObjects = nullptr;
+	std::unique_ptr<UploadBuffer<UINT>> mCullCounterReset = nullptr;
+	ComPtr<ID3D12Resource> mIndirectCommands = nullptr;
+	UINT mIndirectCounterOffset = 0;
+	UINT mCullObjectCount = 0;
+	UINT mCullUavIndex = 0;
+	MeshGeometry* mCullGeo = nullptr;
+	std::vector<UINT> mUnculledObjects;
 	ComPtr<ID3D12DescriptorHeap> mCbvHeap = nullptr;
 
 	ComPtr<ID3D12DescriptorHeap> mSrvDescriptorHeap = nullptr;
 
 	std::unordered_map<std::string, std::unique_ptr<MeshGeometry>> mGeometries;
+
+	// Runtime geometry; only created for a planet that can be streamed.  The scene's
+	// planet submesh is pointed at mStreamedPlanet in the heap once mPendingPlanet,
+	// the version being uploaded, has arrived.
+	std::unique_ptr<GeometryHeap> mGeometryHeap;
+	UINT mPlanetSubmesh = SceneStore::InvalidId;
+	UINT mPlanetStreamCount = 0;
+	UINT mStreamedPlanetSubdivisions = 0;
+	std::string mStreamedPlanet;
+	std::string mPendingPlanet;
+	UINT mPendingPlanetSubdivisions = 0;
+	DirectX::BoundingSphere mPendingPlanetBounds;
+	XMFLOAT3 mPendingPlanetPosScale = { 1.0f, 1.0f, 1.0f };
+	XMFLOAT3 mPendingPlanetPosBias = { 0.0f, 0.0f, 0.0f };
+
+	// With -gpuplanet, the pending planet is written by the next Draw, ahead of its frame.
+	std::unique_ptr<GpuGeometryGenerator> mGpuGeometryGenerator;
+	bool mPendingGpuPlanetWrite = false;
+	GpuGeometryGenerator::Target mPendingGpuPlanetTarget;
+	UINT mPendingGpuPlanetSlices = 0;
+	UINT mPendingGpuPlanetStacks = 0;
 	std::unordered_map<std::string, ComPtr<ID3DBlob>> mShaders;
 	std::unordered_map<std::string, ComPtr<ID3D12PipelineState>> mPSOs;
 
 	std::vector<D3D12_INPUT_ELEMENT_DESC> mInputLayout;
 
-	// List of all the render items.
-	std::vector<std::unique_ptr<RenderItem>> mAllRitems;
+	// Loads the shaders and creates the PSOs in the background during Initialize.  Its
+	// pipelines point to the shaders, input layout and root signatures, so it is
+	// declared after them and joins its threads first.
+	std::unique_ptr<PipelineCache> mPipelineCache;
+
+	// All the render items, stored as contiguous columns.
+	SceneStore mScene;
+
+	// Render items (object indices into mScene) divided by PSO.
+	std::vector<UINT> mOpaqueRitems;
+
+	// Scratch storage reused by UploadWorldMatrices every frame.
+	std::vector<std::pair<UINT, UINT>> mUploadSlots;
+	std::vector<BYTE> mUploadStaging;
 
-	// Render items divided by PSO.
-	std::vector<RenderItem*> mOpaqueRitems;
+	// Groups of wall pieces animated with the batch transform kernel.
+	std::vector<AnimatedGroup> mAnimatedGroups;
+
+	// Opaque render items grouped by submesh for instanced drawing.
+	std::vector<InstanceBatch> mOpaqueInstanceBatches;
+
+	// Opaque render items sorted by state for the draw list path.
+	DrawList mOpaqueDrawList;
+
+	// Scratch storage for the objects that switched LOD level in a frame.
+	std::vector<UINT> mLodChanges;
+
+	// Opaque render items nearest first, sorted every frame they are drawn in that order.
+	DepthSorter mOpaqueDepthOrder;
 
 	PassConstants mMainPassCB;
 
 	UINT mPassCbvOffset = 0;
 
-	bool mIsWireframe = false;
+	// Root signature layout chosen at startup; see AppOptions::BindlessObjectConstants.
+	bool mBindlessObjectConstants = false;
+
+	// Geometry options; see AppOptions::PlanetSubdivisions and AppOptions::IndexMode.
+	UINT mPlanetSubdivisions = 0;
+	GeometryPacker::IndexMode mIndexMode = GeometryPacker::IndexMode::Auto;
+	bool mCompactVertices = false;
+	bool mOptimizeMeshes = false;
+	UINT mGeometryJobs = 1;
+	bool mUseGeometryCache = false;
+	bool mUsePipelineCache = false;
+	bool mGpuGeometryCheck = false;
+	bool mGpuPlanet = false;
+
+	// See AppOptions::ScenePath.
+	std::wstring mScenePath;
+	std::wstring mBakeScenePath;
+
+	// Stress scene; the first mStressAnimatedObjects objects are animated.  Frame times
+	// in milliseconds, of the current report period and of the whole run.
+	UINT mStressObjects = 0;
+	float mStressAnimatedFraction = 0.0f;
+	UINT mStressFrames = 0;
+	UINT mStressAnimatedObjects = 0;
+	UINT mStressFrameCount = 0;
+	float mStressReportTime = 0.0f;
+	std::vector<float> mStressPeriodFrameTimes;
+	std::vector<float> mStressFrameTimes;
+
+	// Held '1': edge overlay, drawn by the opaque PSOs from the pass constants.
+	bool mShowEdges = false;
+	bool mUseInstancing = false;
+	bool mUseDrawList = true;
+	bool mUseMultithreadedRecording = false;
+	bool mAnimateBattlements = false;
+	bool mUseGpuCulling = false;
+	bool mUseDepthPrePass = false;
+
+	// Worker threads that record chunks of the opaque draw list into the
+	// per-frame-resource worker command lists.
+	UINT mNumRecordThreads = 0;
+	std::vector<std::thread> mRecordThreads;
+	std::mutex mRecordMutex;
+	std::condition_variable mRecordStartCv;
+	std::condition_variable mRecordDoneCv;
+	UINT64 mRecordGeneration = 0;
+	UINT mRecordPending = 0;
+	bool mRecordQuit = false;
+	std::exception_ptr mRecordError;
+
+	// Frame state shared with the record threads; written before they are woken.
+	ID3D12PipelineState* mRecordPSO = nullptr;
+	UINT mRecordFrameScope = FrameProfiler::InvalidScope;
+	UINT mRecordOpaqueScope = FrameProfiler::InvalidScope;
+	std::vector<DrawListStats> mRecordStats;
+
+	// Key state from the previous frame, used to detect key presses for toggles.
+	bool mKeyWasDown[256] = {};
 
 	XMFLOAT3 mEyePos = { 0.0f, 0.0f, 0.0f };
 	XMFLOAT4X4 mView = MathHelper::Identity4x4();
@@ -131,6 +517,82 @@ private:
 	POINT mLastMousePos;
 };
 
+AppOptions ParseAppOptions(PSTR cmdLine)
+{
+	AppOptions options;
+
+	std::istringstream args(cmdLine != nullptr ? cmdLine : "");
+	std::string arg;
+	while (args >> arg)
+	{
+		if (arg == "-recordthreads")
+			args >> options.RecordThreads;
+		else if (arg == "-bindless")
+			options.BindlessObjectConstants = true;
+		else if (arg == "-framesinflight")
+			args >> options.FramesInFlight;
+		else if (arg == "-latencywaiter")
+			options.LatencyWaiter = true;
+		else if (arg == "-maxlatency")
+			args >> options.MaxFrameLatency;
+		else if (arg == "-planet")
+			args >> options.PlanetSubdivisions;
+		else if (arg == "-indexmode")
+		{
+			std::string mode;
+			args >> mode;
+			if (mode == "32")
+				options.IndexMode = GeometryPacker::IndexMode::Force32;
+			else if (mode == "split16")
+				options.IndexMode = GeometryPacker::IndexMode::Split16;
+			else
+				options.IndexMode = GeometryPacker::IndexMode::Auto;
+		}
+		else if (arg == "-compactvertices")
+			options.CompactVertices = true;
+		else if (arg == "-optimizemeshes")
+			options.OptimizeMeshes = true;
+		else if (arg == "-geometryjobs")
+			args >> options.GeometryJobs;
+		else if (arg == "-nogeometrycache")
+			options.GeometryCache = false;
+		else if (arg == "-nopipelinecache")
+			options.PipelineCache = false;
+		else if (arg == "-gpugeometrycheck")
+			options.GpuGeometryCheck = true;
+		else if (arg == "-gpuplanet")
+			options.GpuPlanet = true;
+		else if (arg == "-depthprepass")
+			options.DepthPrePass = true;
+		else if (arg == "-scene" && args >> arg)
+			options.ScenePath = AnsiToWString(arg);
+		else if (arg == "-bakescene" && args >> arg)
+			options.BakeScenePath = AnsiToWString(arg);
+		else if (arg == "-profile" && args >> arg)
+			options.ProfilePath = AnsiToWString(arg);
+		else if (arg == "-stress")
+			args >> options.StressObjects;
+		else if (arg == "-stressanimated")
+			args >> options.StressAnimatedFraction;
+		else if (arg == "-stressframes")
+			args >> options.StressFrames;
+	}
+
+	options.RecordThreads = std::max(options.RecordThreads, 1u);
+	options.GeometryJobs = std::max(options.GeometryJobs, 1u);
+	options.FramesInFlight = std::min(std::max(options.FramesInFlight, 1u), 16u);
+	options.MaxFrameLatency = std::min(std::max(options.MaxFrameLatency, 1u), 16u);
+	options.StressAnimatedFraction = std::min(std::max(options.StressAnimatedFraction, 0.0f), 1.0f);
+
+	// One CBV per object per frame resource would not fit a shader-visible heap
+	// (+1 object for the stress ground, +1 per frame for the pass CBV, +1 culling UAV).
+	UINT64 stressDescriptors = ((UINT64)options.StressObjects + 2) * options.FramesInFlight + 1;
+	if (options.StressObjects > 0 && stressDescriptors > D3D12_MAX_SHADER_VISIBLE_DESCRIPTOR_HEAP_SIZE_TIER_1)
+		options.BindlessObjectConstants = true;
+
+	return options;
+}
+
 int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE prevInstance,
 	PSTR cmdLine, int showCmd)
 {
@@ -141,7 +603,7 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE prevInstance,
 
 	try
 	{
-		ShapesApp theApp(hInstance);
+		ShapesApp theApp(hInstance, ParseAppOptions(cmdLine));
 		if (!theApp.Initialize())
 			return 0;
 
@@ -154,15 +616,42 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE prevInstance,
 	}
 }
 
-ShapesApp::ShapesApp(HINSTANCE hInstance)
-	: D3DApp(hInstance)
+ShapesApp::ShapesApp(HINSTANCE hInstance, const AppOptions& options)
+	: D3DApp(hInstance),
+	mNumFrameResources(options.FramesInFlight),
+	mUseLatencyWaiter(options.LatencyWaiter),
+	mMaxFrameLatency(options.MaxFrameLatency),
+	mProfilePath(options.ProfilePath),
+	mScene(options.FramesInFlight),
+	mBindlessObjectConstants(options.BindlessObjectConstants),
+	mPlanetSubdivisions(options.PlanetSubdivisions),
+	mIndexMode(options.IndexMode),
+	mCompactVertices(options.CompactVertices),
+	mOptimizeMeshes(options.OptimizeMeshes),
+	mGeometryJobs(options.GeometryJobs),
+	mUseGeometryCache(options.GeometryCache),
+	mUsePipelineCache(options.PipelineCache),
+	mGpuGeometryCheck(options.GpuGeometryCheck),
+	mGpuPlanet(options.GpuPlanet),
+	mScenePath(options.ScenePath),
+	mBakeScenePath(options.BakeScenePath),
+	mStressObjects(options.StressObjects),
+	mStressAnimatedFraction(options.StressAnimatedFraction),
+	mStressFrames(options.StressFrames),
+	mUseDepthPrePass(options.DepthPrePass),
+	mNumRecordThreads(options.RecordThreads)
 {
 }
 
 ShapesApp::~ShapesApp()
 {
+	StopRecordThreads();
+
 	if (md3dDevice != nullptr)
 		FlushCommandQueue();
+
+	if (mProfiler != nullptr && !mProfilePath.empty())
+		WriteProfile(mProfilePath);
 }
 
 bool ShapesApp::Initialize()
@@ -170,17 +659,32 @@ bool ShapesApp::Initialize()
 	if (!D3DApp::Initialize())
 		return false;
 
+	// D3DApp creates a swap chain without the frame latency waitable object.
+	if (mUseLatencyWaiter)
+		CreateWaitableSwapChain();
+
 	// Reset the command list to prep for initialization commands.
 	ThrowIfFailed(mCommandList->Reset(mDirectCmdListAlloc.Get(), nullptr));
 
+	mPipelineCache = std::make_unique<PipelineCache>(md3dDevice.Get(), mUsePipelineCache ? gPipelineLibraryPath : L"");
+
+	// The PSOs are created on background threads while the geometry and the scene are
+	// built, and collected once the initialization commands have executed.
 	BuildRootSignature();
+	BuildCullRootSignature();
 	BuildShadersAndInputLayout();
+	BuildPSOs();
 	BuildShapeGeometry();
-	BuildRenderItems();
+	BuildGeometryHeap();
+	if (!BuildRenderItems())
+		return false;
+	BuildInstanceBatches();
+	BuildAnimatedGroups();
+	BuildDrawList(mOpaqueRitems, mOpaqueDrawList);
 	BuildFrameResources();
 	BuildDescriptorHeaps();
 	BuildConstantBufferViews();
-	BuildPSOs();
+	BuildCullResources();
 
 	// Execute the initialization commands.
 	ThrowIfFailed(mCommandList->Close());
@@ -190,62 +694,202 @@ bool ShapesApp::Initialize()
 	// Wait until initialization is complete.
 	FlushCommandQueue();
 
+	// The geometry copies have executed; the upload buffers are no longer needed.
+	for (auto& geo : mGeometries)
+		geo.second->DisposeUploaders();
+
+	mPipelineCache->Finish(mPSOs);
+
+	if (mGpuGeometryCheck)
+		CheckGpuGeometry();
+
+	if (mGpuPlanet && mGeometryHeap != nullptr)
+		mGpuGeometryGenerator = std::make_unique<GpuGeometryGenerator>(md3dDevice.Get(), *mPipelineCache);
+
+	mFramePacer = std::make_unique<FramePacer>(mFence.Get(), mNumFrameResources);
+	if (mUseLatencyWaiter && !mFramePacer->EnableLatencyWaiter(mSwapChain.Get(), mMaxFrameLatency))
+		::OutputDebugStringA("FramePacer: swap chain is not waitable, pacing on the fence only\n");
+
+	mProfiler = std::make_unique<FrameProfiler>(md3dDevice.Get(), mCommandQueue.Get(), mNumFrameResources);
+	mBaseCaption = mMainWndCaption;
+
+	StartRecordThreads();
+
 	return true;
 }
 
 void ShapesApp::OnResize()
 {
-	D3DApp::OnResize();
+	ResizeSwapChain();
 
 	// The window resized, so update the aspect ratio and recompute the projection matrix.
-	XMMATRIX P = XMMatrixPerspectiveFovLH(0.25f * MathHelper::Pi, AspectRatio(), 1.0f, 1000.0f);
+	XMMATRIX P = XMMatrixPerspectiveFovLH(0.25f * MathHelper::Pi, AspectRatio(), gNearZ, gFarZ);
 	XMStoreFloat4x4(&mProj, P);
 }
 
+void ShapesApp::CreateWaitableSwapChain()
+{
+	// The same swap chain as D3DApp's, plus the flag.  The old one and its buffers must be
+	// released before the window gets a new one.
+	DXGI_SWAP_CHAIN_DESC sd;
+	ThrowIfFailed(mSwapChain->GetDesc(&sd));
+	mSwapChainFlags = sd.Flags | DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT;
+	sd.Flags = mSwapChainFlags;
+
+	FlushCommandQueue();
+	for (int i = 0; i < SwapChainBufferCount; ++i)
+		mSwapChainBuffer[i].Reset();
+	mSwapChain.Reset();
+
+	// Note: Swap chain uses queue to perform flush.
+	ThrowIfFailed(mdxgiFactory->CreateSwapChain(mCommandQueue.Get(), &sd, mSwapChain.GetAddressOf()));
+
+	// Recreates the render target views of the new buffers.
+	OnResize();
+}
+
+void ShapesApp::ResizeSwapChain()
+{
+	// The app's only resize path, in place of D3DApp::OnResize, which always passes
+	// DXGI_SWAP_CHAIN_FLAG_ALLOW_MODE_SWITCH: ResizeBuffers fails unless the flags are
+	// the ones the swap chain was created with.
+	assert(md3dDevice);
+	assert(mSwapChain);
+	assert(mDirectCmdListAlloc);
+
+	// Flush before changing any resources.
+	FlushCommandQueue();
+
+	ThrowIfFailed(mCommandList->Reset(mDirectCmdListAlloc.Get(), nullptr));
+
+	// Release the previous resources we will be recreating.
+	for (int i = 0; i < SwapChainBufferCount; ++i)
+		mSwapChainBuffer[i].Reset();
+	mDepthStencilBuffer.Reset();
+
+	ThrowIfFailed(mSwapChain->ResizeBuffers(
+		SwapChainBufferCount,
+		mClientWidth, mClientHeight,
+		mBackBufferFormat,
+		mSwapChainFlags));
+
+	mCurrBackBuffer = 0;
+
+	CD3DX12_CPU_DESCRIPTOR_HANDLE rtvHeapHandle(mRtvHeap->GetCPUDescriptorHandleForHeapStart());
+	for (UINT i = 0; i < SwapChainBufferCount; i++)
+	{
+		ThrowIfFailed(mSwapChain->GetBuffer(i, IID_PPV_ARGS(&mSwapChainBuffer[i])));
+		md3dDevice->CreateRenderTargetView(mSwapChainBuffer[i].Get(), nullptr, rtvHeapHandle);
+		rtvHeapHandle.Offset(1, mRtvDescriptorSize);
+	}
+
+	// Create the depth/stencil buffer and view.
+	D3D12_RESOURCE_DESC depthStencilDesc;
+	depthStencilDesc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
+	depthStencilDesc.Alignment = 0;
+	depthStencilDesc.Width = mClientWidth;
+	depthStencilDesc.Height = mClientHeight;
+	depthStencilDesc.DepthOrArraySize = 1;
+	depthStencilDesc.MipLevels = 1;
+	depthStencilDesc.Format = DXGI_FORMAT_R24G8_TYPELESS;
+	depthStencilDesc.SampleDesc.Count = m4xMsaaState ? 4 : 1;
+	depthStencilDesc.SampleDesc.Quality = m4xMsaaState ? (m4xMsaaQuality - 1) : 0;
+	depthStencilDesc.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
+	depthStencilDesc.Flags = D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL;
+
+	D3D12_CLEAR_VALUE optClear;
+	optClear.Format = mDepthStencilFormat;
+	optClear.DepthStencil.Depth = 1.0f;
+	optClear.DepthStencil.Stencil = 0;
+	ThrowIfFailed(md3dDevice->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+		D3D12_HEAP_FLAG_NONE,
+		&depthStencilDesc,
+		D3D12_RESOURCE_STATE_COMMON,
+		&optClear,
+		IID_PPV_ARGS(mDepthStencilBuffer.GetAddressOf())));
+
+	D3D12_DEPTH_STENCIL_VIEW_DESC dsvDesc;
+	dsvDesc.Flags = D3D12_DSV_FLAG_NONE;
+	dsvDesc.ViewDimension = D3D12_DSV_DIMENSION_TEXTURE2D;
+	dsvDesc.Format = mDepthStencilFormat;
+	dsvDesc.Texture2D.MipSlice = 0;
+	md3dDevice->CreateDepthStencilView(mDepthStencilBuffer.Get(), &dsvDesc, DepthStencilView());
+
+	mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(mDepthStencilBuffer.Get(),
+		D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_DEPTH_WRITE));
+
+	// Execute the resize commands.
+	ThrowIfFailed(mCommandList->Close());
+	ID3D12CommandList* cmdsLists[] = { mCommandList.Get() };
+	mCommandQueue->ExecuteCommandLists(_countof(cmdsLists), cmdsLists);
+
+	// Wait until resize is complete.
+	FlushCommandQueue();
+
+	mScreenViewport.TopLeftX = 0;
+	mScreenViewport.TopLeftY = 0;
+	mScreenViewport.Width = static_cast<float>(mClientWidth);
+	mScreenViewport.Height = static_cast<float>(mClientHeight);
+	mScreenViewport.MinDepth = 0.0f;
+	mScreenViewport.MaxDepth = 1.0f;
+
+	mScissorRect = { 0, 0, mClientWidth, mClientHeight };
+}
+
 void ShapesApp::Update(const GameTimer& gt)
 {
+	mProfiler->BeginFrame();
+	FrameProfiler::CpuScope profileScope(mProfiler.get(), "Update");
+
 	OnKeyboardInput(gt);
 	UpdateCamera(gt);
 
 	// Cycle through the circular frame resource array.
-	mCurrFrameResourceIndex = (mCurrFrameResourceIndex + 1) % gNumFrameResources;
+	mCurrFrameResourceIndex = (mCurrFrameResourceIndex + 1) % mNumFrameResources;
 	mCurrFrameResource = mFrameResources[mCurrFrameResourceIndex].get();
 
 	// Has the GPU finished processing the commands of the current frame resource?
 	// If not, wait until the GPU has completed commands up to this fence point.
-	if (mCurrFrameResource->Fence != 0 && mFence->GetCompletedValue() < mCurrFrameResource->Fence)
-	{
-		HANDLE eventHandle = CreateEventEx(nullptr, nullptr, false, EVENT_ALL_ACCESS);
-		ThrowIfFailed(mFence->SetEventOnCompletion(mCurrFrameResource->Fence, eventHandle));
-		WaitForSingleObject(eventHandle, INFINITE);
-		CloseHandle(eventHandle);
-	}
+	mFramePacer->WaitForFrame(mCurrFrameResourceIndex, mCurrFrameResource->Fence);
+	mProfiler->ReadBackFrame(mCurrFrameResourceIndex);
+	ReportFramePacing(gt);
+	ReportProfiler(gt);
+	UpdateStressStats(gt);
 
+	UpdateStreamedGeometry();
 	UpdateObjectCBs(gt);
+	UpdateAnimatedGroups(gt);
+	UpdateLods(gt);
+	UpdateDrawOrder();
 	UpdateMainPassCB(gt);
 }
 
 void ShapesApp::Draw(const GameTimer& gt)
 {
+	FrameProfiler::CpuScope profileScope(mProfiler.get(), "Draw");
+
 	auto cmdListAlloc = mCurrFrameResource->CmdListAlloc;
 
 	// Reuse the memory associated with command recording.
 	// We can only reset when the associated command lists have finished execution on the GPU.
 	ThrowIfFailed(cmdListAlloc->Reset());
 
+	WriteGpuPlanet(cmdListAlloc.Get());
+
 	// A command list can be reset after it has been added to the command queue via ExecuteCommandList.
 	// Reusing the command list reuses memory.
-	if (mIsWireframe)
-	{
-		ThrowIfFailed(mCommandList->Reset(cmdListAlloc.Get(), mPSOs["opaque_wireframe"].Get()));
-	}
-	else
-	{
-		ThrowIfFailed(mCommandList->Reset(cmdListAlloc.Get(), mPSOs["opaque"].Get()));
-	}
-
-	mCommandList->RSSetViewports(1, &mScreenViewport);
-	mCommandList->RSSetScissorRects(1, &mScissorRect);
+	// GPU culling draws with the instanced vertex shader; the base instance comes from the indirect command.
+	// The edge overlay is a pass constant, so the debug views share these PSOs.  After the
+	// depth pre-pass the shading PSOs only pass fragments at the laid down depth.
+	bool depthPrePass = mUseDepthPrePass && !mUseGpuCulling;
+	std::string psoName = (mUseInstancing || mUseGpuCulling) ? "opaque_instanced" : "opaque";
+	if (depthPrePass)
+		psoName += "_equal";
+	ID3D12PipelineState* pso = mPSOs[psoName].Get();
+	ThrowIfFailed(mCommandList->Reset(cmdListAlloc.Get(), pso));
+
+	UINT frameScope = mProfiler->BeginGpuScope(mCommandList.Get(), "Frame");
 
 	// Indicate a state transition on the resource usage.
 	mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(CurrentBackBuffer(),
@@ -255,25 +899,76 @@ void ShapesApp::Draw(const GameTimer& gt)
 	mCommandList->ClearRenderTargetView(CurrentBackBufferView(), Colors::LightSteelBlue, 0, nullptr);
 	mCommandList->ClearDepthStencilView(DepthStencilView(), D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL, 1.0f, 0, 0, nullptr);
 
-	// Specify the buffers we are going to render to.
-	mCommandList->OMSetRenderTargets(1, &CurrentBackBufferView(), true, &DepthStencilView());
+	// The instanced path only issues a handful of draws, so it is not worth spreading over threads.
+	if (mUseMultithreadedRecording && !mUseInstancing && !mUseGpuCulling)
+	{
+		// The main list only clears and draws the depth pre-pass; the worker lists draw and
+		// transition the back buffer.  The last worker list also ends the GPU scopes and
+		// resolves them.
+		if (depthPrePass)
+		{
+			BindPassState(mCommandList.Get());
+			DrawDepthPrePass(mCommandList.Get());
+		}
 
-	ID3D12DescriptorHeap* descriptorHeaps[] = { mCbvHeap.Get() };
-	mCommandList->SetDescriptorHeaps(_countof(descriptorHeaps), descriptorHeaps);
+		mRecordFrameScope = frameScope;
+		mRecordOpaqueScope = mProfiler->BeginGpuScope(mCommandList.Get(), "Opaque");
+		ThrowIfFailed(mCommandList->Close());
 
-	mCommandList->SetGraphicsRootSignature(mRootSignature.Get());
+		mRecordPSO = pso;
+		RecordOpaquePassMultithreaded();
 
-	int passCbvIndex = mPassCbvOffset + mCurrFrameResourceIndex;
-	auto passCbvHandle = CD3DX12_GPU_DESCRIPTOR_HANDLE(mCbvHeap->GetGPUDescriptorHandleForHeapStart());
-	passCbvHandle.Offset(passCbvIndex, mCbvSrvUavDescriptorSize);
-	mCommandList->SetGraphicsRootDescriptorTable(1, passCbvHandle);
+		std::vector<ID3D12CommandList*> cmdsLists;
+		cmdsLists.push_back(mCommandList.Get());
+		for (auto& workerCmdList : mCurrFrameResource->WorkerCmdLists)
+			cmdsLists.push_back(workerCmdList.Get());
+		mCommandQueue->ExecuteCommandLists((UINT)cmdsLists.size(), cmdsLists.data());
+
+		PresentAndSignal();
+		return;
+	}
+
+	BindPassState(mCommandList.Get());
+
+	if (depthPrePass)
+	{
+		DrawDepthPrePass(mCommandList.Get());
+		mCommandList->SetPipelineState(pso);
+	}
+
+	// The culling path times its compute and draw parts itself.
+	if (mUseGpuCulling)
+	{
+		DrawCulledIndirect(mCommandList.Get(), pso);
+	}
+	else
+	{
+		UINT opaqueScope = mProfiler->BeginGpuScope(mCommandList.Get(), "Opaque");
+
+		if (mUseInstancing)
+		{
+			DrawInstanceBatches(mCommandList.Get(), mOpaqueInstanceBatches);
+		}
+		else if (mUseDrawList)
+		{
+			ID3D12PipelineState* layerPSOs[(int)RenderLayer::Count] = { pso };
+			RecordDrawList(mCommandList.Get(), mOpaqueDrawList, layerPSOs, pso);
+		}
+		else
+		{
+			DrawRenderItems(mCommandList.Get(), mOpaqueDepthOrder.Order());
+		}
 
-	DrawRenderItems(mCommandList.Get(), mOpaqueRitems);
+		mProfiler->EndGpuScope(mCommandList.Get(), opaqueScope);
+	}
 
 	// Indicate a state transition on the resource usage.
 	mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(CurrentBackBuffer(),
 		D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PRESENT));
 
+	mProfiler->EndGpuScope(mCommandList.Get(), frameScope);
+	mProfiler->ResolveGpuScopes(mCommandList.Get());
+
 	// Done recording commands.
 	ThrowIfFailed(mCommandList->Close());
 
@@ -281,6 +976,11 @@ void ShapesApp::Draw(const GameTimer& gt)
 	ID3D12CommandList* cmdsLists[] = { mCommandList.Get() };
 	mCommandQueue->ExecuteCommandLists(_countof(cmdsLists), cmdsLists);
 
+	PresentAndSignal();
+}
+
+void ShapesApp::PresentAndSignal()
+{
 	// Swap the back and front buffers
 	ThrowIfFailed(mSwapChain->Present(0, 0));
 	mCurrBackBuffer = (mCurrBackBuffer + 1) % SwapChainBufferCount;
@@ -294,1229 +994,1661 @@ void ShapesApp::Draw(const GameTimer& gt)
 	mCommandQueue->Signal(mFence.Get(), mCurrentFence);
 }
 
-void ShapesApp::OnMouseDown(WPARAM btnState, int x, int y)
+void ShapesApp::ReportFramePacing(const GameTimer& gt)
 {
-	mLastMousePos.x = x;
-	mLastMousePos.y = y;
+	// Report once per second, like the frame stats in the window caption.
+	if (gt.TotalTime() - mFramePacingReportTime < 1.0f)
+		return;
+	mFramePacingReportTime = gt.TotalTime();
 
-	SetCapture(mhMainWnd);
-}
+	FramePacer::Stats stats = mFramePacer->TakeStats();
 
-void ShapesApp::OnMouseUp(WPARAM btnState, int x, int y)
-{
-	ReleaseCapture();
+	std::string text = "FramePacer: " + std::to_string(mFramePacer->FramesInFlight()) + " frames in flight, latency waiter " +
+		(mFramePacer->LatencyWaiterEnabled() ? "on" : "off") + ", CPU wait avg " + std::to_string(stats.AverageWaitMs()) +
+		" ms, max " + std::to_string(stats.MaxWaitMs) + " ms\n";
+	::OutputDebugStringA(text.c_str());
 }
 
-void ShapesApp::OnMouseMove(WPARAM btnState, int x, int y)
+void ShapesApp::ReportProfiler(const GameTimer& gt)
 {
-	if ((btnState & MK_LBUTTON) != 0)
-	{
-		// Make each pixel correspond to a quarter of a degree.
-		float dx = XMConvertToRadians(0.25f * static_cast<float>(x - mLastMousePos.x));
-		float dy = XMConvertToRadians(0.25f * static_cast<float>(y - mLastMousePos.y));
+	if (gt.TotalTime() - mProfilerReportTime < 1.0f)
+		return;
+	mProfilerReportTime = gt.TotalTime();
 
-		// Update angles based on input to orbit camera around box.
-		mTheta += dx;
-		mPhi += dy;
+	std::vector<FrameProfiler::ScopeStats> stats = mProfiler->TakeStats();
 
-		// Restrict the angle mPhi.
-		mPhi = MathHelper::Clamp(mPhi, 0.1f, MathHelper::Pi - 0.1f);
-	}
-	else if ((btnState & MK_RBUTTON) != 0)
+	std::ostringstream report;
+	std::ostringstream overlay;
+	report << std::fixed << std::setprecision(3) << "FrameProfiler:";
+	overlay << std::fixed << std::setprecision(2);
+	for (auto& scope : stats)
 	{
-		// Make each pixel correspond to 0.2 unit in the scene.
-		float dx = 0.05f * static_cast<float>(x - mLastMousePos.x);
-		float dy = 0.05f * static_cast<float>(y - mLastMousePos.y);
-
-		// Update the camera radius based on input.
-		mRadius += dx - dy;
-
-		// Restrict the radius.
-		mRadius = MathHelper::Clamp(mRadius, 5.0f, 150.0f);
+		const char* clock = scope.Gpu ? "GPU " : "CPU ";
+		report << "  " << clock << scope.Name << " avg " << scope.AverageMs() << " ms, max " << scope.MaxMs << " ms";
+		overlay << "  " << clock << scope.Name << " " << scope.AverageMs();
 	}
+	report << "\n";
+	::OutputDebugStringA(report.str().c_str());
 
-	mLastMousePos.x = x;
-	mLastMousePos.y = y;
+	// D3DApp appends the frame stats to the caption once per second.
+	if (mShowProfilerOverlay)
+		mMainWndCaption = mBaseCaption + L"  [ms]" + AnsiToWString(overlay.str());
 }
 
-void ShapesApp::OnKeyboardInput(const GameTimer& gt)
+// Value below which the given fraction of the samples lie; reorders the samples.
+float Percentile(std::vector<float>& samples, float fraction)
 {
-	if (GetAsyncKeyState('1') & 0x8000)
-		mIsWireframe = true;
-	else
-		mIsWireframe = false;
+	if (samples.empty())
+		return 0.0f;
+
+	size_t rank = std::min((size_t)(fraction * samples.size()), samples.size() - 1);
+	std::nth_element(samples.begin(), samples.begin() + rank, samples.end());
+	return samples[rank];
 }
 
-void ShapesApp::UpdateCamera(const GameTimer& gt)
+std::string FrameTimePercentiles(std::vector<float>& frameTimes)
 {
-	// Convert Spherical to Cartesian coordinates.
-	mEyePos.x = mRadius * sinf(mPhi) * cosf(mTheta);
-	mEyePos.z = mRadius * sinf(mPhi) * sinf(mTheta);
-	mEyePos.y = mRadius * cosf(mPhi);
-
-	// Build the view matrix.
-	XMVECTOR pos = XMVectorSet(mEyePos.x, mEyePos.y, mEyePos.z, 1.0f);
-	XMVECTOR target = XMVectorZero();
-	XMVECTOR up = XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
-
-	XMMATRIX view = XMMatrixLookAtLH(pos, target, up);
-	XMStoreFloat4x4(&mView, view);
+	return "p50 " + std::to_string(Percentile(frameTimes, 0.5f)) + " ms, p90 " + std::to_string(Percentile(frameTimes, 0.9f)) +
+		" ms, p99 " + std::to_string(Percentile(frameTimes, 0.99f)) + " ms, max " + std::to_string(Percentile(frameTimes, 1.0f)) + " ms";
 }
 
-void ShapesApp::UpdateObjectCBs(const GameTimer& gt)
+void ShapesApp::UpdateStressStats(const GameTimer& gt)
 {
-	auto currObjectCB = mCurrFrameResource->ObjectCB.get();
-	for (auto& e : mAllRitems)
+	if (mStressObjects == 0)
+		return;
+
+	// The first frames still include startup work, such as the first use of each PSO.
+	const UINT warmupFrames = 30;
+	if (++mStressFrameCount <= warmupFrames)
 	{
-		// Only update the cbuffer data if the constants have changed.  
-		// This needs to be tracked per frame resource.
-		if (e->NumFramesDirty > 0)
-		{
-			XMMATRIX world = XMLoadFloat4x4(&e->World);
+		mStressReportTime = gt.TotalTime();
+		return;
+	}
+
+	float frameMs = gt.DeltaTime() * 1000.0f;
+	mStressPeriodFrameTimes.push_back(frameMs);
+	mStressFrameTimes.push_back(frameMs);
 
-			ObjectConstants objConstants;
-			XMStoreFloat4x4(&objConstants.World, XMMatrixTranspose(world));
+	if (gt.TotalTime() - mStressReportTime >= 1.0f)
+	{
+		mStressReportTime = gt.TotalTime();
 
-			currObjectCB->CopyData(e->ObjCBIndex, objConstants);
+		std::string text = "Stress: " + std::to_string(mScene.Size()) + " objects, " + std::to_string(mStressAnimatedObjects) +
+			" animated, " + std::to_string(mStressPeriodFrameTimes.size()) + " frames, " +
+			FrameTimePercentiles(mStressPeriodFrameTimes) + "\n";
+		::OutputDebugStringA(text.c_str());
+		mStressPeriodFrameTimes.clear();
+	}
 
-			// Next FrameResource need to be updated too.
-			e->NumFramesDirty--;
-		}
+	if (mStressFrames > 0 && mStressFrameTimes.size() >= mStressFrames)
+	{
+		WriteStressResults();
+		mStressFrames = 0;
+		PostQuitMessage(0);
 	}
 }
 
-void ShapesApp::UpdateMainPassCB(const GameTimer& gt)
+void ShapesApp::WriteStressResults()
 {
-	XMMATRIX view = XMLoadFloat4x4(&mView);
-	XMMATRIX proj = XMLoadFloat4x4(&mProj);
-
-	XMMATRIX viewProj = XMMatrixMultiply(view, proj);
-	XMMATRIX invView = XMMatrixInverse(&XMMatrixDeterminant(view), view);
-	XMMATRIX invProj = XMMatrixInverse(&XMMatrixDeterminant(proj), proj);
-	XMMATRIX invViewProj = XMMatrixInverse(&XMMatrixDeterminant(viewProj), viewProj);
+	const char* path = "ShapesStress.csv";
+	bool exists = (bool)std::ifstream(path);
+
+	// One row per run, so runs with different draw paths and counts can be compared.
+	std::ofstream file(path, std::ios::app);
+	if (!exists)
+		file << "objects,animated,instancing,drawlist,multithreaded,gpuculling,bindless,frames,p50_ms,p90_ms,p99_ms,max_ms\n";
+
+	file << mScene.Size() << ',' << mStressAnimatedObjects << ',' << mUseInstancing << ',' << mUseDrawList << ','
+		<< mUseMultithreadedRecording << ',' << mUseGpuCulling << ',' << mBindlessObjectConstants << ','
+		<< mStressFrameTimes.size();
+	for (float fraction : { 0.5f, 0.9f, 0.99f, 1.0f })
+		file << ',' << Percentile(mStressFrameTimes, fraction);
+	file << '\n';
+
+	std::string text = "Stress: " + FrameTimePercentiles(mStressFrameTimes) + " over " +
+		std::to_string(mStressFrameTimes.size()) + " frames" + (file ? ", appended to " : ", could not append to ") + path + "\n";
+	::OutputDebugStringA(text.c_str());
+}
 
-	XMStoreFloat4x4(&mMainPassCB.View, XMMatrixTranspose(view));
-	XMStoreFloat4x4(&mMainPassCB.InvView, XMMatrixTranspose(invView));
-	XMStoreFloat4x4(&mMainPassCB.Proj, XMMatrixTranspose(proj));
-	XMStoreFloat4x4(&mMainPassCB.InvProj, XMMatrixTranspose(invProj));
-	XMStoreFloat4x4(&mMainPassCB.ViewProj, XMMatrixTranspose(viewProj));
-	XMStoreFloat4x4(&mMainPassCB.InvViewProj, XMMatrixTranspose(invViewProj));
-	mMainPassCB.EyePosW = mEyePos;
-	mMainPassCB.RenderTargetSize = XMFLOAT2((float)mClientWidth, (float)mClientHeight);
-	mMainPassCB.InvRenderTargetSize = XMFLOAT2(1.0f / mClientWidth, 1.0f / mClientHeight);
-	mMainPassCB.NearZ = 1.0f;
-	mMainPassCB.FarZ = 1000.0f;
-	mMainPassCB.TotalTime = gt.TotalTime();
-	mMainPassCB.DeltaTime = gt.DeltaTime();
+void ShapesApp::WriteProfile(const std::wstring& path)
+{
+	bool written = mProfiler->WriteCsv(path + L".csv") && mProfiler->WriteChromeTrace(path + L".json");
 
-	auto currPassCB = mCurrFrameResource->PassCB.get();
-	currPassCB->CopyData(0, mMainPassCB);
+	std::string text = "FrameProfiler: " + std::to_string(mProfiler->History().size()) + " frames " +
+		(written ? "written to " : "could not be written to ") + std::string(path.begin(), path.end()) + ".csv/.json\n";
+	::OutputDebugStringA(text.c_str());
 }
 
-void ShapesApp::BuildDescriptorHeaps()
+void ShapesApp::BindPassState(ID3D12GraphicsCommandList* cmdList)
 {
-	UINT objCount = (UINT)mOpaqueRitems.size();
+	cmdList->RSSetViewports(1, &mScreenViewport);
+	cmdList->RSSetScissorRects(1, &mScissorRect);
 
-	// Need a CBV descriptor for each object for each frame resource,
-	// +1 for the perPass CBV for each frame resource.
-	UINT numDescriptors = (objCount + 1) * gNumFrameResources;
+	// Specify the buffers we are going to render to.
+	cmdList->OMSetRenderTargets(1, &CurrentBackBufferView(), true, &DepthStencilView());
 
-	// Save an offset to the start of the pass CBVs.  These are the last 3 descriptors.
-	mPassCbvOffset = objCount * gNumFrameResources;
+	ID3D12DescriptorHeap* descriptorHeaps[] = { mCbvHeap.Get() };
+	cmdList->SetDescriptorHeaps(_countof(descriptorHeaps), descriptorHeaps);
 
-	D3D12_DESCRIPTOR_HEAP_DESC cbvHeapDesc;
-	cbvHeapDesc.NumDescriptors = numDescriptors;
-	cbvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
-	cbvHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
-	cbvHeapDesc.NodeMask = 0;
-	ThrowIfFailed(md3dDevice->CreateDescriptorHeap(&cbvHeapDesc,
-		IID_PPV_ARGS(&mCbvHeap)));
+	cmdList->SetGraphicsRootSignature(mRootSignature.Get());
+
+	int passCbvIndex = mPassCbvOffset + mCurrFrameResourceIndex;
+	auto passCbvHandle = CD3DX12_GPU_DESCRIPTOR_HANDLE(mCbvHeap->GetGPUDescriptorHandleForHeapStart());
+	passCbvHandle.Offset(passCbvIndex, mCbvSrvUavDescriptorSize);
+	cmdList->SetGraphicsRootDescriptorTable(1, passCbvHandle);
+
+	// All object constants of the frame are bound once; draws only select an index.
+	if (mBindlessObjectConstants)
+	{
+		auto objectBuffer = mCurrFrameResource->ObjectCB->Resource();
+		cmdList->SetGraphicsRootShaderResourceView(4, objectBuffer->GetGPUVirtualAddress());
+	}
 }
 
-void ShapesApp::BuildConstantBufferViews()
+void ShapesApp::BindObjectConstants(ID3D12GraphicsCommandList* cmdList, UINT object)
 {
-	UINT objCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(ObjectConstants));
-
-	UINT objCount = (UINT)mOpaqueRitems.size();
+	UINT objCBIndex = mScene.ObjCBIndex[object];
 
-	// Need a CBV descriptor for each object for each frame resource.
-	for (int frameIndex = 0; frameIndex < gNumFrameResources; ++frameIndex)
+	if (mBindlessObjectConstants)
 	{
-		auto objectCB = mFrameResources[frameIndex]->ObjectCB->Resource();
-		for (UINT i = 0; i < objCount; ++i)
-		{
-			D3D12_GPU_VIRTUAL_ADDRESS cbAddress = objectCB->GetGPUVirtualAddress();
+		cmdList->SetGraphicsRoot32BitConstant(0, objCBIndex, 0);
+		return;
+	}
 
-			// Offset to the ith object constant buffer in the buffer.
-			cbAddress += i * objCBByteSize;
+	// Offset to the CBV in the descriptor heap for this object and for this frame resource.
+	UINT cbvIndex = mCurrFrameResourceIndex * (UINT)mOpaqueRitems.size() + objCBIndex;
 
-			// Offset to the object cbv in the descriptor heap.
-			int heapIndex = frameIndex * objCount + i;
-			auto handle = CD3DX12_CPU_DESCRIPTOR_HANDLE(mCbvHeap->GetCPUDescriptorHandleForHeapStart());
-			handle.Offset(heapIndex, mCbvSrvUavDescriptorSize);
-
-			D3D12_CONSTANT_BUFFER_VIEW_DESC cbvDesc;
-			cbvDesc.BufferLocation = cbAddress;
-			cbvDesc.SizeInBytes = objCBByteSize;
-
-			md3dDevice->CreateConstantBufferView(&cbvDesc, handle);
-		}
-	}
-
-	UINT passCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(PassConstants));
-
-	// Last three descriptors are the pass CBVs for each frame resource.
-	for (int frameIndex = 0; frameIndex < gNumFrameResources; ++frameIndex)
-	{
-		auto passCB = mFrameResources[frameIndex]->PassCB->Resource();
-		D3D12_GPU_VIRTUAL_ADDRESS cbAddress = passCB->GetGPUVirtualAddress();
-
-		// Offset to the pass cbv in the descriptor heap.
-		int heapIndex = mPassCbvOffset + frameIndex;
-		auto handle = CD3DX12_CPU_DESCRIPTOR_HANDLE(mCbvHeap->GetCPUDescriptorHandleForHeapStart());
-		handle.Offset(heapIndex, mCbvSrvUavDescriptorSize);
-
-		D3D12_CONSTANT_BUFFER_VIEW_DESC cbvDesc;
-		cbvDesc.BufferLocation = cbAddress;
-		cbvDesc.SizeInBytes = passCBByteSize;
+	auto cbvHandle = CD3DX12_GPU_DESCRIPTOR_HANDLE(mCbvHeap->GetGPUDescriptorHandleForHeapStart());
+	cbvHandle.Offset(cbvIndex, mCbvSrvUavDescriptorSize);
 
-		md3dDevice->CreateConstantBufferView(&cbvDesc, handle);
-	}
+	cmdList->SetGraphicsRootDescriptorTable(0, cbvHandle);
 }
 
-void ShapesApp::BuildRootSignature()
+void ShapesApp::StartRecordThreads()
 {
-	CD3DX12_DESCRIPTOR_RANGE cbvTable0;
-	cbvTable0.Init(D3D12_DESCRIPTOR_RANGE_TYPE_CBV, 1, 0);
-
-	CD3DX12_DESCRIPTOR_RANGE cbvTable1;
-	cbvTable1.Init(D3D12_DESCRIPTOR_RANGE_TYPE_CBV, 1, 1);
-
-	// Root parameter can be a table, root descriptor or root constants.
-	CD3DX12_ROOT_PARAMETER slotRootParameter[2];
-
-	// Create root CBVs.
-	slotRootParameter[0].InitAsDescriptorTable(1, &cbvTable0);
-	slotRootParameter[1].InitAsDescriptorTable(1, &cbvTable1);
-
-	// A root signature is an array of root parameters.
-	CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(2, slotRootParameter, 0, nullptr,
-		D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT);
-
-	// create a root signature with a single slot which points to a descriptor range consisting of a single constant buffer
-	ComPtr<ID3DBlob> serializedRootSig = nullptr;
-	ComPtr<ID3DBlob> errorBlob = nullptr;
-	HRESULT hr = D3D12SerializeRootSignature(&rootSigDesc, D3D_ROOT_SIGNATURE_VERSION_1,
-		serializedRootSig.GetAddressOf(), errorBlob.GetAddressOf());
+	mRecordStats.resize(mNumRecordThreads);
+	for (UINT i = 0; i < mNumRecordThreads; ++i)
+		mRecordThreads.emplace_back(&ShapesApp::RecordThreadLoop, this, i);
+}
 
-	if (errorBlob != nullptr)
+void ShapesApp::StopRecordThreads()
+{
 	{
-		::OutputDebugStringA((char*)errorBlob->GetBufferPointer());
+		std::lock_guard<std::mutex> lock(mRecordMutex);
+		mRecordQuit = true;
 	}
-	ThrowIfFailed(hr);
+	mRecordStartCv.notify_all();
 
-	ThrowIfFailed(md3dDevice->CreateRootSignature(
-		0,
-		serializedRootSig->GetBufferPointer(),
-		serializedRootSig->GetBufferSize(),
-		IID_PPV_ARGS(mRootSignature.GetAddressOf())));
+	for (auto& thread : mRecordThreads)
+		thread.join();
+	mRecordThreads.clear();
 }
 
-void ShapesApp::BuildShadersAndInputLayout()
+void ShapesApp::RecordThreadLoop(UINT threadIndex)
 {
-	mShaders["standardVS"] = d3dUtil::CompileShader(L"Shaders\\VS.hlsl", nullptr, "VS", "vs_5_1");
-	mShaders["opaquePS"] = d3dUtil::CompileShader(L"Shaders\\PS.hlsl", nullptr, "PS", "ps_5_1");
-
-	mInputLayout =
+	UINT64 generation = 0;
+	for (;;)
 	{
-		{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-		{ "COLOR", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-	};
-}
-
-
-void ShapesApp::BuildShapeGeometry()
-{
-	GeometryGenerator geoGen;
-	GeometryGenerator::MeshData box = geoGen.CreateBox(1.0f, 1.0f, 1.0f, 0);
-	GeometryGenerator::MeshData grid = geoGen.CreateGrid(20.0f, 30.0f, 60, 40);
-	GeometryGenerator::MeshData sphere = geoGen.CreateSphere(1.0f, 20, 20);
-	GeometryGenerator::MeshData cylinder = geoGen.CreateCylinder(1.5f, 1.5f, 6.0f, 20, 20);
-
-	GeometryGenerator::MeshData cone = geoGen.CreateCone(2.0f, 0.0f, 3.0f, 20, 20);
-	GeometryGenerator::MeshData wedge = geoGen.CreateWedge(1.0f, 1.0f, 1.0f, 0);
-	GeometryGenerator::MeshData pyramid = geoGen.CreatePyramid(1.0f, 0.0f, 3.0f, 4, 20);
-	GeometryGenerator::MeshData prism = geoGen.CreatePrism(1.0f, 1.0f, 1.0f, 3, 1);
-	GeometryGenerator::MeshData diamond = geoGen.CreateDiamond(1.0f, 0.5f, 1.0f, 0.5f, 10, 20);
-
-	// We are concatenating all the geometry into one big vertex/index buffer.  So
-	// define the regions in the buffer each submesh covers.
-
-	// Cache the vertex offsets to each object in the concatenated vertex buffer.
-	UINT boxVertexOffset = 0;
-	UINT gridVertexOffset = (UINT)box.Vertices.size();
-	UINT sphereVertexOffset = gridVertexOffset + (UINT)grid.Vertices.size();
-	UINT cylinderVertexOffset = sphereVertexOffset + (UINT)sphere.Vertices.size();
-	UINT coneVertexOffset = cylinderVertexOffset + (UINT)cylinder.Vertices.size();
-	UINT wedgeVertexOffset = coneVertexOffset + (UINT)cone.Vertices.size();
-	UINT pyramidVertexOffset = wedgeVertexOffset + (UINT)wedge.Vertices.size();
-	UINT prismVertexOffset = pyramidVertexOffset + (UINT)pyramid.Vertices.size();
-	UINT diamondVertexOffset = prismVertexOffset + (UINT)prism.Vertices.size();
+		{
+			std::unique_lock<std::mutex> lock(mRecordMutex);
+			mRecordStartCv.wait(lock, [&] { return mRecordQuit || mRecordGeneration != generation; });
+			if (mRecordQuit)
+				return;
+			generation = mRecordGeneration;
+		}
 
+		std::exception_ptr error;
+		try
+		{
+			RecordOpaqueChunk(threadIndex);
+		}
+		catch (...)
+		{
+			error = std::current_exception();
+		}
 
+		{
+			std::lock_guard<std::mutex> lock(mRecordMutex);
+			if (error && !mRecordError)
+				mRecordError = error;
+			mRecordPending--;
+		}
+		mRecordDoneCv.notify_one();
+	}
+}
 
+void ShapesApp::RecordOpaqueChunk(UINT threadIndex)
+{
+	auto& cmdListAlloc = mCurrFrameResource->WorkerCmdListAllocs[threadIndex];
+	auto& cmdList = mCurrFrameResource->WorkerCmdLists[threadIndex];
 
-	// Cache the starting index for each object in the concatenated index buffer.
-	UINT boxIndexOffset = 0;
-	UINT gridIndexOffset = (UINT)box.Indices32.size();
-	UINT sphereIndexOffset = gridIndexOffset + (UINT)grid.Indices32.size();
-	UINT cylinderIndexOffset = sphereIndexOffset + (UINT)sphere.Indices32.size();
-	UINT coneIndexOffset = cylinderIndexOffset + (UINT)cylinder.Indices32.size();
-	UINT wedgeIndexOffset = coneIndexOffset + (UINT)cone.Indices32.size();
-	UINT pyramidIndexOffset = wedgeIndexOffset + (UINT)wedge.Indices32.size();
-	UINT prismIndexOffset = pyramidIndexOffset + (UINT)pyramid.Indices32.size();
-	UINT diamondIndexOffset = prismIndexOffset + (UINT)prism.Indices32.size();
+	// Like the main allocator, only reset once the GPU finished with this frame resource.
+	ThrowIfFailed(cmdListAlloc->Reset());
+	ThrowIfFailed(cmdList->Reset(cmdListAlloc.Get(), mRecordPSO));
 
+	BindPassState(cmdList.Get());
 
+	// Each thread records a contiguous chunk of the sorted list, so chunks stay state-coherent.
+	size_t count = mOpaqueDrawList.Entries.size();
+	size_t chunkSize = (count + mNumRecordThreads - 1) / mNumRecordThreads;
+	size_t first = std::min(count, threadIndex * chunkSize);
+	size_t last = std::min(count, first + chunkSize);
 
+	ID3D12PipelineState* layerPSOs[(int)RenderLayer::Count] = { mRecordPSO };
+	mRecordStats[threadIndex] = RecordDrawListRange(cmdList.Get(), mOpaqueDrawList, first, last, layerPSOs, mRecordPSO);
 
+	// The last list submitted hands the back buffer over for presenting.
+	if (threadIndex == mNumRecordThreads - 1)
+	{
+		mProfiler->EndGpuScope(cmdList.Get(), mRecordOpaqueScope);
 
-	// Define the SubmeshGeometry that cover different
-	// regions of the vertex/index buffers.
+		cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(CurrentBackBuffer(),
+			D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PRESENT));
 
-	SubmeshGeometry boxSubmesh;
-	boxSubmesh.IndexCount = (UINT)box.Indices32.size();
-	boxSubmesh.StartIndexLocation = boxIndexOffset;
-	boxSubmesh.BaseVertexLocation = boxVertexOffset;
+		mProfiler->EndGpuScope(cmdList.Get(), mRecordFrameScope);
+		mProfiler->ResolveGpuScopes(cmdList.Get());
+	}
 
-	SubmeshGeometry gridSubmesh;
-	gridSubmesh.IndexCount = (UINT)grid.Indices32.size();
-	gridSubmesh.StartIndexLocation = gridIndexOffset;
-	gridSubmesh.BaseVertexLocation = gridVertexOffset;
+	ThrowIfFailed(cmdList->Close());
+}
 
-	SubmeshGeometry sphereSubmesh;
-	sphereSubmesh.IndexCount = (UINT)sphere.Indices32.size();
-	sphereSubmesh.StartIndexLocation = sphereIndexOffset;
-	sphereSubmesh.BaseVertexLocation = sphereVertexOffset;
+void ShapesApp::RecordOpaquePassMultithreaded()
+{
+	{
+		std::lock_guard<std::mutex> lock(mRecordMutex);
+		mRecordPending = mNumRecordThreads;
+		mRecordGeneration++;
+	}
+	mRecordStartCv.notify_all();
 
-	SubmeshGeometry cylinderSubmesh;
-	cylinderSubmesh.IndexCount = (UINT)cylinder.Indices32.size();
-	cylinderSubmesh.StartIndexLocation = cylinderIndexOffset;
-	cylinderSubmesh.BaseVertexLocation = cylinderVertexOffset;
+	std::unique_lock<std::mutex> lock(mRecordMutex);
+	mRecordDoneCv.wait(lock, [this] { return mRecordPending == 0; });
 
-	SubmeshGeometry coneSubmesh;
-	coneSubmesh.IndexCount = (UINT)cone.Indices32.size();
-	coneSubmesh.StartIndexLocation = coneIndexOffset;
-	coneSubmesh.BaseVertexLocation = coneVertexOffset;
+	if (mRecordError)
+	{
+		std::exception_ptr error = mRecordError;
+		mRecordError = nullptr;
+		std::rethrow_exception(error);
+	}
 
-	SubmeshGeometry wedgeSubmesh;
-	wedgeSubmesh.IndexCount = (UINT)wedge.Indices32.size();
-	wedgeSubmesh.StartIndexLocation = wedgeIndexOffset;
-	wedgeSubmesh.BaseVertexLocation = wedgeVertexOffset;
+	DrawListStats total;
+	for (auto& stats : mRecordStats)
+	{
+		total.PsoChanges += stats.PsoChanges;
+		total.GeometryChanges += stats.GeometryChanges;
+		total.TopologyChanges += stats.TopologyChanges;
+		total.Draws += stats.Draws;
+	}
+	ReportDrawListStats(mOpaqueDrawList, total);
+}
 
-	SubmeshGeometry pyramidSubmesh;
-	pyramidSubmesh.IndexCount = (UINT)pyramid.Indices32.size();
-	pyramidSubmesh.StartIndexLocation = pyramidIndexOffset;
-	pyramidSubmesh.BaseVertexLocation = pyramidVertexOffset;
+void ShapesApp::OnMouseDown(WPARAM btnState, int x, int y)
+{
+	mLastMousePos.x = x;
+	mLastMousePos.y = y;
 
-	SubmeshGeometry prismSubmesh;
-	prismSubmesh.IndexCount = (UINT)prism.Indices32.size();
-	prismSubmesh.StartIndexLocation = prismIndexOffset;
-	prismSubmesh.BaseVertexLocation = prismVertexOffset;
+	SetCapture(mhMainWnd);
+}
 
-	SubmeshGeometry diamondSubmesh;
-	diamondSubmesh.IndexCount = (UINT)diamond.Indices32.size();
-	diamondSubmesh.StartIndexLocation = diamondIndexOffset;
-	diamondSubmesh.BaseVertexLocation = diamondVertexOffset;
+void ShapesApp::OnMouseUp(WPARAM btnState, int x, int y)
+{
+	ReleaseCapture();
+}
 
+void ShapesApp::OnMouseMove(WPARAM btnState, int x, int y)
+{
+	if ((btnState & MK_LBUTTON) != 0)
+	{
+		// Make each pixel correspond to a quarter of a degree.
+		float dx = XMConvertToRadians(0.25f * static_cast<float>(x - mLastMousePos.x));
+		float dy = XMConvertToRadians(0.25f * static_cast<float>(y - mLastMousePos.y));
 
+		// Update angles based on input to orbit camera around box.
+		mTheta += dx;
+		mPhi += dy;
 
-	// Extract the vertex elements we are interested in and pack the
-	// vertices of all the meshes into one vertex buffer.
+		// Restrict the angle mPhi.
+		mPhi = MathHelper::Clamp(mPhi, 0.1f, MathHelper::Pi - 0.1f);
+	}
+	else if ((btnState & MK_RBUTTON) != 0)
+	{
+		// Make each pixel correspond to 0.2 unit in the scene.
+		float dx = 0.05f * static_cast<float>(x - mLastMousePos.x);
+		float dy = 0.05f * static_cast<float>(y - mLastMousePos.y);
 
-	auto totalVertexCount =
-		box.Vertices.size() +
-		grid.Vertices.size() +
-		sphere.Vertices.size() +
-		cylinder.Vertices.size() +
-		cone.Vertices.size() +
-		wedge.Vertices.size() +
-		pyramid.Vertices.size() +
-		prism.Vertices.size()+
-		diamond.Vertices.size();
+		// Update the camera radius based on input.
+		mRadius += dx - dy;
 
+		// Restrict the radius.
+		mRadius = MathHelper::Clamp(mRadius, 5.0f, 150.0f);
+	}
 
-	std::vector<Vertex> vertices(totalVertexCount);
+	mLastMousePos.x = x;
+	mLastMousePos.y = y;
+}
 
-	UINT k = 0;
+void ShapesApp::OnKeyboardInput(const GameTimer& gt)
+{
+	if (GetAsyncKeyState('1') & 0x8000)
+		mShowEdges = true;
+	else
+		mShowEdges = false;
 
-	for (size_t i = 0; i < box.Vertices.size(); ++i, ++k)
-	{
-		vertices[k].Pos = box.Vertices[i].Position;
-		vertices[k].Color = XMFLOAT4(DirectX::Colors::Gold);
-	}
+	if (IsKeyToggled('2'))
+		mUseInstancing = !mUseInstancing;
 
-	for (size_t i = 0; i < grid.Vertices.size(); ++i, ++k)
-	{
-		vertices[k].Pos = grid.Vertices[i].Position;
-		vertices[k].Color = XMFLOAT4(DirectX::Colors::ForestGreen);
-	}
+	if (IsKeyToggled('3'))
+		mUseDrawList = !mUseDrawList;
 
-	for (size_t i = 0; i < sphere.Vertices.size(); ++i, ++k)
-	{
-		vertices[k].Pos = sphere.Vertices[i].Position;
-		vertices[k].Color = XMFLOAT4(DirectX::Colors::Crimson);
-	}
+	if (IsKeyToggled('4'))
+		mUseMultithreadedRecording = !mUseMultithreadedRecording;
 
-	for (size_t i = 0; i < cylinder.Vertices.size(); ++i, ++k)
-	{
-		vertices[k].Pos = cylinder.Vertices[i].Position;
-		vertices[k].Color = XMFLOAT4(DirectX::Colors::SteelBlue);
-	}
+	if (IsKeyToggled('6'))
+		mUseGpuCulling = !mUseGpuCulling;
 
-	for (size_t i = 0; i < cone.Vertices.size(); ++i, ++k)
+	if (IsKeyToggled('7'))
 	{
-		vertices[k].Pos = cone.Vertices[i].Position;
-		vertices[k].Color = XMFLOAT4(DirectX::Colors::Black);
+		mShowProfilerOverlay = !mShowProfilerOverlay;
+		if (!mShowProfilerOverlay)
+			mMainWndCaption = mBaseCaption;
 	}
 
-	for (size_t i = 0; i < wedge.Vertices.size(); ++i, ++k)
-	{
-		vertices[k].Pos = wedge.Vertices[i].Position;
-		vertices[k].Color = XMFLOAT4(DirectX::Colors::White);
-	}
+	if (IsKeyToggled('8'))
+		WriteProfile(L"ShapesProfile");
 
-	for (size_t i = 0; i < pyramid.Vertices.size(); ++i, ++k)
-	{
-		vertices[k].Pos = pyramid.Vertices[i].Position;
-		vertices[k].Color = XMFLOAT4(DirectX::Colors::Yellow);
-	}
+	if (IsKeyToggled('9'))
+		StreamPlanet();
 
-	for (size_t i = 0; i < prism.Vertices.size(); ++i, ++k)
-	{
-		vertices[k].Pos = prism.Vertices[i].Position;
-		vertices[k].Color = XMFLOAT4(DirectX::Colors::Orange);
-	}
+	if (IsKeyToggled('0'))
+		mUseDepthPrePass = !mUseDepthPrePass;
 
-	for (size_t i = 0; i < diamond.Vertices.size(); ++i, ++k)
+	if (IsKeyToggled('5'))
 	{
-		vertices[k].Pos = diamond.Vertices[i].Position;
-		vertices[k].Color = XMFLOAT4(DirectX::Colors::GhostWhite);
+		mAnimateBattlements = !mAnimateBattlements;
+		if (!mAnimateBattlements)
+			RestoreAnimatedGroups();
 	}
+}
 
+bool ShapesApp::IsKeyToggled(int key)
+{
+	// Report a toggle only on the frame the key goes down, not while it is held.
+	bool isDown = (GetAsyncKeyState(key) & 0x8000) != 0;
+	bool toggled = isDown && !mKeyWasDown[key];
+	mKeyWasDown[key] = isDown;
 
-	std::vector<std::uint16_t> indices;
-	indices.insert(indices.end(), std::begin(box.GetIndices16()), std::end(box.GetIndices16()));
-	indices.insert(indices.end(), std::begin(grid.GetIndices16()), std::end(grid.GetIndices16()));
-	indices.insert(indices.end(), std::begin(sphere.GetIndices16()), std::end(sphere.GetIndices16()));
-	indices.insert(indices.end(), std::begin(cylinder.GetIndices16()), std::end(cylinder.GetIndices16()));	
-	indices.insert(indices.end(), std::begin(cone.GetIndices16()), std::end(cone.GetIndices16()));
-	indices.insert(indices.end(), std::begin(wedge.GetIndices16()), std::end(wedge.GetIndices16()));
-	indices.insert(indices.end(), std::begin(pyramid.GetIndices16()), std::end(pyramid.GetIndices16()));
-	indices.insert(indices.end(), std::begin(prism.GetIndices16()), std::end(prism.GetIndices16()));
-	indices.insert(indices.end(), std::begin(diamond.GetIndices16()), std::end(diamond.GetIndices16()));
-
+	return toggled;
+}
 
+void ShapesApp::UpdateCamera(const GameTimer& gt)
+{
+	// Convert Spherical to Cartesian coordinates.
+	mEyePos.x = mRadius * sinf(mPhi) * cosf(mTheta);
+	mEyePos.z = mRadius * sinf(mPhi) * sinf(mTheta);
+	mEyePos.y = mRadius * cosf(mPhi);
 
+	// Build the view matrix.
+	XMVECTOR pos = XMVectorSet(mEyePos.x, mEyePos.y, mEyePos.z, 1.0f);
+	XMVECTOR target = XMVectorZero();
+	XMVECTOR up = XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
 
-	const UINT vbByteSize = (UINT)vertices.size() * sizeof(Vertex);
-	const UINT ibByteSize = (UINT)indices.size() * sizeof(std::uint16_t);
+	XMMATRIX view = XMMatrixLookAtLH(pos, target, up);
+	XMStoreFloat4x4(&mView, view);
+}
 
-	auto geo = std::make_unique<MeshGeometry>();
-	geo->Name = "shapeGeo";
+void ShapesApp::UpdateObjectCBs(const GameTimer& gt)
+{
+	FrameProfiler::CpuScope profileScope(mProfiler.get(), "UpdateObjectCBs");
 
+	// Only the objects whose constants have changed are visited.  This needs to be
+	// tracked per frame resource, which the dirty counters of the scene do.
+	auto& dirtyObjects = mScene.DirtyObjects;
+	if (dirtyObjects.empty())
+		return;
 
-	ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo->VertexBufferCPU));
-	CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), vertices.data(), vbByteSize);
+	UploadWorldMatrices(dirtyObjects, mScene.ObjCBIndex,
+		mCurrFrameResource->ObjectCBMappedData, mCurrFrameResource->ObjectCBStride);
 
-	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
-	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
+	// Keep the instance buffer in sync so either drawing path can be used.
+	UploadWorldMatrices(dirtyObjects, mScene.InstanceIndex,
+		mCurrFrameResource->InstanceBufferMappedData, mCurrFrameResource->InstanceBufferStride);
 
-	geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), vertices.data(), vbByteSize, geo->VertexBufferUploader);
+	// Next FrameResource need to be updated too.
+	mScene.ConsumeDirtyFrame();
+}
 
-	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
+void ShapesApp::UploadWorldMatrices(const std::vector<UINT>& objects, const std::vector<UINT>& slots,
+	BYTE* mappedData, UINT stride)
+{
+	// Object constants and instance data share one layout: the world matrix followed by
+	// the position decode of the object's submesh.
+	static_assert(sizeof(ObjectConstants) == sizeof(InstanceData), "ObjectConstants and InstanceData must match");
+
+	// Sort the objects by destination slot so consecutive slots form runs.
+	mUploadSlots.clear();
+	for (UINT object : objects)
+		mUploadSlots.push_back(std::make_pair(slots[object], object));
+	std::sort(mUploadSlots.begin(), mUploadSlots.end());
+
+	size_t runStart = 0;
+	while (runStart < mUploadSlots.size())
+	{
+		size_t runEnd = runStart + 1;
+		while (runEnd < mUploadSlots.size() && mUploadSlots[runEnd].first == mUploadSlots[runEnd - 1].first + 1)
+			++runEnd;
 
-	geo->VertexByteStride = sizeof(Vertex);
-	geo->VertexBufferByteSize = vbByteSize;
-	geo->IndexFormat = DXGI_FORMAT_R16_UINT;
-	geo->IndexBufferByteSize = ibByteSize;
+		// Build the run with the buffer's element stride, then write it to the
+		// (write-combined) upload memory in one sequential copy.
+		size_t runBytes = (runEnd - runStart) * stride;
+		if (mUploadStaging.size() < runBytes)
+			mUploadStaging.resize(runBytes);
 
-	geo->DrawArgs["box"] = boxSubmesh;
-	geo->DrawArgs["grid"] = gridSubmesh;
-	geo->DrawArgs["sphere"] = sphereSubmesh;
-	geo->DrawArgs["cylinder"] = cylinderSubmesh;
-	geo->DrawArgs["cone"] = coneSubmesh;
-	geo->DrawArgs["wedge"] = wedgeSubmesh;
-	geo->DrawArgs["pyramid"] = pyramidSubmesh;
-	geo->DrawArgs["prism"] = prismSubmesh;
-	geo->DrawArgs["diamond"] = diamondSubmesh;
+		for (size_t i = runStart; i < runEnd; ++i)
+		{
+			UINT object = mUploadSlots[i].second;
+			auto& submesh = mScene.Submeshes[mScene.SubmeshId[object]];
+
+			XMMATRIX world = XMLoadFloat4x4(&mScene.World[object]);
+			auto dest = reinterpret_cast<ObjectConstants*>(&mUploadStaging[(i - runStart) * stride]);
+			XMStoreFloat4x4(&dest->World, XMMatrixTranspose(world));
+			dest->PosScale = XMFLOAT4(submesh.PosScale.x, submesh.PosScale.y, submesh.PosScale.z, 0.0f);
+			dest->PosBias = XMFLOAT4(submesh.PosBias.x, submesh.PosBias.y, submesh.PosBias.z, 0.0f);
+		}
 
+		memcpy(mappedData + (size_t)mUploadSlots[runStart].first * stride, mUploadStaging.data(), runBytes);
 
-	mGeometries[geo->Name] = std::move(geo);
+		runStart = runEnd;
+	}
 }
 
-void ShapesApp::BuildPSOs()
+void ShapesApp::UpdateAnimatedGroups(const GameTimer& gt)
 {
-	D3D12_GRAPHICS_PIPELINE_STATE_DESC opaquePsoDesc;
-
-	// PSO for opaque objects.
-
-	ZeroMemory(&opaquePsoDesc, sizeof(D3D12_GRAPHICS_PIPELINE_STATE_DESC));
-	opaquePsoDesc.InputLayout = { mInputLayout.data(), (UINT)mInputLayout.size() };
-	opaquePsoDesc.pRootSignature = mRootSignature.Get();
+	if (!mAnimateBattlements)
+		return;
 
-	opaquePsoDesc.VS =
+	for (auto& group : mAnimatedGroups)
 	{
-	 reinterpret_cast<BYTE*>(mShaders["standardVS"]->GetBufferPointer()),
-	 mShaders["standardVS"]->GetBufferSize()
-	};
+		// Bob the pieces up and down with a phase offset along the wall.
+		for (UINT i = 0; i < group.Count; ++i)
+			group.AnimatedY[i] = group.TranslationY[i] + 0.25f * sinf(3.0f * gt.TotalTime() + 0.5f * i);
+
+		TransformBatch::Streams streams = group.GetStreams(group.AnimatedY);
+
+		// The group is rewritten every frame, so it goes straight into the current frame
+		// resource's buffers instead of through the dirty list.
+		UINT objCBIndex = mScene.ObjCBIndex[group.FirstObject];
+		TransformBatch::ComposeWorlds(streams, group.Count,
+			mCurrFrameResource->ObjectCBMappedData + (size_t)objCBIndex * mCurrFrameResource->ObjectCBStride,
+			mCurrFrameResource->ObjectCBStride, true);
+
+		UINT instanceIndex = mScene.InstanceIndex[group.FirstObject];
+		TransformBatch::ComposeWorlds(streams, group.Count,
+			mCurrFrameResource->InstanceBufferMappedData + (size_t)instanceIndex * mCurrFrameResource->InstanceBufferStride,
+			mCurrFrameResource->InstanceBufferStride, true);
+
+		// Keep the CPU copy current for anything else that reads the world matrices.
+		TransformBatch::ComposeWorlds(streams, group.Count,
+			reinterpret_cast<std::uint8_t*>(&mScene.World[group.FirstObject]), sizeof(XMFLOAT4X4), false);
+	}
+}
 
-	opaquePsoDesc.PS =
-	{
-	 reinterpret_cast<BYTE*>(mShaders["opaquePS"]->GetBufferPointer()),
-	 mShaders["opaquePS"]->GetBufferSize()
-	};
+void ShapesApp::UpdateLods(const GameTimer& gt)
+{
+	XMVECTOR eyePos = XMLoadFloat3(&mEyePos);
 
-	opaquePsoDesc.RasterizerState = CD3DX12_RASTERIZER_DESC(D3D12_DEFAULT);
-	opaquePsoDesc.RasterizerState.FillMode = D3D12_FILL_MODE_SOLID;
-	opaquePsoDesc.BlendState = CD3DX12_BLEND_DESC(D3D12_DEFAULT);
-	opaquePsoDesc.DepthStencilState = CD3DX12_DEPTH_STENCIL_DESC(D3D12_DEFAULT);
-	opaquePsoDesc.SampleMask = UINT_MAX;
-	opaquePsoDesc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
-	opaquePsoDesc.NumRenderTargets = 1;
-	opaquePsoDesc.RTVFormats[0] = mBackBufferFormat;
-	opaquePsoDesc.SampleDesc.Count = m4xMsaaState ? 4 : 1;
-	opaquePsoDesc.SampleDesc.Quality = m4xMsaaState ? (m4xMsaaQuality - 1) : 0;
-	opaquePsoDesc.DSVFormat = mDepthStencilFormat;
+	// The instanced batches and the indirect arguments of GPU culling are built once
+	// with level 0, so only the per-object paths use the selected levels.
+	if (mUseInstancing || mUseGpuCulling)
+		return;
 
-	ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&opaquePsoDesc, IID_PPV_ARGS(&mPSOs["opaque"])));
+	mLodChanges.clear();
+	mScene.SelectLods(eyePos, mProj(1, 1), gLodObjectsPerFrame, mLodChanges);
+	if (!mLodChanges.empty())
+		PatchDrawList(mOpaqueRitems, mLodChanges, mOpaqueDrawList);
+}
 
-	// PSO for opaque wireframe objects.
+void ShapesApp::UpdateDrawOrder()
+{
+	// Only the per-object draws follow the depth order: the pre-pass, and the main pass
+	// without the draw list, which keeps its state order.
+	if (mUseInstancing || mUseGpuCulling || (mUseDrawList && !mUseDepthPrePass))
+		return;
 
-	D3D12_GRAPHICS_PIPELINE_STATE_DESC opaqueWireframePsoDesc = opaquePsoDesc;
-	opaqueWireframePsoDesc.RasterizerState.FillMode = D3D12_FILL_MODE_WIREFRAME;
-	ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&opaqueWireframePsoDesc, IID_PPV_ARGS(&mPSOs["opaque_wireframe"])));
+	FrameProfiler::CpuScope profileScope(mProfiler.get(), "DepthSort");
+	mOpaqueDepthOrder.Sort(mScene, mOpaqueRitems, XMLoadFloat4x4(&mView), gNearZ, gFarZ);
 }
 
-void ShapesApp::BuildFrameResources()
+void ShapesApp::RestoreAnimatedGroups()
 {
-	for (int i = 0; i < gNumFrameResources; ++i)
+	// Put the pieces back in their rest pose in every frame resource.
+	for (auto& group : mAnimatedGroups)
 	{
-		mFrameResources.push_back(std::make_unique<FrameResource>(md3dDevice.Get(),
-			1, (UINT)mAllRitems.size()));
+		TransformBatch::ComposeWorlds(group.GetStreams(group.TranslationY), group.Count,
+			reinterpret_cast<std::uint8_t*>(&mScene.World[group.FirstObject]), sizeof(XMFLOAT4X4), false);
+
+		for (UINT i = 0; i < group.Count; ++i)
+			mScene.MarkDirty(group.FirstObject + i);
 	}
 }
 
-void ShapesApp::BuildRenderItems()
-{
-	UINT objCBIndex = 0;
-
-	//castle Walls
-	// 
-	//towers cylinders
-	auto cylinderRitem = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&cylinderRitem->World, XMMatrixTranslation(8.0f, 3.0f, -13.0f) * XMMatrixScaling(1, 1, 1));
+void ShapesApp::UpdateMainPassCB(const GameTimer& gt)
+{
+	FrameProfiler::CpuScope profileScope(mProfiler.get(), "UpdateMainPassCB");
 
-	cylinderRitem->ObjCBIndex = objCBIndex++;
-	cylinderRitem->Geo = mGeometries["shapeGeo"].get();
-	cylinderRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	cylinderRitem->IndexCount = cylinderRitem->Geo->DrawArgs["cylinder"].IndexCount;
-	cylinderRitem->StartIndexLocation = cylinderRitem->Geo->DrawArgs["cylinder"].StartIndexLocation;
-	cylinderRitem->BaseVertexLocation = cylinderRitem->Geo->DrawArgs["cylinder"].BaseVertexLocation;
-	mAllRitems.push_back(std::move(cylinderRitem));
+	XMMATRIX view = XMLoadFloat4x4(&mView);
+	XMMATRIX proj = XMLoadFloat4x4(&mProj);
 
+	XMMATRIX viewProj = XMMatrixMultiply(view, proj);
+	XMMATRIX invView = XMMatrixInverse(&XMMatrixDeterminant(view), view);
+	XMMATRIX invProj = XMMatrixInverse(&XMMatrixDeterminant(proj), proj);
+	XMMATRIX invViewProj = XMMatrixInverse(&XMMatrixDeterminant(viewProj), viewProj);
 
-	auto cylinderRitem2 = std::make_unique<RenderItem>();
+	XMStoreFloat4x4(&mMainPassCB.View, XMMatrixTranspose(view));
+	XMStoreFloat4x4(&mMainPassCB.InvView, XMMatrixTranspose(invView));
+	XMStoreFloat4x4(&mMainPassCB.Proj, XMMatrixTranspose(proj));
+	XMStoreFloat4x4(&mMainPassCB.InvProj, XMMatrixTranspose(invProj));
+	XMStoreFloat4x4(&mMainPassCB.ViewProj, XMMatrixTranspose(viewProj));
+	XMStoreFloat4x4(&mMainPassCB.InvViewProj, XMMatrixTranspose(invViewProj));
+	mMainPassCB.EyePosW = mEyePos;
+	mMainPassCB.RenderTargetSize = XMFLOAT2((float)mClientWidth, (float)mClientHeight);
+	mMainPassCB.InvRenderTargetSize = XMFLOAT2(1.0f / mClientWidth, 1.0f / mClientHeight);
+	mMainPassCB.NearZ = gNearZ;
+	mMainPassCB.FarZ = gFarZ;
+	mMainPassCB.TotalTime = gt.TotalTime();
+	mMainPassCB.DeltaTime = gt.DeltaTime();
+	mMainPassCB.EdgeOpacity = mShowEdges ? 1.0f : 0.0f;
 
-	XMStoreFloat4x4(&cylinderRitem2->World, XMMatrixTranslation(-8.0f, 3.0f, -13.0f) * XMMatrixScaling(1, 1, 1));
-	cylinderRitem2->ObjCBIndex = objCBIndex++;
-	cylinderRitem2->Geo = mGeometries["shapeGeo"].get();
-	cylinderRitem2->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	cylinderRitem2->IndexCount = cylinderRitem2->Geo->DrawArgs["cylinder"].IndexCount;
-	cylinderRitem2->StartIndexLocation = cylinderRitem2->Geo->DrawArgs["cylinder"].StartIndexLocation;
-	cylinderRitem2->BaseVertexLocation = cylinderRitem2->Geo->DrawArgs["cylinder"].BaseVertexLocation;
-	mAllRitems.push_back(std::move(cylinderRitem2));
+	auto currPassCB = mCurrFrameResource->PassCB.get();
+	currPassCB->CopyData(0, mMainPassCB);
+}
 
-	auto cylinderRitem3 = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&cylinderRitem3->World, XMMatrixTranslation(-8.0f, 3.0f, 13.0f) * XMMatrixScaling(1, 1, 1));
+void ShapesApp::BuildDescriptorHeaps()
+{
+	// With bindless object constants only the pass CBVs live in the heap.
+	UINT objCount = mBindlessObjectConstants ? 0 : (UINT)mOpaqueRitems.size();
 
-	cylinderRitem3->ObjCBIndex = objCBIndex++;
-	cylinderRitem3->Geo = mGeometries["shapeGeo"].get();
-	cylinderRitem3->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	cylinderRitem3->IndexCount = cylinderRitem3->Geo->DrawArgs["cylinder"].IndexCount;
-	cylinderRitem3->StartIndexLocation = cylinderRitem3->Geo->DrawArgs["cylinder"].StartIndexLocation;
-	cylinderRitem3->BaseVertexLocation = cylinderRitem3->Geo->DrawArgs["cylinder"].BaseVertexLocation;
-	mAllRitems.push_back(std::move(cylinderRitem3));
+	// Need a CBV descriptor for each object for each frame resource,
+	// +1 for the perPass CBV for each frame resource, +1 for the culling UAV.
+	UINT numDescriptors = (objCount + 1) * mNumFrameResources + 1;
 
-	auto cylinderRitem4 = std::make_unique<RenderItem>();
+	// Save an offset to the start of the pass CBVs.  These follow the object CBVs.
+	mPassCbvOffset = objCount * mNumFrameResources;
+	mCullUavIndex = numDescriptors - 1;
 
-	XMStoreFloat4x4(&cylinderRitem4->World, XMMatrixTranslation(8.0f, 3.0f, 13.0f) * XMMatrixScaling(1, 1, 1));
-	cylinderRitem4->ObjCBIndex = objCBIndex++;
-	cylinderRitem4->Geo = mGeometries["shapeGeo"].get();
-	cylinderRitem4->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	cylinderRitem4->IndexCount = cylinderRitem4->Geo->DrawArgs["cylinder"].IndexCount;
-	cylinderRitem4->StartIndexLocation = cylinderRitem4->Geo->DrawArgs["cylinder"].StartIndexLocation;
-	cylinderRitem4->BaseVertexLocation = cylinderRitem4->Geo->DrawArgs["cylinder"].BaseVertexLocation;
-	mAllRitems.push_back(std::move(cylinderRitem4));
+	D3D12_DESCRIPTOR_HEAP_DESC cbvHeapDesc;
+	cbvHeapDesc.NumDescriptors = numDescriptors;
+	cbvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
+	cbvHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
+	cbvHeapDesc.NodeMask = 0;
+	ThrowIfFailed(md3dDevice->CreateDescriptorHeap(&cbvHeapDesc,
+		IID_PPV_ARGS(&mCbvHeap)));
+}
 
-	//Entrance prism
+void ShapesApp::BuildConstantBufferViews()
+{
+	UINT objCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(ObjectConstants));
 
-	auto prismRitem = std::make_unique<RenderItem>();
+	// Bindless object constants are read through a root SRV and need no descriptors.
+	UINT objCount = mBindlessObjectConstants ? 0 : (UINT)mOpaqueRitems.size();
 
-	XMStoreFloat4x4(&prismRitem->World, XMMatrixTranslation(1.9f, 0.5f, -5.75f) * XMMatrixScaling(1.5f, 7.0f, 2.25f));
+	// Need a CBV descriptor for each object for each frame resource.
+	for (UINT frameIndex = 0; frameIndex < mNumFrameResources; ++frameIndex)
+	{
+		auto objectCB = mFrameResources[frameIndex]->ObjectCB->Resource();
+		for (UINT i = 0; i < objCount; ++i)
+		{
+			D3D12_GPU_VIRTUAL_ADDRESS cbAddress = objectCB->GetGPUVirtualAddress();
 
-	prismRitem->ObjCBIndex = objCBIndex++;
-	prismRitem->Geo = mGeometries["shapeGeo"].get();
-	prismRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	prismRitem->IndexCount = prismRitem->Geo->DrawArgs["prism"].IndexCount;
-	prismRitem->StartIndexLocation = prismRitem->Geo->DrawArgs["prism"].StartIndexLocation;
-	prismRitem->BaseVertexLocation = prismRitem->Geo->DrawArgs["prism"].BaseVertexLocation;
-	mAllRitems.push_back(std::move(prismRitem));
+			// Offset to the ith object constant buffer in the buffer.
+			cbAddress += i * objCBByteSize;
 
-	auto prismRitem2 = std::make_unique<RenderItem>();
+			// Offset to the object cbv in the descriptor heap.
+			UINT heapIndex = frameIndex * objCount + i;
+			auto handle = CD3DX12_CPU_DESCRIPTOR_HANDLE(mCbvHeap->GetCPUDescriptorHandleForHeapStart());
+			handle.Offset(heapIndex, mCbvSrvUavDescriptorSize);
 
-	XMStoreFloat4x4(&prismRitem2->World, XMMatrixTranslation(1.9f, 0.5f, 5.75f) * XMMatrixScaling(1.5f, 7.0f, 2.25f)
-		* XMMatrixRotationY(3.1416));
+			D3D12_CONSTANT_BUFFER_VIEW_DESC cbvDesc;
+			cbvDesc.BufferLocation = cbAddress;
+			cbvDesc.SizeInBytes = objCBByteSize;
 
-	prismRitem2->ObjCBIndex = objCBIndex++;
-	prismRitem2->Geo = mGeometries["shapeGeo"].get();
-	prismRitem2->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	prismRitem2->IndexCount = prismRitem2->Geo->DrawArgs["prism"].IndexCount;
-	prismRitem2->StartIndexLocation = prismRitem2->Geo->DrawArgs["prism"].StartIndexLocation;
-	prismRitem2->BaseVertexLocation = prismRitem2->Geo->DrawArgs["prism"].BaseVertexLocation;
-	mAllRitems.push_back(std::move(prismRitem2));
+			md3dDevice->CreateConstantBufferView(&cbvDesc, handle);
+		}
+	}
 
-	//gate
-	auto posts = std::make_unique<RenderItem>();
+	UINT passCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(PassConstants));
 
-	XMStoreFloat4x4(&posts->World, XMMatrixTranslation(0.0f, 4.0f, -4.25f) * XMMatrixScaling(9.0f, 2.0f, 3.0f));
+	// The last descriptors are the pass CBVs for each frame resource.
+	for (UINT frameIndex = 0; frameIndex < mNumFrameResources; ++frameIndex)
+	{
+		auto passCB = mFrameResources[frameIndex]->PassCB->Resource();
+		D3D12_GPU_VIRTUAL_ADDRESS cbAddress = passCB->GetGPUVirtualAddress();
 
-	posts->ObjCBIndex = objCBIndex++;
-	posts->Geo = mGeometries["shapeGeo"].get();
-	posts->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	posts->IndexCount = posts->Geo->DrawArgs["box"].IndexCount;
-	posts->StartIndexLocation = posts->Geo->DrawArgs["box"].StartIndexLocation;
-	posts->BaseVertexLocation = posts->Geo->DrawArgs["box"].BaseVertexLocation;
-	mAllRitems.push_back(std::move(posts));
+		// Offset to the pass cbv in the descriptor heap.
+		UINT heapIndex = mPassCbvOffset + frameIndex;
+		auto handle = CD3DX12_CPU_DESCRIPTOR_HANDLE(mCbvHeap->GetCPUDescriptorHandleForHeapStart());
+		handle.Offset(heapIndex, mCbvSrvUavDescriptorSize);
 
-	auto pyramidRitem = std::make_unique<RenderItem>();
+		D3D12_CONSTANT_BUFFER_VIEW_DESC cbvDesc;
+		cbvDesc.BufferLocation = cbAddress;
+		cbvDesc.SizeInBytes = passCBByteSize;
 
-	XMStoreFloat4x4(&pyramidRitem->World, XMMatrixTranslation(0.0f, 10.5f, -8.5f)* XMMatrixScaling(4.0f, 1.0f, 1.5f));
+		md3dDevice->CreateConstantBufferView(&cbvDesc, handle);
+	}
+}
 
-	pyramidRitem->ObjCBIndex = objCBIndex++;
-	pyramidRitem->Geo = mGeometries["shapeGeo"].get();
-	pyramidRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	pyramidRitem->IndexCount = pyramidRitem->Geo->DrawArgs["pyramid"].IndexCount;
-	pyramidRitem->StartIndexLocation = pyramidRitem->Geo->DrawArgs["pyramid"].StartIndexLocation;
-	pyramidRitem->BaseVertexLocation = pyramidRitem->Geo->DrawArgs["pyramid"].BaseVertexLocation;
-	mAllRitems.push_back(std::move(pyramidRitem));
-
-
-	//TowerCones
-
-	auto coneRitem = std::make_unique<RenderItem>();
-
-	XMStoreFloat4x4(&coneRitem->World, XMMatrixTranslation(8.0f, 7.0f, -13.0f) * XMMatrixScaling(1.0f, 1.0f, 1.0f));
-
-	coneRitem->ObjCBIndex = objCBIndex++;
-	coneRitem->Geo = mGeometries["shapeGeo"].get();
-	coneRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	coneRitem->IndexCount = coneRitem->Geo->DrawArgs["cone"].IndexCount;
-	coneRitem->StartIndexLocation = coneRitem->Geo->DrawArgs["cone"].StartIndexLocation;
-	coneRitem->BaseVertexLocation = coneRitem->Geo->DrawArgs["cone"].BaseVertexLocation;
-	mAllRitems.push_back(std::move(coneRitem));
-
-	auto coneRitem2 = std::make_unique<RenderItem>();
-
-	XMStoreFloat4x4(&coneRitem2->World, XMMatrixTranslation(-8.0f, 7.0f, -13.0f) * XMMatrixScaling(1.0f, 1.0f, 1.0f));
-
-	coneRitem2->ObjCBIndex = objCBIndex++;
-	coneRitem2->Geo = mGeometries["shapeGeo"].get();
-	coneRitem2->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	coneRitem2->IndexCount = coneRitem2->Geo->DrawArgs["cone"].IndexCount;
-	coneRitem2->StartIndexLocation = coneRitem2->Geo->DrawArgs["cone"].StartIndexLocation;
-	coneRitem2->BaseVertexLocation = coneRitem2->Geo->DrawArgs["cone"].BaseVertexLocation;
-	mAllRitems.push_back(std::move(coneRitem2));
+void ShapesApp::BuildRootSignature()
+{
+	CD3DX12_DESCRIPTOR_RANGE cbvTable0;
+	cbvTable0.Init(D3D12_DESCRIPTOR_RANGE_TYPE_CBV, 1, 0);
 
-	auto coneRitem3 = std::make_unique<RenderItem>();
+	CD3DX12_DESCRIPTOR_RANGE cbvTable1;
+	cbvTable1.Init(D3D12_DESCRIPTOR_RANGE_TYPE_CBV, 1, 1);
 
-	XMStoreFloat4x4(&coneRitem3->World, XMMatrixTranslation(-8.0f, 7.0f, 13.0f) * XMMatrixScaling(1.0f, 1.0f, 1.0f));
+	// Root parameter can be a table, root descriptor or root constants.
+	CD3DX12_ROOT_PARAMETER slotRootParameter[5];
 
-	coneRitem3->ObjCBIndex = objCBIndex++;
-	coneRitem3->Geo = mGeometries["shapeGeo"].get();
-	coneRitem3->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	coneRitem3->IndexCount = coneRitem3->Geo->DrawArgs["cone"].IndexCount;
-	coneRitem3->StartIndexLocation = coneRitem3->Geo->DrawArgs["cone"].StartIndexLocation;
-	coneRitem3->BaseVertexLocation = coneRitem3->Geo->DrawArgs["cone"].BaseVertexLocation;
-	mAllRitems.push_back(std::move(coneRitem3));
+	// Object constants: either a per-object CBV table, or the index of the object
+	// in the structured buffer bound at slot 4.
+	if (mBindlessObjectConstants)
+		slotRootParameter[0].InitAsConstants(1, 0);
+	else
+		slotRootParameter[0].InitAsDescriptorTable(1, &cbvTable0);
 
-	auto coneRitem4 = std::make_unique<RenderItem>();
+	slotRootParameter[1].InitAsDescriptorTable(1, &cbvTable1);
 
-	XMStoreFloat4x4(&coneRitem4->World, XMMatrixTranslation(8.0f, 7.0f, 13.0f) * XMMatrixScaling(1.0f, 1.0f, 1.0f));
+	// Instanced drawing: root SRV for the instance buffer and the first instance of the batch.
+	slotRootParameter[2].InitAsShaderResourceView(0);
+	slotRootParameter[3].InitAsConstants(1, 2);
 
-	coneRitem4->ObjCBIndex = objCBIndex++;
-	coneRitem4->Geo = mGeometries["shapeGeo"].get();
-	coneRitem4->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	coneRitem4->IndexCount = coneRitem4->Geo->DrawArgs["cone"].IndexCount;
-	coneRitem4->StartIndexLocation = coneRitem4->Geo->DrawArgs["cone"].StartIndexLocation;
-	coneRitem4->BaseVertexLocation = coneRitem4->Geo->DrawArgs["cone"].BaseVertexLocation;
-	mAllRitems.push_back(std::move(coneRitem4));
+	// Bindless object constants: root SRV for the per-frame object buffer.
+	slotRootParameter[4].InitAsShaderResourceView(1);
 
-	//spheres
-	auto sphereRitem = std::make_unique<RenderItem>();
+	// A root signature is an array of root parameters.
+	CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(5, slotRootParameter, 0, nullptr,
+		D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT);
 
-	XMStoreFloat4x4(&sphereRitem->World, XMMatrixTranslation(8.0f, 10.0f, -13.0f)* XMMatrixScaling(1.0f, 1.0f, 1.0f));
+	// create a root signature with a single slot which points to a descriptor range consisting of a single constant buffer
+	ComPtr<ID3DBlob> serializedRootSig = nullptr;
+	ComPtr<ID3DBlob> errorBlob = nullptr;
+	HRESULT hr = D3D12SerializeRootSignature(&rootSigDesc, D3D_ROOT_SIGNATURE_VERSION_1,
+		serializedRootSig.GetAddressOf(), errorBlob.GetAddressOf());
 
-	sphereRitem->ObjCBIndex = objCBIndex++;
-	sphereRitem->Geo = mGeometries["shapeGeo"].get();
-	sphereRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	sphereRitem->IndexCount = sphereRitem->Geo->DrawArgs["sphere"].IndexCount;
-	sphereRitem->StartIndexLocation = sphereRitem->Geo->DrawArgs["sphere"].StartIndexLocation;
-	sphereRitem->BaseVertexLocation = sphereRitem->Geo->DrawArgs["sphere"].BaseVertexLocation;
-	mAllRitems.push_back(std::move(sphereRitem));
+	if (errorBlob != nullptr)
+	{
+		::OutputDebugStringA((char*)errorBlob->GetBufferPointer());
+	}
+	ThrowIfFailed(hr);
 
-	auto sphereRitem2 = std::make_unique<RenderItem>();
+	ThrowIfFailed(md3dDevice->CreateRootSignature(
+		0,
+		serializedRootSig->GetBufferPointer(),
+		serializedRootSig->GetBufferSize(),
+		IID_PPV_ARGS(mRootSignature.GetAddressOf())));
+}
 
-	XMStoreFloat4x4(&sphereRitem2->World, XMMatrixTranslation(-8.0f, 10.0f, -13.0f)* XMMatrixScaling(1.0f, 1.0f, 1.0f));
+void ShapesApp::BuildCullRootSignature()
+{
+	CD3DX12_DESCRIPTOR_RANGE uavTable;
+	uavTable.Init(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 1, 0);
 
-	sphereRitem2->ObjCBIndex = objCBIndex++;
-	sphereRitem2->Geo = mGeometries["shapeGeo"].get();
-	sphereRitem2->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	sphereRitem2->IndexCount = sphereRitem2->Geo->DrawArgs["sphere"].IndexCount;
-	sphereRitem2->StartIndexLocation = sphereRitem2->Geo->DrawArgs["sphere"].StartIndexLocation;
-	sphereRitem2->BaseVertexLocation = sphereRitem2->Geo->DrawArgs["sphere"].BaseVertexLocation;
-	mAllRitems.push_back(std::move(sphereRitem2));
+	CD3DX12_ROOT_PARAMETER slotRootParameter[5];
 
-	auto sphereRitem3 = std::make_unique<RenderItem>();
+	// Object count, pass constants, instance buffer, cull objects and the command
+	// buffer.  The append buffer needs a descriptor table because root UAVs have no counter.
+	slotRootParameter[0].InitAsConstants(1, 0);
+	slotRootParameter[1].InitAsConstantBufferView(1);
+	slotRootParameter[2].InitAsShaderResourceView(0);
+	slotRootParameter[3].InitAsShaderResourceView(1);
+	slotRootParameter[4].InitAsDescriptorTable(1, &uavTable);
 
-	XMStoreFloat4x4(&sphereRitem3->World, XMMatrixTranslation(-8.0f, 10.0f, 13.0f)* XMMatrixScaling(1.0f, 1.0f, 1.0f));
+	CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(5, slotRootParameter, 0, nullptr,
+		D3D12_ROOT_SIGNATURE_FLAG_NONE);
 
-	sphereRitem3->ObjCBIndex = objCBIndex++;
-	sphereRitem3->Geo = mGeometries["shapeGeo"].get();
-	sphereRitem3->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	sphereRitem3->IndexCount = sphereRitem3->Geo->DrawArgs["sphere"].IndexCount;
-	sphereRitem3->StartIndexLocation = sphereRitem3->Geo->DrawArgs["sphere"].StartIndexLocation;
-	sphereRitem3->BaseVertexLocation = sphereRitem3->Geo->DrawArgs["sphere"].BaseVertexLocation;
-	mAllRitems.push_back(std::move(sphereRitem3));
+	ComPtr<ID3DBlob> serializedRootSig = nullptr;
+	ComPtr<ID3DBlob> errorBlob = nullptr;
+	HRESULT hr = D3D12SerializeRootSignature(&rootSigDesc, D3D_ROOT_SIGNATURE_VERSION_1,
+		serializedRootSig.GetAddressOf(), errorBlob.GetAddressOf());
 
+	if (errorBlob != nullptr)
+	{
+		::OutputDebugStringA((char*)errorBlob->GetBufferPointer());
+	}
+	ThrowIfFailed(hr);
 
-	auto sphereRitem4 = std::make_unique<RenderItem>();
+	ThrowIfFailed(md3dDevice->CreateRootSignature(
+		0,
+		serializedRootSig->GetBufferPointer(),
+		serializedRootSig->GetBufferSize(),
+		IID_PPV_ARGS(mCullRootSignature.GetAddressOf())));
+}
 
-	XMStoreFloat4x4(&sphereRitem4->World, XMMatrixTranslation(8.0f, 10.0f, 13.0f)* XMMatrixScaling(1.0f, 1.0f, 1.0f));
+void ShapesApp::BuildCullResources()
+{
+	// One ExecuteIndirect binds a single vertex/index buffer, so only the objects of the
+	// main shape geometry are culled; objects in other buffers are drawn directly.  So
+	// is a streamed planet, which moves to the geometry heap.  The indirect arguments
+	// are written here from level 0 submeshes; UpdateLods leaves this path out.
+	mCullGeo = mGeometries.count("shapeGeo") ? mGeometries["shapeGeo"].get() : mGeometries["shapeGeo_32"].get();
+
+	std::vector<UINT> culledObjects;
+	for (UINT i = 0; i < (UINT)mScene.Size(); ++i)
+	{
+		if (mScene.Submeshes[mScene.SubmeshId[i]].Geo == mCullGeo && mScene.SubmeshId[i] != mPlanetSubmesh)
+			culledObjects.push_back(i);
+		else
+			mUnculledObjects.push_back(i);
+	}
 
-	sphereRitem4->ObjCBIndex = objCBIndex++;
-	sphereRitem4->Geo = mGeometries["shapeGeo"].get();
-	sphereRitem4->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	sphereRitem4->IndexCount = sphereRitem4->Geo->DrawArgs["sphere"].IndexCount;
-	sphereRitem4->StartIndexLocation = sphereRitem4->Geo->DrawArgs["sphere"].StartIndexLocation;
-	sphereRitem4->BaseVertexLocation = sphereRitem4->Geo->DrawArgs["sphere"].BaseVertexLocation;
-	mAllRitems.push_back(std::move(sphereRitem4));
+	// Static cull data: the bounds and draw arguments of every object never change,
+	// only the world matrices in the instance buffer do.
+	mCullObjectCount = (UINT)culledObjects.size();
+	mCullObjects = std::make_unique<UploadBuffer<CullObjectData>>(md3dDevice.Get(), std::max(mCullObjectCount, 1u), false);
+	for (UINT i = 0; i < mCullObjectCount; ++i)
+	{
+		UINT object = culledObjects[i];
+		auto& submesh = mScene.Submeshes[mScene.SubmeshId[object]];
+
+		CullObjectData cullObject;
+		cullObject.Center = submesh.Bounds.Center;
+		cullObject.Radius = submesh.Bounds.Radius;
+		cullObject.IndexCount = submesh.IndexCount;
+		cullObject.StartIndexLocation = submesh.StartIndexLocation;
+		cullObject.BaseVertexLocation = submesh.BaseVertexLocation;
+		cullObject.InstanceIndex = mScene.InstanceIndex[object];
+		mCullObjects->CopyData(i, cullObject);
+	}
 
-	//Walls
-	// 
-	//left
-	auto boxRitem = std::make_unique<RenderItem>();
+	mCullCounterReset = std::make_unique<UploadBuffer<UINT>>(md3dDevice.Get(), 1, false);
+	mCullCounterReset->CopyData(0, 0);
+
+	// The counter must be placed at an aligned offset; put it right after the commands.
+	UINT commandBytes = mCullObjectCount * sizeof(IndirectCommand);
+	mIndirectCounterOffset = (commandBytes + (D3D12_UAV_COUNTER_PLACEMENT_ALIGNMENT - 1)) &
+		~(D3D12_UAV_COUNTER_PLACEMENT_ALIGNMENT - 1);
+
+	ThrowIfFailed(md3dDevice->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(mIndirectCounterOffset + sizeof(UINT), D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS),
+		D3D12_RESOURCE_STATE_COPY_DEST,
+		nullptr,
+		IID_PPV_ARGS(mIndirectCommands.GetAddressOf())));
+
+	D3D12_UNORDERED_ACCESS_VIEW_DESC uavDesc = {};
+	uavDesc.Format = DXGI_FORMAT_UNKNOWN;
+	uavDesc.ViewDimension = D3D12_UAV_DIMENSION_BUFFER;
+	uavDesc.Buffer.FirstElement = 0;
+	uavDesc.Buffer.NumElements = std::max(mCullObjectCount, 1u);
+	uavDesc.Buffer.StructureByteStride = sizeof(IndirectCommand);
+	uavDesc.Buffer.CounterOffsetInBytes = mIndirectCounterOffset;
+	uavDesc.Buffer.Flags = D3D12_BUFFER_UAV_FLAG_NONE;
+
+	auto uavHandle = CD3DX12_CPU_DESCRIPTOR_HANDLE(mCbvHeap->GetCPUDescriptorHandleForHeapStart());
+	uavHandle.Offset(mCullUavIndex, mCbvSrvUavDescriptorSize);
+	md3dDevice->CreateUnorderedAccessView(mIndirectCommands.Get(), mIndirectCommands.Get(), &uavDesc, uavHandle);
+
+	// Each command sets the base instance root constant of the graphics root signature
+	// and then draws.
+	D3D12_INDIRECT_ARGUMENT_DESC argumentDescs[2] = {};
+	argumentDescs[0].Type = D3D12_INDIRECT_ARGUMENT_TYPE_CONSTANT;
+	argumentDescs[0].Constant.RootParameterIndex = 3;
+	argumentDescs[0].Constant.DestOffsetIn32BitValues = 0;
+	argumentDescs[0].Constant.Num32BitValuesToSet = 1;
+	argumentDescs[1].Type = D3D12_INDIRECT_ARGUMENT_TYPE_DRAW_INDEXED;
+
+	D3D12_COMMAND_SIGNATURE_DESC commandSignatureDesc = {};
+	commandSignatureDesc.ByteStride = sizeof(IndirectCommand);
+	commandSignatureDesc.NumArgumentDescs = _countof(argumentDescs);
+	commandSignatureDesc.pArgumentDescs = argumentDescs;
+
+	ThrowIfFailed(md3dDevice->CreateCommandSignature(&commandSignatureDesc, mRootSignature.Get(),
+		IID_PPV_ARGS(mCullCommandSignature.GetAddressOf())));
+}
 
-	XMStoreFloat4x4(&boxRitem->World, XMMatrixTranslation(-4.0f, 0.5f, 0.0f) * XMMatrixScaling(2.0f, 4.0f, 28.0f)) ;
+void ShapesApp::BuildShadersAndInputLayout()
+{
+	// The compact layout needs a vertex shader that decodes the positions.  The structured
+	// buffer shaders always decode; the scale and bias are the identity otherwise.
+	// Precompiled .cso files are used when they are up to date; see PipelineCache.
+	std::vector<PipelineCache::ShaderDesc> shaders =
+	{
+		{ "standardVS", mCompactVertices ? L"Shaders\\CompactVS.hlsl" : L"Shaders\\VS.hlsl", "VS", "vs_5_1" },
+		{ "edgeGS", L"Shaders\\EdgeOverlay.hlsl", "GS", "gs_5_1" },
+		{ "opaquePS", L"Shaders\\EdgeOverlay.hlsl", "PS", "ps_5_1" },
+		{ "instancedVS", L"Shaders\\InstancedVS.hlsl", "VS", "vs_5_1" },
+		{ "bindlessVS", L"Shaders\\BindlessVS.hlsl", "VS", "vs_5_1" },
+		{ "cullCS", L"Shaders\\CullCS.hlsl", "CS", "cs_5_1" },
+	};
+	mPipelineCache->LoadShaders(shaders, DefaultJobCount(), mShaders);
 
-	boxRitem->ObjCBIndex = objCBIndex++;
-	boxRitem->Geo = mGeometries["shapeGeo"].get();
-	boxRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	boxRitem->IndexCount = boxRitem->Geo->DrawArgs["box"].IndexCount;
-	boxRitem->StartIndexLocation = boxRitem->Geo->DrawArgs["box"].StartIndexLocation;
-	boxRitem->BaseVertexLocation = boxRitem->Geo->DrawArgs["box"].BaseVertexLocation;
-	mAllRitems.push_back(std::move(boxRitem));
+	if (mCompactVertices)
+	{
+		// Layout of CompactVertex.
+		mInputLayout =
+		{
+			{ "POSITION", 0, DXGI_FORMAT_R16G16B16A16_SNORM, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+			{ "COLOR", 0, DXGI_FORMAT_R8G8B8A8_UNORM, 0, 8, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+		};
+	}
+	else
+	{
+		mInputLayout =
+		{
+			{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+			{ "COLOR", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+		};
+	}
+}
 
-	
 
-	for (int i = 0; i < 12; i++)
+void ShapesApp::BuildShapeGeometry()
+{
+	ShapeGeometryOptions options;
+	options.PlanetSubdivisions = mPlanetSubdivisions;
+	options.IndexMode = mIndexMode;
+	options.CompactVertices = mCompactVertices;
+	options.OptimizeMeshes = mOptimizeMeshes;
+	options.Jobs = mGeometryJobs;
+	ShapeGeometryBuilder builder(options);
+
+	// We are concatenating all the geometry into shared vertex/index buffers.  The
+	// packer defines the regions in the buffers each submesh covers.
+	GeometryPacker packer;
+	builder.ConfigurePacker(packer);
+
+	std::uint64_t cacheKey = builder.CacheKey();
+	bool cacheLoaded = mUseGeometryCache &&
+		packer.LoadCache(md3dDevice.Get(), mCommandList.Get(), gGeometryCachePath, cacheKey);
+
+	if (!cacheLoaded)
 	{
-		auto borders = std::make_unique<RenderItem>();
-		auto dersbor = std::make_unique<RenderItem>();
-		XMMATRIX bordersleft = XMMatrixTranslation(-8.5f, 4.5f, -11.0f + i * 2);
-		XMMATRIX dersborleft = XMMatrixTranslation(8.5f, 4.5f, -12.0f + i * 2) *XMMatrixRotationY(3.1416);
+		builder.Generate(packer);
 
-		XMStoreFloat4x4(&borders->World, bordersleft);
-		XMStoreFloat4x4(&dersbor->World, dersborleft);
+		// The cache is written from the CPU copies, which are dropped afterwards.
+		packer.SetKeepCpuCopy(mUseGeometryCache);
+		packer.Build(md3dDevice.Get(), mCommandList.Get(), "shapeGeo", mIndexMode);
 
+		if (mUseGeometryCache)
+		{
+			if (!packer.SaveCache(gGeometryCachePath, cacheKey))
+				::OutputDebugStringA("GeometryCache: could not write the cache file\n");
+
+			for (auto& geo : packer.Geometries())
+			{
+				geo->VertexBufferCPU = nullptr;
+				geo->IndexBufferCPU = nullptr;
+			}
+		}
+	}
 
-		borders->ObjCBIndex = objCBIndex++;
-		borders->Geo = mGeometries["shapeGeo"].get();
-		borders->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-		borders->IndexCount = borders->Geo->DrawArgs["wedge"].IndexCount;
-		borders->StartIndexLocation = borders->Geo->DrawArgs["wedge"].StartIndexLocation;
-		borders->BaseVertexLocation = borders->Geo->DrawArgs["wedge"].BaseVertexLocation;
+	builder.RegisterSubmeshes(packer, mScene);
 
+	for (auto& geo : packer.Geometries())
+		mGeometries[geo->Name] = std::move(geo);
+}
 
-		dersbor->ObjCBIndex = objCBIndex++;
-		dersbor->Geo = mGeometries["shapeGeo"].get();
-		dersbor->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-		dersbor->IndexCount = dersbor->Geo->DrawArgs["wedge"].IndexCount;
-		dersbor->StartIndexLocation = dersbor->Geo->DrawArgs["wedge"].StartIndexLocation;
-		dersbor->BaseVertexLocation = dersbor->Geo->DrawArgs["wedge"].BaseVertexLocation;
+void ShapesApp::CheckGpuGeometry()
+{
+	// The demo's grid, sphere and cylinder, with every attribute.
+	struct Check
+	{
+		const char* Name;
+		GeometryGenerator::MeshData Mesh;
+		std::function<void(ID3D12GraphicsCommandList*, const GpuGeometryGenerator::Target&)> Generate;
+		ComPtr<ID3D12Resource> Buffer;
+		ComPtr<ID3D12Resource> Readback;
+		UINT64 IndexOffset = 0;
+	};
 
-		mAllRitems.push_back(std::move(borders));
+	GeometryGenerator geoGen;
+	GpuGeometryGenerator gpuGeoGen(md3dDevice.Get(), *mPipelineCache);
+	std::vector<Check> checks;
+	checks.push_back({ "grid", geoGen.CreateGrid(20.0f, 30.0f, 60, 40),
+		[&](ID3D12GraphicsCommandList* cmdList, const GpuGeometryGenerator::Target& target)
+		{ gpuGeoGen.Grid(cmdList, target, 20.0f, 30.0f, 60, 40); } });
+	checks.push_back({ "sphere", geoGen.CreateSphere(1.0f, 20, 20),
+		[&](ID3D12GraphicsCommandList* cmdList, const GpuGeometryGenerator::Target& target)
+		{ gpuGeoGen.Sphere(cmdList, target, 1.0f, 20, 20); } });
+	checks.push_back({ "cylinder", geoGen.CreateCylinder(1.5f, 1.5f, 6.0f, 20, 20),
+		[&](ID3D12GraphicsCommandList* cmdList, const GpuGeometryGenerator::Target& target)
+		{ gpuGeoGen.Cylinder(cmdList, target, 1.5f, 1.5f, 6.0f, 20, 20); } });
+
+	ThrowIfFailed(mDirectCmdListAlloc->Reset());
+	ThrowIfFailed(mCommandList->Reset(mDirectCmdListAlloc.Get(), nullptr));
 
-		mAllRitems.push_back(std::move(dersbor));
+	// Vertices and indices share one buffer per shape.
+	for (auto& check : checks)
+	{
+		check.IndexOffset = check.Mesh.Vertices.size() * sizeof(GeometryGenerator::Vertex);
+		UINT64 byteSize = check.IndexOffset + check.Mesh.Indices32.size() * sizeof(GeometryGenerator::uint32);
+
+		ThrowIfFailed(md3dDevice->CreateCommittedResource(
+			&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+			D3D12_HEAP_FLAG_NONE,
+			&CD3DX12_RESOURCE_DESC::Buffer(byteSize, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS),
+			D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
+			nullptr,
+			IID_PPV_ARGS(check.Buffer.GetAddressOf())));
+		ThrowIfFailed(md3dDevice->CreateCommittedResource(
+			&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_READBACK),
+			D3D12_HEAP_FLAG_NONE,
+			&CD3DX12_RESOURCE_DESC::Buffer(byteSize),
+			D3D12_RESOURCE_STATE_COPY_DEST,
+			nullptr,
+			IID_PPV_ARGS(check.Readback.GetAddressOf())));
+
+		GpuGeometryGenerator::Target target;
+		target.Vertices = check.Buffer->GetGPUVirtualAddress();
+		target.Indices = target.Vertices + check.IndexOffset;
+		check.Generate(mCommandList.Get(), target);
+
+		mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(check.Buffer.Get(),
+			D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_SOURCE));
+		mCommandList->CopyResource(check.Readback.Get(), check.Buffer.Get());
 	}
 
+	ThrowIfFailed(mCommandList->Close());
+	ID3D12CommandList* cmdsLists[] = { mCommandList.Get() };
+	mCommandQueue->ExecuteCommandLists(_countof(cmdsLists), cmdsLists);
+	FlushCommandQueue();
 
-	//right
-	auto boxRitem2 = std::make_unique<RenderItem>();
+	for (auto& check : checks)
+	{
+		BYTE* data = nullptr;
+		ThrowIfFailed(check.Readback->Map(0, nullptr, reinterpret_cast<void**>(&data)));
 
-	XMStoreFloat4x4(&boxRitem2->World, XMMatrixTranslation(4.0f, 0.5f, 0.0f)* XMMatrixScaling(2.0f, 4.0f, 28.0f));
+		// Largest distance in units in the last place over every vertex component.  The bit
+		// patterns are mapped so integer order matches float order across the sign (-0 == +0).
+		auto orderedBits = [](const float& f)
+		{
+			INT32 bits;
+			std::memcpy(&bits, &f, sizeof(float));
+			return bits < 0 ? (INT64)INT32_MIN - bits : (INT64)bits;
+		};
+		const float* gpuFloats = reinterpret_cast<const float*>(data);
+		const float* cpuFloats = &check.Mesh.Vertices[0].Position.x;
+		size_t floatCount = check.IndexOffset / sizeof(float);
+		INT64 maxUlps = 0;
+		for (size_t i = 0; i < floatCount; ++i)
+		{
+			maxUlps = std::max(maxUlps, std::abs(orderedBits(gpuFloats[i]) - orderedBits(cpuFloats[i])));
+		}
 
-	boxRitem2->ObjCBIndex = objCBIndex++;
-	boxRitem2->Geo = mGeometries["shapeGeo"].get();
-	boxRitem2->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	boxRitem2->IndexCount = boxRitem2->Geo->DrawArgs["box"].IndexCount;
-	boxRitem2->StartIndexLocation = boxRitem2->Geo->DrawArgs["box"].StartIndexLocation;
-	boxRitem2->BaseVertexLocation = boxRitem2->Geo->DrawArgs["box"].BaseVertexLocation;
-	mAllRitems.push_back(std::move(boxRitem2));
+		bool sameIndices = std::memcmp(data + check.IndexOffset, check.Mesh.Indices32.data(),
+			check.Mesh.Indices32.size() * sizeof(GeometryGenerator::uint32)) == 0;
 
-	for (int i = 0; i < 12; i++)
-	{
-		auto borders = std::make_unique<RenderItem>();
-		auto dersbor = std::make_unique<RenderItem>();
-		XMMATRIX bordersleft = XMMatrixTranslation(8.5f, 4.5f, -11.0f + i * 2);
-		XMMATRIX dersborleft = XMMatrixTranslation(-8.5f, 4.5f, -12.0f + i * 2) * XMMatrixRotationY(3.1416);
+		D3D12_RANGE writeRange = { 0, 0 };
+		check.Readback->Unmap(0, &writeRange);
 
-		XMStoreFloat4x4(&borders->World, bordersleft);
-		XMStoreFloat4x4(&dersbor->World, dersborleft);
+		std::string text = std::string("GpuGeometry: ") + check.Name + " indices " + (sameIndices ? "identical" : "DIFFERENT") +
+			", vertices within " + std::to_string(maxUlps) + " ulps\n";
+		::OutputDebugStringA(text.c_str());
+	}
+}
 
+void ShapesApp::BuildGeometryHeap()
+{
+	// The planet is drawn through one submesh, so a split planet cannot be swapped.
+	mPlanetSubmesh = mScene.FindSubmesh("planet");
+	if (mPlanetSubmesh != SceneStore::InvalidId && mScene.FindSubmesh("planet#1") != SceneStore::InvalidId)
+	{
+		::OutputDebugStringA("GeometryHeap: the planet is split for 16-bit indices and is not streamed\n");
+		mPlanetSubmesh = SceneStore::InvalidId;
+	}
+	if (mPlanetSubmesh == SceneStore::InvalidId)
+		return;
 
-		borders->ObjCBIndex = objCBIndex++;
-		borders->Geo = mGeometries["shapeGeo"].get();
-		borders->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-		borders->IndexCount = borders->Geo->DrawArgs["wedge"].IndexCount;
-		borders->StartIndexLocation = borders->Geo->DrawArgs["wedge"].StartIndexLocation;
-		borders->BaseVertexLocation = borders->Geo->DrawArgs["wedge"].BaseVertexLocation;
+	auto vertexFormat = mCompactVertices ? GeometryPacker::VertexFormat::Compact : GeometryPacker::VertexFormat::Full;
+	UINT vertexByteStride = GeometryPacker::VertexByteStride(vertexFormat);
+	GeometryGenerator::MeshSize planetSize = GeometryGenerator::GeosphereSize(gMaxStreamedPlanetSubdivisions);
 
+	// The ring holds two of the largest planets, one uploading while the next is written.
+	UINT64 uploadByteSize = 2 * ((UINT64)planetSize.VertexCount * vertexByteStride + (UINT64)planetSize.IndexCount * sizeof(std::uint32_t));
 
-		dersbor->ObjCBIndex = objCBIndex++;
-		dersbor->Geo = mGeometries["shapeGeo"].get();
-		dersbor->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-		dersbor->IndexCount = dersbor->Geo->DrawArgs["wedge"].IndexCount;
-		dersbor->StartIndexLocation = dersbor->Geo->DrawArgs["wedge"].StartIndexLocation;
-		dersbor->BaseVertexLocation = dersbor->Geo->DrawArgs["wedge"].BaseVertexLocation;
+	mGeometryHeap = std::make_unique<GeometryHeap>(md3dDevice.Get(), "streamGeo", vertexByteStride,
+		gGeometryHeapPlanetCapacity * planetSize.VertexCount, gGeometryHeapPlanetCapacity * planetSize.IndexCount,
+		uploadByteSize);
+	mStreamedPlanetSubdivisions = mPlanetSubdivisions;
+}
 
-		mAllRitems.push_back(std::move(borders));
+void ShapesApp::StreamPlanet()
+{
+	if (mGeometryHeap == nullptr)
+		return;
 
-		mAllRitems.push_back(std::move(dersbor));
+	// One version in flight at a time.
+	if (!mPendingPlanet.empty())
+	{
+		::OutputDebugStringA("GeometryHeap: the previous planet is still uploading\n");
+		return;
 	}
 
-	//backwall
-	auto backWall = std::make_unique<RenderItem>();
-
-	XMStoreFloat4x4(&backWall->World, XMMatrixTranslation(0.0f, 0.5f, 6.5f)* XMMatrixScaling(14.0f, 4.0f, 2.0f));
-
-	backWall->ObjCBIndex = objCBIndex++;
-	backWall->Geo = mGeometries["shapeGeo"].get();
-	backWall->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	backWall->IndexCount = backWall->Geo->DrawArgs["box"].IndexCount;
-	backWall->StartIndexLocation = backWall->Geo->DrawArgs["box"].StartIndexLocation;
-	backWall->BaseVertexLocation = backWall->Geo->DrawArgs["box"].BaseVertexLocation;
+	UINT subdivisions = mStreamedPlanetSubdivisions % gMaxStreamedPlanetSubdivisions + 1;
+	std::string name = "planet@" + std::to_string(++mPlanetStreamCount);
+	if (mGpuGeometryGenerator != nullptr)
+	{
+		if (!AddGpuPlanet(name, subdivisions))
+			::OutputDebugStringA("GeometryHeap: no room for the planet yet, try again\n");
+		return;
+	}
 
-	mAllRitems.push_back(std::move(backWall));
+	GeometryGenerator::MeshData planet = ShapeGeometryBuilder::CreatePlanet(subdivisions, mOptimizeMeshes);
 
-	for (int i = 0; i < 7; i++)
+	BYTE* vertices = nullptr;
+	std::uint32_t* indices = nullptr;
+	if (!mGeometryHeap->AddSubmesh(name, planet.VertexCount(), (UINT)planet.Indices32.size(), planet.Bounds,
+		&vertices, &indices))
 	{
-		auto borders = std::make_unique<RenderItem>();
-		auto dersbor = std::make_unique<RenderItem>();
-		XMMATRIX bordersleft = XMMatrixTranslation(13.5f, 4.5f, -5.0f + i * 2)*XMMatrixRotationY(-3.1416 / 2);
-		XMMATRIX dersborleft = XMMatrixTranslation(-13.5f, 4.5f, 6.0f - i * 2) * XMMatrixRotationY(3.1416/2);
-
-		XMStoreFloat4x4(&borders->World, bordersleft);
-		XMStoreFloat4x4(&dersbor->World, dersborleft);
+		::OutputDebugStringA("GeometryHeap: no room for the planet yet, try again\n");
+		return;
+	}
 
+	// The heap is drawn with the PSOs of the packed geometry, so it uses the same format.
+	auto vertexFormat = mCompactVertices ? GeometryPacker::VertexFormat::Compact : GeometryPacker::VertexFormat::Full;
+	GeometryPacker::GetPositionDecode(vertexFormat, planet.Bounds, mPendingPlanetPosScale, mPendingPlanetPosBias);
+	GeometryPacker::WriteVertices(vertexFormat, planet, ShapeGeometryBuilder::PlanetColor(),
+		mPendingPlanetPosScale, mPendingPlanetPosBias, vertices);
+	std::copy(planet.Indices32.begin(), planet.Indices32.end(), indices);
+	mGeometryHeap->Submit();
+
+	mPendingPlanet = name;
+	mPendingPlanetSubdivisions = subdivisions;
+	mPendingPlanetBounds = planet.SphereBounds;
+}
 
-		borders->ObjCBIndex = objCBIndex++;
-		borders->Geo = mGeometries["shapeGeo"].get();
-		borders->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-		borders->IndexCount = borders->Geo->DrawArgs["wedge"].IndexCount;
-		borders->StartIndexLocation = borders->Geo->DrawArgs["wedge"].StartIndexLocation;
-		borders->BaseVertexLocation = borders->Geo->DrawArgs["wedge"].BaseVertexLocation;
+bool ShapesApp::AddGpuPlanet(const std::string& name, UINT subdivisions)
+{
+	// The compute generators have no geosphere.  This UV sphere has fewer vertices and
+	// indices than the geosphere of the same subdivisions, which the heap is sized for.
+	float radius = ShapeGeometryBuilder::PlanetRadius();
+	UINT stackCount = 2u << subdivisions;
+	UINT sliceCount = 4u << subdivisions;
+	GeometryGenerator::MeshSize size = GeometryGenerator::SphereSize(sliceCount, stackCount);
+	BoundingBox bounds(XMFLOAT3(0.0f, 0.0f, 0.0f), XMFLOAT3(radius, radius, radius));
+
+	GpuGeometryGenerator::Target target;
+	if (!mGeometryHeap->AddGpuSubmesh(name, size.VertexCount, size.IndexCount, bounds, &target.Vertices, &target.Indices))
+		return false;
 
+	// The heap is drawn with the PSOs of the packed geometry, so it uses the same format.
+	auto vertexFormat = mCompactVertices ? GeometryPacker::VertexFormat::Compact : GeometryPacker::VertexFormat::Full;
+	GeometryPacker::GetPositionDecode(vertexFormat, bounds, mPendingPlanetPosScale, mPendingPlanetPosBias);
+	target.VertexLayout = GpuGeometryGenerator::PackerLayout(vertexFormat);
+	target.Color = ShapeGeometryBuilder::PlanetColor();
+	target.PosScale = mPendingPlanetPosScale;
+	target.PosBias = mPendingPlanetPosBias;
+
+	mPendingGpuPlanetWrite = true;
+	mPendingGpuPlanetTarget = target;
+	mPendingGpuPlanetSlices = sliceCount;
+	mPendingGpuPlanetStacks = stackCount;
+
+	mPendingPlanet = name;
+	mPendingPlanetSubdivisions = subdivisions;
+	mPendingPlanetBounds = BoundingSphere(XMFLOAT3(0.0f, 0.0f, 0.0f), radius);
+	return true;
+}
 
-		dersbor->ObjCBIndex = objCBIndex++;
-		dersbor->Geo = mGeometries["shapeGeo"].get();
-		dersbor->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-		dersbor->IndexCount = dersbor->Geo->DrawArgs["wedge"].IndexCount;
-		dersbor->StartIndexLocation = dersbor->Geo->DrawArgs["wedge"].StartIndexLocation;
-		dersbor->BaseVertexLocation = dersbor->Geo->DrawArgs["wedge"].BaseVertexLocation;
+void ShapesApp::WriteGpuPlanet(ID3D12CommandAllocator* cmdListAlloc)
+{
+	if (!mPendingGpuPlanetWrite)
+		return;
+
+	// A list of its own: the heap buffers are promoted to UNORDERED_ACCESS here and decay
+	// back to COMMON when it completes, before the frame's lists draw from them.
+	ThrowIfFailed(mCommandList->Reset(cmdListAlloc, nullptr));
+	mGpuGeometryGenerator->Sphere(mCommandList.Get(), mPendingGpuPlanetTarget, ShapeGeometryBuilder::PlanetRadius(),
+		mPendingGpuPlanetSlices, mPendingGpuPlanetStacks, GeometryGenerator::AttributePosition);
+	ThrowIfFailed(mCommandList->Close());
 
-		mAllRitems.push_back(std::move(borders));
+	ID3D12CommandList* cmdsLists[] = { mCommandList.Get() };
+	mCommandQueue->ExecuteCommandLists(_countof(cmdsLists), cmdsLists);
+	mPendingGpuPlanetWrite = false;
+}
 
-		mAllRitems.push_back(std::move(dersbor));
+void ShapesApp::UpdateStreamedGeometry()
+{
+	if (mGeometryHeap == nullptr)
+		return;
+
+	mGeometryHeap->Collect(mFence->GetCompletedValue());
+
+	if (mPendingPlanet.empty() || !mGeometryHeap->IsUploaded(mPendingPlanet))
+		return;
+
+	// Draw args are read when the frames are recorded, so switching the submesh moves
+	// every planet object over from this frame on.
+	auto& args = mGeometryHeap->Geometry()->DrawArgs[mPendingPlanet];
+	auto& submesh = mScene.Submeshes[mPlanetSubmesh];
+	submesh.Geo = mGeometryHeap->Geometry();
+	submesh.IndexCount = args.IndexCount;
+	submesh.StartIndexLocation = args.StartIndexLocation;
+	submesh.BaseVertexLocation = args.BaseVertexLocation;
+	submesh.Bounds = mPendingPlanetBounds;
+	submesh.PosScale = mPendingPlanetPosScale;
+	submesh.PosBias = mPendingPlanetPosBias;
+
+	// The frames submitted so far may still draw the previous version.
+	if (!mStreamedPlanet.empty())
+		mGeometryHeap->RemoveSubmesh(mStreamedPlanet, mCurrentFence);
+	mStreamedPlanet = mPendingPlanet;
+	mStreamedPlanetSubdivisions = mPendingPlanetSubdivisions;
+	mPendingPlanet.clear();
+
+	// The position decode is in the object constants.
+	for (UINT i = 0; i < (UINT)mScene.Size(); ++i)
+	{
+		if (mScene.SubmeshId[i] == mPlanetSubmesh)
+			mScene.MarkDirty(i);
 	}
+	BuildDrawList(mOpaqueRitems, mOpaqueDrawList);
 
-	auto FrontWall = std::make_unique<RenderItem>();
-
-	XMStoreFloat4x4(&FrontWall->World, XMMatrixTranslation(0.95f, 0.5f, -6.5f)* XMMatrixScaling(5.0f, 4.0f, 2.0f));
+	std::string text = "GeometryHeap: planet at " + std::to_string(mStreamedPlanetSubdivisions) + " subdivisions, " +
+		std::to_string(mGeometryHeap->FreeVertexCount()) + " of " + std::to_string(mGeometryHeap->VertexCapacity()) +
+		" vertices and " + std::to_string(mGeometryHeap->FreeIndexCount()) + " of " +
+		std::to_string(mGeometryHeap->IndexCapacity()) + " indices free\n";
+	::OutputDebugStringA(text.c_str());
+}
 
-	FrontWall->ObjCBIndex = objCBIndex++;
-	FrontWall->Geo = mGeometries["shapeGeo"].get();
-	FrontWall->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	FrontWall->IndexCount = FrontWall->Geo->DrawArgs["box"].IndexCount;
-	FrontWall->StartIndexLocation = FrontWall->Geo->DrawArgs["box"].StartIndexLocation;
-	FrontWall->BaseVertexLocation = FrontWall->Geo->DrawArgs["box"].BaseVertexLocation;
-	mAllRitems.push_back(std::move(FrontWall));
+void ShapesApp::BuildPSOs()
+{
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC opaquePsoDesc;
 
-	auto FrontWall2 = std::make_unique<RenderItem>();
+	// PSO for opaque objects.
 
-	XMStoreFloat4x4(&FrontWall2->World, XMMatrixTranslation(-0.95f, 0.5f, -6.5f)* XMMatrixScaling(5.0f, 4.0f, 2.0f));
+	ZeroMemory(&opaquePsoDesc, sizeof(D3D12_GRAPHICS_PIPELINE_STATE_DESC));
+	opaquePsoDesc.InputLayout = { mInputLayout.data(), (UINT)mInputLayout.size() };
+	opaquePsoDesc.pRootSignature = mRootSignature.Get();
 
-	FrontWall2->ObjCBIndex = objCBIndex++;
-	FrontWall2->Geo = mGeometries["shapeGeo"].get();
-	FrontWall2->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	FrontWall2->IndexCount = FrontWall2->Geo->DrawArgs["box"].IndexCount;
-	FrontWall2->StartIndexLocation = FrontWall2->Geo->DrawArgs["box"].StartIndexLocation;
-	FrontWall2->BaseVertexLocation = FrontWall2->Geo->DrawArgs["box"].BaseVertexLocation;
-	mAllRitems.push_back(std::move(FrontWall2));
+	// The bindless layout reads object constants from a structured buffer.
+	ID3DBlob* opaqueVS = mShaders[mBindlessObjectConstants ? "bindlessVS" : "standardVS"].Get();
+	opaquePsoDesc.VS =
+	{
+	 reinterpret_cast<BYTE*>(opaqueVS->GetBufferPointer()),
+	 opaqueVS->GetBufferSize()
+	};
 
-	for (int i = 0; i < 3; i++)
+	// The geometry shader adds the barycentrics the pixel shader draws the edge overlay with.
+	opaquePsoDesc.GS =
 	{
-		auto borders = std::make_unique<RenderItem>();
-		auto dersbor = std::make_unique<RenderItem>();
-		XMMATRIX bordersleft = XMMatrixTranslation(-13.5f, 4.5f, -8.0f + i * 2) * XMMatrixRotationY(-3.1416 / 2);
-		XMMATRIX dersborleft = XMMatrixTranslation(13.5f, 4.5f, 7.0f - i * 2) * XMMatrixRotationY(3.1416 / 2);
+	 reinterpret_cast<BYTE*>(mShaders["edgeGS"]->GetBufferPointer()),
+	 mShaders["edgeGS"]->GetBufferSize()
+	};
 
-		XMStoreFloat4x4(&borders->World, bordersleft);
-		XMStoreFloat4x4(&dersbor->World, dersborleft);
+	opaquePsoDesc.PS =
+	{
+	 reinterpret_cast<BYTE*>(mShaders["opaquePS"]->GetBufferPointer()),
+	 mShaders["opaquePS"]->GetBufferSize()
+	};
 
+	opaquePsoDesc.RasterizerState = CD3DX12_RASTERIZER_DESC(D3D12_DEFAULT);
+	opaquePsoDesc.RasterizerState.FillMode = D3D12_FILL_MODE_SOLID;
+	opaquePsoDesc.BlendState = CD3DX12_BLEND_DESC(D3D12_DEFAULT);
+	opaquePsoDesc.DepthStencilState = CD3DX12_DEPTH_STENCIL_DESC(D3D12_DEFAULT);
+	opaquePsoDesc.SampleMask = UINT_MAX;
+	opaquePsoDesc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
+	opaquePsoDesc.NumRenderTargets = 1;
+	opaquePsoDesc.RTVFormats[0] = mBackBufferFormat;
+	opaquePsoDesc.SampleDesc.Count = m4xMsaaState ? 4 : 1;
+	opaquePsoDesc.SampleDesc.Quality = m4xMsaaState ? (m4xMsaaQuality - 1) : 0;
+	opaquePsoDesc.DSVFormat = mDepthStencilFormat;
 
-		borders->ObjCBIndex = objCBIndex++;
-		borders->Geo = mGeometries["shapeGeo"].get();
-		borders->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-		borders->IndexCount = borders->Geo->DrawArgs["wedge"].IndexCount;
-		borders->StartIndexLocation = borders->Geo->DrawArgs["wedge"].StartIndexLocation;
-		borders->BaseVertexLocation = borders->Geo->DrawArgs["wedge"].BaseVertexLocation;
+	mPipelineCache->AddGraphicsPipeline("opaque", opaquePsoDesc);
 
+	// PSO for the instanced drawing path.
 
-		dersbor->ObjCBIndex = objCBIndex++;
-		dersbor->Geo = mGeometries["shapeGeo"].get();
-		dersbor->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-		dersbor->IndexCount = dersbor->Geo->DrawArgs["wedge"].IndexCount;
-		dersbor->StartIndexLocation = dersbor->Geo->DrawArgs["wedge"].StartIndexLocation;
-		dersbor->BaseVertexLocation = dersbor->Geo->DrawArgs["wedge"].BaseVertexLocation;
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC instancedPsoDesc = opaquePsoDesc;
+	instancedPsoDesc.VS =
+	{
+	 reinterpret_cast<BYTE*>(mShaders["instancedVS"]->GetBufferPointer()),
+	 mShaders["instancedVS"]->GetBufferSize()
+	};
+	mPipelineCache->AddGraphicsPipeline("opaque_instanced", instancedPsoDesc);
+
+	// PSOs shading after the depth pre-pass: the depth is already final.  EQUAL needs
+	// bit-identical depths in both passes, so the vertex shaders compute the clip space
+	// position as precise, which the compiler must not reassociate or fuse.
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC equalPsoDesc = opaquePsoDesc;
+	equalPsoDesc.DepthStencilState.DepthFunc = D3D12_COMPARISON_FUNC_EQUAL;
+	equalPsoDesc.DepthStencilState.DepthWriteMask = D3D12_DEPTH_WRITE_MASK_ZERO;
+	mPipelineCache->AddGraphicsPipeline("opaque_equal", equalPsoDesc);
+
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC instancedEqualPsoDesc = instancedPsoDesc;
+	instancedEqualPsoDesc.DepthStencilState = equalPsoDesc.DepthStencilState;
+	mPipelineCache->AddGraphicsPipeline("opaque_instanced_equal", instancedEqualPsoDesc);
+
+	// Depth pre-pass PSOs: the same vertex shaders, with neither the edge geometry shader
+	// nor a pixel shader or render target.  The shading passes see the same depths, since
+	// their geometry shader copies SV_Position through unmodified.
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC depthPsoDesc = opaquePsoDesc;
+	depthPsoDesc.GS = {};
+	depthPsoDesc.PS = {};
+	depthPsoDesc.NumRenderTargets = 0;
+	depthPsoDesc.RTVFormats[0] = DXGI_FORMAT_UNKNOWN;
+	mPipelineCache->AddGraphicsPipeline("depth_prepass", depthPsoDesc);
+
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC instancedDepthPsoDesc = depthPsoDesc;
+	instancedDepthPsoDesc.VS = instancedPsoDesc.VS;
+	mPipelineCache->AddGraphicsPipeline("depth_prepass_instanced", instancedDepthPsoDesc);
+
+	// PSO for the frustum culling compute pass.
+	D3D12_COMPUTE_PIPELINE_STATE_DESC cullPsoDesc = {};
+	cullPsoDesc.pRootSignature = mCullRootSignature.Get();
+	cullPsoDesc.CS =
+	{
+	 reinterpret_cast<BYTE*>(mShaders["cullCS"]->GetBufferPointer()),
+	 mShaders["cullCS"]->GetBufferSize()
+	};
+	mPipelineCache->AddComputePipeline("cull", cullPsoDesc);
 
-		mAllRitems.push_back(std::move(borders));
+	// Collected by Finish at the end of Initialize.
+	mPipelineCache->Start(DefaultJobCount());
+}
 
-		mAllRitems.push_back(std::move(dersbor));
+void ShapesApp::BuildFrameResources()
+{
+	for (UINT i = 0; i < mNumFrameResources; ++i)
+	{
+		mFrameResources.push_back(std::make_unique<FrameResource>(md3dDevice.Get(),
+			1, (UINT)mScene.Size(), mNumRecordThreads, !mBindlessObjectConstants));
 	}
+}
 
-	for (int i = 0; i < 3; i++)
+bool ShapesApp::BuildRenderItems()
+{
+	if (mStressObjects > 0)
 	{
-		auto borders = std::make_unique<RenderItem>();
-		auto dersbor = std::make_unique<RenderItem>();
-		XMMATRIX bordersleft = XMMatrixTranslation(-13.5f, 4.5f, 4.0f + i * 2) * XMMatrixRotationY(-3.1416 / 2);
-		XMMATRIX dersborleft = XMMatrixTranslation(13.5f, 4.5f, -3.0f - i * 2) * XMMatrixRotationY(3.1416 / 2);
-
-		XMStoreFloat4x4(&borders->World, bordersleft);
-		XMStoreFloat4x4(&dersbor->World, dersborleft);
+		StressSceneOptions stress;
+		stress.ObjectCount = mStressObjects;
+		stress.AnimatedFraction = mStressAnimatedFraction;
+		mStressAnimatedObjects = ShapeGeometryBuilder::PlaceStressScene(stress, mScene);
+		mAnimateBattlements = mStressAnimatedObjects > 0;
 
+		for (UINT i = 0; i < (UINT)mScene.Size(); ++i)
+			mOpaqueRitems.push_back(i);
 
-		borders->ObjCBIndex = objCBIndex++;
-		borders->Geo = mGeometries["shapeGeo"].get();
-		borders->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-		borders->IndexCount = borders->Geo->DrawArgs["wedge"].IndexCount;
-		borders->StartIndexLocation = borders->Geo->DrawArgs["wedge"].StartIndexLocation;
-		borders->BaseVertexLocation = borders->Geo->DrawArgs["wedge"].BaseVertexLocation;
-
+		return true;
+	}
 
-		dersbor->ObjCBIndex = objCBIndex++;
-		dersbor->Geo = mGeometries["shapeGeo"].get();
-		dersbor->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-		dersbor->IndexCount = dersbor->Geo->DrawArgs["wedge"].IndexCount;
-		dersbor->StartIndexLocation = dersbor->Geo->DrawArgs["wedge"].StartIndexLocation;
-		dersbor->BaseVertexLocation = dersbor->Geo->DrawArgs["wedge"].BaseVertexLocation;
+	SceneDesc scene;
+	std::string error;
+	if (!SceneFile::Load(mScenePath, scene, error))
+	{
+		std::string message = "Cannot load " + std::string(mScenePath.begin(), mScenePath.end()) + ": " + error;
+		::OutputDebugStringA((message + "\n").c_str());
+		MessageBoxA(nullptr, message.c_str(), "Scene", MB_OK);
+		return false;
+	}
 
-		mAllRitems.push_back(std::move(borders));
+	if (!mBakeScenePath.empty() && !SceneFile::SaveBinary(mBakeScenePath, scene))
+		::OutputDebugStringA("Scene: could not write the binary scene\n");
 
-		mAllRitems.push_back(std::move(dersbor));
+	if (!ShapeGeometryBuilder::PlaceScene(scene, mScene, error))
+	{
+		::OutputDebugStringA((error + "\n").c_str());
+		MessageBoxA(nullptr, error.c_str(), "Scene", MB_OK);
+		return false;
 	}
 
-	//stairs
-
-	auto Stairs = std::make_unique<RenderItem>();
+	// All the render items are opaque.
+	for (UINT i = 0; i < (UINT)mScene.Size(); ++i)
+		mOpaqueRitems.push_back(i);
 
-	XMStoreFloat4x4(&Stairs->World, XMMatrixTranslation(0.0f, 0.5f, -14.5f) * XMMatrixScaling(4.5f, 0.5f, 1.0f) );
+	return true;
+}
 
-	Stairs->ObjCBIndex = objCBIndex++;
-	Stairs->Geo = mGeometries["shapeGeo"].get();
-	Stairs->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	Stairs->IndexCount = Stairs->Geo->DrawArgs["wedge"].IndexCount;
-	Stairs->StartIndexLocation = Stairs->Geo->DrawArgs["wedge"].StartIndexLocation;
-	Stairs->BaseVertexLocation = Stairs->Geo->DrawArgs["wedge"].BaseVertexLocation;
-	mAllRitems.push_back(std::move(Stairs));
+void ShapesApp::BuildInstanceBatches()
+{
+	// Items that draw the same DrawArgs submesh are drawn together.  The batches are
+	// built once with the level 0 submeshes, so instanced draws do not switch LOD.
+	std::vector<size_t> batchLookup(mScene.Submeshes.size(), SIZE_MAX);
 
-	auto Stairs2 = std::make_unique<RenderItem>();
+	mOpaqueInstanceBatches.clear();
+	for (UINT object : mOpaqueRitems)
+	{
+		UINT submeshId = mScene.SubmeshId[object];
+		if (batchLookup[submeshId] == SIZE_MAX)
+		{
+			InstanceBatch batch;
+			batch.SubmeshId = submeshId;
 
-	XMStoreFloat4x4(&Stairs2->World, XMMatrixTranslation(0.0f, 0.5f, 11.5f)* XMMatrixScaling(4.5f, 0.5f, 1.0f)* XMMatrixRotationY(3.1416));
+			batchLookup[submeshId] = mOpaqueInstanceBatches.size();
+			mOpaqueInstanceBatches.push_back(batch);
+		}
 
-	Stairs2->ObjCBIndex = objCBIndex++;
-	Stairs2->Geo = mGeometries["shapeGeo"].get();
-	Stairs2->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	Stairs2->IndexCount = Stairs2->Geo->DrawArgs["wedge"].IndexCount;
-	Stairs2->StartIndexLocation = Stairs2->Geo->DrawArgs["wedge"].StartIndexLocation;
-	Stairs2->BaseVertexLocation = Stairs2->Geo->DrawArgs["wedge"].BaseVertexLocation;
-	mAllRitems.push_back(std::move(Stairs2));
+		mOpaqueInstanceBatches[batchLookup[submeshId]].Objects.push_back(object);
+	}
 
-	auto middlestairs = std::make_unique<RenderItem>();
+	// Lay out the instances of each batch contiguously in the instance buffer.
+	UINT instanceIndex = 0;
+	for (auto& batch : mOpaqueInstanceBatches)
+	{
+		batch.StartInstance = instanceIndex;
+		for (UINT object : batch.Objects)
+			mScene.InstanceIndex[object] = instanceIndex++;
+	}
+}
 
-	XMStoreFloat4x4(&middlestairs->World, XMMatrixTranslation(0.0f, 0.5f, -6.5f)* XMMatrixScaling(4.5f, 0.5f, 2.0f));
+void ShapesApp::BuildAnimatedGroups()
+{
+	// A group needs consecutive constant buffer and instance slots so the kernel can
+	// write it in place, which runs of objects of one submesh added in a row have.
+	auto isContinuation = [&](UINT object)
+	{
+		return mScene.SubmeshId[object] == mScene.SubmeshId[object - 1] &&
+			mScene.ObjCBIndex[object] == mScene.ObjCBIndex[object - 1] + 1 &&
+			mScene.InstanceIndex[object] == mScene.InstanceIndex[object - 1] + 1;
+	};
 
-	middlestairs->ObjCBIndex = objCBIndex++;
-	middlestairs->Geo = mGeometries["shapeGeo"].get();
-	middlestairs->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	middlestairs->IndexCount = middlestairs->Geo->DrawArgs["box"].IndexCount;
-	middlestairs->StartIndexLocation = middlestairs->Geo->DrawArgs["box"].StartIndexLocation;
-	middlestairs->BaseVertexLocation = middlestairs->Geo->DrawArgs["box"].BaseVertexLocation;
-	mAllRitems.push_back(std::move(middlestairs));
+	// The stress scene animates its leading objects, whatever their shape.
+	if (mStressObjects > 0)
+	{
+		UINT first = 0;
+		while (first < mStressAnimatedObjects)
+		{
+			UINT last = first + 1;
+			while (last < mStressAnimatedObjects && isContinuation(last))
+				++last;
 
-	//Garden
+			AddAnimatedGroup(first, last);
+			first = last;
+		}
+		return;
+	}
 
+	// The battlements are runs of consecutive wedge objects added by the wall loops.
+	const UINT minGroupSize = 6;
+	UINT wedgeSubmesh = mScene.FindSubmesh("wedge");
 
-	for (int i = 0; i < 3; i++)
+	UINT objectCount = (UINT)mScene.Size();
+	UINT first = 0;
+	while (first < objectCount)
 	{
-		auto bushes = std::make_unique<RenderItem>();
-		auto bushes2 = std::make_unique<RenderItem>();
-		XMStoreFloat4x4(&bushes->World, XMMatrixTranslation(-2.0f, 0.0f, -5.0f + i * 2)* XMMatrixScaling(2.0f, 2.0f+i, 2.0f));
-		XMStoreFloat4x4(&bushes2->World, XMMatrixTranslation(2.0f, 0.0f, -5.0f + i * 2)* XMMatrixScaling(2.0f, 2.0f+i, 2.0f));
+		if (mScene.SubmeshId[first] != wedgeSubmesh)
+		{
+			++first;
+			continue;
+		}
 
-		bushes->ObjCBIndex = objCBIndex++;
-		bushes->Geo = mGeometries["shapeGeo"].get();
-		bushes->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-		bushes->IndexCount = bushes->Geo->DrawArgs["sphere"].IndexCount;
-		bushes->StartIndexLocation = bushes->Geo->DrawArgs["sphere"].StartIndexLocation;
-		bushes->BaseVertexLocation = bushes->Geo->DrawArgs["sphere"].BaseVertexLocation;
+		UINT last = first + 1;
+		while (last < objectCount && isContinuation(last))
+			++last;
 
-		bushes2->ObjCBIndex = objCBIndex++;
-		bushes2->Geo = mGeometries["shapeGeo"].get();
-		bushes2->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-		bushes2->IndexCount = bushes2->Geo->DrawArgs["sphere"].IndexCount;
-		bushes2->StartIndexLocation = bushes2->Geo->DrawArgs["sphere"].StartIndexLocation;
-		bushes2->BaseVertexLocation = bushes2->Geo->DrawArgs["sphere"].BaseVertexLocation;
+		if (last - first >= minGroupSize)
+			AddAnimatedGroup(first, last);
 
-		mAllRitems.push_back(std::move(bushes));
-		mAllRitems.push_back(std::move(bushes2));
+		first = last;
 	}
+}
 
-	//house
-
-	auto house = std::make_unique<RenderItem>();
+void ShapesApp::AddAnimatedGroup(UINT first, UINT last)
+{
+	AnimatedGroup group;
+	group.FirstObject = first;
+	group.Count = last - first;
 
-	XMStoreFloat4x4(&house->World, XMMatrixTranslation(0.0f, 0.5f, 0.5f) * XMMatrixScaling(13.0f, 8.0f, 11.0f));
+	for (UINT i = first; i < last; ++i)
+	{
+		XMVECTOR scale, rotation, translation;
+		XMMatrixDecompose(&scale, &rotation, &translation, XMLoadFloat4x4(&mScene.World[i]));
+
+		group.TranslationX.push_back(XMVectorGetX(translation));
+		group.TranslationY.push_back(XMVectorGetY(translation));
+		group.TranslationZ.push_back(XMVectorGetZ(translation));
+		group.RotationX.push_back(XMVectorGetX(rotation));
+		group.RotationY.push_back(XMVectorGetY(rotation));
+		group.RotationZ.push_back(XMVectorGetZ(rotation));
+		group.RotationW.push_back(XMVectorGetW(rotation));
+		group.ScaleX.push_back(XMVectorGetX(scale));
+		group.ScaleY.push_back(XMVectorGetY(scale));
+		group.ScaleZ.push_back(XMVectorGetZ(scale));
+	}
+	group.AnimatedY = group.TranslationY;
 
-	house->ObjCBIndex = objCBIndex++;
-	house->Geo = mGeometries["shapeGeo"].get();
-	house->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	house->IndexCount = house->Geo->DrawArgs["box"].IndexCount;
-	house->StartIndexLocation = house->Geo->DrawArgs["box"].StartIndexLocation;
-	house->BaseVertexLocation = house->Geo->DrawArgs["box"].BaseVertexLocation;
-	mAllRitems.push_back(std::move(house));
+	mAnimatedGroups.push_back(std::move(group));
+}
 
-	auto Door = std::make_unique<RenderItem>();
+void ShapesApp::BuildDrawList(const std::vector<UINT>& ritems, DrawList& drawList)
+{
+	drawList.Geometries.clear();
+	drawList.Entries.clear();
+	drawList.Entries.reserve(ritems.size());
+	for (UINT object : ritems)
+	{
+		DrawList::Entry entry;
+		entry.SortKey = DrawListSortKey(object, drawList);
+		entry.Object = object;
 
-	XMStoreFloat4x4(&Door->World, XMMatrixTranslation(0.0f, 0.5f, -1.0f)* XMMatrixScaling(4.0f, 5.0f, 0.1f));
+		drawList.Entries.push_back(entry);
+	}
 
-	Door->ObjCBIndex = objCBIndex++;
-	Door->Geo = mGeometries["shapeGeo"].get();
-	Door->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	Door->IndexCount = Door->Geo->DrawArgs["wedge"].IndexCount;
-	Door->StartIndexLocation = Door->Geo->DrawArgs["wedge"].StartIndexLocation;
-	Door->BaseVertexLocation = Door->Geo->DrawArgs["wedge"].BaseVertexLocation;
-	mAllRitems.push_back(std::move(Door));
+	std::stable_sort(drawList.Entries.begin(), drawList.Entries.end(),
+		[](const DrawList::Entry& a, const DrawList::Entry& b) { return a.SortKey < b.SortKey; });
 
-	//top house
-	auto tophouse = std::make_unique<RenderItem>();
+	drawList.ObjectEntries.assign(mScene.Size(), SIZE_MAX);
+	for (size_t i = 0; i < drawList.Entries.size(); ++i)
+		drawList.ObjectEntries[drawList.Entries[i].Object] = i;
+}
 
-	XMStoreFloat4x4(&tophouse->World, XMMatrixTranslation(0.0f, 5.5f, 1.0f)* XMMatrixScaling(6.5f, 2.0f, 5.5f));
+void ShapesApp::PatchDrawList(const std::vector<UINT>& ritems, const std::vector<UINT>& changedObjects, DrawList& drawList)
+{
+	// Entries are recorded with the current submesh of their object, so a new level in
+	// the same geometry keeps the order; only a new geometry or topology re-sorts.
+	for (UINT object : changedObjects)
+	{
+		size_t entry = drawList.ObjectEntries[object];
+		if (entry != SIZE_MAX && DrawListSortKey(object, drawList) != drawList.Entries[entry].SortKey)
+		{
+			BuildDrawList(ritems, drawList);
+			return;
+		}
+	}
+}
 
-	tophouse->ObjCBIndex = objCBIndex++;
-	tophouse->Geo = mGeometries["shapeGeo"].get();
-	tophouse->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	tophouse->IndexCount = tophouse->Geo->DrawArgs["pyramid"].IndexCount;
-	tophouse->StartIndexLocation = tophouse->Geo->DrawArgs["pyramid"].StartIndexLocation;
-	tophouse->BaseVertexLocation = tophouse->Geo->DrawArgs["pyramid"].BaseVertexLocation;
-	mAllRitems.push_back(std::move(tophouse));
+UINT64 ShapesApp::DrawListSortKey(UINT object, DrawList& drawList)
+{
+	auto& submesh = mScene.Submeshes[mScene.SubmeshId[object]];
+
+	// Geometry has no natural small id, so number them in order of appearance.
+	auto geoIt = std::find(drawList.Geometries.begin(), drawList.Geometries.end(), submesh.Geo);
+	UINT64 geoId = (UINT64)(geoIt - drawList.Geometries.begin());
+	if (geoIt == drawList.Geometries.end())
+		drawList.Geometries.push_back(submesh.Geo);
+
+	// Sort key, most significant first:
+	// [63..56] layer (PSO), [55..48] geometry, [47..40] topology.  The submesh binds no
+	// state, so it is left out and LOD switches do not move entries.
+	return ((UINT64)mScene.Layer[object] << 56) |
+		((geoId & 0xff) << 48) |
+		(((UINT64)submesh.PrimitiveType & 0xff) << 40);
+}
 
-	auto diamondRitem = std::make_unique<RenderItem>();
+void ShapesApp::RecordDrawList(ID3D12GraphicsCommandList* cmdList, DrawList& drawList,
+	ID3D12PipelineState* const layerPSOs[], ID3D12PipelineState* boundPSO)
+{
+	DrawListStats stats = RecordDrawListRange(cmdList, drawList, 0, drawList.Entries.size(), layerPSOs, boundPSO);
+	ReportDrawListStats(drawList, stats);
+}
 
-	XMStoreFloat4x4(&diamondRitem->World, XMMatrixTranslation(0.0f, 4.5f, 0.0f)* XMMatrixScaling(2.0f, 2.0f, 2.0f));
+DrawListStats ShapesApp::RecordDrawListRange(ID3D12GraphicsCommandList* cmdList, const DrawList& drawList,
+	size_t first, size_t last, ID3D12PipelineState* const layerPSOs[], ID3D12PipelineState* boundPSO)
+{
+	ID3D12PipelineState* currPSO = boundPSO;
+	MeshGeometry* currGeo = nullptr;
+	D3D12_PRIMITIVE_TOPOLOGY currTopology = D3D_PRIMITIVE_TOPOLOGY_UNDEFINED;
 
-	diamondRitem->ObjCBIndex = objCBIndex++;
-	diamondRitem->Geo = mGeometries["shapeGeo"].get();
-	diamondRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	diamondRitem->IndexCount = diamondRitem->Geo->DrawArgs["diamond"].IndexCount;
-	diamondRitem->StartIndexLocation = diamondRitem->Geo->DrawArgs["diamond"].StartIndexLocation;
-	diamondRitem->BaseVertexLocation = diamondRitem->Geo->DrawArgs["diamond"].BaseVertexLocation;
-	mAllRitems.push_back(std::move(diamondRitem));
+	DrawListStats stats;
 
-	for (int i = 0; i < 5; i++)
+	for (size_t i = first; i < last; ++i)
 	{
-		auto borders = std::make_unique<RenderItem>();
-		auto dersbor = std::make_unique<RenderItem>();
-		XMMATRIX bordersleft = XMMatrixTranslation(6.0f, 8.5f, 0.5f + i * 2);
-		XMMATRIX dersborleft = XMMatrixTranslation(-6.0f, 8.5f, -1.5f - i * 2) * XMMatrixRotationY(3.1416);
-
-		XMStoreFloat4x4(&borders->World, bordersleft);
-		XMStoreFloat4x4(&dersbor->World, dersborleft);
+		UINT object = drawList.Entries[i].Object;
+		auto& submesh = mScene.Submeshes[mScene.SubmeshId[object]];
 
+		ID3D12PipelineState* pso = layerPSOs[(int)mScene.Layer[object]];
+		if (pso != currPSO)
+		{
+			cmdList->SetPipelineState(pso);
+			currPSO = pso;
+			stats.PsoChanges++;
+		}
 
-		borders->ObjCBIndex = objCBIndex++;
-		borders->Geo = mGeometries["shapeGeo"].get();
-		borders->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-		borders->IndexCount = borders->Geo->DrawArgs["wedge"].IndexCount;
-		borders->StartIndexLocation = borders->Geo->DrawArgs["wedge"].StartIndexLocation;
-		borders->BaseVertexLocation = borders->Geo->DrawArgs["wedge"].BaseVertexLocation;
+		if (submesh.Geo != currGeo)
+		{
+			cmdList->IASetVertexBuffers(0, 1, &submesh.Geo->VertexBufferView());
+			cmdList->IASetIndexBuffer(&submesh.Geo->IndexBufferView());
+			currGeo = submesh.Geo;
+			stats.GeometryChanges++;
+		}
 
+		if (submesh.PrimitiveType != currTopology)
+		{
+			cmdList->IASetPrimitiveTopology(submesh.PrimitiveType);
+			currTopology = submesh.PrimitiveType;
+			stats.TopologyChanges++;
+		}
 
-		dersbor->ObjCBIndex = objCBIndex++;
-		dersbor->Geo = mGeometries["shapeGeo"].get();
-		dersbor->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-		dersbor->IndexCount = dersbor->Geo->DrawArgs["wedge"].IndexCount;
-		dersbor->StartIndexLocation = dersbor->Geo->DrawArgs["wedge"].StartIndexLocation;
-		dersbor->BaseVertexLocation = dersbor->Geo->DrawArgs["wedge"].BaseVertexLocation;
+		BindObjectConstants(cmdList, object);
+		cmdList->DrawIndexedInstanced(submesh.IndexCount, 1, submesh.StartIndexLocation, submesh.BaseVertexLocation, 0);
+		stats.Draws++;
+	}
 
-		mAllRitems.push_back(std::move(borders));
+	return stats;
+}
 
-		mAllRitems.push_back(std::move(dersbor));
-	}
-	for (int i = 0; i < 5; i++)
+void ShapesApp::ReportDrawListStats(DrawList& drawList, const DrawListStats& stats)
+{
+	// Report when the counters change (e.g. after switching the draw path) so they show up in the debug log.
+	if (stats.StateChanges() != drawList.Stats.StateChanges() || stats.Draws != drawList.Stats.Draws)
 	{
-		auto borders = std::make_unique<RenderItem>();
-		auto dersbor = std::make_unique<RenderItem>();
-		XMMATRIX bordersleft = XMMatrixTranslation(-6.0f, 8.5f, 0.5f + i * 2);
-		XMMATRIX dersborleft = XMMatrixTranslation(6.0f, 8.5f, -1.5f - i * 2) * XMMatrixRotationY(3.1416);
-
-		XMStoreFloat4x4(&borders->World, bordersleft);
-		XMStoreFloat4x4(&dersbor->World, dersborleft);
+		std::string text = "DrawList: " + std::to_string(stats.Draws) + " draws, " +
+			std::to_string(stats.StateChanges()) + " state changes (pso " + std::to_string(stats.PsoChanges) +
+			", geometry " + std::to_string(stats.GeometryChanges) + ", topology " + std::to_string(stats.TopologyChanges) + ")\n";
+		::OutputDebugStringA(text.c_str());
+	}
 
+	drawList.Stats = stats;
+}
 
-		borders->ObjCBIndex = objCBIndex++;
-		borders->Geo = mGeometries["shapeGeo"].get();
-		borders->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-		borders->IndexCount = borders->Geo->DrawArgs["wedge"].IndexCount;
-		borders->StartIndexLocation = borders->Geo->DrawArgs["wedge"].StartIndexLocation;
-		borders->BaseVertexLocation = borders->Geo->DrawArgs["wedge"].BaseVertexLocation;
+void ShapesApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<UINT>& ritems)
+{
+	FrameProfiler::CpuScope profileScope(mProfiler.get(), "DrawRenderItems");
 
+	// For each render item...
 
-		dersbor->ObjCBIndex = objCBIndex++;
-		dersbor->Geo = mGeometries["shapeGeo"].get();
-		dersbor->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-		dersbor->IndexCount = dersbor->Geo->DrawArgs["wedge"].IndexCount;
-		dersbor->StartIndexLocation = dersbor->Geo->DrawArgs["wedge"].StartIndexLocation;
-		dersbor->BaseVertexLocation = dersbor->Geo->DrawArgs["wedge"].BaseVertexLocation;
+	for (size_t i = 0; i < ritems.size(); ++i)
+	{
+		UINT object = ritems[i];
+		auto& submesh = mScene.Submeshes[mScene.SubmeshId[object]];
 
-		mAllRitems.push_back(std::move(borders));
+		cmdList->IASetVertexBuffers(0, 1, &submesh.Geo->VertexBufferView());
+		cmdList->IASetIndexBuffer(&submesh.Geo->IndexBufferView());
+		cmdList->IASetPrimitiveTopology(submesh.PrimitiveType);
 
-		mAllRitems.push_back(std::move(dersbor));
+		BindObjectConstants(cmdList, object);
+		cmdList->DrawIndexedInstanced(submesh.IndexCount, 1, submesh.StartIndexLocation, submesh.BaseVertexLocation, 0);
 	}
-	for (int i = 0; i < 6; i++)
-	{
-		auto borders = std::make_unique<RenderItem>();
-		auto dersbor = std::make_unique<RenderItem>();
-		XMMATRIX bordersleft = XMMatrixTranslation(10.5f, 8.5f, -5.5f + i * 2) * XMMatrixRotationY(-3.1416 / 2);
-		XMMATRIX dersborleft = XMMatrixTranslation(-10.5f, 8.5f, 4.5f - i * 2) * XMMatrixRotationY(3.1416 / 2);
-
-		XMStoreFloat4x4(&borders->World, bordersleft);
-		XMStoreFloat4x4(&dersbor->World, dersborleft);
+}
 
+void ShapesApp::DrawCulledIndirect(ID3D12GraphicsCommandList* cmdList, ID3D12PipelineState* pso)
+{
+	auto instanceBuffer = mCurrFrameResource->InstanceBuffer->Resource();
 
-		borders->ObjCBIndex = objCBIndex++;
-		borders->Geo = mGeometries["shapeGeo"].get();
-		borders->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-		borders->IndexCount = borders->Geo->DrawArgs["wedge"].IndexCount;
-		borders->StartIndexLocation = borders->Geo->DrawArgs["wedge"].StartIndexLocation;
-		borders->BaseVertexLocation = borders->Geo->DrawArgs["wedge"].BaseVertexLocation;
+	// Reset the append counter.  The command buffer rests in COPY_DEST between frames.
+	cmdList->CopyBufferRegion(mIndirectCommands.Get(), mIndirectCounterOffset,
+		mCullCounterReset->Resource(), 0, sizeof(UINT));
+	cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(mIndirectCommands.Get(),
+		D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_UNORDERED_ACCESS));
 
+	auto uavHandle = CD3DX12_GPU_DESCRIPTOR_HANDLE(mCbvHeap->GetGPUDescriptorHandleForHeapStart());
+	uavHandle.Offset(mCullUavIndex, mCbvSrvUavDescriptorSize);
 
-		dersbor->ObjCBIndex = objCBIndex++;
-		dersbor->Geo = mGeometries["shapeGeo"].get();
-		dersbor->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-		dersbor->IndexCount = dersbor->Geo->DrawArgs["wedge"].IndexCount;
-		dersbor->StartIndexLocation = dersbor->Geo->DrawArgs["wedge"].StartIndexLocation;
-		dersbor->BaseVertexLocation = dersbor->Geo->DrawArgs["wedge"].BaseVertexLocation;
+	UINT cullScope = mProfiler->BeginGpuScope(cmdList, "Cull");
 
-		mAllRitems.push_back(std::move(borders));
+	cmdList->SetPipelineState(mPSOs["cull"].Get());
+	cmdList->SetComputeRootSignature(mCullRootSignature.Get());
+	cmdList->SetComputeRoot32BitConstant(0, mCullObjectCount, 0);
+	cmdList->SetComputeRootConstantBufferView(1, mCurrFrameResource->PassCB->Resource()->GetGPUVirtualAddress());
+	cmdList->SetComputeRootShaderResourceView(2, instanceBuffer->GetGPUVirtualAddress());
+	cmdList->SetComputeRootShaderResourceView(3, mCullObjects->Resource()->GetGPUVirtualAddress());
+	cmdList->SetComputeRootDescriptorTable(4, uavHandle);
+	cmdList->Dispatch((mCullObjectCount + 63) / 64, 1, 1);
 
-		mAllRitems.push_back(std::move(dersbor));
-	}
-	for (int i = 0; i < 6; i++)
-	{
-		auto borders = std::make_unique<RenderItem>();
-		auto dersbor = std::make_unique<RenderItem>();
-		XMMATRIX bordersleft = XMMatrixTranslation(0.5f, 8.5f, -5.5f + i * 2) * XMMatrixRotationY(-3.1416 / 2);
-		XMMATRIX dersborleft = XMMatrixTranslation(-0.5f, 8.5f, 4.5f - i * 2) * XMMatrixRotationY(3.1416 / 2);
+	cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(mIndirectCommands.Get(),
+		D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT));
 
-		XMStoreFloat4x4(&borders->World, bordersleft);
-		XMStoreFloat4x4(&dersbor->World, dersborleft);
+	mProfiler->EndGpuScope(cmdList, cullScope);
+	UINT opaqueScope = mProfiler->BeginGpuScope(cmdList, "Opaque");
 
+	// All culled submeshes live in one vertex/index buffer, so the input assembler is bound once.
+	cmdList->SetPipelineState(pso);
+	cmdList->IASetVertexBuffers(0, 1, &mCullGeo->VertexBufferView());
+	cmdList->IASetIndexBuffer(&mCullGeo->IndexBufferView());
+	cmdList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	cmdList->SetGraphicsRootShaderResourceView(2, instanceBuffer->GetGPUVirtualAddress());
 
-		borders->ObjCBIndex = objCBIndex++;
-		borders->Geo = mGeometries["shapeGeo"].get();
-		borders->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-		borders->IndexCount = borders->Geo->DrawArgs["wedge"].IndexCount;
-		borders->StartIndexLocation = borders->Geo->DrawArgs["wedge"].StartIndexLocation;
-		borders->BaseVertexLocation = borders->Geo->DrawArgs["wedge"].BaseVertexLocation;
+	cmdList->ExecuteIndirect(mCullCommandSignature.Get(), mCullObjectCount,
+		mIndirectCommands.Get(), 0, mIndirectCommands.Get(), mIndirectCounterOffset);
 
+	cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(mIndirectCommands.Get(),
+		D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT, D3D12_RESOURCE_STATE_COPY_DEST));
 
-		dersbor->ObjCBIndex = objCBIndex++;
-		dersbor->Geo = mGeometries["shapeGeo"].get();
-		dersbor->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-		dersbor->IndexCount = dersbor->Geo->DrawArgs["wedge"].IndexCount;
-		dersbor->StartIndexLocation = dersbor->Geo->DrawArgs["wedge"].StartIndexLocation;
-		dersbor->BaseVertexLocation = dersbor->Geo->DrawArgs["wedge"].BaseVertexLocation;
+	// Objects in other buffers, drawn as single instances with the same PSO.
+	for (UINT object : mUnculledObjects)
+	{
+		auto& submesh = mScene.Submeshes[mScene.SubmeshId[object]];
 
-		mAllRitems.push_back(std::move(borders));
+		cmdList->IASetVertexBuffers(0, 1, &submesh.Geo->VertexBufferView());
+		cmdList->IASetIndexBuffer(&submesh.Geo->IndexBufferView());
+		cmdList->IASetPrimitiveTopology(submesh.PrimitiveType);
 
-		mAllRitems.push_back(std::move(dersbor));
+		cmdList->SetGraphicsRoot32BitConstant(3, mScene.InstanceIndex[object], 0);
+		cmdList->DrawIndexedInstanced(submesh.IndexCount, 1, submesh.StartIndexLocation, submesh.BaseVertexLocation, 0);
 	}
-	//grid
-	auto gridRitem = std::make_unique<RenderItem>();
-
-	gridRitem->World = MathHelper::Identity4x4();
-	gridRitem->ObjCBIndex = objCBIndex++;
-	gridRitem->Geo = mGeometries["shapeGeo"].get();
-	gridRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-
-	gridRitem->IndexCount = gridRitem->Geo->DrawArgs["grid"].IndexCount;
-	gridRitem->StartIndexLocation = gridRitem->Geo->DrawArgs["grid"].StartIndexLocation;
-	gridRitem->BaseVertexLocation = gridRitem->Geo->DrawArgs["grid"].BaseVertexLocation;
 
-	mAllRitems.push_back(std::move(gridRitem));
-
-	// All the render items are opaque.
-	for (auto& e : mAllRitems)
-		mOpaqueRitems.push_back(e.get());
+	mProfiler->EndGpuScope(cmdList, opaqueScope);
 }
 
-void ShapesApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems)
+void ShapesApp::DrawDepthPrePass(ID3D12GraphicsCommandList* cmdList)
 {
-	UINT objCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(ObjectConstants));
-	auto objectCB = mCurrFrameResource->ObjectCB->Resource();
-	// For each render item...
+	UINT depthScope = mProfiler->BeginGpuScope(cmdList, "DepthPrePass");
 
-	for (size_t i = 0; i < ritems.size(); ++i)
+	// Depth only; the back buffer is bound again for the shading pass.
+	cmdList->OMSetRenderTargets(0, nullptr, false, &DepthStencilView());
+
+	if (mUseInstancing)
 	{
-		auto ri = ritems[i];
-		cmdList->IASetVertexBuffers(0, 1, &ri->Geo->VertexBufferView());
-		cmdList->IASetIndexBuffer(&ri->Geo->IndexBufferView());
-		cmdList->IASetPrimitiveTopology(ri->PrimitiveType);
+		cmdList->SetPipelineState(mPSOs["depth_prepass_instanced"].Get());
+		DrawInstanceBatches(cmdList, mOpaqueInstanceBatches);
+	}
+	else
+	{
+		// Nearest first, so the farther objects mostly fail the depth test early.
+		cmdList->SetPipelineState(mPSOs["depth_prepass"].Get());
+		DrawRenderItems(cmdList, mOpaqueDepthOrder.Order());
+	}
 
-		// Offset to the CBV in the descriptor heap for this object and for this frame resource.
+	cmdList->OMSetRenderTargets(1, &CurrentBackBufferView(), true, &DepthStencilView());
 
-		UINT cbvIndex = mCurrFrameResourceIndex * (UINT)mOpaqueRitems.size() + ri->ObjCBIndex;
+	mProfiler->EndGpuScope(cmdList, depthScope);
+}
 
-		auto cbvHandle = CD3DX12_GPU_DESCRIPTOR_HANDLE(mCbvHeap->GetGPUDescriptorHandleForHeapStart());
+void ShapesApp::DrawInstanceBatches(ID3D12GraphicsCommandList* cmdList, const std::vector<InstanceBatch>& batches)
+{
+	auto instanceBuffer = mCurrFrameResource->InstanceBuffer->Resource();
+	cmdList->SetGraphicsRootShaderResourceView(2, instanceBuffer->GetGPUVirtualAddress());
 
-		cbvHandle.Offset(cbvIndex, mCbvSrvUavDescriptorSize);
+	// One draw call per batch; the instance id selects the world matrix.
+	for (size_t i = 0; i < batches.size(); ++i)
+	{
+		auto& batch = batches[i];
+		auto& submesh = mScene.Submeshes[batch.SubmeshId];
+
+		cmdList->IASetVertexBuffers(0, 1, &submesh.Geo->VertexBufferView());
+		cmdList->IASetIndexBuffer(&submesh.Geo->IndexBufferView());
+		cmdList->IASetPrimitiveTopology(submesh.PrimitiveType);
 
-		cmdList->SetGraphicsRootDescriptorTable(0, cbvHandle);
-		cmdList->DrawIndexedInstanced(ri->IndexCount, 1, ri->StartIndexLocation, ri->BaseVertexLocation, 0);
+		cmdList->SetGraphicsRoot32BitConstant(3, batch.StartInstance, 0);
+		cmdList->DrawIndexedInstanced(submesh.IndexCount, (UINT)batch.Objects.size(),
+			submesh.StartIndexLocation, submesh.BaseVertexLocation, 0);
 	}
 }
-